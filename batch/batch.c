@@ -0,0 +1,801 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(HAVE_POSIX_SPAWN)
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "anmlist.h"
+#include "file.h"
+#include "program.h"
+#include "thecl.h"
+#include "trace.h"
+#include "util.h"
+#include "mygetopt.h"
+
+/* Runs jobs for the thtk tools, read one per line from standard input, on a
+ * pool of workers.  ECL dumps and ANM listings run in this process, each with
+ * a context of its own, and keep the map files they load for later jobs.
+ * Other jobs are a separate process of the tool, so one job can't disturb the
+ * state of another.  Standard output only carries one JSON status object per
+ * finished job, in the order they finish; whatever the tools print goes to
+ * standard error unless a job redirects it. */
+
+#ifdef _WIN32
+#define BATCH_EXE_SUFFIX ".exe"
+#define BATCH_NULL_DEVICE "NUL"
+#else
+#define BATCH_EXE_SUFFIX ""
+#define BATCH_NULL_DEVICE "/dev/null"
+#endif
+
+static const char* const batch_tools[] = {
+    "thanm", "thdat", "thecl", "thmsg", "thstd"
+};
+#define BATCH_TOOL_COUNT (sizeof(batch_tools) / sizeof(batch_tools[0]))
+
+/* Resolved executable for every tool in batch_tools. */
+static char* batch_tool_paths[BATCH_TOOL_COUNT];
+
+typedef struct {
+    unsigned long number;
+    unsigned long line;
+    size_t tool;
+    int argc;
+    char** argv;
+    const char* input;
+    const char* output;
+} batch_job_t;
+
+/* Options of a job that dumps a file in this process. */
+typedef struct {
+    unsigned int version;
+    char** maps;
+    size_t map_count;
+    /* thecl -r, -x and -j. */
+    bool rawoutput;
+    bool hexdebug;
+    bool encode_cp932;
+    /* thanm -o and -u. */
+    bool print_offsets;
+    bool unique_filenames;
+    const char* input;
+    const char* output;
+} batch_dump_t;
+
+/* Map files loaded by earlier jobs. */
+typedef struct {
+    size_t tool;
+    /* The map files in the order they were given, one per line. */
+    char* key;
+    /* An eclmap_t or anmmap_t. */
+    void* map;
+} batch_map_t;
+
+static batch_map_t* batch_maps;
+static size_t batch_map_count;
+static size_t batch_map_capacity;
+
+static void
+print_usage(
+    void)
+{
+    printf("Usage: %s [-V] [-j JOBS] [-p DIR] < COMMANDS\n"
+           "Options:\n"
+           "  -j  number of jobs to run at once (default: one per processor)\n"
+           "  -p  run the tools from DIR instead of looking next to %s and in PATH\n"
+           "  -V  display version information and exit\n"
+           "  --trace FILE  write a Chrome trace-event JSON file (for Perfetto)\n"
+           "Every line of COMMANDS is a tool name followed by its arguments, e.g.\n"
+           "  thecl -d 17 st01.ecl > st01.txt\n"
+           "Arguments can be quoted with '' or \"\", and a backslash escapes the next\n"
+           "character.  < FILE and > FILE redirect the standard input and output of\n"
+           "the job.  Empty lines and lines starting with # are skipped.\n"
+           "Tools: thanm, thdat, thecl, thmsg, thstd\n"
+           "Report bugs to <" PACKAGE_BUGREPORT ">.\n", argv0, argv0);
+}
+
+static char*
+batch_join(
+    const char* dir,
+    size_t dir_len,
+    const char* name)
+{
+    char* path = malloc(dir_len + strlen(name) + sizeof(BATCH_EXE_SUFFIX) + 1);
+    memcpy(path, dir, dir_len);
+    path[dir_len] = '/';
+    strcpy(path + dir_len + 1, name);
+    strcat(path, BATCH_EXE_SUFFIX);
+    return path;
+}
+
+/* Finds the tools in dir, next to the batch program, or leaves them to a
+ * PATH search. */
+static void
+batch_resolve_tools(
+    const char* dir,
+    const char* self)
+{
+    size_t self_len = 0;
+    for (const char* p = self; *p; ++p)
+        if (*p == '/' || *p == '\\')
+            self_len = p - self;
+
+    for (size_t t = 0; t < BATCH_TOOL_COUNT; ++t) {
+        if (dir) {
+            batch_tool_paths[t] = batch_join(dir, strlen(dir), batch_tools[t]);
+            continue;
+        }
+        if (self_len) {
+            char* path = batch_join(self, self_len, batch_tools[t]);
+            FILE* f = fopen(path, "rb");
+            if (f) {
+                fclose(f);
+                batch_tool_paths[t] = path;
+                continue;
+            }
+            free(path);
+        }
+        batch_tool_paths[t] = malloc(strlen(batch_tools[t]) + 1);
+        strcpy(batch_tool_paths[t], batch_tools[t]);
+    }
+}
+
+/* Reads a whole line without the line break.  Returns NULL at the end of
+ * the stream. */
+static char*
+batch_read_line(
+    FILE* stream)
+{
+    size_t len = 0, cap = 256;
+    char* line = malloc(cap);
+    while (fgets(line + len, cap - len, stream)) {
+        len += strlen(line + len);
+        if (len && line[len - 1] == '\n')
+            break;
+        if (len + 1 == cap)
+            line = realloc(line, cap *= 2);
+    }
+    if (!len) {
+        free(line);
+        return NULL;
+    }
+    while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        line[--len] = '\0';
+    return line;
+}
+
+/* Splits line into the job's arguments, in place.  Returns NULL on success,
+ * otherwise a description of the problem. */
+static const char*
+batch_parse(
+    char* line,
+    batch_job_t* job)
+{
+    char* in = line;
+    char* out = line;
+    const char** redirect = NULL;
+    size_t cap = 0;
+
+    job->argc = 0;
+    job->argv = NULL;
+    for (;;) {
+        while (*in == ' ' || *in == '\t')
+            ++in;
+        if (!*in)
+            break;
+
+        char* word = out;
+        int quoted = 0;
+        while (*in && *in != ' ' && *in != '\t') {
+            if (*in == '\'' || *in == '"') {
+                char quote = *in++;
+                quoted = 1;
+                while (*in && *in != quote) {
+                    if (quote == '"' && *in == '\\' && in[1])
+                        ++in;
+                    *out++ = *in++;
+                }
+                if (!*in)
+                    return "unterminated quote";
+                ++in;
+            } else {
+                if (*in == '\\' && in[1])
+                    ++in;
+                *out++ = *in++;
+            }
+        }
+        /* The terminator may overwrite the blank that ended the word. */
+        char* end = out++;
+        int is_space = *in == ' ' || *in == '\t';
+        *end = '\0';
+        if (is_space)
+            ++in;
+
+        if (redirect) {
+            *redirect = word;
+            redirect = NULL;
+        } else if (!quoted && (!strcmp(word, "<") || !strcmp(word, ">"))) {
+            redirect = word[0] == '<' ? &job->input : &job->output;
+        } else {
+            util_vec_ensure(&job->argv, &cap, job->argc + 2, sizeof(*job->argv));
+            job->argv[job->argc++] = word;
+            job->argv[job->argc] = NULL;
+        }
+    }
+    if (redirect)
+        return "missing file name after redirection";
+    if (!job->argc)
+        return "empty command";
+
+    for (job->tool = 0; job->tool < BATCH_TOOL_COUNT; ++job->tool)
+        if (!strcmp(job->argv[0], batch_tools[job->tool]))
+            return NULL;
+    return "unknown tool";
+}
+
+static int
+batch_is_thecl(
+    size_t tool)
+{
+    return !strcmp(batch_tools[tool], "thecl");
+}
+
+/* Reads the options of a job.  Returns 1 if it is an ECL dump or an ANM
+ * listing, the only modes that run in this process; the parsers keep global
+ * state and exit on errors, and the other tools have no map files to keep,
+ * so everything else still runs as a process. */
+static int
+batch_dump_parse(
+    const batch_job_t* job,
+    batch_dump_t* dump)
+{
+    const int ecl = batch_is_thecl(job->tool);
+    const char mode_option = ecl ? 'd' : 'l';
+    const size_t positional_max = ecl ? 2 : 1;
+    size_t positional = 0;
+    size_t cap = 0;
+    int mode = 0;
+
+    memset(dump, 0, sizeof(*dump));
+    if (!ecl && strcmp(batch_tools[job->tool], "thanm"))
+        return 0;
+    for (int i = 1; i < job->argc; ++i) {
+        char* arg = job->argv[i];
+        if (arg[0] != '-' || !arg[1]) {
+            if (positional == 0)
+                dump->input = arg;
+            else if (positional == 1)
+                dump->output = arg;
+            if (++positional > positional_max)
+                goto process;
+            continue;
+        }
+        for (char* c = arg + 1; *c; ++c) {
+            if (*c == mode_option || *c == 'm') {
+                char* value = c[1] ? c + 1 : job->argv[++i];
+                if (!value)
+                    goto process;
+                if (*c == 'm') {
+                    util_vec_ensure(&dump->maps, &cap, dump->map_count + 1, sizeof(*dump->maps));
+                    dump->maps[dump->map_count++] = value;
+                } else if (mode) {
+                    goto process;
+                } else {
+                    mode = 1;
+                    dump->version = parse_version(value);
+                }
+                break;
+            } else if (ecl && *c == 'r') {
+                dump->rawoutput = true;
+            } else if (ecl && *c == 'x') {
+                dump->hexdebug = true;
+            } else if (ecl && *c == 'j') {
+                dump->encode_cp932 = true;
+            } else if (!ecl && *c == 'o') {
+                dump->print_offsets = true;
+            } else if (!ecl && *c == 'u') {
+                dump->unique_filenames = true;
+            } else {
+                goto process;
+            }
+        }
+    }
+    if (mode && (ecl ? thecl_module(dump->version) != NULL
+                     : positional == 1 && thanm_version_supported(dump->version)))
+        return 1;
+process:
+    free(dump->maps);
+    dump->maps = NULL;
+    return 0;
+}
+
+static void
+batch_map_free(
+    size_t tool,
+    void* map)
+{
+    if (batch_is_thecl(tool))
+        eclmap_free(map);
+    else
+        anmmap_free(map);
+}
+
+/* Returns the map loaded from the job's map files, which are only read by
+ * the first job that uses them.  A map file that can't be opened fails an
+ * ECL dump, but is skipped by an ANM listing, as the tools do; such a map
+ * isn't kept, and *owned tells the caller to free it. */
+static void*
+batch_map(
+    size_t tool,
+    const batch_dump_t* dump,
+    int* owned)
+{
+    const int ecl = batch_is_thecl(tool);
+    size_t key_len = 0;
+    for (size_t m = 0; m < dump->map_count; ++m)
+        key_len += strlen(dump->maps[m]) + 1;
+    char* key = malloc(key_len + 1);
+    char* p = key;
+    for (size_t m = 0; m < dump->map_count; ++m) {
+        size_t len = strlen(dump->maps[m]);
+        memcpy(p, dump->maps[m], len);
+        p += len;
+        *p++ = '\n';
+    }
+    *p = '\0';
+
+    void* map = NULL;
+    *owned = 0;
+#pragma omp critical(batch_map)
+    {
+        for (size_t e = 0; e < batch_map_count && !map; ++e)
+            if (batch_maps[e].tool == tool && !strcmp(batch_maps[e].key, key))
+                map = batch_maps[e].map;
+
+        if (!map) {
+            map = ecl ? (void*)eclmap_new() : (void*)anmmap_new();
+            for (size_t m = 0; m < dump->map_count; ++m) {
+                FILE* map_file = fopen(dump->maps[m], "r");
+                if (!map_file) {
+                    fprintf(stderr, "%s: couldn't open %s for reading: %s\n",
+                        argv0, dump->maps[m], strerror(errno));
+                    *owned = 1;
+                    if (ecl)
+                        break;
+                    continue;
+                }
+                if (ecl)
+                    eclmap_load(dump->version, map, map_file, dump->maps[m]);
+                else
+                    anmmap_load(map, map_file, dump->maps[m]);
+                fclose(map_file);
+            }
+            if (ecl && *owned) {
+                eclmap_free(map);
+                map = NULL;
+                *owned = 0;
+            } else if (ecl) {
+                eclmap_rebuild(map);
+            }
+            if (map && !*owned) {
+                util_vec_ensure(&batch_maps, &batch_map_capacity,
+                    batch_map_count + 1, sizeof(*batch_maps));
+                batch_maps[batch_map_count].tool = tool;
+                batch_maps[batch_map_count].key = key;
+                batch_maps[batch_map_count].map = map;
+                ++batch_map_count;
+                key = NULL;
+            }
+        }
+    }
+    free(key);
+    return map;
+}
+
+/* Dumps an ECL file or lists an ANM archive in this process, as thecl -d and
+ * thanm -l would. */
+static int
+batch_run_dump(
+    const batch_job_t* job,
+    const batch_dump_t* dump,
+    int* status,
+    const char** error)
+{
+    const char* input = dump->input ? dump->input : "(stdin)";
+    int owned;
+    void* map;
+    FILE* in;
+    FILE* out = stderr;
+
+    *status = 1;
+    if (!(map = batch_map(job->tool, dump, &owned)))
+        return 1;
+
+    in = dump->input ? file_open_input(dump->input, dump->version)
+        : fopen(job->input ? job->input : BATCH_NULL_DEVICE, "rb");
+    if (!in) {
+        if (owned)
+            batch_map_free(job->tool, map);
+        if (!dump->input) {
+            *error = "couldn't open redirected file";
+            return 0;
+        }
+        fprintf(stderr, "%s: couldn't open %s for reading: %s\n",
+            argv0, dump->input, strerror(errno));
+        return 1;
+    }
+    if (dump->output || job->output) {
+        out = fopen(dump->output ? dump->output : job->output, "wb");
+        if (!out) {
+            file_close(in);
+            if (owned)
+                batch_map_free(job->tool, map);
+            if (!dump->output) {
+                *error = "couldn't open redirected file";
+                return 0;
+            }
+            fprintf(stderr, "%s: couldn't open %s for writing: %s\n",
+                argv0, dump->output, strerror(errno));
+            return 1;
+        }
+    }
+
+    if (batch_is_thecl(job->tool)) {
+        thecl_context_t context;
+        memset(&context, 0, sizeof(context));
+        context.eclmap = map;
+        context.rawoutput = dump->rawoutput;
+        context.hexdebug = dump->hexdebug;
+        context.encode_cp932 = dump->encode_cp932;
+        context.input = input;
+        if (thecl_dump(&context, dump->version, in, out)) {
+            if (context.was_error)
+                fprintf(stderr, "%s: %s: there were errors.\n", argv0, input);
+            else
+                *status = 0;
+        }
+    } else {
+        const thanm_context_t context = {
+            .anmmap = map,
+            .print_offsets = dump->print_offsets,
+            .unique_filenames = dump->unique_filenames,
+            .input = input,
+        };
+        if (thanm_list(&context, dump->version, in, out))
+            *status = 0;
+    }
+
+    file_close(in);
+    if (out != stderr)
+        fclose(out);
+    if (owned)
+        batch_map_free(job->tool, map);
+    return 1;
+}
+
+#if defined(_WIN32)
+/* Appends arg to cmd quoted the way the C runtime splits it again. */
+static char*
+batch_quote(
+    char* cmd,
+    const char* arg)
+{
+    size_t len = cmd ? strlen(cmd) : 0;
+    cmd = realloc(cmd, len + strlen(arg) * 2 + 4);
+    char* p = cmd + len;
+    if (len)
+        *p++ = ' ';
+    *p++ = '"';
+    for (;;) {
+        size_t backslashes = 0;
+        while (*arg == '\\') {
+            ++arg;
+            ++backslashes;
+        }
+        if (!*arg || *arg == '"') {
+            /* Backslashes before a quote, or the closing quote, are doubled. */
+            backslashes *= 2;
+            if (*arg == '"')
+                ++backslashes;
+        }
+        while (backslashes--)
+            *p++ = '\\';
+        if (!*arg)
+            break;
+        *p++ = *arg++;
+    }
+    *p++ = '"';
+    *p = '\0';
+    return cmd;
+}
+
+static int
+batch_run(
+    const batch_job_t* job,
+    int* status,
+    const char** error)
+{
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, TRUE };
+    STARTUPINFOA si;
+    PROCESS_INFORMATION pi;
+    HANDLE in = INVALID_HANDLE_VALUE, out = INVALID_HANDLE_VALUE;
+    char* cmd = batch_quote(NULL, batch_tool_paths[job->tool]);
+    int ret = 0;
+
+    for (int i = 1; i < job->argc; ++i)
+        cmd = batch_quote(cmd, job->argv[i]);
+
+    in = CreateFileA(job->input ? job->input : BATCH_NULL_DEVICE, GENERIC_READ, FILE_SHARE_READ,
+        &sa, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (job->output)
+        out = CreateFileA(job->output, GENERIC_WRITE, 0,
+            &sa, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (in == INVALID_HANDLE_VALUE || (job->output && out == INVALID_HANDLE_VALUE)) {
+        *error = "couldn't open redirected file";
+        goto out;
+    }
+
+    memset(&si, 0, sizeof(si));
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = in;
+    si.hStdOutput = job->output ? out : GetStdHandle(STD_ERROR_HANDLE);
+    si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+    if (!CreateProcessA(NULL, cmd, NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi)) {
+        *error = "couldn't start the tool";
+        goto out;
+    }
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    DWORD code;
+    GetExitCodeProcess(pi.hProcess, &code);
+    *status = (int)code;
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+    ret = 1;
+out:
+    if (in != INVALID_HANDLE_VALUE)
+        CloseHandle(in);
+    if (out != INVALID_HANDLE_VALUE)
+        CloseHandle(out);
+    free(cmd);
+    return ret;
+}
+#elif defined(HAVE_POSIX_SPAWN)
+extern char** environ;
+
+static int
+batch_run(
+    const batch_job_t* job,
+    int* status,
+    const char** error)
+{
+    posix_spawn_file_actions_t actions;
+    const char* path = batch_tool_paths[job->tool];
+    pid_t pid;
+    int ret;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0,
+        job->input ? job->input : BATCH_NULL_DEVICE, O_RDONLY, 0);
+    if (job->output)
+        posix_spawn_file_actions_addopen(&actions, 1,
+            job->output, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    else
+        posix_spawn_file_actions_adddup2(&actions, 2, 1);
+
+    char** argv = job->argv;
+    const char* name = argv[0];
+    argv[0] = (char*)path;
+    if (strchr(path, '/'))
+        ret = posix_spawn(&pid, path, &actions, NULL, argv, environ);
+    else
+        ret = posix_spawnp(&pid, path, &actions, NULL, argv, environ);
+    argv[0] = (char*)name;
+    posix_spawn_file_actions_destroy(&actions);
+    if (ret) {
+        *error = strerror(ret);
+        return 0;
+    }
+
+    int wstatus;
+    while (waitpid(pid, &wstatus, 0) == -1) {
+        if (errno != EINTR) {
+            *error = strerror(errno);
+            return 0;
+        }
+    }
+    if (WIFEXITED(wstatus)) {
+        *status = WEXITSTATUS(wstatus);
+        /* posix_spawnp reports a failed exec only through this status. */
+        if (*status == 127) {
+            *error = "couldn't run the tool";
+            return 0;
+        }
+    } else {
+        *status = 128 + WTERMSIG(wstatus);
+    }
+    return 1;
+}
+#else
+static int
+batch_run(
+    const batch_job_t* job,
+    int* status,
+    const char** error)
+{
+    (void)job;
+    (void)status;
+    *error = "running tools is not supported on this platform";
+    return 0;
+}
+#endif
+
+/* Prints s as a JSON string. */
+static void
+batch_print_string(
+    FILE* stream,
+    const char* s)
+{
+    fputc('"', stream);
+    for (; *s; ++s) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            fprintf(stream, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(stream, "\\u%04x", c);
+        else
+            fputc(c, stream);
+    }
+    fputc('"', stream);
+}
+
+int
+main(
+    int argc,
+    char* argv[])
+{
+    const char* tool_dir = NULL;
+    int jobs = 0;
+    unsigned long line_number = 0, job_number = 0;
+    int ret = 0;
+
+    argv0 = util_shortname(argv[0]);
+    trace_init_args(&argc, argv);
+    int opt;
+    int ind = 0;
+    while (argv[util_optind]) {
+        switch (opt = util_getopt(argc, argv, "+:j:p:V")) {
+        case 'j':
+            jobs = atoi(util_optarg);
+            break;
+        case 'p':
+            tool_dir = util_optarg;
+            break;
+        default:
+            util_getopt_default(&ind, argv, opt, print_usage);
+        }
+    }
+    if (ind) {
+        print_usage();
+        exit(1);
+    }
+
+    batch_resolve_tools(tool_dir, argv[0]);
+
+#ifdef _OPENMP
+    if (jobs > 0)
+        omp_set_num_threads(jobs);
+#else
+    (void)jobs;
+#endif
+#pragma omp parallel
+    for (;;) {
+        batch_job_t job;
+        char* line;
+
+#pragma omp critical(batch_input)
+        {
+            for (;;) {
+                line = batch_read_line(stdin);
+                ++line_number;
+                if (!line)
+                    break;
+                const char* p = line + strspn(line, " \t");
+                if (*p && *p != '#')
+                    break;
+                free(line);
+            }
+            job.number = ++job_number;
+            job.line = line_number;
+        }
+        if (!line)
+            break;
+
+        job.input = NULL;
+        job.output = NULL;
+        int status = -1;
+        TRACE_BEGIN(t);
+        uint64_t start = trace_now();
+        const char* error = batch_parse(line, &job);
+        if (!error) {
+            batch_dump_t dump;
+            if (batch_dump_parse(&job, &dump)) {
+                batch_run_dump(&job, &dump, &status, &error);
+                free(dump.maps);
+            } else {
+                batch_run(&job, &status, &error);
+            }
+        }
+        double seconds = (trace_now() - start) / 1e9;
+        TRACE_END(t, "job", job.argc ? job.argv[0] : NULL);
+
+#pragma omp critical(batch_output)
+        {
+            printf("{\"job\":%lu,\"line\":%lu", job.number, job.line);
+            if (job.argc) {
+                printf(",\"tool\":");
+                batch_print_string(stdout, job.argv[0]);
+            }
+            if (error) {
+                printf(",\"error\":");
+                batch_print_string(stdout, error);
+                ret = 1;
+            } else {
+                printf(",\"status\":%d", status);
+                if (status)
+                    ret = 1;
+            }
+            printf(",\"seconds\":%.3f}\n", seconds);
+            fflush(stdout);
+        }
+
+        free(job.argv);
+        free(line);
+    }
+
+    for (size_t t = 0; t < BATCH_TOOL_COUNT; ++t)
+        free(batch_tool_paths[t]);
+    for (size_t e = 0; e < batch_map_count; ++e) {
+        free(batch_maps[e].key);
+        batch_map_free(batch_maps[e].tool, batch_maps[e].map);
+    }
+    free(batch_maps);
+    return ret;
+}
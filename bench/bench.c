@@ -0,0 +1,766 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thtk/thtk.h>
+#include <thtk/thcrypt.h>
+#include <thtk/thlzss.h>
+#include "thtk/thrle.h"
+#include "thanm/pixel.h"
+#include "thanm/pngenc.h"
+#ifdef HAVE_LIBPNG
+#include <png.h>
+#endif
+#include "program.h"
+#include "trace.h"
+#include "util.h"
+#include "mygetopt.h"
+
+/* Benchmarks for libthtk.  Every input is generated from a fixed seed, so
+ * results can be compared across commits.  One JSON object is printed per
+ * line; progress goes to stderr. */
+
+typedef enum {
+    CORPUS_RANDOM,
+    CORPUS_TEXT,
+    CORPUS_IMAGE,
+    CORPUS_COUNT
+} corpus_t;
+
+static const char* corpus_names[CORPUS_COUNT] = {
+    "random", "text", "image"
+};
+
+/* Approximate shape of the real archives.  File counts are multiplied by
+ * the scale option, sizes are kept. */
+typedef struct {
+    unsigned int version;
+    const char* game;
+    unsigned int file_count;
+    unsigned int mean_size;
+} archive_profile_t;
+
+static const archive_profile_t archive_profiles[] = {
+    {   2, "th02",    40,  24 * 1024 },
+    {   6, "th06",   160,  64 * 1024 },
+    {   7, "th07",   480,  96 * 1024 },
+    {   8, "th08",   900,  96 * 1024 },
+    {   9, "th09",   700,  96 * 1024 },
+    {  95, "th095",  360,  64 * 1024 },
+    {  10, "th10",   440,  96 * 1024 },
+    {  11, "th11",   520,  96 * 1024 },
+    {  12, "th12",   560,  96 * 1024 },
+    {  13, "th13",   640, 112 * 1024 },
+    {  14, "th14",   800, 112 * 1024 },
+    {  15, "th15",   960, 128 * 1024 },
+    {  16, "th16",   880, 128 * 1024 },
+    {  17, "th17",   860, 128 * 1024 },
+    {  18, "th18",  1100, 144 * 1024 },
+    {  19, "th19",  1500, 160 * 1024 },
+    {  20, "th20",  1400, 160 * 1024 },
+    {  75, "th075",  600,  48 * 1024 },
+    { 105, "th105", 1800,  48 * 1024 },
+    { 123, "th123", 2000,  48 * 1024 },
+};
+
+static FILE* bench_out;
+static unsigned int option_iterations = 3;
+static size_t option_size = 1 << 20;
+static double option_scale = 0.05;
+static const char* option_archive = "thtk-bench.dat";
+
+static void
+print_usage(
+    void)
+{
+    printf("Usage: %s [-V] [-n ITERATIONS] [-S SIZE] [-s SCALE] [-t FILE] [-o FILE] [codec | pixel | png | archive]...\n"
+           "Options:\n"
+           "  -n  number of runs per benchmark, the best one is reported (default 3)\n"
+           "  -S  size of the codec corpora and textures in KiB (default 1024)\n"
+           "  -s  fraction of the real file counts used for archives (default 0.05)\n"
+           "  -t  temporary archive file (default thtk-bench.dat)\n"
+           "  -o  write results to FILE instead of stdout\n"
+           "  -V  display version information and exit\n"
+           "Results are printed as one JSON object per line.\n"
+           "Report bugs to <" PACKAGE_BUGREPORT ">.\n", argv0);
+}
+
+/* SplitMix64. */
+static uint64_t
+bench_random(
+    uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static void
+corpus_fill(
+    corpus_t corpus,
+    unsigned char* data,
+    size_t size,
+    uint64_t seed)
+{
+    static const char* words[] = {
+        "ins_", "set", "var", "wait", "call", "jmp", "enemy", "bullet",
+        "sprite", "script", "0", "1", "16", "255", "-1.0f", "3.14159f",
+        "{", "}", "(", ")", ";", "=", "+", "$I0", "%F1", "@", "st01",
+        "anmLoad", "etNew", "etOn", "moveTo", "timer", "if", "loop"
+    };
+    uint64_t state = seed;
+    size_t i = 0;
+
+    switch (corpus) {
+    case CORPUS_RANDOM:
+        while (i < size) {
+            uint64_t r = bench_random(&state);
+            for (unsigned int b = 0; b < 8 && i < size; ++b, r >>= 8)
+                data[i++] = r;
+        }
+        break;
+    case CORPUS_TEXT: {
+        unsigned int column = 0;
+        while (i < size) {
+            const char* word = words[bench_random(&state) % (sizeof(words) / sizeof(*words))];
+            size_t len = strlen(word);
+            for (size_t c = 0; c < len && i < size; ++c)
+                data[i++] = word[c];
+            column += len + 1;
+            if (i < size)
+                data[i++] = column > 60 ? (column = 0, '\n') : ' ';
+        }
+        break;
+    }
+    case CORPUS_IMAGE: {
+        /* 256 pixel wide RGBA rows: gradients, transparent areas and a
+         * little noise, which compresses roughly like game sprites. */
+        const size_t stride = 256 * 4;
+        while (i < size) {
+            size_t x = (i % stride) / 4;
+            size_t y = i / stride;
+            unsigned char noise = bench_random(&state) & 3;
+            int transparent = ((x / 32) + (y / 32)) % 3 == 0;
+            data[i++] = transparent ? 0 : (unsigned char)(x + noise);
+            if (i < size) data[i++] = transparent ? 0 : (unsigned char)(y + noise);
+            if (i < size) data[i++] = transparent ? 0 : (unsigned char)((x ^ y) & 0xf0);
+            if (i < size) data[i++] = transparent ? 0 : 0xff;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void
+bench_report(
+    const char* bench,
+    const char* subject,
+    size_t bytes,
+    size_t out_bytes,
+    double seconds)
+{
+    fprintf(bench_out,
+        "{\"bench\":\"%s\",\"subject\":\"%s\",\"bytes\":%zu,\"out_bytes\":%zu,"
+        "\"iterations\":%u,\"seconds\":%.6f,\"mbps\":%.3f}\n",
+        bench, subject, bytes, out_bytes, option_iterations, seconds,
+        seconds > 0 ? bytes / 1e6 / seconds : 0.0);
+    fflush(bench_out);
+    fprintf(stderr, "%s: %-14s %-8s %10.2f MB/s\n",
+        argv0, bench, subject, seconds > 0 ? bytes / 1e6 / seconds : 0.0);
+}
+
+static void
+bench_fail(
+    const char* what,
+    thtk_error_t* error)
+{
+    fprintf(stderr, "%s: %s failed: %s\n",
+        argv0, what, error ? thtk_error_message(error) : "verification failed");
+    exit(1);
+}
+
+/* Memory IO objects free their buffer when closed, so they get a copy. */
+static thtk_io_t*
+bench_open_copy(
+    const unsigned char* data,
+    size_t size)
+{
+    thtk_error_t* error = NULL;
+    unsigned char* copy = util_malloc(size);
+    memcpy(copy, data, size);
+    return thtk_io_open_memory(copy, size, &error);
+}
+
+typedef ssize_t (*encode_t)(thtk_io_t*, size_t, thtk_io_t*, thtk_error_t**);
+typedef ssize_t (*decode_t)(thtk_io_t*, size_t, size_t, thtk_io_t*, thtk_error_t**);
+
+static ssize_t
+bench_unlzss(
+    thtk_io_t* input,
+    size_t input_size,
+    size_t output_size,
+    thtk_io_t* output,
+    thtk_error_t** error)
+{
+    (void)input_size;
+    return th_unlzss(input, output, output_size, error);
+}
+
+static ssize_t
+bench_unrle(
+    thtk_io_t* input,
+    size_t input_size,
+    size_t output_size,
+    thtk_io_t* output,
+    thtk_error_t** error)
+{
+    (void)output_size;
+    return thtk_unrle(input, input_size, output, error);
+}
+
+/* Runs encode and decode over data, checks the round trip, and reports the
+ * best time of each. */
+static void
+bench_codec(
+    const char* encode_name,
+    encode_t encode,
+    const char* decode_name,
+    decode_t decode,
+    const char* subject,
+    unsigned char* data,
+    size_t size)
+{
+    double best_encode = 0, best_decode = 0;
+    size_t zsize = 0;
+    thtk_error_t* error = NULL;
+
+    for (unsigned int n = 0; n < option_iterations; ++n) {
+        thtk_io_t* input = bench_open_copy(data, size);
+        thtk_io_t* packed = thtk_io_open_growing_memory(&error);
+        uint64_t start = trace_now();
+        ssize_t ret = encode(input, size, packed, &error);
+        double seconds = (trace_now() - start) / 1e9;
+        if (ret == -1)
+            bench_fail(encode_name, error);
+        if (!n || seconds < best_encode)
+            best_encode = seconds;
+        zsize = ret;
+
+        thtk_io_t* unpacked = thtk_io_open_growing_memory(&error);
+        if (thtk_io_seek(packed, 0, SEEK_SET, &error) == -1)
+            bench_fail("seek", error);
+        start = trace_now();
+        ret = decode(packed, zsize, size, unpacked, &error);
+        seconds = (trace_now() - start) / 1e9;
+        if (ret == -1)
+            bench_fail(decode_name, error);
+        if (!n || seconds < best_decode)
+            best_decode = seconds;
+
+        unsigned char* map = thtk_io_map(unpacked, 0, size, &error);
+        if (ret != (ssize_t)size || !map || memcmp(map, data, size))
+            bench_fail(decode_name, error);
+        thtk_io_unmap(unpacked, map);
+
+        thtk_io_close(unpacked);
+        thtk_io_close(packed);
+        thtk_io_close(input);
+    }
+
+    bench_report(encode_name, subject, size, zsize, best_encode);
+    bench_report(decode_name, subject, size, size, best_decode);
+}
+
+static void
+bench_crypt(
+    const char* subject,
+    unsigned char* data,
+    size_t size)
+{
+    double best_encrypt = 0, best_decrypt = 0;
+    unsigned char* copy = malloc(size);
+    memcpy(copy, data, size);
+
+    for (unsigned int n = 0; n < option_iterations; ++n) {
+        uint64_t start = trace_now();
+        th_encrypt(copy, size, 0x1b, 0x37, 0x400, size);
+        double seconds = (trace_now() - start) / 1e9;
+        if (!n || seconds < best_encrypt)
+            best_encrypt = seconds;
+
+        start = trace_now();
+        th_decrypt(copy, size, 0x1b, 0x37, 0x400, size);
+        seconds = (trace_now() - start) / 1e9;
+        if (!n || seconds < best_decrypt)
+            best_decrypt = seconds;
+
+        if (memcmp(copy, data, size))
+            bench_fail("decrypt", NULL);
+    }
+    free(copy);
+
+    bench_report("encrypt", subject, size, size, best_encrypt);
+    bench_report("decrypt", subject, size, size, best_decrypt);
+}
+
+static void
+bench_codecs(
+    void)
+{
+    unsigned char* data = malloc(option_size);
+
+    for (int c = 0; c < CORPUS_COUNT; ++c) {
+        corpus_fill(c, data, option_size, 0x7468746b + c);
+        bench_codec("lzss", th_lzss, "unlzss", bench_unlzss,
+            corpus_names[c], data, option_size);
+        bench_codec("rle", thtk_rle, "unrle", bench_unrle,
+            corpus_names[c], data, option_size);
+        bench_crypt(corpus_names[c], data, option_size);
+    }
+
+    free(data);
+}
+
+static const struct {
+    format_t format;
+    const char* name;
+} pixel_formats[] = {
+    { FORMAT_BGRA8888, "bgra8888" },
+    { FORMAT_RGB565,   "rgb565" },
+    { FORMAT_ARGB4444, "argb4444" },
+    { FORMAT_GRAY8,    "gray8" },
+    { FORMAT_RGBA8888, "rgba8888" },
+};
+
+/* Converts an RGBA texture to every format and back with each of thanm's
+ * pixel conversion implementations, and checks that they all produce the
+ * same bytes as the scalar one. */
+static void
+bench_pixel(
+    void)
+{
+    size_t pixels = option_size / sizeof(uint32_t);
+    uint32_t* rgba = malloc(pixels * sizeof(uint32_t));
+    uint32_t* back = malloc(pixels * sizeof(uint32_t));
+    uint32_t* ref_back = malloc(pixels * sizeof(uint32_t));
+    unsigned char* converted = malloc(pixels * sizeof(uint32_t));
+    unsigned char* ref = malloc(pixels * sizeof(uint32_t));
+
+    corpus_fill(CORPUS_IMAGE, (unsigned char*)rgba, pixels * sizeof(uint32_t), 0x7468746b);
+
+    for (size_t f = 0; f < sizeof(pixel_formats) / sizeof(*pixel_formats); ++f) {
+        format_t format = pixel_formats[f].format;
+        char encode_name[32], decode_name[32];
+        size_t size = 0;
+
+        snprintf(encode_name, sizeof(encode_name), "to_%s", pixel_formats[f].name);
+        snprintf(decode_name, sizeof(decode_name), "from_%s", pixel_formats[f].name);
+        switch ((int)format) {
+        case FORMAT_GRAY8:
+            size = pixels;
+            break;
+        case FORMAT_ARGB4444:
+        case FORMAT_RGB565:
+            size = pixels * 2;
+            break;
+        default:
+            size = pixels * 4;
+            break;
+        }
+
+        pixel_from_rgba(ref, rgba, pixels, format, PIXEL_ISA_SCALAR);
+        pixel_to_rgba(ref_back, ref, pixels, format, PIXEL_ISA_SCALAR);
+
+        for (int isa = 0; isa < PIXEL_ISA_COUNT; ++isa) {
+            double best_from = 0, best_to = 0;
+
+            if (!pixel_isa_supported(isa))
+                continue;
+
+            for (unsigned int n = 0; n < option_iterations; ++n) {
+                uint64_t start = trace_now();
+                pixel_from_rgba(converted, rgba, pixels, format, isa);
+                double seconds = (trace_now() - start) / 1e9;
+                if (!n || seconds < best_from)
+                    best_from = seconds;
+
+                start = trace_now();
+                pixel_to_rgba(back, converted, pixels, format, isa);
+                seconds = (trace_now() - start) / 1e9;
+                if (!n || seconds < best_to)
+                    best_to = seconds;
+
+                if (memcmp(converted, ref, size))
+                    bench_fail(encode_name, NULL);
+                if (memcmp(back, ref_back, pixels * sizeof(uint32_t)))
+                    bench_fail(decode_name, NULL);
+            }
+
+            bench_report(encode_name, pixel_isa_names[isa], pixels * sizeof(uint32_t), size, best_from);
+            bench_report(decode_name, pixel_isa_names[isa], size, pixels * sizeof(uint32_t), best_to);
+        }
+    }
+
+    free(ref);
+    free(converted);
+    free(ref_back);
+    free(back);
+    free(rgba);
+}
+
+#ifdef HAVE_LIBPNG
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} bench_buffer_t;
+
+static int
+bench_buffer_write(
+    void* user,
+    const void* data,
+    size_t size)
+{
+    bench_buffer_t* buffer = user;
+    if (util_vec_ensure(&buffer->data, &buffer->capacity, buffer->size + size, 1))
+        return -1;
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 0;
+}
+
+static void
+bench_libpng_write(
+    png_structp png_ptr,
+    png_bytep data,
+    size_t size)
+{
+    bench_buffer_write(png_get_io_ptr(png_ptr), data, size);
+}
+
+/* What thanm -x did before --png-level and friends: libpng with its default
+ * filters at zlib level 1. */
+static void
+bench_libpng_encode(
+    bench_buffer_t* buffer,
+    const unsigned char* data,
+    unsigned int width,
+    unsigned int height)
+{
+    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    png_set_compression_level(png_ptr, 1);
+    png_set_write_fn(png_ptr, buffer, bench_libpng_write, NULL);
+    png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB_ALPHA,
+        PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png_ptr, info_ptr);
+    for (unsigned int y = 0; y < height; ++y)
+        png_write_row(png_ptr, data + (size_t)y * width * 4);
+    png_write_end(png_ptr, info_ptr);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+}
+
+static const struct {
+    const char* name;
+    int level;
+    pngenc_filter_t filter;
+    int striped;
+} png_configs[] = {
+    { "libpng",     1, PNGENC_FILTER_ALL,   0 },
+    { "l1_all",     1, PNGENC_FILTER_ALL,   0 },
+    { "l1_all_mt",  1, PNGENC_FILTER_ALL,   1 },
+    { "l0_none_mt", 0, PNGENC_FILTER_NONE,  1 },
+    { "l1_none_mt", 1, PNGENC_FILTER_NONE,  1 },
+    { "l3_none",    3, PNGENC_FILTER_NONE,  0 },
+    { "l6_all_mt",  6, PNGENC_FILTER_ALL,   1 },
+    { "l9_all",     9, PNGENC_FILTER_ALL,   0 },
+    { "l9_all_mt",  9, PNGENC_FILTER_ALL,   1 },
+};
+
+/* Encodes a texture with libpng the way thanm does by default and with
+ * thanm's own encoder at several settings, and checks that every PNG
+ * decodes to the original pixels.  out_bytes is the size of the PNG. */
+static void
+bench_png(
+    void)
+{
+    const unsigned int width = 256;
+    const unsigned int height = option_size / (width * 4) ? option_size / (width * 4) : 1;
+    const size_t size = (size_t)width * height * 4;
+    unsigned char* rgba = malloc(size);
+    unsigned char* back = malloc(size);
+
+    corpus_fill(CORPUS_IMAGE, rgba, size, 0x7468746b);
+
+    for (size_t c = 0; c < sizeof(png_configs) / sizeof(*png_configs); ++c) {
+        pngenc_options_t options = {
+            png_configs[c].level,
+            png_configs[c].filter,
+            png_configs[c].striped ? PNGENC_STRIPE_SIZE : 0
+        };
+        bench_buffer_t buffer = { NULL, 0, 0 };
+        double best = 0;
+
+        for (unsigned int n = 0; n < option_iterations; ++n) {
+            png_image png;
+
+            buffer.size = 0;
+            uint64_t start = trace_now();
+            if (!c)
+                bench_libpng_encode(&buffer, rgba, width, height);
+            else if (pngenc_write(rgba, width, height, 4, &options, bench_buffer_write, &buffer))
+                bench_fail("pngenc_write", NULL);
+            double seconds = (trace_now() - start) / 1e9;
+            if (!n || seconds < best)
+                best = seconds;
+
+            memset(&png, 0, sizeof(png));
+            png.version = PNG_IMAGE_VERSION;
+            if (!png_image_begin_read_from_memory(&png, buffer.data, buffer.size))
+                bench_fail(png_configs[c].name, NULL);
+            png.format = PNG_FORMAT_RGBA;
+            if (!png_image_finish_read(&png, NULL, back, 0, NULL) ||
+                png.width != width || png.height != height || memcmp(back, rgba, size))
+                bench_fail(png_configs[c].name, NULL);
+        }
+
+        bench_report("png_encode", png_configs[c].name, size, buffer.size, best);
+        free(buffer.data);
+    }
+
+    free(back);
+    free(rgba);
+}
+#endif
+
+typedef struct {
+    char name[16];
+    unsigned char* data;
+    size_t size;
+} bench_file_t;
+
+static bench_file_t*
+archive_corpus(
+    const archive_profile_t* profile,
+    size_t* countp,
+    size_t* total)
+{
+    static const char* extensions[CORPUS_COUNT] = { "WAV", "ECL", "ANM" };
+    uint64_t state = profile->version;
+    size_t count = profile->file_count * option_scale;
+    if (count < 4)
+        count = 4;
+    bench_file_t* files = calloc(count, sizeof(*files));
+
+    *total = 0;
+    for (size_t f = 0; f < count; ++f) {
+        uint64_t r = bench_random(&state);
+        /* 50% images, 35% scripts and text, 15% incompressible data. */
+        corpus_t corpus = r % 20 < 10 ? CORPUS_IMAGE : r % 20 < 17 ? CORPUS_TEXT : CORPUS_RANDOM;
+        /* Sizes between a quarter of and twice the mean. */
+        size_t size = profile->mean_size / 4 +
+            (r >> 8) % (profile->mean_size * 7 / 4);
+        /* 8.3 uppercase names are accepted by every format. */
+        snprintf(files[f].name, sizeof(files[f].name), "F%07u.%s", (unsigned int)(f % 10000000), extensions[corpus]);
+        files[f].data = malloc(size);
+        files[f].size = size;
+        corpus_fill(corpus, files[f].data, size, r);
+        *total += size;
+    }
+
+    *countp = count;
+    return files;
+}
+
+/* Times one create, close, open and extract cycle of an archive, and checks
+ * that every entry comes back unchanged.  The archive is written to a file
+ * because some formats seek past the end while writing. */
+static void
+bench_archive(
+    const archive_profile_t* profile)
+{
+    thtk_error_t* error = NULL;
+    size_t count, total;
+    bench_file_t* files = archive_corpus(profile, &count, &total);
+    double best_create = 0, best_extract = 0;
+    size_t archive_size = 0;
+
+    for (unsigned int n = 0; n < option_iterations; ++n) {
+        thtk_io_t* archive;
+        thdat_t* thdat;
+
+        if (!(archive = thtk_io_open_file(option_archive, "w+b", &error)))
+            bench_fail("thtk_io_open_file", error);
+
+        uint64_t start = trace_now();
+        if (!(thdat = thdat_create(profile->version, archive, count, &error)))
+            bench_fail("thdat_create", error);
+        for (size_t f = 0; f < count; ++f)
+            if (!thdat_entry_set_name(thdat, f, files[f].name, &error))
+                bench_fail("thdat_entry_set_name", error);
+        if (!thdat_init(thdat, &error))
+            bench_fail("thdat_init", error);
+        for (size_t f = 0; f < count; ++f) {
+            thtk_io_t* input = bench_open_copy(files[f].data, files[f].size);
+            if (thdat_entry_write_data(thdat, f, input, files[f].size, &error) == -1)
+                bench_fail("thdat_entry_write_data", error);
+            thtk_io_close(input);
+        }
+        if (!thdat_close(thdat, &error))
+            bench_fail("thdat_close", error);
+        thdat_free(thdat);
+        double seconds = (trace_now() - start) / 1e9;
+        if (!n || seconds < best_create)
+            best_create = seconds;
+        archive_size = thtk_io_seek(archive, 0, SEEK_END, &error);
+
+        start = trace_now();
+        if (!(thdat = thdat_open(profile->version, archive, &error)))
+            bench_fail("thdat_open", error);
+        if (thdat_entry_count(thdat, &error) != (ssize_t)count)
+            bench_fail("thdat_entry_count", error);
+        for (size_t f = 0; f < count; ++f) {
+            thtk_io_t* output = thtk_io_open_growing_memory(&error);
+            ssize_t e = thdat_entry_by_name(thdat, files[f].name, &error);
+            if (e == -1)
+                bench_fail("thdat_entry_by_name", error);
+            if (thdat_entry_read_data(thdat, e, output, &error) == -1)
+                bench_fail("thdat_entry_read_data", error);
+            unsigned char* map = thtk_io_map(output, 0, files[f].size, &error);
+            if (!map || memcmp(map, files[f].data, files[f].size))
+                bench_fail("extract", error);
+            thtk_io_unmap(output, map);
+            thtk_io_close(output);
+        }
+        thdat_free(thdat);
+        seconds = (trace_now() - start) / 1e9;
+        if (!n || seconds < best_extract)
+            best_extract = seconds;
+
+        thtk_io_close(archive);
+    }
+
+    remove(option_archive);
+
+    bench_report("thdat_create", profile->game, total, archive_size, best_create);
+    bench_report("thdat_extract", profile->game, total, total, best_extract);
+
+    for (size_t f = 0; f < count; ++f)
+        free(files[f].data);
+    free(files);
+}
+
+int
+main(
+    int argc,
+    char* argv[])
+{
+    const char* output = NULL;
+    int run_codecs = 0, run_pixel = 0, run_png = 0, run_archives = 0;
+
+    argv0 = util_shortname(argv[0]);
+    int opt;
+    int ind = 0;
+    while (argv[util_optind]) {
+        switch (opt = util_getopt(argc, argv, "+:n:S:s:t:o:V")) {
+        case 'n':
+            option_iterations = strtoul(util_optarg, NULL, 10);
+            if (!option_iterations)
+                option_iterations = 1;
+            break;
+        case 'S':
+            option_size = strtoul(util_optarg, NULL, 10) * 1024;
+            if (!option_size)
+                option_size = 1024;
+            break;
+        case 's':
+            option_scale = strtod(util_optarg, NULL);
+            break;
+        case 't':
+            option_archive = util_optarg;
+            break;
+        case 'o':
+            output = util_optarg;
+            break;
+        default:
+            util_getopt_default(&ind, argv, opt, print_usage);
+        }
+    }
+    argc = ind;
+    argv[argc] = NULL;
+
+    for (int i = 0; i < argc; ++i) {
+        if (!strcmp(argv[i], "codec")) {
+            run_codecs = 1;
+        } else if (!strcmp(argv[i], "pixel")) {
+            run_pixel = 1;
+        } else if (!strcmp(argv[i], "png")) {
+            run_png = 1;
+        } else if (!strcmp(argv[i], "archive")) {
+            run_archives = 1;
+        } else {
+            print_usage();
+            exit(1);
+        }
+    }
+    if (!run_codecs && !run_pixel && !run_png && !run_archives)
+        run_codecs = run_pixel = run_png = run_archives = 1;
+
+    bench_out = stdout;
+    if (output && !(bench_out = fopen(output, "w"))) {
+        fprintf(stderr, "%s: couldn't open %s for writing\n", argv0, output);
+        exit(1);
+    }
+
+    fprintf(bench_out,
+        "{\"thtk_bench\":1,\"version\":\"" PACKAGE_VERSION "\","
+        "\"iterations\":%u,\"corpus_size\":%zu,\"scale\":%g}\n",
+        option_iterations, option_size, option_scale);
+
+    if (run_codecs)
+        bench_codecs();
+    if (run_pixel)
+        bench_pixel();
+#ifdef HAVE_LIBPNG
+    if (run_png)
+        bench_png();
+#endif
+    if (run_archives)
+        for (size_t p = 0; p < sizeof(archive_profiles) / sizeof(*archive_profiles); ++p)
+            bench_archive(&archive_profiles[p]);
+
+    if (bench_out != stdout)
+        fclose(bench_out);
+    return 0;
+}
@@ -1356,6 +1356,7 @@ main(
 #endif
 
     argv0 = util_shortname(argv[0]);
+    util_stats_at_exit();
     int opt;
     int ind=0;
     while(argv[util_optind]) {
@@ -0,0 +1,61 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#ifndef ANMLIST_H_
+#define ANMLIST_H_
+
+#include <config.h>
+#include <stdio.h>
+#include "anmmap.h"
+
+/* Settings of one listing.  thtk-batch lists several ANM archives at once on
+ * its worker threads, each with a context of its own.  This is kept apart from
+ * thanm.h, whose parser types would clash with those of thecl. */
+typedef struct {
+    /* Shared between jobs, and not changed once loaded. */
+    anmmap_t* anmmap;
+    unsigned int print_offsets;
+    unsigned int unique_filenames;
+    /* Name of the input for messages and unique filenames. */
+    const char* input;
+} thanm_context_t;
+
+/* Returns 1 if the version is supported. */
+int thanm_version_supported(
+    unsigned int version);
+
+/* Lists an ANM archive as thanm -l does.  Returns 0 if the file couldn't be
+ * read. */
+int thanm_list(
+    const thanm_context_t* ctx,
+    unsigned int version,
+    FILE* in,
+    FILE* out);
+
+#endif
@@ -210,17 +210,17 @@ Statement:
 
 Entry:
     "entry" IDENTIFIER[entry_name] "{" Properties[prop_list] "}" {
-        anm_entry_t* entry = (anm_entry_t*)calloc(1, sizeof(anm_entry_t));
-        entry->header = (anm_header06_t*)calloc(1, sizeof(anm_header06_t));
-        entry->thtx = (thtx_header_t*)calloc(1, sizeof(thtx_header_t));
+        anm_entry_t* entry = (anm_entry_t*)arena_calloc(state->arena, sizeof(anm_entry_t));
+        entry->header = (anm_header06_t*)arena_calloc(state->arena, sizeof(anm_header06_t));
+        entry->thtx = (thtx_header_t*)arena_calloc(state->arena, sizeof(thtx_header_t));
 
         entry->thtx->magic[0] = 'T';
         entry->thtx->magic[1] = 'H';
         entry->thtx->magic[2] = 'T';
         entry->thtx->magic[3] = 'X';
 
-        list_init(&entry->sprites);
-        list_init(&entry->scripts);
+        list_init_arena(&entry->sprites, state->arena);
+        list_init_arena(&entry->scripts, state->arena);
 
         prop_list_entry_t* prop;
         #define REQUIRE(x, y, l) { \
@@ -251,13 +251,13 @@ Entry:
         state->current_version = entry->header->version;
 
         REQUIRE("name", 't', $prop_list);
-        entry->name = strdup(prop->value->val.t);
+        entry->name = arena_strdup(state->arena, prop->value->val.t);
 
         OPTIONAL("name2", 't', $prop_list);
-        if (prop) entry->name2 = strdup(prop->value->val.t);
+        if (prop) entry->name2 = arena_strdup(state->arena, prop->value->val.t);
 
         OPTIONAL("filename", 't', $prop_list);
-        if (prop) entry->filename = strdup(prop->value->val.t);
+        if (prop) entry->filename = arena_strdup(state->arena, prop->value->val.t);
 
         OPTIONAL("format", 'S', $prop_list);
         entry->header->format = prop ? prop->value->val.S : 1;
@@ -322,7 +322,7 @@ Entry:
                 list_t* inner_list = prop->value->val.l;
                 char* name = prop->key;
 
-                sprite19_t* sprite = (sprite19_t*)malloc(sizeof(sprite19_t));
+                sprite19_t* sprite = (sprite19_t*)arena_alloc(state->arena, sizeof(sprite19_t));
 
                 OPTIONAL("id", 'S', inner_list);
                 if (prop) state->sprite_id = prop->value->val.S;
@@ -456,9 +456,9 @@ Script:
             yyerror(state, "an entry is required before a script");
             return 1;
         }
-        anm_script_t* script = anm_script_new();
+        anm_script_t* script = anm_script_new(state->arena);
         reg_reset(state->current_version);
-        script->offset = malloc(sizeof(*script->offset));
+        script->offset = arena_alloc(state->arena, sizeof(*script->offset));
         script->offset->id = state->script_id++;
         script->real_index = state->script_real_index++;
         script->no_sentinel = $no_sentinel;
@@ -502,12 +502,10 @@ ScriptStatement:
     | IDENTIFIER[name] ":" {
         if (label_find(state->current_script, $name) != NULL) {
             yyerror(state, "duplicate label: %s", $name);
+            free($name);
+        } else {
+            label_add(state->current_script, $name, state->offset, state->time);
         }
-        label_t* label = (label_t*)malloc(sizeof(label_t));
-        label->name = $name;
-        label->offset = state->offset;
-        label->time = state->time;
-        list_append_new(&state->current_script->labels, label);
     }
     | IDENTIFIER[ident] "(" Expressions[exprs] ")" ";" {
         int id = identifier_instr($ident);
@@ -539,8 +537,7 @@ ScriptStatement:
         free($exprs);
 
         instr_check_types(state, id, param_list);
-        thanm_instr_t* instr = instr_new(state, id, param_list);
-        list_append_new(&state->current_script->instrs, instr);
+        instr_new(state, id, param_list);
 
         reg_t* reg;
         list_for_each(&regs_to_free, reg)
@@ -1042,7 +1039,7 @@ var_create(
 ) {
     /* Create variables without assigning registers, and only assign them if
      * the var is actually used. */
-    var_t* var = var_new(name, type);
+    var_t* var = var_new(state->arena, name, type);
     if (expr != NULL) {
         var_assign(state, var, expr);
     }
@@ -570,8 +570,7 @@ expr_output(
             list_append_new(params, child->param);
             child->param = NULL; /* Setting it to NULL to avoid freeing it twice.  */
         }
-        thanm_instr_t* instr = instr_new(state, id, params);
-        list_append_new(&state->current_script->instrs, instr);
+        instr_new(state, id, params);
     }
 
     /* Now, expr has to be simplified to EXPR_VAL that uses
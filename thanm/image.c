@@ -37,6 +37,7 @@
 #include "image.h"
 #include "program.h"
 #include "thanm.h"
+#include "util.h"
 
 unsigned int
 format_Bpp(
@@ -59,57 +60,64 @@ format_Bpp(
 }
 
 #ifdef HAVE_LIBPNG
+int png_option_level = -1;
+int png_option_filter = -1;
+int png_option_striped = 0;
+
+/* Returns 0 if the PNG options weren't given and libpng should be used
+ * as before.  level and filter are used for the options left out. */
+static int
+png_options(
+    pngenc_options_t* options,
+    int level,
+    pngenc_filter_t filter)
+{
+    if (png_option_level == -1 && png_option_filter == -1 && !png_option_striped)
+        return 0;
+    options->level = png_option_level != -1 ? png_option_level : level;
+    options->filter = png_option_filter != -1 ? (pngenc_filter_t)png_option_filter : filter;
+    options->stripe_size = png_option_striped ? PNGENC_STRIPE_SIZE : 0;
+    return 1;
+}
+
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} png_buffer_t;
+
+static int
+png_buffer_write(
+    void* user,
+    const void* data,
+    size_t size)
+{
+    png_buffer_t* buffer = user;
+    if (util_vec_ensure(&buffer->data, &buffer->capacity, buffer->size + size, 1))
+        return -1;
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 0;
+}
+
+static int
+png_stream_write(
+    void* user,
+    const void* data,
+    size_t size)
+{
+    return fwrite(data, 1, size, user) == size ? 0 : -1;
+}
+
 unsigned char*
 format_from_rgba(
     const uint32_t* data,
     unsigned int pixels,
     format_t format)
 {
-    unsigned int i;
-    unsigned char* out = NULL;
+    unsigned char* out = malloc(format_Bpp(format) * pixels);
 
-    if (format == FORMAT_GRAY8) {
-        out = malloc(pixels);
-        for (i = 0; i < pixels; ++i) {
-            out[i] = data[i] & 0xff;
-        }
-    } else if (format == FORMAT_BGRA8888) {
-        const unsigned char* data8 = (const unsigned char*)data;
-        out = malloc(sizeof(uint32_t) * pixels);
-        for (i = 0; i < pixels; ++i) {
-            out[i * sizeof(uint32_t) + 0] = data8[i * sizeof(uint32_t) + 2];
-            out[i * sizeof(uint32_t) + 1] = data8[i * sizeof(uint32_t) + 1];
-            out[i * sizeof(uint32_t) + 2] = data8[i * sizeof(uint32_t) + 0];
-            out[i * sizeof(uint32_t) + 3] = data8[i * sizeof(uint32_t) + 3];
-        }
-    } else if (format == FORMAT_ARGB4444) {
-        out = malloc(sizeof(uint16_t) * pixels);
-        for (i = 0; i < pixels; ++i) {
-            /* Use the extra precision for rounding. */
-            const unsigned char r = (((data[i] & 0xff000000) >> 24) + 8) / 17;
-            const unsigned char g = (((data[i] &   0xff0000) >> 16) + 8) / 17;
-            const unsigned char b = (((data[i] &     0xff00) >>  8) + 8) / 17;
-            const unsigned char a = (((data[i] &       0xff)      ) + 8) / 17;
-
-            out[i * sizeof(uint16_t) + 0] = (b << 4) | g;
-            out[i * sizeof(uint16_t) + 1] = (r << 4) | a;
-        }
-    } else if (format == FORMAT_RGB565) {
-        uint16_t* out16;
-        out = malloc(sizeof(uint16_t) * pixels);
-        out16 = (uint16_t*)out;
-        for (i = 0; i < pixels; ++i) {
-                     /* 00000000 00000000 11111000 -> 00000000 00011111 */
-            out16[i] = ((data[i] &     0xf8) << 8)
-                     /* 00000000 11111100 00000000 -> 00000111 11100000 */
-                     | ((data[i] &   0xfc00) >> 5)
-                     /* 11111000 00000000 00000000 -> 11111000 00000000 */
-                     | ((data[i] & 0xf80000) >>19);
-        }
-    } else if (format == FORMAT_RGBA8888) {
-        out = malloc(sizeof(uint32_t) * pixels);
-        memcpy(out, data, sizeof(uint32_t) * pixels);
-    } else {
+    if (pixel_from_rgba(out, data, pixels, format, pixel_isa_best()) == -1) {
         fprintf(stderr, "%s: unknown format: %u\n", argv0, format);
         abort();
     }
@@ -117,65 +125,31 @@ format_from_rgba(
     return out;
 }
 
+void
+format_from_rgba_rect(
+    unsigned char* out,
+    const uint32_t* data,
+    unsigned int stride,
+    unsigned int w,
+    unsigned int h,
+    format_t format)
+{
+    if (pixel_from_rgba_rect(out, (size_t)w * format_Bpp(format), data, stride,
+            w, h, format, pixel_isa_best()) == -1) {
+        fprintf(stderr, "%s: unknown format: %u\n", argv0, format);
+        abort();
+    }
+}
+
 unsigned char*
 format_to_rgba(
     const unsigned char* data,
     unsigned int pixels,
     format_t format)
 {
-    unsigned int i;
     uint32_t* out = malloc(sizeof(uint32_t) * pixels);
 
-    if (format == FORMAT_GRAY8) {
-        for (i = 0; i < pixels; ++i) {
-            out[i] = 0xff000000
-                   | (data[i] << 16 & 0xff0000)
-                   | (data[i] <<  8 &   0xff00)
-                   | (data[i] <<  0 &     0xff);
-        }
-    } else if (format == FORMAT_BGRA8888) {
-        unsigned char* out8 = (unsigned char*)out;
-        for (i = 0; i < pixels; ++i) {
-            out8[i * sizeof(uint32_t) + 0] = data[i * sizeof(uint32_t) + 2];
-            out8[i * sizeof(uint32_t) + 1] = data[i * sizeof(uint32_t) + 1];
-            out8[i * sizeof(uint32_t) + 2] = data[i * sizeof(uint32_t) + 0];
-            out8[i * sizeof(uint32_t) + 3] = data[i * sizeof(uint32_t) + 3];
-        }
-    } else if (format == FORMAT_ARGB4444) {
-        for (i = 0; i < pixels; ++i) {
-            /* Extends like this: 0x0 -> 0x00, 0x3 -> 0x33, 0xf -> 0xff.
-             * It's required for proper alpha. */
-            out[i] = ((data[i * sizeof(uint16_t) + 1] & 0xf0) << 24 & 0xf0000000)
-                   | ((data[i * sizeof(uint16_t) + 1] & 0xf0) << 20 & 0x0f000000)
-                   | ((data[i * sizeof(uint16_t) + 0] & 0x0f) << 20 &   0xf00000)
-                   | ((data[i * sizeof(uint16_t) + 0] & 0x0f) << 16 &   0x0f0000)
-                   | ((data[i * sizeof(uint16_t) + 0] & 0xf0) <<  8 &     0xf000)
-                   | ((data[i * sizeof(uint16_t) + 0] & 0xf0) <<  4 &     0x0f00)
-                   | ((data[i * sizeof(uint16_t) + 1] & 0x0f) <<  4 &       0xf0)
-                   | ((data[i * sizeof(uint16_t) + 1] & 0x0f) <<  0 &       0x0f);
-        }
-    } else if (format == FORMAT_RGB565) {
-        uint16_t* u16 = (uint16_t*)data;
-        for (i = 0; i < pixels; ++i) {
-            /* Bit-extends channels: 00001b -> 00001111b. */
-            out[i] = 0xff000000
-                   | ((u16[i] & 0x001f) << 19 & 0xf80000)
-                   | ((u16[i] & 0x0001) << 16 & 0x040000)
-                   | ((u16[i] & 0x0001) << 16 & 0x020000)
-                   | ((u16[i] & 0x0001) << 16 & 0x010000)
-
-                   | ((u16[i] & 0x07e0) <<  5 & 0x00fc00)
-                   | ((u16[i] & 0x0020) <<  4 & 0x000200)
-                   | ((u16[i] & 0x0020) <<  3 & 0x000100)
-
-                   | ((u16[i] & 0xf800) >>  8 & 0x0000f8)
-                   | ((u16[i] & 0x0800) >>  9 & 0x000004)
-                   | ((u16[i] & 0x0800) >> 10 & 0x000002)
-                   | ((u16[i] & 0x0800) >> 11 & 0x000001);
-        }
-    } else if (format == FORMAT_RGBA8888) {
-        memcpy(out, data, sizeof(uint32_t) * pixels);
-    } else {
+    if (pixel_to_rgba(out, data, pixels, format, pixel_isa_best()) == -1) {
         fprintf(stderr, "%s: unknown format: %u\n", argv0, format);
         abort();
     }
@@ -217,6 +191,19 @@ png_write_mem(
     image_t *image,
     size_t *outsize)
 {
+    pngenc_options_t options;
+    /* The same settings PNG_IMAGE_FLAG_FAST gives libpng. */
+    if (png_options(&options, 3, PNGENC_FILTER_NONE)) {
+        png_buffer_t buffer = { NULL, 0, 0 };
+        if (pngenc_write(image->data, image->width, image->height, 4,
+                &options, png_buffer_write, &buffer)) {
+            fprintf(stderr, "%s: error encoding png\n", argv0);
+            exit(1);
+        }
+        *outsize = buffer.size;
+        return buffer.data;
+    }
+
     png_image png;
     memset(&png, 0, sizeof(png));
     png.version = PNG_IMAGE_VERSION;
@@ -245,7 +232,7 @@ png_read(
     const char* filename)
 {
     FILE* stream;
-    image_t* image;
+    image_t* image = NULL;
     png_image png = {
         .version = PNG_IMAGE_VERSION,
         .opaque = NULL
@@ -255,7 +242,7 @@ png_read(
     if(!stream) {
         fprintf(stderr, "%s: couldn't open %s for reading: %s\n",
             argv0, filename, strerror(errno));
-        exit(1);
+        return NULL;
     }
 
 #define ERR_WRAP(x) \
@@ -263,7 +250,7 @@ png_read(
     if(PNG_IMAGE_FAILED(png)) { \
         fprintf(stderr, "%s: error reading %s: %s\n", \
             argv0, filename, png.message); \
-        exit(1); \
+        goto fail; \
     }
 
     ERR_WRAP(png_image_begin_read_from_stdio(&png, stream));
@@ -281,6 +268,15 @@ png_read(
 #undef ERR_WRAP
 
     return image;
+
+fail:
+    png_image_free(&png);
+    fclose(stream);
+    if (image) {
+        free(image->data);
+        free(image);
+    }
+    return NULL;
 }
 
 void
@@ -314,6 +310,15 @@ png_write(
         bytes_per_pixel = 4;
     } /* else { abort(); } */
 
+    pngenc_options_t options;
+    if (png_options(&options, 1, PNGENC_FILTER_ALL)) {
+        if (pngenc_write(image->data, image->width, image->height, bytes_per_pixel,
+                &options, png_stream_write, stream))
+            fprintf(stderr, "%s: error writing %s\n", argv0, filename);
+        fclose(stream);
+        return;
+    }
+
     png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     png_set_compression_level(png_ptr, 1);
     info_ptr = png_create_info_struct(png_ptr);
@@ -32,9 +32,8 @@
 #include <config.h>
 #include <anm_types.h>
 #include <stdio.h>
-
- /* Internal use only. */
-#define FORMAT_RGBA8888 ((format_t)-1)
+#include "pixel.h"
+#include "pngenc.h"
 
 unsigned int
 format_Bpp(
@@ -46,6 +45,17 @@ format_from_rgba(
     unsigned int pixels,
     format_t format);
 
+/* Converts the w by h rectangle at data, whose rows are stride pixels
+ * apart, into out without gaps between the rows. */
+void
+format_from_rgba_rect(
+    unsigned char* out,
+    const uint32_t* data,
+    unsigned int stride,
+    unsigned int w,
+    unsigned int h,
+    format_t format);
+
 unsigned char*
 format_to_rgba(
     const unsigned char* data,
@@ -70,6 +80,13 @@ png_write_mem(
     image_t *image,
     size_t *outsize);
 
+/* Set by --png-level, --png-filter and --png-striped.  -1 and 0 keep the
+ * default libpng settings of png_write and png_write_mem. */
+extern int png_option_level;
+extern int png_option_filter;
+extern int png_option_striped;
+
+/* Returns NULL and prints a message if the file can't be read. */
 image_t*
 png_read(
     const char* filename);
@@ -0,0 +1,280 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "file.h"
+#include "image.h"
+#include "thanm.h"
+#include "program.h"
+#include "trace.h"
+#include "util.h"
+#include "mygetopt.h"
+
+static void
+print_usage(void)
+{
+#ifdef HAVE_LIBPNG
+#define USAGE_LIBPNGFLAGS " | -x | -r | -c"
+#else
+#define USAGE_LIBPNGFLAGS ""
+#endif
+    printf("Usage: %s [-Vfouv] [[-l" USAGE_LIBPNGFLAGS "] VERSION] [-m ANMMAP]... [-s SYMBOLS] ARCHIVE ...\n"
+           "Options:\n"
+           "  -l VERSION ARCHIVE            list archive\n"
+#ifdef HAVE_LIBPNG
+           "  -x VERSION ARCHIVE [FILE...]  extract entries\n"
+           "  -X VERSION ARCHIVE...         extract all entries from multiple archives\n"
+           "  -r VERSION ARCHIVE NAME FILE  replace entry in archive, more NAME FILE\n"
+           "                                pairs can follow\n"
+           "  -c VERSION ARCHIVE SPEC       create archive\n"
+           "  -s SYMBOLS                    save symbol ids to the given file as globaldefs\n"
+#endif
+           "  -m ANMMAP                     use map file for translating mnemonics\n"
+           "  -V                            display version information and exit\n"
+           "  -f                            ignore errors when possible\n"
+           "  -o                            add address information for ANM instructions\n"
+           "  -u                            extract each texture into a separate file\n"
+           "  -uu                           ignore x/y offset\n"
+           "  -v                            verbose output\n"
+#ifdef HAVE_LIBPNG
+           "  --incremental                 with -x and -X, don't rewrite images that\n"
+           "                                are unchanged since the last extraction;\n"
+           "                                with -c, reuse the textures of images that\n"
+           "                                are unchanged since the last build\n"
+           "  --png-level LEVEL             zlib level (0-9) of written PNG files\n"
+           "  --png-filter FILTER           row filter of written PNG files: none, sub,\n"
+           "                                up, avg, paeth or all\n"
+           "  --png-striped                 compress PNG files in stripes on several threads\n"
+#endif
+           "  --trace FILE                  write a Chrome trace-event JSON file (for Perfetto)\n"
+           "VERSION can be:\n"
+           "  6, 7, 8, 9, 95, 10, 103, 11, 12, 125, 128, 13, 14, 143, 15, 16, 165, 17, 18, 185, 19, or 20\n"
+           /* NEWHU: 20 */
+           "Report bugs to <" PACKAGE_BUGREPORT ">.\n", argv0);
+}
+
+static void
+free_globals(void)
+{
+    anmmap_free(g_anmmap);
+}
+
+int
+main(
+    int argc,
+    char* argv[])
+{
+    g_anmmap = anmmap_new();
+    atexit(free_globals);
+
+    const char commands[] = "+:l:om:"
+#ifdef HAVE_LIBPNG
+                            "x:X:r:c:s:"
+#endif
+                            "Vfuv";
+    int command = -1;
+
+    FILE* in;
+    unsigned version = 0;
+#ifdef HAVE_LIBPNG
+    FILE* symbolfp = NULL;
+#endif
+
+    argv0 = util_shortname(argv[0]);
+    util_stats_at_exit();
+    trace_init_args(&argc, argv);
+    const char* png_level = NULL;
+    const char* png_filter = NULL;
+    const util_long_option_t long_options[] = {
+        { "incremental", &option_incremental, NULL },
+#ifdef HAVE_LIBPNG
+        { "png-level", NULL, &png_level },
+        { "png-filter", NULL, &png_filter },
+        { "png-striped", &png_option_striped, NULL },
+#endif
+        { NULL, NULL, NULL }
+    };
+    util_long_options(&argc, argv, long_options);
+#ifdef HAVE_LIBPNG
+    if (png_level) {
+        char* end;
+        long level = strtol(png_level, &end, 10);
+        if (*end || end == png_level || level < 0 || level > 9) {
+            fprintf(stderr, "%s: invalid PNG compression level: %s\n", argv0, png_level);
+            exit(1);
+        }
+        png_option_level = level;
+    }
+    if (png_filter && (png_option_filter = pngenc_filter_parse(png_filter)) == -1) {
+        fprintf(stderr, "%s: unknown PNG filter: %s\n", argv0, png_filter);
+        exit(1);
+    }
+#endif
+    int opt;
+    int ind = 0;
+    while(argv[util_optind]) {
+        switch(opt = util_getopt(argc,argv,commands)) {
+        case 'c':
+            if (option_print_offsets) {
+                fprintf(stderr, "%s: 'o' option can't be used when creating ANM archive\n", argv0);
+                exit(1);
+            }
+            /* fallthrough */
+        case 'l':
+        case 'x':
+        case 'X':
+        case 'r':
+            if(command != -1) {
+                fprintf(stderr,"%s: More than one mode specified\n",argv0);
+                print_usage();
+                exit(1);
+            }
+            command = opt;
+            version = parse_version(util_optarg);
+            break;
+        case 'm': {
+            FILE* map_file = NULL;
+            map_file = fopen(util_optarg, "r");
+            if (!map_file) {
+                fprintf(stderr, "%s: couldn't open %s for reading: %s\n",
+                    argv0, util_optarg, strerror(errno));
+            } else {
+                anmmap_load(g_anmmap, map_file, util_optarg);
+                fclose(map_file);
+            }
+            break;
+        }
+        case 's':
+            symbolfp = fopen(util_optarg, "w");
+            if (!symbolfp) {
+                fprintf(stderr, "%s: couldn't open %s for writing: %s\n",
+                    argv0, util_optarg, strerror(errno));
+            }
+            break;
+        case 'f':
+            option_force = 1;
+            break;
+        case 'u':
+            if (option_unique_filenames)
+                option_dont_add_offset_border = 1;
+            else
+                option_unique_filenames = 1;
+            break;
+        case 'v':
+            option_verbose++;
+            break;
+        case 'o':
+            if (command == 'c') {
+                fprintf(stderr, "%s: 'o' option can't be used when creating ANM archive\n", argv0);
+                exit(1);
+            }
+            option_print_offsets = 1;
+            break;
+        default:
+            util_getopt_default(&ind,argv,opt,print_usage);
+        }
+    }
+    argc = ind;
+    argv[argc] = NULL;
+
+    if (command == -1) {
+        print_usage();
+        exit(1);
+    }
+
+    if (option_incremental && command != 'x' && command != 'X' && command != 'c') {
+        fprintf(stderr, "%s: --incremental only works with -x, -X and -c\n", argv0);
+        exit(1);
+    }
+
+    if (!thanm_version_supported(version)) {
+        if (version == 0)
+            fprintf(stderr, "%s: version must be specified\n", argv0);
+        else
+            fprintf(stderr, "%s: version %u is unsupported\n", argv0, version);
+        exit(1);
+    }
+
+    switch (command) {
+    case 'l': {
+        if (argc != 1) {
+            print_usage();
+            exit(1);
+        }
+
+        const thanm_context_t context = {
+            .anmmap = g_anmmap,
+            .print_offsets = option_print_offsets,
+            .unique_filenames = option_unique_filenames,
+            .input = argv[0],
+        };
+        current_input = argv[0];
+        in = file_open_input(argv[0], version);
+        if (!in) {
+            fprintf(stderr, "%s: couldn't open %s for reading\n", argv0, current_input);
+            exit(1);
+        }
+        int ret = thanm_list(&context, version, in, stdout);
+        file_close(in);
+        exit(ret ? 0 : 1);
+    }
+#ifdef HAVE_LIBPNG
+    case 'x':
+        if (argc < 1) {
+            print_usage();
+            exit(1);
+        }
+        exit(thanm_extract(version, argc, argv));
+    case 'X':
+        if (argc < 1) {
+            print_usage();
+            exit(1);
+        }
+        exit(thanm_extract_multiple(version, argc, argv));
+    case 'r':
+        if (argc < 3 || argc % 2 == 0) {
+            print_usage();
+            exit(1);
+        }
+        exit(thanm_replace(version, argc, argv));
+    case 'c':
+        if (argc != 2) {
+            print_usage();
+            exit(1);
+        }
+        exit(thanm_create(version, argv[0], argv[1], symbolfp));
+#endif
+    default:
+        print_usage();
+        exit(1);
+    }
+}
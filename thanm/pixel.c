@@ -0,0 +1,889 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include <config.h>
+#include <string.h>
+#include "pixel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PIXEL_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(_MSC_VER)
+/* AVX2 is compiled in whenever SSE2 is and picked at runtime. */
+#define PIXEL_AVX2
+#include <immintrin.h>
+#ifdef __GNUC__
+#define PIXEL_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#include <intrin.h>
+#define PIXEL_TARGET_AVX2
+#endif
+#endif
+#endif
+
+#if (defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)) || defined(_M_ARM64)
+#define PIXEL_NEON
+#include <arm_neon.h>
+#endif
+
+const char* pixel_isa_names[PIXEL_ISA_COUNT] = {
+    "scalar", "sse2", "avx2", "neon"
+};
+
+/* Every kernel converts pixels from data to out.  The vector kernels do
+ * as many pixels as fit in whole vectors and leave the rest to the scalar
+ * kernel. */
+typedef void (*pixel_kernel_t)(unsigned char*, const unsigned char*, size_t);
+
+enum {
+    KERNEL_GRAY8,
+    KERNEL_BGRA8888,
+    KERNEL_ARGB4444,
+    KERNEL_RGB565,
+    KERNEL_COUNT
+};
+
+/* (x + 8) / 17 for 0 <= x <= 255, which rounds to the nearest 4-bit value.
+ * The vector kernels compute it the same way. */
+static inline unsigned int
+div17(
+    unsigned int x)
+{
+    return ((x + 8) * 241) >> 12;
+}
+
+static void
+gray8_from_scalar(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    const uint32_t* data32 = (const uint32_t*)data;
+    for (size_t i = 0; i < pixels; ++i)
+        out[i] = data32[i] & 0xff;
+}
+
+/* BGRA8888 and RGBA8888 only differ in the order of the first and third
+ * byte, so the same kernel converts in both directions. */
+static void
+swap_rb_scalar(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    for (size_t i = 0; i < pixels; ++i) {
+        out[i * sizeof(uint32_t) + 0] = data[i * sizeof(uint32_t) + 2];
+        out[i * sizeof(uint32_t) + 1] = data[i * sizeof(uint32_t) + 1];
+        out[i * sizeof(uint32_t) + 2] = data[i * sizeof(uint32_t) + 0];
+        out[i * sizeof(uint32_t) + 3] = data[i * sizeof(uint32_t) + 3];
+    }
+}
+
+static void
+argb4444_from_scalar(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    const uint32_t* data32 = (const uint32_t*)data;
+    for (size_t i = 0; i < pixels; ++i) {
+        /* Use the extra precision for rounding. */
+        const unsigned char r = div17((data32[i] & 0xff000000) >> 24);
+        const unsigned char g = div17((data32[i] &   0xff0000) >> 16);
+        const unsigned char b = div17((data32[i] &     0xff00) >>  8);
+        const unsigned char a = div17((data32[i] &       0xff)      );
+
+        out[i * sizeof(uint16_t) + 0] = (b << 4) | g;
+        out[i * sizeof(uint16_t) + 1] = (r << 4) | a;
+    }
+}
+
+static void
+rgb565_from_scalar(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    const uint32_t* data32 = (const uint32_t*)data;
+    uint16_t* out16 = (uint16_t*)out;
+    for (size_t i = 0; i < pixels; ++i) {
+                   /* 00000000 00000000 11111000 -> 00000000 00011111 */
+        out16[i] = ((data32[i] &     0xf8) << 8)
+                   /* 00000000 11111100 00000000 -> 00000111 11100000 */
+                 | ((data32[i] &   0xfc00) >> 5)
+                   /* 11111000 00000000 00000000 -> 11111000 00000000 */
+                 | ((data32[i] & 0xf80000) >>19);
+    }
+}
+
+static void
+gray8_to_scalar(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    uint32_t* out32 = (uint32_t*)out;
+    for (size_t i = 0; i < pixels; ++i) {
+        out32[i] = 0xff000000
+                 | (data[i] << 16 & 0xff0000)
+                 | (data[i] <<  8 &   0xff00)
+                 | (data[i] <<  0 &     0xff);
+    }
+}
+
+static void
+argb4444_to_scalar(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    uint32_t* out32 = (uint32_t*)out;
+    for (size_t i = 0; i < pixels; ++i) {
+        /* Extends like this: 0x0 -> 0x00, 0x3 -> 0x33, 0xf -> 0xff.
+         * It's required for proper alpha. */
+        out32[i] = ((uint32_t)(data[i * sizeof(uint16_t) + 1] & 0xf0) << 24 & 0xf0000000)
+                 | ((data[i * sizeof(uint16_t) + 1] & 0xf0) << 20 & 0x0f000000)
+                 | ((data[i * sizeof(uint16_t) + 0] & 0x0f) << 20 &   0xf00000)
+                 | ((data[i * sizeof(uint16_t) + 0] & 0x0f) << 16 &   0x0f0000)
+                 | ((data[i * sizeof(uint16_t) + 0] & 0xf0) <<  8 &     0xf000)
+                 | ((data[i * sizeof(uint16_t) + 0] & 0xf0) <<  4 &     0x0f00)
+                 | ((data[i * sizeof(uint16_t) + 1] & 0x0f) <<  4 &       0xf0)
+                 | ((data[i * sizeof(uint16_t) + 1] & 0x0f) <<  0 &       0x0f);
+    }
+}
+
+static void
+rgb565_to_scalar(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    const uint16_t* u16 = (const uint16_t*)data;
+    uint32_t* out32 = (uint32_t*)out;
+    for (size_t i = 0; i < pixels; ++i) {
+        /* Bit-extends channels: 00001b -> 00001111b. */
+        out32[i] = 0xff000000
+                 | ((u16[i] & 0x001f) << 19 & 0xf80000)
+                 | ((u16[i] & 0x0001) << 16 & 0x040000)
+                 | ((u16[i] & 0x0001) << 16 & 0x020000)
+                 | ((u16[i] & 0x0001) << 16 & 0x010000)
+
+                 | ((u16[i] & 0x07e0) <<  5 & 0x00fc00)
+                 | ((u16[i] & 0x0020) <<  4 & 0x000200)
+                 | ((u16[i] & 0x0020) <<  3 & 0x000100)
+
+                 | ((u16[i] & 0xf800) >>  8 & 0x0000f8)
+                 | ((u16[i] & 0x0800) >>  9 & 0x000004)
+                 | ((u16[i] & 0x0800) >> 10 & 0x000002)
+                 | ((u16[i] & 0x0800) >> 11 & 0x000001);
+    }
+}
+
+#ifdef PIXEL_SSE2
+#define LOAD128(p) _mm_loadu_si128((const __m128i*)(p))
+#define STORE128(p, v) _mm_storeu_si128((__m128i*)(p), (v))
+
+/* _mm_packs_epi32 saturates signed values, so the 16-bit results are
+ * sign-extended first to keep all of their bits. */
+static inline __m128i
+pack32_sse2(
+    __m128i a,
+    __m128i b)
+{
+    a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    return _mm_packs_epi32(a, b);
+}
+
+static void
+gray8_from_sse2(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    size_t i;
+    for (i = 0; i + 16 <= pixels; i += 16) {
+        __m128i a = _mm_and_si128(LOAD128(data + i * 4 +  0), mask);
+        __m128i b = _mm_and_si128(LOAD128(data + i * 4 + 16), mask);
+        __m128i c = _mm_and_si128(LOAD128(data + i * 4 + 32), mask);
+        __m128i d = _mm_and_si128(LOAD128(data + i * 4 + 48), mask);
+        STORE128(out + i, _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+    }
+    gray8_from_scalar(out + i, data + i * 4, pixels - i);
+}
+
+static void
+swap_rb_sse2(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    const __m128i ga = _mm_set1_epi32((int)0xff00ff00);
+    const __m128i low = _mm_set1_epi32(0xff);
+    size_t i;
+    for (i = 0; i + 4 <= pixels; i += 4) {
+        __m128i v = LOAD128(data + i * 4);
+        v = _mm_or_si128(_mm_and_si128(v, ga),
+            _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 16), low),
+                         _mm_slli_epi32(_mm_and_si128(v, low), 16)));
+        STORE128(out + i * 4, v);
+    }
+    swap_rb_scalar(out + i * 4, data + i * 4, pixels - i);
+}
+
+/* Converts four pixels, leaving the results in the low halves. */
+static inline __m128i
+argb4444_from4_sse2(
+    __m128i v)
+{
+    const __m128i lo8 = _mm_set1_epi32(0x00ff00ff);
+    const __m128i eight = _mm_set1_epi16(8);
+    /* (x * 3856) >> 16 == (x * 241) >> 12. */
+    const __m128i recip = _mm_set1_epi16(241 << 4);
+    const __m128i nibble = _mm_set1_epi32(0xf);
+    /* a | g << 16 and b | r << 16. */
+    __m128i ag = _mm_mulhi_epu16(_mm_add_epi16(_mm_and_si128(v, lo8), eight), recip);
+    __m128i br = _mm_mulhi_epu16(_mm_add_epi16(_mm_and_si128(_mm_srli_epi32(v, 8), lo8), eight), recip);
+    return _mm_or_si128(
+        _mm_or_si128(_mm_srli_epi32(ag, 16), _mm_slli_epi32(_mm_and_si128(ag, nibble), 8)),
+        _mm_or_si128(_mm_slli_epi32(_mm_and_si128(br, nibble), 4), _mm_slli_epi32(_mm_srli_epi32(br, 16), 12)));
+}
+
+static void
+argb4444_from_sse2(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    size_t i;
+    for (i = 0; i + 8 <= pixels; i += 8) {
+        __m128i a = argb4444_from4_sse2(LOAD128(data + i * 4 +  0));
+        __m128i b = argb4444_from4_sse2(LOAD128(data + i * 4 + 16));
+        STORE128(out + i * 2, pack32_sse2(a, b));
+    }
+    argb4444_from_scalar(out + i * 2, data + i * 4, pixels - i);
+}
+
+static inline __m128i
+rgb565_from4_sse2(
+    __m128i v)
+{
+    return _mm_or_si128(
+        _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xf8)), 8),
+        _mm_or_si128(_mm_srli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xfc00)), 5),
+                     _mm_srli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xf80000)), 19)));
+}
+
+static void
+rgb565_from_sse2(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    size_t i;
+    for (i = 0; i + 8 <= pixels; i += 8) {
+        __m128i a = rgb565_from4_sse2(LOAD128(data + i * 4 +  0));
+        __m128i b = rgb565_from4_sse2(LOAD128(data + i * 4 + 16));
+        STORE128(out + i * 2, pack32_sse2(a, b));
+    }
+    rgb565_from_scalar(out + i * 2, data + i * 4, pixels - i);
+}
+
+static void
+gray8_to_sse2(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    const __m128i alpha = _mm_set1_epi8((char)0xff);
+    size_t i;
+    for (i = 0; i + 16 <= pixels; i += 16) {
+        __m128i g = LOAD128(data + i);
+        __m128i gg_lo = _mm_unpacklo_epi8(g, g);
+        __m128i gg_hi = _mm_unpackhi_epi8(g, g);
+        __m128i ga_lo = _mm_unpacklo_epi8(g, alpha);
+        __m128i ga_hi = _mm_unpackhi_epi8(g, alpha);
+        STORE128(out + i * 4 +  0, _mm_unpacklo_epi16(gg_lo, ga_lo));
+        STORE128(out + i * 4 + 16, _mm_unpackhi_epi16(gg_lo, ga_lo));
+        STORE128(out + i * 4 + 32, _mm_unpacklo_epi16(gg_hi, ga_hi));
+        STORE128(out + i * 4 + 48, _mm_unpackhi_epi16(gg_hi, ga_hi));
+    }
+    gray8_to_scalar(out + i * 4, data + i, pixels - i);
+}
+
+/* Takes four zero-extended 16-bit pixels. */
+static inline __m128i
+argb4444_to4_sse2(
+    __m128i x)
+{
+    __m128i t = _mm_or_si128(
+        _mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 8), _mm_set1_epi32(0x0f)),
+                     _mm_and_si128(_mm_slli_epi32(x, 4), _mm_set1_epi32(0x0f00))),
+        _mm_or_si128(_mm_and_si128(_mm_slli_epi32(x, 16), _mm_set1_epi32(0x0f0000)),
+                     _mm_and_si128(_mm_slli_epi32(x, 12), _mm_set1_epi32(0x0f000000))));
+    return _mm_or_si128(t, _mm_slli_epi32(t, 4));
+}
+
+static void
+argb4444_to_sse2(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i;
+    for (i = 0; i + 8 <= pixels; i += 8) {
+        __m128i u = LOAD128(data + i * 2);
+        STORE128(out + i * 4 +  0, argb4444_to4_sse2(_mm_unpacklo_epi16(u, zero)));
+        STORE128(out + i * 4 + 16, argb4444_to4_sse2(_mm_unpackhi_epi16(u, zero)));
+    }
+    argb4444_to_scalar(out + i * 4, data + i * 2, pixels - i);
+}
+
+/* The same bits as rgb565_to_scalar, with the terms that are always zero
+ * left out. */
+static inline __m128i
+rgb565_to4_sse2(
+    __m128i x)
+{
+    const __m128i bit0 = _mm_and_si128(x, _mm_set1_epi32(0x0001));
+    const __m128i bit5 = _mm_and_si128(x, _mm_set1_epi32(0x0020));
+    const __m128i bit11 = _mm_and_si128(x, _mm_set1_epi32(0x0800));
+    __m128i r = _mm_or_si128(
+        _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x001f)), 19),
+        _mm_slli_epi32(bit0, 16));
+    __m128i g = _mm_or_si128(
+        _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x07e0)), 5),
+        _mm_or_si128(_mm_slli_epi32(bit5, 4), _mm_slli_epi32(bit5, 3)));
+    __m128i b = _mm_or_si128(
+        _mm_or_si128(_mm_srli_epi32(_mm_and_si128(x, _mm_set1_epi32(0xf800)), 8),
+                     _mm_srli_epi32(bit11, 9)),
+        _mm_or_si128(_mm_srli_epi32(bit11, 10), _mm_srli_epi32(bit11, 11)));
+    return _mm_or_si128(_mm_or_si128(r, g),
+                        _mm_or_si128(b, _mm_set1_epi32((int)0xff000000)));
+}
+
+static void
+rgb565_to_sse2(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i;
+    for (i = 0; i + 8 <= pixels; i += 8) {
+        __m128i u = LOAD128(data + i * 2);
+        STORE128(out + i * 4 +  0, rgb565_to4_sse2(_mm_unpacklo_epi16(u, zero)));
+        STORE128(out + i * 4 + 16, rgb565_to4_sse2(_mm_unpackhi_epi16(u, zero)));
+    }
+    rgb565_to_scalar(out + i * 4, data + i * 2, pixels - i);
+}
+#endif
+
+#ifdef PIXEL_AVX2
+#define LOAD256(p) _mm256_loadu_si256((const __m256i*)(p))
+#define STORE256(p, v) _mm256_storeu_si256((__m256i*)(p), (v))
+
+static int
+pixel_cpu_avx2(
+    void)
+{
+#ifdef __GNUC__
+    return !!__builtin_cpu_supports("avx2");
+#else
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return 0;
+    /* The OS has to save the YMM registers too. */
+    __cpuid(info, 1);
+    if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6)
+        return 0;
+    __cpuidex(info, 7, 0);
+    return !!(info[1] & (1 << 5));
+#endif
+}
+
+/* The 256-bit packs work on each 128-bit half separately, so their results
+ * are put back in order with a permute. */
+static PIXEL_TARGET_AVX2 void
+gray8_from_avx2(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i;
+    for (i = 0; i + 32 <= pixels; i += 32) {
+        __m256i a = _mm256_and_si256(LOAD256(data + i * 4 +  0), mask);
+        __m256i b = _mm256_and_si256(LOAD256(data + i * 4 + 32), mask);
+        __m256i c = _mm256_and_si256(LOAD256(data + i * 4 + 64), mask);
+        __m256i d = _mm256_and_si256(LOAD256(data + i * 4 + 96), mask);
+        __m256i v = _mm256_packus_epi16(_mm256_packus_epi32(a, b), _mm256_packus_epi32(c, d));
+        STORE256(out + i, _mm256_permutevar8x32_epi32(v, order));
+    }
+    gray8_from_scalar(out + i, data + i * 4, pixels - i);
+}
+
+static PIXEL_TARGET_AVX2 void
+swap_rb_avx2(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    const __m256i order = _mm256_setr_epi8(
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i;
+    for (i = 0; i + 8 <= pixels; i += 8)
+        STORE256(out + i * 4, _mm256_shuffle_epi8(LOAD256(data + i * 4), order));
+    swap_rb_scalar(out + i * 4, data + i * 4, pixels - i);
+}
+
+static inline PIXEL_TARGET_AVX2 __m256i
+argb4444_from8_avx2(
+    __m256i v)
+{
+    const __m256i lo8 = _mm256_set1_epi32(0x00ff00ff);
+    const __m256i eight = _mm256_set1_epi16(8);
+    const __m256i recip = _mm256_set1_epi16(241 << 4);
+    const __m256i nibble = _mm256_set1_epi32(0xf);
+    __m256i ag = _mm256_mulhi_epu16(_mm256_add_epi16(_mm256_and_si256(v, lo8), eight), recip);
+    __m256i br = _mm256_mulhi_epu16(_mm256_add_epi16(_mm256_and_si256(_mm256_srli_epi32(v, 8), lo8), eight), recip);
+    return _mm256_or_si256(
+        _mm256_or_si256(_mm256_srli_epi32(ag, 16), _mm256_slli_epi32(_mm256_and_si256(ag, nibble), 8)),
+        _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(br, nibble), 4), _mm256_slli_epi32(_mm256_srli_epi32(br, 16), 12)));
+}
+
+static PIXEL_TARGET_AVX2 void
+argb4444_from_avx2(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    size_t i;
+    for (i = 0; i + 16 <= pixels; i += 16) {
+        __m256i a = argb4444_from8_avx2(LOAD256(data + i * 4 +  0));
+        __m256i b = argb4444_from8_avx2(LOAD256(data + i * 4 + 32));
+        STORE256(out + i * 2, _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    argb4444_from_scalar(out + i * 2, data + i * 4, pixels - i);
+}
+
+static inline PIXEL_TARGET_AVX2 __m256i
+rgb565_from8_avx2(
+    __m256i v)
+{
+    return _mm256_or_si256(
+        _mm256_slli_epi32(_mm256_and_si256(v, _mm256_set1_epi32(0xf8)), 8),
+        _mm256_or_si256(_mm256_srli_epi32(_mm256_and_si256(v, _mm256_set1_epi32(0xfc00)), 5),
+                        _mm256_srli_epi32(_mm256_and_si256(v, _mm256_set1_epi32(0xf80000)), 19)));
+}
+
+static PIXEL_TARGET_AVX2 void
+rgb565_from_avx2(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    size_t i;
+    for (i = 0; i + 16 <= pixels; i += 16) {
+        __m256i a = rgb565_from8_avx2(LOAD256(data + i * 4 +  0));
+        __m256i b = rgb565_from8_avx2(LOAD256(data + i * 4 + 32));
+        STORE256(out + i * 2, _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    rgb565_from_scalar(out + i * 2, data + i * 4, pixels - i);
+}
+
+static PIXEL_TARGET_AVX2 void
+gray8_to_avx2(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+    size_t i;
+    for (i = 0; i + 8 <= pixels; i += 8) {
+        __m256i x = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(data + i)));
+        x = _mm256_or_si256(_mm256_or_si256(x, alpha),
+            _mm256_or_si256(_mm256_slli_epi32(x, 8), _mm256_slli_epi32(x, 16)));
+        STORE256(out + i * 4, x);
+    }
+    gray8_to_scalar(out + i * 4, data + i, pixels - i);
+}
+
+static PIXEL_TARGET_AVX2 void
+argb4444_to_avx2(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    size_t i;
+    for (i = 0; i + 8 <= pixels; i += 8) {
+        __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(data + i * 2)));
+        __m256i t = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(x, 8), _mm256_set1_epi32(0x0f)),
+                            _mm256_and_si256(_mm256_slli_epi32(x, 4), _mm256_set1_epi32(0x0f00))),
+            _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(x, 16), _mm256_set1_epi32(0x0f0000)),
+                            _mm256_and_si256(_mm256_slli_epi32(x, 12), _mm256_set1_epi32(0x0f000000))));
+        STORE256(out + i * 4, _mm256_or_si256(t, _mm256_slli_epi32(t, 4)));
+    }
+    argb4444_to_scalar(out + i * 4, data + i * 2, pixels - i);
+}
+
+static PIXEL_TARGET_AVX2 void
+rgb565_to_avx2(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    size_t i;
+    for (i = 0; i + 8 <= pixels; i += 8) {
+        __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(data + i * 2)));
+        __m256i bit0 = _mm256_and_si256(x, _mm256_set1_epi32(0x0001));
+        __m256i bit5 = _mm256_and_si256(x, _mm256_set1_epi32(0x0020));
+        __m256i bit11 = _mm256_and_si256(x, _mm256_set1_epi32(0x0800));
+        __m256i r = _mm256_or_si256(
+            _mm256_slli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0x001f)), 19),
+            _mm256_slli_epi32(bit0, 16));
+        __m256i g = _mm256_or_si256(
+            _mm256_slli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0x07e0)), 5),
+            _mm256_or_si256(_mm256_slli_epi32(bit5, 4), _mm256_slli_epi32(bit5, 3)));
+        __m256i b = _mm256_or_si256(
+            _mm256_or_si256(_mm256_srli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0xf800)), 8),
+                            _mm256_srli_epi32(bit11, 9)),
+            _mm256_or_si256(_mm256_srli_epi32(bit11, 10), _mm256_srli_epi32(bit11, 11)));
+        STORE256(out + i * 4, _mm256_or_si256(_mm256_or_si256(r, g),
+            _mm256_or_si256(b, _mm256_set1_epi32((int)0xff000000))));
+    }
+    rgb565_to_scalar(out + i * 4, data + i * 2, pixels - i);
+}
+#endif
+
+#ifdef PIXEL_NEON
+static void
+gray8_from_neon(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    size_t i;
+    for (i = 0; i + 16 <= pixels; i += 16)
+        vst1q_u8(out + i, vld4q_u8(data + i * 4).val[0]);
+    gray8_from_scalar(out + i, data + i * 4, pixels - i);
+}
+
+static void
+swap_rb_neon(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    size_t i;
+    for (i = 0; i + 16 <= pixels; i += 16) {
+        uint8x16x4_t v = vld4q_u8(data + i * 4);
+        uint8x16_t t = v.val[0];
+        v.val[0] = v.val[2];
+        v.val[2] = t;
+        vst4q_u8(out + i * 4, v);
+    }
+    swap_rb_scalar(out + i * 4, data + i * 4, pixels - i);
+}
+
+static inline uint8x16_t
+div17_neon(
+    uint8x16_t x)
+{
+    uint16x8_t lo = vaddl_u8(vget_low_u8(x), vdup_n_u8(8));
+    uint16x8_t hi = vaddl_u8(vget_high_u8(x), vdup_n_u8(8));
+    return vcombine_u8(vshrn_n_u16(vmulq_n_u16(lo, 241), 12),
+                       vshrn_n_u16(vmulq_n_u16(hi, 241), 12));
+}
+
+static void
+argb4444_from_neon(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    size_t i;
+    for (i = 0; i + 16 <= pixels; i += 16) {
+        uint8x16x4_t v = vld4q_u8(data + i * 4);
+        uint8x16x2_t o;
+        o.val[0] = vorrq_u8(vshlq_n_u8(div17_neon(v.val[1]), 4), div17_neon(v.val[2]));
+        o.val[1] = vorrq_u8(vshlq_n_u8(div17_neon(v.val[3]), 4), div17_neon(v.val[0]));
+        vst2q_u8(out + i * 2, o);
+    }
+    argb4444_from_scalar(out + i * 2, data + i * 4, pixels - i);
+}
+
+static void
+rgb565_from_neon(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    size_t i;
+    for (i = 0; i + 16 <= pixels; i += 16) {
+        uint8x16x4_t v = vld4q_u8(data + i * 4);
+        uint8x16x2_t o;
+        o.val[0] = vorrq_u8(vshlq_n_u8(vshrq_n_u8(v.val[1], 2), 5), vshrq_n_u8(v.val[2], 3));
+        o.val[1] = vorrq_u8(vandq_u8(v.val[0], vdupq_n_u8(0xf8)), vshrq_n_u8(v.val[1], 5));
+        vst2q_u8(out + i * 2, o);
+    }
+    rgb565_from_scalar(out + i * 2, data + i * 4, pixels - i);
+}
+
+static void
+gray8_to_neon(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    size_t i;
+    for (i = 0; i + 16 <= pixels; i += 16) {
+        uint8x16x4_t v;
+        v.val[0] = v.val[1] = v.val[2] = vld1q_u8(data + i);
+        v.val[3] = vdupq_n_u8(0xff);
+        vst4q_u8(out + i * 4, v);
+    }
+    gray8_to_scalar(out + i * 4, data + i, pixels - i);
+}
+
+/* 0x0n -> 0xnn and 0xn0 -> 0xnn. */
+static inline uint8x16_t
+extend_low_neon(
+    uint8x16_t x)
+{
+    x = vandq_u8(x, vdupq_n_u8(0x0f));
+    return vsliq_n_u8(x, x, 4);
+}
+
+static inline uint8x16_t
+extend_high_neon(
+    uint8x16_t x)
+{
+    x = vandq_u8(x, vdupq_n_u8(0xf0));
+    return vsriq_n_u8(x, x, 4);
+}
+
+static void
+argb4444_to_neon(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    size_t i;
+    for (i = 0; i + 16 <= pixels; i += 16) {
+        uint8x16x2_t u = vld2q_u8(data + i * 2);
+        uint8x16x4_t v;
+        v.val[0] = extend_low_neon(u.val[1]);
+        v.val[1] = extend_high_neon(u.val[0]);
+        v.val[2] = extend_low_neon(u.val[0]);
+        v.val[3] = extend_high_neon(u.val[1]);
+        vst4q_u8(out + i * 4, v);
+    }
+    argb4444_to_scalar(out + i * 4, data + i * 2, pixels - i);
+}
+
+static void
+rgb565_to_neon(
+    unsigned char* out,
+    const unsigned char* data,
+    size_t pixels)
+{
+    size_t i;
+    for (i = 0; i + 16 <= pixels; i += 16) {
+        uint8x16x2_t u = vld2q_u8(data + i * 2);
+        uint8x16_t lo = u.val[0], hi = u.val[1];
+        uint8x16_t one = vdupq_n_u8(1);
+        uint8x16x4_t v;
+        v.val[0] = vorrq_u8(vandq_u8(hi, vdupq_n_u8(0xf8)),
+            vmulq_u8(vandq_u8(vshrq_n_u8(hi, 3), one), vdupq_n_u8(7)));
+        v.val[1] = vorrq_u8(
+            vorrq_u8(vshlq_n_u8(hi, 5), vshlq_n_u8(vshrq_n_u8(lo, 5), 2)),
+            vmulq_u8(vandq_u8(vshrq_n_u8(lo, 5), one), vdupq_n_u8(3)));
+        v.val[2] = vorrq_u8(vshlq_n_u8(lo, 3), vandq_u8(lo, one));
+        v.val[3] = vdupq_n_u8(0xff);
+        vst4q_u8(out + i * 4, v);
+    }
+    rgb565_to_scalar(out + i * 4, data + i * 2, pixels - i);
+}
+#endif
+
+static const pixel_kernel_t from_kernels[PIXEL_ISA_COUNT][KERNEL_COUNT] = {
+    [PIXEL_ISA_SCALAR] = {
+        gray8_from_scalar, swap_rb_scalar, argb4444_from_scalar, rgb565_from_scalar },
+#ifdef PIXEL_SSE2
+    [PIXEL_ISA_SSE2] = {
+        gray8_from_sse2, swap_rb_sse2, argb4444_from_sse2, rgb565_from_sse2 },
+#endif
+#ifdef PIXEL_AVX2
+    [PIXEL_ISA_AVX2] = {
+        gray8_from_avx2, swap_rb_avx2, argb4444_from_avx2, rgb565_from_avx2 },
+#endif
+#ifdef PIXEL_NEON
+    [PIXEL_ISA_NEON] = {
+        gray8_from_neon, swap_rb_neon, argb4444_from_neon, rgb565_from_neon },
+#endif
+};
+
+static const pixel_kernel_t to_kernels[PIXEL_ISA_COUNT][KERNEL_COUNT] = {
+    [PIXEL_ISA_SCALAR] = {
+        gray8_to_scalar, swap_rb_scalar, argb4444_to_scalar, rgb565_to_scalar },
+#ifdef PIXEL_SSE2
+    [PIXEL_ISA_SSE2] = {
+        gray8_to_sse2, swap_rb_sse2, argb4444_to_sse2, rgb565_to_sse2 },
+#endif
+#ifdef PIXEL_AVX2
+    [PIXEL_ISA_AVX2] = {
+        gray8_to_avx2, swap_rb_avx2, argb4444_to_avx2, rgb565_to_avx2 },
+#endif
+#ifdef PIXEL_NEON
+    [PIXEL_ISA_NEON] = {
+        gray8_to_neon, swap_rb_neon, argb4444_to_neon, rgb565_to_neon },
+#endif
+};
+
+int
+pixel_isa_supported(
+    pixel_isa_t isa)
+{
+    switch (isa) {
+    case PIXEL_ISA_SCALAR:
+        return 1;
+#ifdef PIXEL_SSE2
+    case PIXEL_ISA_SSE2:
+        return 1;
+#endif
+#ifdef PIXEL_AVX2
+    case PIXEL_ISA_AVX2:
+        return pixel_cpu_avx2();
+#endif
+#ifdef PIXEL_NEON
+    case PIXEL_ISA_NEON:
+        return 1;
+#endif
+    default:
+        return 0;
+    }
+}
+
+pixel_isa_t
+pixel_isa_best(
+    void)
+{
+    static const pixel_isa_t order[] = {
+        PIXEL_ISA_AVX2, PIXEL_ISA_SSE2, PIXEL_ISA_NEON
+    };
+    for (size_t i = 0; i < sizeof(order) / sizeof(*order); ++i)
+        if (pixel_isa_supported(order[i]))
+            return order[i];
+    return PIXEL_ISA_SCALAR;
+}
+
+static int
+pixel_kernel(
+    format_t format)
+{
+    switch ((int)format) {
+    case FORMAT_GRAY8:
+        return KERNEL_GRAY8;
+    case FORMAT_BGRA8888:
+        return KERNEL_BGRA8888;
+    case FORMAT_ARGB4444:
+        return KERNEL_ARGB4444;
+    case FORMAT_RGB565:
+        return KERNEL_RGB565;
+    default:
+        return -1;
+    }
+}
+
+int
+pixel_from_rgba(
+    unsigned char* out,
+    const uint32_t* data,
+    size_t pixels,
+    format_t format,
+    pixel_isa_t isa)
+{
+    int kernel = pixel_kernel(format);
+
+    if (!pixel_isa_supported(isa))
+        return -1;
+    if (format == FORMAT_RGBA8888) {
+        memcpy(out, data, sizeof(uint32_t) * pixels);
+        return 0;
+    }
+    if (kernel == -1)
+        return -1;
+    from_kernels[isa][kernel](out, (const unsigned char*)data, pixels);
+    return 0;
+}
+
+int
+pixel_from_rgba_rect(
+    unsigned char* out,
+    size_t out_stride,
+    const uint32_t* data,
+    size_t stride,
+    unsigned int w,
+    unsigned int h,
+    format_t format,
+    pixel_isa_t isa)
+{
+    for (unsigned int y = 0; y < h; ++y)
+        if (pixel_from_rgba(out + y * out_stride, data + y * stride, w, format, isa) == -1)
+            return -1;
+    return 0;
+}
+
+int
+pixel_to_rgba(
+    uint32_t* out,
+    const unsigned char* data,
+    size_t pixels,
+    format_t format,
+    pixel_isa_t isa)
+{
+    int kernel = pixel_kernel(format);
+
+    if (!pixel_isa_supported(isa))
+        return -1;
+    if (format == FORMAT_RGBA8888) {
+        memcpy(out, data, sizeof(uint32_t) * pixels);
+        return 0;
+    }
+    if (kernel == -1)
+        return -1;
+    to_kernels[isa][kernel]((unsigned char*)out, data, pixels);
+    return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#ifndef PIXEL_H_
+#define PIXEL_H_
+
+#include <config.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <anm_types.h>
+
+ /* Internal use only. */
+#define FORMAT_RGBA8888 ((format_t)-1)
+
+/* Conversion between RGBA8888 and the texture formats.  Every
+ * implementation produces the same bytes as the scalar one. */
+
+typedef enum {
+    PIXEL_ISA_SCALAR,
+    PIXEL_ISA_SSE2,
+    PIXEL_ISA_AVX2,
+    PIXEL_ISA_NEON,
+    PIXEL_ISA_COUNT
+} pixel_isa_t;
+
+extern const char* pixel_isa_names[PIXEL_ISA_COUNT];
+
+/* Returns 1 if the implementation was compiled in and the CPU supports it. */
+int
+pixel_isa_supported(
+    pixel_isa_t isa);
+
+/* Returns the fastest supported implementation. */
+pixel_isa_t
+pixel_isa_best(
+    void);
+
+/* Converts pixels RGBA8888 pixels to format, which may also be
+ * FORMAT_RGBA8888.  out must hold pixels * format_Bpp(format) bytes.
+ * Returns -1 for an unknown format or an unsupported isa. */
+int
+pixel_from_rgba(
+    unsigned char* out,
+    const uint32_t* data,
+    size_t pixels,
+    format_t format,
+    pixel_isa_t isa);
+
+/* Converts the w by h rectangle at data, whose rows are stride pixels
+ * apart, to format.  Rows in out are out_stride bytes apart. */
+int
+pixel_from_rgba_rect(
+    unsigned char* out,
+    size_t out_stride,
+    const uint32_t* data,
+    size_t stride,
+    unsigned int w,
+    unsigned int h,
+    format_t format,
+    pixel_isa_t isa);
+
+/* The reverse of pixel_from_rgba. */
+int
+pixel_to_rgba(
+    uint32_t* out,
+    const unsigned char* data,
+    size_t pixels,
+    format_t format,
+    pixel_isa_t isa);
+
+#endif
@@ -0,0 +1,403 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include <config.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pngenc.h"
+/* zlib comes with libpng. */
+#ifdef HAVE_LIBPNG
+#include <zlib.h>
+
+const char* pngenc_filter_names[PNGENC_FILTER_COUNT] = {
+    "none", "sub", "up", "avg", "paeth", "all"
+};
+
+/* zlib takes lengths as uInt, so larger buffers are passed in pieces. */
+#define PNGENC_PIECE ((size_t)1 << 30)
+
+int
+pngenc_filter_parse(
+    const char* name)
+{
+    for (int f = 0; f < PNGENC_FILTER_COUNT; ++f)
+        if (!strcmp(name, pngenc_filter_names[f]))
+            return f;
+    return -1;
+}
+
+static unsigned char
+pngenc_paeth(
+    int a,
+    int b,
+    int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+/* Writes the filter type followed by the filtered row to out.  prev is the
+ * unfiltered row above, all zeroes for the first row. */
+static void
+pngenc_filter_row(
+    unsigned char* out,
+    const unsigned char* row,
+    const unsigned char* prev,
+    size_t len,
+    unsigned int bpp,
+    pngenc_filter_t filter)
+{
+    size_t i;
+
+    *out++ = filter;
+    switch (filter) {
+    case PNGENC_FILTER_NONE:
+        memcpy(out, row, len);
+        break;
+    case PNGENC_FILTER_SUB:
+        for (i = 0; i < bpp; ++i)
+            out[i] = row[i];
+        for (; i < len; ++i)
+            out[i] = row[i] - row[i - bpp];
+        break;
+    case PNGENC_FILTER_UP:
+        for (i = 0; i < len; ++i)
+            out[i] = row[i] - prev[i];
+        break;
+    case PNGENC_FILTER_AVG:
+        for (i = 0; i < bpp; ++i)
+            out[i] = row[i] - (prev[i] >> 1);
+        for (; i < len; ++i)
+            out[i] = row[i] - ((row[i - bpp] + prev[i]) >> 1);
+        break;
+    case PNGENC_FILTER_PAETH:
+        for (i = 0; i < bpp; ++i)
+            out[i] = row[i] - prev[i];
+        for (; i < len; ++i)
+            out[i] = row[i] - pngenc_paeth(row[i - bpp], prev[i], prev[i - bpp]);
+        break;
+    default:
+        break;
+    }
+}
+
+/* The sum of the filtered bytes taken as signed values, which libpng also
+ * uses to pick a filter per row. */
+static size_t
+pngenc_filter_cost(
+    const unsigned char* data,
+    size_t len)
+{
+    size_t cost = 0;
+    for (size_t i = 0; i < len; ++i)
+        cost += data[i] < 128 ? data[i] : 256 - data[i];
+    return cost;
+}
+
+/* Tries every filter on the row and keeps the cheapest.  scratch holds
+ * PNGENC_FILTER_ALL rows of len + 1 bytes. */
+static void
+pngenc_filter_row_best(
+    unsigned char* out,
+    const unsigned char* row,
+    const unsigned char* prev,
+    size_t len,
+    unsigned int bpp,
+    unsigned char* scratch)
+{
+    size_t best_cost = 0;
+    int best = 0;
+
+    for (int f = 0; f < PNGENC_FILTER_ALL; ++f) {
+        unsigned char* candidate = scratch + f * (len + 1);
+        pngenc_filter_row(candidate, row, prev, len, bpp, f);
+        size_t cost = pngenc_filter_cost(candidate + 1, len);
+        if (!f || cost < best_cost) {
+            best_cost = cost;
+            best = f;
+        }
+    }
+    memcpy(out, scratch + best * (len + 1), len + 1);
+}
+
+static uLong
+pngenc_adler32(
+    uLong adler,
+    const unsigned char* data,
+    size_t size)
+{
+    while (size) {
+        size_t piece = size < PNGENC_PIECE ? size : PNGENC_PIECE;
+        adler = adler32(adler, data, (uInt)piece);
+        data += piece;
+        size -= piece;
+    }
+    return adler;
+}
+
+/* Compresses one stripe as raw deflate data.  Every stripe but the last
+ * ends with a sync flush, which leaves the output at a byte boundary, so
+ * the stripes can be concatenated.  head bytes are left free at the start
+ * of the output for the zlib header. */
+static int
+pngenc_deflate(
+    unsigned char** out,
+    size_t* out_size,
+    size_t head,
+    const unsigned char* data,
+    size_t size,
+    const unsigned char* dict,
+    size_t dict_size,
+    int level,
+    int last)
+{
+    z_stream stream;
+    unsigned char* buf;
+    size_t cap, done = head, pos = 0;
+    int ret;
+
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return -1;
+    /* Lets the stripe refer back to the end of the previous one, which
+     * makes the result almost as small as compressing in one go. */
+    if (dict_size && deflateSetDictionary(&stream, dict, (uInt)dict_size) != Z_OK) {
+        deflateEnd(&stream);
+        return -1;
+    }
+
+    cap = head + (size < PNGENC_PIECE ? deflateBound(&stream, (uLong)size) : size) + 64;
+    buf = malloc(cap);
+    for (;;) {
+        int flush;
+
+        if (!stream.avail_in && pos < size) {
+            size_t piece = size - pos < PNGENC_PIECE ? size - pos : PNGENC_PIECE;
+            stream.next_in = (Bytef*)data + pos;
+            stream.avail_in = (uInt)piece;
+            pos += piece;
+        }
+        flush = pos < size ? Z_NO_FLUSH : last ? Z_FINISH : Z_SYNC_FLUSH;
+
+        if (cap - done < 64) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+        stream.next_out = buf + done;
+        stream.avail_out = (uInt)(cap - done < PNGENC_PIECE ? cap - done : PNGENC_PIECE);
+
+        ret = deflate(&stream, flush);
+        done = stream.next_out - buf;
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            deflateEnd(&stream);
+            free(buf);
+            return -1;
+        }
+        if (flush == Z_FINISH && ret == Z_STREAM_END)
+            break;
+        if (flush == Z_SYNC_FLUSH && stream.avail_out)
+            break;
+    }
+    deflateEnd(&stream);
+
+    *out = buf;
+    *out_size = done;
+    return 0;
+}
+
+static void
+pngenc_put32(
+    unsigned char* p,
+    uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static int
+pngenc_chunk(
+    pngenc_write_t write,
+    void* user,
+    const char* type,
+    const unsigned char* data,
+    size_t size)
+{
+    unsigned char head[8], tail[4];
+    uLong crc = crc32(0, (const Bytef*)type, 4);
+
+    pngenc_put32(head, (uint32_t)size);
+    memcpy(head + 4, type, 4);
+    for (size_t pos = 0; pos < size; pos += PNGENC_PIECE)
+        crc = crc32(crc, data + pos, (uInt)(size - pos < PNGENC_PIECE ? size - pos : PNGENC_PIECE));
+    pngenc_put32(tail, (uint32_t)crc);
+
+    if (write(user, head, sizeof(head)))
+        return -1;
+    if (size && write(user, data, size))
+        return -1;
+    return write(user, tail, sizeof(tail));
+}
+
+/* Chunks are limited to 2^31 - 1 bytes, but IDAT data can be split
+ * across as many chunks as needed. */
+static int
+pngenc_idat(
+    pngenc_write_t write,
+    void* user,
+    const unsigned char* data,
+    size_t size)
+{
+    do {
+        size_t piece = size < PNGENC_PIECE ? size : PNGENC_PIECE;
+        if (pngenc_chunk(write, user, "IDAT", data, piece))
+            return -1;
+        data += piece;
+        size -= piece;
+    } while (size);
+    return 0;
+}
+
+int
+pngenc_write(
+    const unsigned char* data,
+    unsigned int width,
+    unsigned int height,
+    unsigned int channels,
+    const pngenc_options_t* options,
+    pngenc_write_t write,
+    void* user)
+{
+    static const unsigned char signature[8] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+    };
+    const size_t len = (size_t)width * channels;
+    const size_t filtered_size = (len + 1) * height;
+    const int level = options->level;
+    unsigned char ihdr[13];
+    unsigned char* filtered;
+    unsigned char* zero;
+    unsigned char** stripes;
+    size_t* stripe_sizes;
+    uLong* stripe_adlers;
+    size_t stripe_size, stripe_count;
+    uLong adler;
+    ptrdiff_t i;
+    int failed = 0;
+
+    pngenc_put32(ihdr, width);
+    pngenc_put32(ihdr + 4, height);
+    ihdr[8] = 8;
+    ihdr[9] = channels == 1 ? 0 : 6;
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+    if (write(user, signature, sizeof(signature)) ||
+        pngenc_chunk(write, user, "IHDR", ihdr, sizeof(ihdr)))
+        return -1;
+
+    filtered = malloc(filtered_size ? filtered_size : 1);
+    zero = calloc(len + 1, 1);
+#pragma omp parallel
+    {
+        unsigned char* scratch = options->filter == PNGENC_FILTER_ALL
+            ? malloc((len + 1) * PNGENC_FILTER_ALL) : NULL;
+        ptrdiff_t y;
+#pragma omp for schedule(static)
+        for (y = 0; y < (ptrdiff_t)height; ++y) {
+            const unsigned char* row = data + y * len;
+            const unsigned char* prev = y ? row - len : zero;
+            unsigned char* out = filtered + y * (len + 1);
+            if (scratch)
+                pngenc_filter_row_best(out, row, prev, len, channels, scratch);
+            else
+                pngenc_filter_row(out, row, prev, len, channels, options->filter);
+        }
+        free(scratch);
+    }
+    free(zero);
+
+    stripe_size = options->stripe_size && options->stripe_size < filtered_size
+        ? options->stripe_size : filtered_size;
+    stripe_count = stripe_size ? (filtered_size + stripe_size - 1) / stripe_size : 1;
+    stripes = calloc(stripe_count, sizeof(*stripes));
+    stripe_sizes = calloc(stripe_count, sizeof(*stripe_sizes));
+    stripe_adlers = calloc(stripe_count, sizeof(*stripe_adlers));
+
+#pragma omp parallel for schedule(dynamic) if(stripe_count > 1)
+    for (i = 0; i < (ptrdiff_t)stripe_count; ++i) {
+        size_t offset = i * stripe_size;
+        size_t size = i == (ptrdiff_t)stripe_count - 1 ? filtered_size - offset : stripe_size;
+        size_t dict_size = offset < 32768 ? offset : 32768;
+
+        if (pngenc_deflate(&stripes[i], &stripe_sizes[i], i ? 0 : 2,
+                filtered + offset, size, filtered + offset - dict_size, dict_size,
+                level, i == (ptrdiff_t)stripe_count - 1)) {
+#pragma omp atomic write
+            failed = 1;
+        }
+        stripe_adlers[i] = pngenc_adler32(adler32(0, NULL, 0), filtered + offset, size);
+    }
+    free(filtered);
+
+    if (!failed) {
+        /* The zlib header goes in front of the first stripe, the combined
+         * checksum after the last. */
+        int flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+        stripes[0][0] = 0x78;
+        stripes[0][1] = flevel << 6;
+        stripes[0][1] += 31 - (0x7800 + stripes[0][1]) % 31;
+
+        adler = stripe_adlers[0];
+        for (size_t s = 1; s < stripe_count; ++s)
+            adler = adler32_combine(adler, stripe_adlers[s],
+                (z_off_t)(s == stripe_count - 1 ? filtered_size - s * stripe_size : stripe_size));
+        stripes[stripe_count - 1] = realloc(stripes[stripe_count - 1], stripe_sizes[stripe_count - 1] + 4);
+        pngenc_put32(stripes[stripe_count - 1] + stripe_sizes[stripe_count - 1], (uint32_t)adler);
+        stripe_sizes[stripe_count - 1] += 4;
+
+        for (size_t s = 0; s < stripe_count && !failed; ++s)
+            failed = pngenc_idat(write, user, stripes[s], stripe_sizes[s]);
+    }
+
+    for (size_t s = 0; s < stripe_count; ++s)
+        free(stripes[s]);
+    free(stripe_adlers);
+    free(stripe_sizes);
+    free(stripes);
+
+    if (failed || pngenc_chunk(write, user, "IEND", NULL, 0))
+        return -1;
+    return 0;
+}
+#endif
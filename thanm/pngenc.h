@@ -0,0 +1,90 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#ifndef PNGENC_H_
+#define PNGENC_H_
+
+#include <config.h>
+#include <stddef.h>
+
+/* A PNG writer for 8-bit gray and RGBA images that gives control over the
+ * zlib level and the row filter, and can compress horizontal stripes of
+ * the image on separate threads.  The stripes are joined into a single
+ * zlib stream, so the result is an ordinary PNG. */
+
+typedef enum {
+    PNGENC_FILTER_NONE,
+    PNGENC_FILTER_SUB,
+    PNGENC_FILTER_UP,
+    PNGENC_FILTER_AVG,
+    PNGENC_FILTER_PAETH,
+    /* Picks a filter for every row, like libpng does by default. */
+    PNGENC_FILTER_ALL,
+    PNGENC_FILTER_COUNT
+} pngenc_filter_t;
+
+extern const char* pngenc_filter_names[PNGENC_FILTER_COUNT];
+
+/* Size of the filtered image data compressed by each thread when striping.
+ * Fixed, so that the output doesn't depend on the number of threads. */
+#define PNGENC_STRIPE_SIZE (256 * 1024)
+
+typedef struct {
+    /* zlib compression level, 0-9. */
+    int level;
+    pngenc_filter_t filter;
+    /* Bytes of filtered data per stripe, or 0 to compress the image as a
+     * whole. */
+    size_t stripe_size;
+} pngenc_options_t;
+
+/* Receives the encoded PNG piece by piece.  Returns 0 on success. */
+typedef int (*pngenc_write_t)(
+    void* user,
+    const void* data,
+    size_t size);
+
+/* Returns the filter with the given name, or -1. */
+int
+pngenc_filter_parse(
+    const char* name);
+
+/* Encodes width by height pixels of channels bytes each, 1 for gray and 4
+ * for RGBA, with rows following each other without gaps.  Returns 0 on
+ * success, or -1 if compression or write fails. */
+int
+pngenc_write(
+    const unsigned char* data,
+    unsigned int width,
+    unsigned int height,
+    unsigned int channels,
+    const pngenc_options_t* options,
+    pngenc_write_t write,
+    void* user);
+
+#endif
@@ -53,7 +53,7 @@ regs_v2_v3_v4_v7_v8[] = {
 };
 
 static list_t
-regs_user = { NULL, NULL };
+regs_user = { NULL, NULL, NULL };
 
 reg_t*
 reg_new(
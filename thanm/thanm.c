@@ -34,13 +34,17 @@
 #include <string.h>
 #include <math.h>
 #include <errno.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <thtk/hash.h>
 #include "file.h"
 #include "image.h"
+#include "incremental.h"
 #include "thanm.h"
 #include "program.h"
+#include "trace.h"
 #include "util.h"
 #include "value.h"
-#include "mygetopt.h"
 #include "reg.h"
 
 #define TH19_OR_NEWER(version) (version >= 19 && (version < 100 || version >= 200))
@@ -51,6 +55,11 @@ unsigned int option_print_offsets = 0;
 unsigned int option_unique_filenames = 0;
 unsigned int option_dont_add_offset_border = 0;
 unsigned int option_verbose = 0;
+int option_incremental = 0;
+
+/* Kept in the current directory by --incremental. */
+#define THANM_INCREMENTAL_INDEX ".thanm-index"
+static incremental_t* g_incremental = NULL;
 
 /* SPECIAL FORMATS:
  * 'o' - offset (for labels)
@@ -641,35 +650,38 @@ convert_header_to_11(
 }
 #endif
 
-anm_script_t* anm_script_new() {
-    anm_script_t* script = (anm_script_t*)malloc(sizeof(anm_script_t));
-    list_init(&script->labels);
-    list_init(&script->instrs);
-    list_init(&script->raw_instrs);
-    list_init(&script->vars);
-    script->offset = NULL;
-    script->no_sentinel = 0;
+anm_script_t* anm_script_new(
+    arena_t* arena
+) {
+    anm_script_t* script = (anm_script_t*)arena_calloc(arena, sizeof(anm_script_t));
+    script->arena = arena;
+    list_init_arena(&script->vars, arena);
     return script;
 }
 
+thanm_instr_t*
+anm_script_add_instr(
+    anm_script_t* script
+) {
+    arena_vec_ensure(script->arena, &script->instrs, &script->instr_capacity,
+        script->instr_count + 1, sizeof(thanm_instr_t));
+    thanm_instr_t* instr = &script->instrs[script->instr_count++];
+    memset(instr, 0, sizeof(*instr));
+    return instr;
+}
+
 var_t* var_new(
+    arena_t* arena,
     char* name,
     int type
 ) {
-    var_t* var = (var_t*)malloc(sizeof(var_t));
+    var_t* var = (var_t*)arena_alloc(arena, sizeof(var_t));
     var->name = name;
     var->type = type;
     var->reg = NULL;
     return var;
 }
 
-void var_free(
-    var_t* var
-) {
-    free(var->name);
-    free(var);
-}
-
 const char *
 anm_find_format(
     unsigned version,
@@ -713,20 +725,93 @@ anm_find_format(
     return format;
 }
 
+/* Open addressing hash table of entry names, used to intern the names and
+ * to link the entries that share one. */
+typedef struct {
+    char* name;
+    anm_entry_t* first;
+    /* The last entry with this name linked so far. */
+    anm_entry_t* last;
+} anm_name_slot_t;
+
+typedef struct {
+    anm_name_slot_t* slots;
+    size_t slot_count;
+    size_t used;
+} anm_name_index_t;
+
+static int
+anm_name_index_stop(
+    const void* table,
+    size_t slot,
+    const void* key)
+{
+    const anm_name_slot_t* slots = table;
+    return !slots[slot].name || slots[slot].name == key || strcmp(slots[slot].name, key) == 0;
+}
+
+static anm_name_slot_t*
+anm_name_index_probe(
+    const anm_name_index_t* index,
+    const char* name)
+{
+    const uint32_t hash = thtk_fnv1a(THTK_FNV1A_INIT, name, strlen(name));
+    return &index->slots[thtk_probe(index->slot_count, hash, anm_name_index_stop, index->slots, name)];
+}
+
+/* Returns the slot for name.  A new slot has a NULL name, which the caller
+ * has to set. */
+static anm_name_slot_t*
+anm_name_index_get(
+    anm_name_index_t* index,
+    const char* name)
+{
+    if ((index->used + 1) * 2 > index->slot_count) {
+        anm_name_index_t grown = *index;
+        grown.slot_count = index->slot_count ? index->slot_count * 2 : 64;
+        grown.slots = util_malloc(grown.slot_count * sizeof(*grown.slots));
+        memset(grown.slots, 0, grown.slot_count * sizeof(*grown.slots));
+        for (size_t i = 0; i < index->slot_count; ++i)
+            if (index->slots[i].name)
+                *anm_name_index_probe(&grown, index->slots[i].name) = index->slots[i];
+        free(index->slots);
+        *index = grown;
+    }
+
+    anm_name_slot_t* slot = anm_name_index_probe(index, name);
+    if (!slot->name)
+        index->used++;
+    return slot;
+}
+
+/* Appends entry to the chain of entries with the same name. */
+static void
+anm_name_index_link(
+    anm_name_index_t* index,
+    anm_entry_t* entry)
+{
+    anm_name_slot_t* slot = anm_name_index_get(index, entry->name);
+    if (slot->name) {
+        slot->last->next_by_name = entry;
+    } else {
+        slot->name = entry->name;
+        slot->first = entry;
+    }
+    slot->last = entry;
+}
+
 static char*
 anm_get_name(
     anm_archive_t* archive,
+    anm_name_index_t* names,
     const char* name)
 {
-    char* other_name;
-    list_for_each(&archive->names, other_name) {
-        if (strcmp(name, other_name) == 0)
-            return other_name;
+    anm_name_slot_t* slot = anm_name_index_get(names, name);
+    if (!slot->name) {
+        slot->name = arena_strdup(&archive->arena, name);
+        list_append_new(&archive->names, slot->name);
     }
-
-    other_name = strdup(name);
-    list_append_new(&archive->names, other_name);
-    return other_name;
+    return slot->name;
 }
 
 thanm_param_t*
@@ -752,16 +837,21 @@ thanm_param_free(
     free(param);
 }
 
+/* The parameters are allocated from arena. */
 static void
 thanm_make_params(
+    arena_t* arena,
     anm_instr_t* raw_instr,
-    list_t* param_list,
+    thanm_instr_t* instr,
     const char* format
 ) {
     size_t i = 0;
     size_t v = 0;
+    size_t capacity = 0;
+    if (format)
+        arena_vec_ensure(arena, &instr->params, &capacity, strlen(format), sizeof(thanm_param_t));
     while(i < raw_instr->length - sizeof(anm_instr_t)) {
-        value_t* value = (value_t*)malloc(sizeof(value_t));
+        value_t* value = (value_t*)arena_alloc(arena, sizeof(value_t));
         ssize_t read;
         char c = format ? format[v] : 'S';
         switch(c) {
@@ -789,15 +879,14 @@ thanm_make_params(
         }
 
         i += read;
-        thanm_param_t* param = thanm_param_new(c);
-        if (raw_instr->param_mask & 1 << v) {
-            param->is_var = 1;
-        }
-
+        arena_vec_ensure(arena, &instr->params, &capacity, v + 1, sizeof(thanm_param_t));
+        thanm_param_t* param = &instr->params[v];
+        param->type = c;
+        param->is_var = (raw_instr->param_mask & 1 << v) != 0;
+        param->expr = NULL;
         param->val = value;
 
-        list_append_new(param_list, param);
-        ++v;
+        instr->param_count = ++v;
     }
 }
 
@@ -831,6 +920,7 @@ anm_is_valid_script_index(
 
 static void
 anm_stringify_param(
+    const thanm_context_t* ctx,
     FILE* stream,
     thanm_param_t* param,
     thanm_instr_t* instr,
@@ -883,7 +973,7 @@ anm_stringify_param(
         else
             abort(); /* shouldn't happen */
 
-        seqmap_entry_t* ent = seqmap_get(g_anmmap->gvar_names, val);
+        seqmap_entry_t* ent = seqmap_get(ctx->anmmap->gvar_names, val);
         if (ent) {
             fprintf(stream, "%c%s", param->val->type == 'f' ? '%' : '$', ent->value);
         }
@@ -899,22 +989,14 @@ anm_stringify_param(
         free(disp);
 }
 
-thanm_instr_t*
-thanm_instr_new() {
-    thanm_instr_t* ret = (thanm_instr_t*)util_malloc(sizeof(thanm_instr_t));
-    list_init(&ret->params);
-    return ret;
-}
-
 uint32_t
 instr_get_size(
     thanm_instr_t* instr,
     int32_t version
 ) {
     uint32_t size = version == 0 ? sizeof(anm_instr0_t) : sizeof(anm_instr_t);
-    thanm_param_t* param;
-    list_for_each(&instr->params, param) {
-        switch(param->type) {
+    for (size_t i = 0; i < instr->param_count; ++i) {
+        switch(instr->params[i].type) {
             case 's':
                 size += sizeof(int16_t);
                 break;
@@ -926,138 +1008,184 @@ instr_get_size(
     return size;
 }
 
-thanm_instr_t*
+void
 instr_new(
     parser_state_t* state,
     uint16_t id,
     list_t* params
 ) {
-    thanm_instr_t* instr = thanm_instr_new();
+    anm_script_t* script = state->current_script;
+    thanm_instr_t* instr = anm_script_add_instr(script);
     instr->type = THANM_INSTR_INSTR;
     instr->time = state->time;
     instr->offset = state->offset;
     instr->id = id;
-    instr->params = *params;
+
+    /* The parameters are copied into the instruction, but their values
+     * stay on the heap until thanm_instr_free_params. */
+    thanm_param_t* param;
+    list_for_each(params, param)
+        ++instr->param_count;
+    instr->params = arena_alloc(script->arena, instr->param_count * sizeof(thanm_param_t));
+    size_t i = 0;
+    list_for_each(params, param) {
+        instr->params[i++] = *param;
+        free(param);
+    }
+    list_free_nodes(params);
     free(params);
+
     instr->size = instr_get_size(instr, state->current_version);
     state->offset += instr->size;
-    return instr;
 }
 
 static thanm_instr_t*
 thanm_instr_new_raw(
+    anm_script_t* script,
     anm_instr_t* raw_instr,
     const char* format
 ) {
-    thanm_instr_t* ret = thanm_instr_new();
+    thanm_instr_t* ret = anm_script_add_instr(script);
     ret->type = THANM_INSTR_INSTR;
     ret->time = raw_instr->time;
     ret->id = raw_instr->type;
     ret->size = raw_instr->length;
     ret->param_mask = raw_instr->param_mask;
-    thanm_make_params(raw_instr, &ret->params, format);
+    thanm_make_params(script->arena, raw_instr, ret, format);
     return ret;
 }
 
 static thanm_instr_t*
 thanm_instr_new_time(
+    anm_script_t* script,
     int16_t time
 ) {
-    thanm_instr_t* ret = thanm_instr_new();
+    thanm_instr_t* ret = anm_script_add_instr(script);
     ret->type = THANM_INSTR_TIME;
     ret->time = time;
     ret->id = -1;
     return ret;
 }
 
-static thanm_instr_t*
-thanm_instr_new_label() {
-    thanm_instr_t* ret = thanm_instr_new();
-    ret->type = THANM_INSTR_LABEL;
-    ret->time = 0;
-    ret->id = -1;
-    return ret;
-}
-
+/* Frees the values of the parameters that the parser made for instr.  The
+ * rest belongs to the arena of the archive. */
 static void
-thanm_instr_free(
+thanm_instr_free_params(
     thanm_instr_t* instr
 ) {
-    thanm_param_t* param;
-    list_for_each(&instr->params, param)
-        thanm_param_free(param);
-    list_free_nodes(&instr->params);
+    for (size_t i = 0; i < instr->param_count; ++i) {
+        if (instr->params[i].val) {
+            value_free(instr->params[i].val);
+            free(instr->params[i].val);
+        }
+    }
+    instr->param_count = 0;
+}
 
-    free(instr);
+static int
+anm_offset_cmp(
+    const void* a,
+    const void* b)
+{
+    const uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
 }
 
+/* Adds a label before every instruction that an offset parameter points
+ * to, and after the last one if it's pointed to. */
 static void
 anm_insert_labels(
-    anm_script_t* script,
-    int32_t scriptn
+    anm_script_t* script
 ) {
-    (void)scriptn;
-    thanm_instr_t* instr;
-    list_for_each(&script->instrs, instr) {
+    uint32_t* offsets = NULL;
+    size_t offset_count = 0, offset_capacity = 0;
+
+    for (size_t i = 0; i < script->instr_count; ++i) {
+        const thanm_instr_t* instr = &script->instrs[i];
         if (instr->type != THANM_INSTR_INSTR)
             continue;
-
-        thanm_param_t* param;
-        list_for_each(&instr->params, param) {
-            if (param->type == 'o') {
-                uint32_t offset = param->val->val.S;
-                thanm_instr_t* search_instr;
-                list_node_t* node;
-                list_node_t* instr_node;
-                list_for_each_node(&script->instrs, node) {
-                    thanm_instr_t* iter_instr = (thanm_instr_t*)node->data;
-                    if (iter_instr->type == THANM_INSTR_LABEL && iter_instr->offset == offset) {
-                        /* Label already exists. */
-                        break;
-                    }
-                    if (iter_instr->type == THANM_INSTR_INSTR)  {
-                        search_instr = iter_instr;
-                        instr_node = node;
-                        if (search_instr-> type == THANM_INSTR_INSTR && search_instr->offset == offset) {
-                            thanm_instr_t* instr_label = thanm_instr_new_label();
-                            instr_label->offset = offset;
-                            list_prepend_to(&script->instrs, instr_label, instr_node);
-                            break;
-                        }
-                    }
-                }
-                /* There is a possibility that the label has to be inserted after the last instruction,
-                 * and we can know that we need to do that if the loop didn't end with a break (when node is NULL) */
-                if (node == NULL && search_instr->offset + search_instr->size == offset) {
-                    thanm_instr_t* instr_label = thanm_instr_new_label();
-                    instr_label->offset = offset;
-                    list_append_to(&script->instrs, instr_label, instr_node);
-                }
+        for (size_t p = 0; p < instr->param_count; ++p) {
+            if (instr->params[p].type != 'o')
+                continue;
+            if (util_vec_ensure(&offsets, &offset_capacity, offset_count + 1, sizeof(*offsets)))
+                exit(1);
+            offsets[offset_count++] = instr->params[p].val->val.S;
+        }
+    }
+    if (!offset_count)
+        return;
+    qsort(offsets, offset_count, sizeof(*offsets), anm_offset_cmp);
+
+    /* Both lists are sorted by offset, so the labels can be merged in. */
+    thanm_instr_t* instrs = arena_alloc(script->arena,
+        (script->instr_count + offset_count) * sizeof(thanm_instr_t));
+    const thanm_instr_t* last = NULL;
+    size_t count = 0, k = 0;
+    for (size_t i = 0; i < script->instr_count; ++i) {
+        const thanm_instr_t* instr = &script->instrs[i];
+        if (instr->type == THANM_INSTR_INSTR) {
+            while (k < offset_count && offsets[k] < instr->offset)
+                ++k;
+            if (k < offset_count && offsets[k] == instr->offset) {
+                thanm_instr_t* label = &instrs[count++];
+                memset(label, 0, sizeof(*label));
+                label->type = THANM_INSTR_LABEL;
+                label->id = -1;
+                label->offset = instr->offset;
             }
+            last = instr;
+        }
+        instrs[count++] = *instr;
+    }
+    if (last) {
+        const uint32_t end = last->offset + last->size;
+        while (k < offset_count && offsets[k] < end)
+            ++k;
+        if (k < offset_count && offsets[k] == end) {
+            thanm_instr_t* label = &instrs[count++];
+            memset(label, 0, sizeof(*label));
+            label->type = THANM_INSTR_LABEL;
+            label->id = -1;
+            label->offset = end;
         }
     }
+    free(offsets);
+
+    script->instrs = instrs;
+    script->instr_count = count;
+    script->instr_capacity = script->instr_count + offset_count;
 }
 
+/* Returns NULL if the file can't be read, name is only used for messages. */
 static anm_archive_t*
 anm_read_file(
     FILE* in,
-    unsigned version)
+    unsigned version,
+    const char* name)
 {
     anm_archive_t* archive = malloc(sizeof(*archive));
-    list_init(&archive->names);
-    list_init(&archive->entries);
+    anm_name_index_t names = { NULL, 0, 0 };
+    arena_init(&archive->arena);
+    list_init_arena(&archive->names, &archive->arena);
+    list_init_arena(&archive->entries, &archive->arena);
+    TRACE_BEGIN(t);
 
     long file_size;
     unsigned char* map_base;
     unsigned char* map;
 
     archive->map_size = file_size = file_fsize(in);
-    archive->map = map_base = file_mmap(in, file_size);
+    if (file_size <= 0 || !(archive->map = map_base = file_mmap(in, file_size))) {
+        fprintf(stderr, "%s:%s: couldn't read the archive\n", argv0, name);
+        arena_free(&archive->arena);
+        free(archive);
+        return NULL;
+    }
     map = map_base;
 
     int32_t scriptn = 0;
     for (;;) {
-        anm_entry_t* entry = calloc(1, sizeof(*entry));
+        anm_entry_t* entry = arena_calloc(&archive->arena, sizeof(*entry));
         anm_header06_t* header = (anm_header06_t*)map;
 
         list_append_new(&archive->entries, entry);
@@ -1071,7 +1199,7 @@ anm_read_file(
          *
          * Another way to express this is that bytes 6-12 must be zero in th06 format.  */
         if (header->rt_textureslot != 0 || header->scripts > 65535) {
-            header = malloc(sizeof(*header));
+            header = arena_alloc(&archive->arena, sizeof(*header));
             memcpy(header, map, sizeof(*header));
             convert_header_to_old(header);
         }
@@ -1095,7 +1223,7 @@ anm_read_file(
         assert(TH19_OR_NEWER(version) || header->jpeg_quality == 0);
 
         /* Lengths, including padding, observed are: 16, 32, 48. */
-        entry->name = anm_get_name(archive, (const char*)map + header->nameoffset);
+        entry->name = anm_get_name(archive, &names, (const char*)map + header->nameoffset);
         if (header->version == 0 && header->y != 0)
             entry->name2 = (char*)map + header->y;
 
@@ -1103,7 +1231,7 @@ anm_read_file(
             (header->hasdata == 0 || (entry->name && entry->name[0] == '@')) ==
             (header->thtxoffset == 0));
 
-        list_init(&entry->sprites);
+        list_init_arena(&entry->sprites, &archive->arena);
         if (header->sprites) {
             uint32_t* sprite_offsets = (uint32_t*)(map + sizeof(*header));
             for (uint32_t s = 0; s < header->sprites; ++s) {
@@ -1111,12 +1239,12 @@ anm_read_file(
             }
         }
 
-        list_init(&entry->scripts);
+        list_init_arena(&entry->scripts, &archive->arena);
         if (header->scripts) {
             anm_offset_t* script_offsets =
                 (anm_offset_t*)(map + sizeof(*header) + header->sprites * sizeof(uint32_t));
             for (uint32_t s = 0; s < header->scripts; ++s) {
-                anm_script_t* script = anm_script_new();
+                anm_script_t* script = anm_script_new(&archive->arena);
                 script->real_index = scriptn;
                 script->offset = &(script_offsets[s]);
 
@@ -1169,8 +1297,7 @@ anm_read_file(
                     }
 
                     if (instr->time != time) {
-                        thanm_instr_t* time_instr = thanm_instr_new_time(instr->time);
-                        list_append_new(&script->instrs, time_instr);
+                        thanm_instr_new_time(script, instr->time);
                         time = instr->time;
                     }
 
@@ -1184,10 +1311,9 @@ anm_read_file(
                         fprintf(stderr, "\n");
 #endif
                     }
-                    thanm_instr_t* thanm_instr = thanm_instr_new_raw(instr, format);
+                    thanm_instr_t* thanm_instr = thanm_instr_new_raw(script, instr, format);
                     thanm_instr->offset = (uint32_t)((ptrdiff_t)instr_ptr - (ptrdiff_t)(map + script->offset->offset));
                     thanm_instr->address = (ptrdiff_t)instr_ptr - (ptrdiff_t)map_base;
-                    list_append_new(&script->instrs, thanm_instr);
 
                     if (header->version == 0)
                         free(instr);
@@ -1195,7 +1321,7 @@ anm_read_file(
                     instr_ptr += len;
                 }
 
-                anm_insert_labels(script, scriptn);
+                anm_insert_labels(script);
                 list_append_new(&entry->scripts, script);
                 ++scriptn;
             }
@@ -1222,20 +1348,23 @@ anm_read_file(
 
         map = map + header->nextoffset;
     }
+    free(names.slots);
 
+    TRACE_END(t, "anm_read_file", name);
     return archive;
 }
 
 static void
 anm_stringify_instr(
+    const thanm_context_t* ctx,
     FILE* stream,
     thanm_instr_t* instr,
     const anm_archive_t* anm,
     int32_t scriptn
 ) {
-    seqmap_entry_t* ent = seqmap_get(g_anmmap->ins_names, instr->id);
+    seqmap_entry_t* ent = seqmap_get(ctx->anmmap->ins_names, instr->id);
 
-    if (option_print_offsets)
+    if (ctx->print_offsets)
         fprintf(stream, " /* %5x (+%5x) */ ", instr->address, instr->offset);
 
     if (ent)
@@ -1243,10 +1372,9 @@ anm_stringify_instr(
     else
         fprintf(stream, "ins_%d(", instr->id);
 
-    thanm_param_t* param;
-    list_for_each(&instr->params, param) {
-        anm_stringify_param(stream, param, instr, anm, scriptn);
-        if (!list_is_last_iteration()) {
+    for (size_t i = 0; i < instr->param_count; ++i) {
+        anm_stringify_param(ctx, stream, &instr->params[i], instr, anm, scriptn);
+        if (i + 1 < instr->param_count) {
             fprintf(stream, ", ");
         }
     }
@@ -1288,10 +1416,10 @@ anm_make_unique_filename(
 
 static void
 anm_dump(
+    const thanm_context_t* ctx,
     FILE* stream,
     const anm_archive_t* anm,
-    unsigned version,
-    const char *anmfilename)
+    unsigned version)
 {
     unsigned int entry_num = 0;
     anm_entry_t* entry;
@@ -1302,8 +1430,8 @@ anm_dump(
         fprintf(stream, "entry entry%u {\n", entry_num++);
         fprintf(stream, "    version: %u,\n", entry->header->version);
         fprintf(stream, "    name: \"%s\",\n", entry->name);
-        if (option_unique_filenames) {
-            char *filename = anm_make_unique_filename(entry->name, anmfilename, entry_num-1);
+        if (ctx->unique_filenames) {
+            char *filename = anm_make_unique_filename(entry->name, ctx->input, entry_num-1);
             fprintf(stream, "    filename: \"%s\",\n", filename);
             free(filename);
         }
@@ -1389,14 +1517,14 @@ anm_dump(
             }
             prev_script_id = script->offset->id;
 
-            thanm_instr_t* instr;
             int time = 0;
             int is_negative_time = 0;
-            list_for_each(&script->instrs, instr) {
+            for (size_t i = 0; i < script->instr_count; ++i) {
+                thanm_instr_t* instr = &script->instrs[i];
                 switch(instr->type) {
                     case THANM_INSTR_INSTR:
                         fprintf(stream, "    ");
-                        anm_stringify_instr(stream, instr, anm, script->real_index);
+                        anm_stringify_instr(ctx, stream, instr, anm, script->real_index);
                         break;
                     case THANM_INSTR_TIME:
                         if (instr->time < 0)
@@ -1428,57 +1556,98 @@ anm_dump(
 }
 
 #ifdef HAVE_LIBPNG
-static anm_entry_t *
-util_entry_by_name(
-    const anm_archive_t *anm,
-    const char *name)
-{
-    anm_entry_t *entry, *rv = 0;
-    list_for_each(&anm->entries, entry)
-        if (entry->name == name) {
-            rv = entry;
-            break;
-        }
-    return rv;
-}
-
 static void
 anm_build_name_lists(
     const anm_archive_t *anm)
 {
-    const char *name;
-    anm_entry_t *entry, *tmp, **nextloc;
-    list_for_each(&anm->names, name) {
-        nextloc = &tmp;
-        list_for_each(&anm->entries, entry)
-            if (entry->name == name) {
-                *nextloc = entry;
-                nextloc = &entry->next_by_name;
-            }
-    }
+    anm_name_index_t index = { NULL, 0, 0 };
+    anm_entry_t *entry;
+    list_for_each(&anm->entries, entry)
+        anm_name_index_link(&index, entry);
+    free(index.slots);
 }
 
+/* Links entries with the same name across all archives, in archive order. */
 static void
 anm_build_name_lists_multiple(
     list_t *anms)
 {
-    const anm_archive_t *anm, *anm2;
-    const char *name;
-    anm_entry_t *entry, *tmp, **nextloc;
+    anm_name_index_t index = { NULL, 0, 0 };
+    const anm_archive_t *anm;
+    anm_entry_t *entry;
     list_for_each(anms, anm)
-        list_for_each(&anm->names, name) {
-            nextloc = &tmp;
-            list_for_each(anms, anm2)
-                list_for_each(&anm2->entries, entry)
-                    if (entry->name == name || !strcmp(name, entry->name)) {
-                        name = entry->name;
-                        if (entry->next_by_name)
-                            goto next_name; /* we already did this name */
-                        *nextloc = entry;
-                        nextloc = &entry->next_by_name;
-                    }
-            next_name:;
-        }
+        list_for_each(&anm->entries, entry)
+            anm_name_index_link(&index, entry);
+    free(index.slots);
+}
+
+/* Messages of one extraction or import task.  They are collected while the
+ * task runs, so that parallel tasks print them in the same order as a
+ * serial run would. */
+typedef struct {
+    char* text;
+    size_t size;
+    size_t capacity;
+} anm_log_t;
+
+/* Prints straight to stderr if log is NULL. */
+static void
+anm_log(
+    anm_log_t* log,
+    const char* format,
+    ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, format);
+    if (!log) {
+        vfprintf(stderr, format, ap);
+        va_end(ap);
+        return;
+    }
+    n = vsnprintf(NULL, 0, format, ap);
+    va_end(ap);
+    if (n < 0 || util_vec_ensure(&log->text, &log->capacity, log->size + n + 1, 1))
+        return;
+    va_start(ap, format);
+    vsnprintf(log->text + log->size, n + 1, format, ap);
+    va_end(ap);
+    log->size += n;
+}
+
+static const format_t anm_formats[] = {
+    FORMAT_GRAY8,
+    FORMAT_ARGB4444,
+    FORMAT_RGB565,
+    FORMAT_BGRA8888,
+    FORMAT_RGBA8888
+};
+
+static int
+anm_format_known(
+    uint16_t format)
+{
+    for (unsigned int f = 0; f < sizeof(anm_formats) / sizeof(anm_formats[0]); ++f)
+        if (anm_formats[f] == format)
+            return 1;
+    return 0;
+}
+
+/* Returns 0 for TH19+ textures that are extracted and imported as they are
+ * stored, without composing the entries that share the name. */
+static int
+anm_composes(
+    anm_entry_t* entry,
+    unsigned version)
+{
+    const uint32_t ox = option_dont_add_offset_border ? 0 : entry->header->x;
+    const uint32_t oy = option_dont_add_offset_border ? 0 : entry->header->y;
+
+    if (!TH19_OR_NEWER(version))
+        return 1;
+    return png_identify(entry->data, entry->thtx->size) &&
+        (ox || oy || entry->next_by_name);
 }
 
 static void
@@ -1506,30 +1675,28 @@ util_total_entry_size(
     *heightptr = height;
 }
 
-static void
+/* source is the decoded image file, or NULL to have it read here.  Returns 0
+ * if the image can't be imported, which the caller has to stop on; this runs
+ * on a worker thread, so it doesn't exit itself. */
+static int
 anm_replace(
     anm_archive_t* anm,
     FILE* anmfp,
     anm_entry_t* entry_first,
     const char* filename,
-    int version)
+    int version,
+    image_t* source,
+    anm_log_t* log)
 {
-    const format_t formats[] = {
-        FORMAT_RGBA8888,
-        FORMAT_BGRA8888,
-        FORMAT_RGB565,
-        FORMAT_ARGB4444,
-        FORMAT_GRAY8
-    };
-    unsigned int f;
     unsigned int width = 0;
     unsigned int height = 0;
     image_t* image;
+    TRACE_BEGIN(t);
 
     util_total_entry_size(entry_first, &width, &height);
     if (width == 0 || height == 0) {
         /* There's nothing to do. */
-        return;
+        return 1;
     }
 
     int is_png = 0;
@@ -1537,102 +1704,432 @@ anm_replace(
         anm_entry_t *entry = entry_first;
         const uint32_t ox = option_dont_add_offset_border ? 0 : entry->header->x;
         const uint32_t oy = option_dont_add_offset_border ? 0 : entry->header->y;
-        if (!(png_identify(entry->data, entry->thtx->size) && (ox || oy || entry->next_by_name))) {
+        if (!anm_composes(entry, version)) {
             if (option_verbose >= 2)
-                fprintf(stderr, "%s: not composing %s\n", argv0, filename);
+                anm_log(log, "%s: not composing %s\n", argv0, filename);
             /* TH19's ability/dummy.png is used twice, but it's the same texture.
              * Avoid printing a warning in this particular case. */
             if (ox || oy || entry->next_by_name && (entry->next_by_name->next_by_name ||
                     entry->thtx->size != entry->next_by_name->thtx->size ||
                     memcmp(entry->data, entry->next_by_name->data, entry->thtx->size))) {
-                fprintf(stderr, "%s: warning: %s can't be composed because it's a JPEG\n", argv0, filename);
+                anm_log(log, "%s: warning: %s can't be composed because it's a JPEG\n", argv0, filename);
             }
-            return;
+            return 1;
         }
         if (option_verbose >= 2)
-            fprintf(stderr, "%s: composing %s\n", argv0, filename);
+            anm_log(log, "%s: composing %s\n", argv0, filename);
         image = malloc(sizeof(image_t));
+        TRACE_BEGIN(t_png);
         png_read_mem(image, entry->data, entry->thtx->size);
+        TRACE_END(t_png, "png_read", filename);
         is_png = 1;
+    } else if (source) {
+        image = source;
     } else {
+        TRACE_BEGIN(t_png);
         image = png_read(filename);
+        TRACE_END(t_png, "png_read", filename);
+        if (!image)
+            return 0;
     }
 
+    int ret = 1;
     if (width > image->width || height > image->height) {
-        fprintf(stderr,
+        anm_log(log,
             "%s:%s:%s: wrong image dimensions for %s: %u, %u instead of %u, %u\n",
             argv0, current_input, entry_first->name, filename, image->width, image->height,
             width, height);
-        exit(1);
+        ret = 0;
     }
 
-    for (f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
-        long offset = 0;
-        anm_entry_t *entry, *entry_next = entry_first;
-        list_for_each(&anm->entries, entry) {
-            if (entry == entry_next &&
-                entry->thtx->format == formats[f] &&
-                entry->header->hasdata) {
-                unsigned int y;
-                format_t fmt = formats[f];
-
-                if (is_png) {
-                    if (fmt != FORMAT_BGRA8888) {
-                        fprintf(stderr, "%s: %s is not FORMAT_BGRA8888\n", argv0, entry->name);
-                        exit(1);
-                    }
-                    fmt = FORMAT_RGBA8888;
-                    entry->thtx->size = entry->thtx->w*entry->thtx->h*4;
-                    free(entry->data);
-                    entry->data = malloc(entry->thtx->size);
-                }
+    for (anm_entry_t *entry = entry_first; ret && entry; entry = entry->next_by_name) {
+        if (entry->header->hasdata && anm_format_known(entry->thtx->format)) {
+            format_t fmt = entry->thtx->format;
 
-                unsigned char* converted_data = format_from_rgba((uint32_t*)image->data, width * height, fmt);
-                const uint32_t ox = option_dont_add_offset_border ? 0 : entry->header->x;
-                const uint32_t oy = option_dont_add_offset_border ? 0 : entry->header->y;
-
-                if (anmfp) {
-                    for (y = oy; y < oy + entry->thtx->h; ++y) {
-                        if (!file_seek(anmfp,
-                            offset + entry->header->thtxoffset + sizeof(thtx_header_t) + (y - oy) * entry->thtx->w * format_Bpp(fmt)))
-                            exit(1);
-                        if (!file_write(anmfp, converted_data + y * width * format_Bpp(fmt) + ox * format_Bpp(fmt), entry->thtx->w * format_Bpp(fmt)))
-                            exit(1);
-                    }
-                } else {
-                    for (y = oy; y < oy + entry->thtx->h; ++y) {
-                        memcpy(entry->data + (y - oy) * entry->thtx->w * format_Bpp(fmt),
-                               converted_data + y * width * format_Bpp(fmt) + ox * format_Bpp(fmt),
-                               entry->thtx->w * format_Bpp(fmt));
-                    }
+            if (is_png) {
+                if (fmt != FORMAT_BGRA8888) {
+                    anm_log(log, "%s: %s is not FORMAT_BGRA8888\n", argv0, entry->name);
+                    ret = 0;
+                    break;
                 }
+                fmt = FORMAT_RGBA8888;
+                entry->thtx->size = entry->thtx->w*entry->thtx->h*4;
+                free(entry->data);
+                entry->data = malloc(entry->thtx->size);
+            }
 
+            const uint32_t ox = option_dont_add_offset_border ? 0 : entry->header->x;
+            const uint32_t oy = option_dont_add_offset_border ? 0 : entry->header->y;
+            const size_t row_size = entry->thtx->w * format_Bpp(fmt);
+            /* Only the rectangle used by this entry is converted.  The
+             * composed image is laid out width pixels per row. */
+            const uint32_t* src = (uint32_t*)image->data + (size_t)oy * width + ox;
+
+            if (anmfp) {
+                /* The rows are stored one after another, so the texture
+                 * goes to the file in one piece. */
+                unsigned char* converted_data = malloc(row_size * entry->thtx->h);
+                const long offset = (long)((unsigned char*)entry->thtx->data - anm->map);
+                int written;
+                format_from_rgba_rect(converted_data, src, width,
+                    entry->thtx->w, entry->thtx->h, fmt);
+#pragma omp critical(anm_replace_write)
+                written = file_seek(anmfp, offset) &&
+                    file_write(anmfp, converted_data, row_size * entry->thtx->h);
                 free(converted_data);
-
-                if (is_png) {
-                    image_t image2 = {
-                        .data = entry->data,
-                        .width = entry->thtx->w,
-                        .height = entry->thtx->h,
-                        .format = FORMAT_RGBA8888,
-                    };
-                    size_t size;
-                    entry->data = png_write_mem(&image2, &size);
-                    entry->thtx->size = size;
-                    free(image2.data);
+                if (!written) {
+                    ret = 0;
+                    break;
                 }
+            } else {
+                format_from_rgba_rect(entry->data, src, width,
+                    entry->thtx->w, entry->thtx->h, fmt);
+            }
 
-                entry->processed = 1;
+            if (is_png) {
+                image_t image2 = {
+                    .data = entry->data,
+                    .width = entry->thtx->w,
+                    .height = entry->thtx->h,
+                    .format = FORMAT_RGBA8888,
+                };
+                size_t size;
+                TRACE_BEGIN(t_png);
+                entry->data = png_write_mem(&image2, &size);
+                TRACE_END(t_png, "png_write", entry->name);
+                entry->thtx->size = size;
+                free(image2.data);
             }
-            if (entry == entry_next)
-                entry_next = entry->next_by_name;
 
-            offset += entry->header->nextoffset;
+            entry->processed = 1;
+        }
+    }
+
+    if (image != source) {
+        free(image->data);
+        free(image);
+    }
+    TRACE_END(t, "anm_replace", filename);
+    return ret;
+}
+
+/* Marks the entries anm_replace will fill in as processed. */
+static void
+anm_replace_claim(
+    anm_entry_t* entry_first,
+    int version)
+{
+    unsigned int width = 0, height = 0;
+
+    util_total_entry_size(entry_first, &width, &height);
+    if (width == 0 || height == 0 ||
+            (TH19_OR_NEWER(version) && !anm_composes(entry_first, version)))
+        return;
+    for (anm_entry_t *entry = entry_first; entry; entry = entry->next_by_name)
+        if (entry->header->hasdata && anm_format_known(entry->thtx->format))
+            entry->processed = 1;
+}
+
+typedef struct {
+    const char* path;
+    image_t* image;
+    /* With --incremental, a hash of the tasks that use the image, and
+     * whether their textures were taken from the previous archive. */
+    thtk_xxh64_t tasks_hash;
+    int reused;
+    /* Tasks that haven't used the image yet. */
+    size_t users;
+} anm_image_cache_t;
+
+/* Frees a decoded image once the last task that uses it is done. */
+static void
+anm_image_release(
+    anm_image_cache_t* cache)
+{
+    size_t users;
+#pragma omp atomic capture
+    users = --cache->users;
+    if (!users && cache->image) {
+        free(cache->image->data);
+        free(cache->image);
+        cache->image = NULL;
+    }
+}
+
+typedef struct {
+    anm_entry_t* entry;
+    /* Position of entry in the archive. */
+    size_t position;
+    const char* filename;
+    /* Index in the image cache, or -1 if anm_replace doesn't read a file. */
+    ptrdiff_t image;
+    /* Set for the tasks that follow the previous one on the same thread,
+     * because they fill in some of the same entries. */
+    int follows;
+} anm_replace_task_t;
+
+/* Adds what decides the textures anm_replace makes for task to the hash of
+ * its image, so that --incremental knows when the entries still line up
+ * with those that were built from the image last time. */
+static void
+anm_replace_hash_task(
+    thtk_xxh64_t* xxh,
+    const anm_replace_task_t* task)
+{
+    const uint64_t position = task->position;
+    thtk_xxh64_update(xxh, &position, sizeof(position));
+    thtk_xxh64_update(xxh, task->filename, strlen(task->filename) + 1);
+    for (anm_entry_t *entry = task->entry; entry; entry = entry->next_by_name) {
+        const uint32_t header[] = {
+            entry->header->hasdata, entry->header->x, entry->header->y,
+            entry->header->hasdata ? entry->thtx->w : 0,
+            entry->header->hasdata ? entry->thtx->h : 0,
+            entry->header->hasdata ? entry->thtx->format : 0,
+            entry->header->hasdata ? entry->thtx->size : 0,
+        };
+        thtk_xxh64_update(xxh, header, sizeof(header));
+    }
+}
+
+/* Returns 1 if the entries task fills in match those of the previous
+ * archive, base_entries, in name and texture layout.  With copy, their
+ * textures are copied over as well. */
+static int
+anm_replace_reuse(
+    const anm_replace_task_t* task,
+    anm_entry_t** base_entries,
+    size_t base_count,
+    int copy)
+{
+    anm_entry_t *entry, *base;
+
+    if (task->position >= base_count ||
+            strcmp(base_entries[task->position]->name, task->entry->name))
+        return 0;
+    for (entry = task->entry, base = base_entries[task->position];
+            entry && base;
+            entry = entry->next_by_name, base = base->next_by_name) {
+        if (entry->header->hasdata != base->header->hasdata ||
+                entry->header->x != base->header->x ||
+                entry->header->y != base->header->y)
+            return 0;
+        if (!entry->header->hasdata)
+            continue;
+        if (entry->thtx->w != base->thtx->w ||
+                entry->thtx->h != base->thtx->h ||
+                entry->thtx->format != base->thtx->format ||
+                entry->thtx->size != base->thtx->size)
+            return 0;
+        if (copy && anm_format_known(entry->thtx->format)) {
+            memcpy(entry->data, base->data, entry->thtx->size);
+            entry->processed = 1;
+        }
+    }
+    return !entry && !base;
+}
+
+static void
+anm_replace_plan_task(
+    anm_entry_t* entry,
+    size_t position,
+    int version,
+    int follows,
+    anm_replace_task_t** tasks,
+    size_t* count,
+    size_t* capacity,
+    anm_image_cache_t** images,
+    size_t* image_count,
+    size_t* image_capacity)
+{
+    unsigned int width = 0, height = 0;
+    anm_replace_task_t* task;
+
+    if (util_vec_ensure(tasks, capacity, *count + 1, sizeof(**tasks)))
+        exit(1);
+    task = &(*tasks)[(*count)++];
+    task->entry = entry;
+    task->position = position;
+    task->filename = entry->filename ? entry->filename : entry->name;
+    task->image = -1;
+    task->follows = follows;
+
+    /* TH19+ textures are composed from the data already in the entries. */
+    util_total_entry_size(entry, &width, &height);
+    if (width && height && !TH19_OR_NEWER(version)) {
+        size_t i;
+        for (i = 0; i < *image_count; ++i)
+            if (!strcmp((*images)[i].path, task->filename))
+                break;
+        if (i == *image_count) {
+            if (util_vec_ensure(images, image_capacity, *image_count + 1, sizeof(**images)))
+                exit(1);
+            (*images)[i].path = task->filename;
+            (*images)[i].image = NULL;
+            (*images)[i].reused = 0;
+            (*images)[i].users = 0;
+            thtk_xxh64_init(&(*images)[i].tasks_hash, version);
+            ++*image_count;
+        }
+        task->image = i;
+        if (g_incremental)
+            anm_replace_hash_task(&(*images)[i].tasks_hash, task);
+    }
+
+    anm_replace_claim(entry, version);
+}
+
+/* Imports the images of every entry of anm that hasn't been processed yet.
+ * Each image file is decoded once, even if several names use it, and freed
+ * after the last of them; an image that only one name uses is decoded by
+ * that name's task.  The files and then the names are handled on a pool of
+ * threads.  If anmfp is given, the textures are written to it instead of the
+ * entries.  Exits once the threads are done if an image can't be imported.
+ *
+ * With --incremental, base is the archive as the previous run of -c left
+ * it.  The textures made from images that haven't changed since then are
+ * copied from it instead. */
+static void
+anm_replace_all(
+    anm_archive_t* anm,
+    FILE* anmfp,
+    int version,
+    const anm_archive_t* base)
+{
+    anm_replace_task_t* tasks = NULL;
+    size_t task_count = 0, task_capacity = 0;
+    anm_image_cache_t* images = NULL;
+    size_t image_count = 0, image_capacity = 0;
+    anm_entry_t* entry;
+    size_t position = 0;
+    int failed = 0;
+    ptrdiff_t i;
+
+    list_for_each(&anm->entries, entry) {
+        if (entry->processed) {
+            ++position;
+            continue;
+        }
+        anm_replace_plan_task(entry, position, version, 0, &tasks, &task_count, &task_capacity,
+            &images, &image_count, &image_capacity);
+        /* anm_replace runs again for the unclaimed entries that share the
+         * name, so they stay in order with this task. */
+        for (anm_entry_t *entryp = entry->next_by_name; entryp; entryp = entryp->next_by_name) {
+            if (entryp->processed)
+                continue;
+            anm_replace_plan_task(entryp, position, version, 1, &tasks, &task_count, &task_capacity,
+                &images, &image_count, &image_capacity);
+            entryp->processed = 1;
+        }
+        ++position;
+    }
+
+    if (base) {
+        anm_entry_t** base_entries = NULL;
+        size_t base_count = 0, base_capacity = 0;
+        anm_entry_t* base_entry;
+
+        list_for_each(&base->entries, base_entry) {
+            if (util_vec_ensure(&base_entries, &base_capacity, base_count + 1, sizeof(*base_entries)))
+                exit(1);
+            base_entries[base_count++] = base_entry;
+        }
+
+        for (size_t k = 0; k < image_count; ++k) {
+            int reusable = 1;
+            /* Tasks that fill in the same entries as others are run
+             * again, since the order they overwrite each other in
+             * matters. */
+            for (size_t t = 0; t < task_count && reusable; ++t)
+                if (tasks[t].image == (ptrdiff_t)k)
+                    reusable = !tasks[t].follows &&
+                        !(t + 1 < task_count && tasks[t + 1].follows) &&
+                        anm_replace_reuse(&tasks[t], base_entries, base_count, 0);
+            if (!reusable || !incremental_unchanged(g_incremental, images[k].path,
+                    thtk_xxh64_final(&images[k].tasks_hash), NULL, 0))
+                continue;
+            for (size_t t = 0; t < task_count; ++t)
+                if (tasks[t].image == (ptrdiff_t)k)
+                    anm_replace_reuse(&tasks[t], base_entries, base_count, 1);
+            images[k].reused = 1;
+        }
+        free(base_entries);
+    }
+
+    for (size_t t = 0; t < task_count; ++t)
+        if (tasks[t].image != -1 && !images[tasks[t].image].reused)
+            ++images[tasks[t].image].users;
+
+#pragma omp parallel for schedule(dynamic)
+    for (i = 0; i < (ptrdiff_t)image_count; ++i) {
+        if (images[i].reused || images[i].users < 2)
+            continue;
+        TRACE_BEGIN(t_png);
+        images[i].image = png_read(images[i].path);
+        TRACE_END(t_png, "png_read", images[i].path);
+        if (!images[i].image) {
+#pragma omp atomic write
+            failed = 1;
+        }
+    }
+
+#pragma omp parallel for ordered schedule(dynamic)
+    for (i = 0; i < (ptrdiff_t)task_count; ++i) {
+        anm_log_t log = { NULL, 0, 0 };
+        size_t k = i;
+        int stop;
+        int ok;
+
+        if (tasks[i].follows ||
+                (tasks[i].image != -1 && images[tasks[i].image].reused))
+            continue;
+        /* Once a task has failed, the others are skipped. */
+#pragma omp atomic read
+        stop = failed;
+        ok = !stop;
+        while (ok) {
+            const anm_replace_task_t* task = &tasks[k];
+            ok = anm_replace(anm, anmfp, task->entry, task->filename, version,
+                task->image == -1 ? NULL : images[task->image].image, &log);
+            if (task->image != -1)
+                anm_image_release(&images[task->image]);
+            if (++k == task_count || !tasks[k].follows)
+                break;
+        }
+        if (!ok && !stop) {
+#pragma omp atomic write
+            failed = 1;
+        }
+
+#pragma omp ordered
+        if (log.size)
+            fputs(log.text, stderr);
+        free(log.text);
+    }
+
+    if (!failed && g_incremental) {
+        size_t reused = 0;
+        for (size_t k = 0; k < image_count; ++k) {
+            if (images[k].reused)
+                ++reused;
+            else
+                incremental_written(g_incremental, images[k].path,
+                    thtk_xxh64_final(&images[k].tasks_hash));
         }
+        if (option_verbose >= 1)
+            fprintf(stderr, "%s: %zu images imported, %zu unchanged\n", argv0, image_count - reused, reused);
     }
 
-    free(image->data);
-    free(image);
+    /* Only images of tasks that didn't run are left. */
+    for (size_t k = 0; k < image_count; ++k) {
+        if (images[k].image) {
+            free(images[k].image->data);
+            free(images[k].image);
+        }
+    }
+    free(images);
+    free(tasks);
+    if (failed)
+        exit(1);
 }
 
 static unsigned char *
@@ -1649,22 +2146,57 @@ entry_to_rgba(
     }
 }
 
+/* Hashes everything the image extracted for entry is made from. */
+static uint64_t
+anm_extract_hash(
+    anm_entry_t* entry,
+    unsigned version)
+{
+    thtk_xxh64_t xxh;
+    thtk_xxh64_init(&xxh, 0);
+    thtk_xxh64_update(&xxh, &version, sizeof(version));
+    thtk_xxh64_update(&xxh, &option_dont_add_offset_border, sizeof(option_dont_add_offset_border));
+    for (anm_entry_t *entryp = entry; entryp; entryp = entryp->next_by_name) {
+        const uint32_t header[] = {
+            entryp->header->x, entryp->header->y,
+            entryp->thtx->w, entryp->thtx->h,
+            entryp->thtx->format, entryp->thtx->size,
+        };
+        thtk_xxh64_update(&xxh, header, sizeof(header));
+        thtk_xxh64_update(&xxh, entryp->data, entryp->thtx->size);
+    }
+    return thtk_xxh64_final(&xxh);
+}
+
+/* Marks the entries whose images are part of the one extracted for entry
+ * as processed, so that they aren't extracted again. */
+static void
+anm_extract_claim(
+    anm_entry_t* entry,
+    unsigned version)
+{
+    unsigned int width = 0, height = 0;
+
+    util_total_entry_size(entry, &width, &height);
+    if (width == 0 || height == 0 || !anm_composes(entry, version))
+        return;
+    for (anm_entry_t *entryp = entry; entryp; entryp = entryp->next_by_name)
+        if (anm_format_known(entryp->thtx->format))
+            entryp->processed = 1;
+}
+
+/* Call anm_extract_claim first. */
 static void
 anm_extract(
     anm_entry_t* entry,
     const char* filename,
-    unsigned version)
+    unsigned version,
+    anm_log_t* log)
 {
-    const format_t formats[] = {
-        FORMAT_GRAY8,
-        FORMAT_ARGB4444,
-        FORMAT_RGB565,
-        FORMAT_BGRA8888,
-        FORMAT_RGBA8888
-    };
     image_t image;
+    TRACE_BEGIN(t);
 
-    unsigned int f, y;
+    unsigned int y;
 
     image.width = 0;
     image.height = 0;
@@ -1679,70 +2211,219 @@ anm_extract(
 
     util_makepath(filename);
 
+    uint64_t hash = g_incremental ? anm_extract_hash(entry, version) : 0;
+
     uint32_t ox = option_dont_add_offset_border ? 0 : entry->header->x;
     uint32_t oy = option_dont_add_offset_border ? 0 : entry->header->y;
     int is_png = 0;
 
     if (TH19_OR_NEWER(version)) {
-        if (png_identify(entry->thtx->data, entry->thtx->size) &&
-                (ox || oy || entry->next_by_name)) {
+        if (anm_composes(entry, version)) {
             if (option_verbose >= 2)
-                fprintf(stderr, "%s: composing %s\n", argv0, filename);
+                anm_log(log, "%s: composing %s\n", argv0, filename);
             is_png = 1;
         } else {
             if (option_verbose >= 2)
-                fprintf(stderr, "%s: not composing %s\n", argv0, filename);
+                anm_log(log, "%s: not composing %s\n", argv0, filename);
             /* TH19's ability/dummy.png is used twice, but it's the same texture.
              * Avoid printing a warning in this particular case. */
             if (ox || oy || entry->next_by_name && (entry->next_by_name->next_by_name ||
                     entry->thtx->size != entry->next_by_name->thtx->size ||
                     memcmp(entry->thtx->data, entry->next_by_name->thtx->data, entry->thtx->size))) {
-                fprintf(stderr, "%s: warning: %s can't be composed because it's a JPEG\n", argv0, filename);
+                anm_log(log, "%s: warning: %s can't be composed because it's a JPEG\n", argv0, filename);
             }
+            if (g_incremental &&
+                incremental_unchanged(g_incremental, filename, hash, entry->thtx->data, entry->thtx->size))
+                return;
             FILE* stream = fopen(filename, "wb");
             if (stream) {
                 fwrite(entry->thtx->data, 1, entry->thtx->size, stream);
                 fclose(stream);
+                if (g_incremental)
+                    incremental_written(g_incremental, filename, hash);
             }
             return;
         }
     }
 
-    image.data = malloc(image.width * image.height * 4);
+    /* Skipping the composition and PNG encoding is where the time goes. */
+    if (g_incremental && incremental_unchanged(g_incremental, filename, hash, NULL, 0)) {
+        TRACE_END(t, "anm_extract_unchanged", filename);
+        return;
+    }
+
+    image.data = malloc(image.width * image.height * 4);
     /* XXX: Why 0xff? */
     memset(image.data, 0xff, image.width* image.height * 4);
     for (anm_entry_t *entryp = entry; entryp; entryp = entryp->next_by_name) {
-        for (f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
-            if (formats[f] == entryp->thtx->format) {
-                ox = option_dont_add_offset_border ? 0 : entryp->header->x;
-                oy = option_dont_add_offset_border ? 0 : entryp->header->y;
-                unsigned char* temp_data = entry_to_rgba(entryp, is_png);
-                for (y = oy; y < oy + entryp->thtx->h; ++y) {
-                    memcpy(image.data + y * image.width * 4 + ox * 4,
-                        temp_data + (y - oy) * entryp->thtx->w * 4,
-                        entryp->thtx->w * 4);
-                }
-                free(temp_data);
-                entryp->processed = 1;
+        if (anm_format_known(entryp->thtx->format)) {
+            ox = option_dont_add_offset_border ? 0 : entryp->header->x;
+            oy = option_dont_add_offset_border ? 0 : entryp->header->y;
+            unsigned char* temp_data = entry_to_rgba(entryp, is_png);
+            for (y = oy; y < oy + entryp->thtx->h; ++y) {
+                memcpy(image.data + y * image.width * 4 + ox * 4,
+                    temp_data + (y - oy) * entryp->thtx->w * 4,
+                    entryp->thtx->w * 4);
             }
+            free(temp_data);
         }
     }
 
+    TRACE_BEGIN(t_png);
     png_write(filename, &image);
+    TRACE_END(t_png, "png_write", filename);
+    if (g_incremental)
+        incremental_written(g_incremental, filename, hash);
     free(image.data);
+    TRACE_END(t, "anm_extract", filename);
+}
+
+typedef struct {
+    anm_entry_t* entry;
+    char* filename; /* NULL to use the entry name */
+    /* Set for the tasks that write the same file as the previous one.  They
+     * are run by the same thread, after it. */
+    int follows;
+} anm_extract_task_t;
+
+/* Adds a task for every entry of anm that hasn't been processed yet, in
+ * the order a serial extraction would handle them. */
+static void
+anm_extract_plan(
+    anm_archive_t* anm,
+    const char* anmname,
+    unsigned version,
+    anm_extract_task_t** tasks,
+    size_t* count,
+    size_t* capacity)
+{
+    anm_entry_t* entry;
+    int j = 0;
+
+    list_for_each(&anm->entries, entry) {
+        if (!entry->processed) {
+            anm_extract_task_t* task;
+            if (util_vec_ensure(tasks, capacity, *count + 1, sizeof(**tasks)))
+                exit(1);
+            task = &(*tasks)[(*count)++];
+            task->entry = entry;
+            task->filename = option_unique_filenames ?
+                anm_make_unique_filename(entry->name, anmname, j) : NULL;
+            task->follows = 0;
+            anm_extract_claim(entry, version);
+
+            /* Entries that weren't claimed would be extracted later to the
+             * same file, so they have to stay in order with this one. */
+            if (!option_unique_filenames) {
+                for (anm_entry_t *entryp = entry->next_by_name; entryp; entryp = entryp->next_by_name) {
+                    if (entryp->processed)
+                        continue;
+                    if (util_vec_ensure(tasks, capacity, *count + 1, sizeof(**tasks)))
+                        exit(1);
+                    task = &(*tasks)[(*count)++];
+                    task->entry = entryp;
+                    task->filename = NULL;
+                    task->follows = 1;
+                    anm_extract_claim(entryp, version);
+                    entryp->processed = 1;
+                }
+            }
+        }
+        j++;
+    }
+}
+
+/* Runs the tasks on a pool of threads.  Messages are printed in task
+ * order. */
+static void
+anm_extract_run(
+    anm_extract_task_t* tasks,
+    size_t count,
+    unsigned version)
+{
+    ptrdiff_t i;
+
+#pragma omp parallel for ordered schedule(dynamic)
+    for (i = 0; i < (ptrdiff_t)count; ++i) {
+        anm_log_t log = { NULL, 0, 0 };
+        size_t k = i;
+
+        if (tasks[i].follows)
+            continue;
+        do {
+            const anm_extract_task_t* task = &tasks[k];
+            if (option_verbose >= 1)
+                anm_log(&log, "%s\n", task->entry->name);
+            anm_extract(task->entry, task->filename ? task->filename : task->entry->name, version, &log);
+        } while (++k < count && tasks[k].follows);
+
+#pragma omp ordered
+        if (log.size)
+            fputs(log.text, stderr);
+        free(log.text);
+    }
+
+    for (size_t k = 0; k < count; ++k)
+        free(tasks[k].filename);
+}
+
+static int
+label_probe_stop(
+    const void* table,
+    size_t slot,
+    const void* key
+) {
+    label_t* const* slots = table;
+    return !slots[slot] || !strcmp(slots[slot]->name, key);
+}
+
+/* Returns the slot of script->label_slots where name is or would go. */
+static label_t**
+label_probe(
+    anm_script_t* script,
+    const char* name
+) {
+    const uint32_t hash = thtk_fnv1a(THTK_FNV1A_INIT, name, strlen(name));
+    return &script->label_slots[thtk_probe(script->label_slot_count, hash,
+        label_probe_stop, script->label_slots, name)];
 }
 
 label_t*
 label_find(
     anm_script_t* script,
-    char* name
+    const char* name
 ) {
-    label_t* label;
-    list_for_each(&script->labels, label) {
-        if (strcmp(label->name, name) == 0)
-            return label;
+    if (!script->label_count)
+        return NULL;
+    return *label_probe(script, name);
+}
+
+void
+label_add(
+    anm_script_t* script,
+    char* name,
+    uint32_t offset,
+    int16_t time
+) {
+    /* Keep the table at most half full. */
+    if ((script->label_count + 1) * 2 > script->label_slot_count) {
+        label_t** old_slots = script->label_slots;
+        size_t old_count = script->label_slot_count;
+
+        script->label_slot_count = old_count ? old_count * 2 : 16;
+        script->label_slots = arena_calloc(script->arena,
+            script->label_slot_count * sizeof(label_t*));
+        for (size_t i = 0; i < old_count; ++i)
+            if (old_slots[i])
+                *label_probe(script, old_slots[i]->name) = old_slots[i];
     }
-    return NULL;
+
+    label_t* label = arena_alloc(script->arena, sizeof(label_t));
+    label->name = name;
+    label->offset = offset;
+    label->time = time;
+    *label_probe(script, name) = label;
+    ++script->label_count;
 }
 
 static symbol_id_pair_t*
@@ -1769,15 +2450,14 @@ anm_serialize_instr(
      * So we need to get size it would get as if it was anm_instr_t, no matter what. */
     uint32_t size = instr_get_size(instr, 8);
 
-    anm_instr_t* raw = (anm_instr_t*)util_malloc(size);
+    anm_instr_t* raw = (anm_instr_t*)arena_alloc(state->arena, size);
     raw->type = instr->id;
     raw->length = size - sizeof(anm_instr_t); /* size of parametes. */
     raw->time = instr->time;
     raw->param_mask = 0;
-    thanm_param_t* param;
-    int i = 0;
     size_t offset = 0;
-    list_for_each(&instr->params, param) {
+    for (size_t i = 0; i < instr->param_count; ++i) {
+        const thanm_param_t* param = &instr->params[i];
         /* Format checking was done by the parser, no need to do it here again. */
         if (param->is_var)
             raw->param_mask |= 1 << i;
@@ -1837,7 +2517,6 @@ anm_serialize_instr(
                 break;
             }
         }
-        ++i;
     }
     return raw;
 }
@@ -1847,21 +2526,19 @@ anm_serialize_script(
     parser_state_t* state,
     anm_script_t* script
 ) {
-    thanm_instr_t* instr;
-    list_for_each(&script->instrs, instr) {
-        anm_instr_t* raw_instr = anm_serialize_instr(state, instr, script);
-        if (raw_instr != NULL)
-            list_append_new(&script->raw_instrs, raw_instr);
-        thanm_instr_free(instr);
+    script->raw_instrs = arena_alloc(state->arena, script->instr_count * sizeof(anm_instr_t*));
+    for (size_t i = 0; i < script->instr_count; ++i) {
+        thanm_instr_t* instr = &script->instrs[i];
+        script->raw_instrs[script->raw_instr_count++] = anm_serialize_instr(state, instr, script);
+        thanm_instr_free_params(instr);
     }
-    list_free_nodes(&script->instrs);
+    script->instr_count = 0;
 
-    label_t* label;
-    list_for_each(&script->labels, label) {
-        free(label->name);
-        free(label);
-    }
-    list_free_nodes(&script->labels);
+    for (size_t i = 0; i < script->label_slot_count; ++i)
+        if (script->label_slots[i])
+            free(script->label_slots[i]->name);
+    script->label_slot_count = 0;
+    script->label_count = 0;
 }
 
 static int anm_is_old_format(
@@ -1893,6 +2570,12 @@ anm_create(
         return NULL;
     }
 
+    anm_archive_t* anm = (anm_archive_t*)util_malloc(sizeof(anm_archive_t));
+    anm->map = NULL;
+    anm->map_size = 0;
+    arena_init(&anm->arena);
+    list_init_arena(&anm->names, &anm->arena);
+
     parser_state_t state;
     state.was_error = 0;
     state.time = 0;
@@ -1901,7 +2584,8 @@ anm_create(
     state.sprite_id = 0;
     state.script_id = 0;
     state.script_real_index = 0;
-    list_init(&state.entries);
+    state.arena = &anm->arena;
+    list_init_arena(&state.entries, &anm->arena);
     list_init(&state.globals);
     list_init(&state.script_names);
     list_init(&state.sprite_names);
@@ -1914,31 +2598,28 @@ anm_create(
     path_init(&state.path_state, spec, argv0);
 
     thanm_yyin = in;
-    if (thanm_yyparse(&state) || state.was_error)
+    TRACE_BEGIN(t);
+    if (thanm_yyparse(&state) || state.was_error) {
+        arena_free(&anm->arena);
+        free(anm);
         return NULL;
+    }
+    TRACE_END(t, "parse", spec);
 
     path_free(&state.path_state);
 
-    anm_archive_t* anm = (anm_archive_t*)util_malloc(sizeof(anm_archive_t));
-    anm->map = NULL;
-    anm->map_size = 0;
-    list_init(&anm->names);
     anm->entries = state.entries;
 
+    anm_name_index_t names = { NULL, 0, 0 };
     anm_entry_t* entry;
     list_for_each(&anm->entries, entry) {
-        char* name;
-        int found = 0;
-        list_for_each(&anm->names, name) {
-            if (strcmp(entry->name, name) == 0) {
-                free(entry->name);
-                entry->name = name;
-                found = 1;
-                break;
-            }
-        }
-        if (!found)
+        anm_name_slot_t* slot = anm_name_index_get(&names, entry->name);
+        if (slot->name) {
+            entry->name = slot->name;
+        } else {
+            slot->name = entry->name;
             list_append_new(&anm->names, entry->name);
+        }
 
         anm_script_t* script;
         list_for_each(&entry->scripts, script) {
@@ -1946,12 +2627,12 @@ anm_create(
 
             /* Free vars. */
             var_t* var;
-            list_for_each(&script->vars, var) {
-                var_free(var);
-            }
+            list_for_each(&script->vars, var)
+                free(var->name);
             list_free_nodes(&script->vars);
         }
     }
+    free(names.slots);
 
     /* Free stuff. */
     reg_free_user();
@@ -2103,6 +2784,7 @@ anm_write(
     unsigned version)
 {
     FILE* stream;
+    TRACE_BEGIN(t);
 
     stream = fopen(filename, "wb");
     if (!stream) {
@@ -2158,8 +2840,8 @@ anm_write(
         list_for_each(&entry->scripts, script) {
             script->offset->offset = file_tell(stream) - base;
 
-            anm_instr_t* instr;
-            list_for_each(&script->raw_instrs, instr) {
+            for (size_t i = 0; i < script->raw_instr_count; ++i) {
+                anm_instr_t* instr = script->raw_instrs[i];
                 if (entry->header->version == 0) {
                     anm_instr0_t new_instr;
                     new_instr.time = instr->time;
@@ -2232,6 +2914,7 @@ anm_write(
     }
 
     fclose(stream);
+    TRACE_END(t, "anm_write", filename);
 }
 #endif
 
@@ -2239,199 +2922,24 @@ static void
 anm_free(
     anm_archive_t* anm)
 {
-    int is_mapped = anm->map != NULL;
-
-    char* name;
-    list_for_each(&anm->names, name)
-        free(name);
-    list_free_nodes(&anm->names);
-
-    anm_entry_t* entry;
-    list_for_each(&anm->entries, entry) {
-        anm_script_t* script;
-        list_for_each(&entry->scripts, script) {
-            if (!is_mapped)
-                free(script->offset);
-
-            thanm_instr_t* instr;
-            list_for_each(&script->instrs, instr) {
-                thanm_instr_free(instr);
-            }
-            if (!is_mapped || entry->header->version == 0) {
-                anm_instr_t* instr;
-                list_for_each(&script->raw_instrs, instr) {
-                    free(instr);
-                }
-            }
-            list_free_nodes(&script->instrs);
-            list_free_nodes(&script->raw_instrs);
-
-            free(script);
-        }
-        list_free_nodes(&entry->scripts);
-
-        if (!is_mapped) {
-            free(entry->header);
-            free(entry->thtx);
-            free(entry->name2);
+    /* Everything else is in the arena. */
+    if (!anm->map) {
+        anm_entry_t* entry;
+        list_for_each(&anm->entries, entry)
             free(entry->data);
-
-            sprite19_t* sprite;
-            list_for_each(&entry->sprites, sprite)
-                free(sprite);
-        } else if (entry->header->version >= 7) {
-            free(entry->header);
-        }
-        list_free_nodes(&entry->sprites);
-
-        free(entry->filename);
-        free(entry);
     }
-    list_free_nodes(&anm->entries);
 
-    if (is_mapped)
+    if (anm->map)
         file_munmap(anm->map, anm->map_size);
 
+    arena_free(&anm->arena);
     free(anm);
 }
 
-static void
-print_usage(void)
-{
-#ifdef HAVE_LIBPNG
-#define USAGE_LIBPNGFLAGS " | -x | -r | -c"
-#else
-#define USAGE_LIBPNGFLAGS ""
-#endif
-    printf("Usage: %s [-Vfouv] [[-l" USAGE_LIBPNGFLAGS "] VERSION] [-m ANMMAP]... [-s SYMBOLS] ARCHIVE ...\n"
-           "Options:\n"
-           "  -l VERSION ARCHIVE            list archive\n"
-#ifdef HAVE_LIBPNG
-           "  -x VERSION ARCHIVE [FILE...]  extract entries\n"
-           "  -X VERSION ARCHIVE...         extract all entries from multiple archives\n"
-           "  -r VERSION ARCHIVE NAME FILE  replace entry in archive\n"
-           "  -c VERSION ARCHIVE SPEC       create archive\n"
-           "  -s SYMBOLS                    save symbol ids to the given file as globaldefs\n"
-#endif
-           "  -m ANMMAP                     use map file for translating mnemonics\n"
-           "  -V                            display version information and exit\n"
-           "  -f                            ignore errors when possible\n"
-           "  -o                            add address information for ANM instructions\n"
-           "  -u                            extract each texture into a separate file\n"
-           "  -uu                           ignore x/y offset\n"
-           "  -v                            verbose output\n"
-           "VERSION can be:\n"
-           "  6, 7, 8, 9, 95, 10, 103, 11, 12, 125, 128, 13, 14, 143, 15, 16, 165, 17, 18, 185, 19, or 20\n"
-           /* NEWHU: 20 */
-           "Report bugs to <" PACKAGE_BUGREPORT ">.\n", argv0);
-}
-
-static void
-free_globals(void) {
-    anmmap_free(g_anmmap);
-}
-
 int
-main(
-    int argc,
-    char* argv[])
+thanm_version_supported(
+    unsigned int version)
 {
-    g_anmmap = anmmap_new();
-    atexit(free_globals);
-
-    const char commands[] = "+:l:om:"
-#ifdef HAVE_LIBPNG
-                            "x:X:r:c:s:"
-#endif
-                            "Vfuv";
-    int command = -1;
-
-    FILE* in;
-    unsigned version = 0;
-
-    anm_archive_t* anm;
-#ifdef HAVE_LIBPNG
-    anm_entry_t* entry;
-    char* name;
-
-    FILE* anmfp;
-    FILE* symbolfp = NULL;
-    int i;
-#endif
-
-    argv0 = util_shortname(argv[0]);
-    int opt;
-    int ind = 0;
-    while(argv[util_optind]) {
-        switch(opt = util_getopt(argc,argv,commands)) {
-        case 'c':
-            if (option_print_offsets) {
-                fprintf(stderr, "%s: 'o' option can't be used when creating ANM archive\n", argv0);
-                exit(1);
-            }
-            /* fallthrough */
-        case 'l':
-        case 'x':
-        case 'X':
-        case 'r':
-            if(command != -1) {
-                fprintf(stderr,"%s: More than one mode specified\n",argv0);
-                print_usage();
-                exit(1);
-            }
-            command = opt;
-            version = parse_version(util_optarg);
-            break;
-        case 'm': {
-            FILE* map_file = NULL;
-            map_file = fopen(util_optarg, "r");
-            if (!map_file) {
-                fprintf(stderr, "%s: couldn't open %s for reading: %s\n",
-                    argv0, util_optarg, strerror(errno));
-            } else {
-                anmmap_load(g_anmmap, map_file, util_optarg);
-                fclose(map_file);
-            }
-            break;
-        }
-        case 's':
-            symbolfp = fopen(util_optarg, "w");
-            if (!symbolfp) {
-                fprintf(stderr, "%s: couldn't open %s for writing: %s\n",
-                    argv0, util_optarg, strerror(errno));
-            }
-            break;
-        case 'f':
-            option_force = 1;
-            break;
-        case 'u':
-            if (option_unique_filenames)
-                option_dont_add_offset_border = 1;
-            else
-                option_unique_filenames = 1;
-            break;
-        case 'v':
-            option_verbose++;
-            break;
-        case 'o':
-            if (command == 'c') {
-                fprintf(stderr, "%s: 'o' option can't be used when creating ANM archive\n", argv0);
-                exit(1);
-            }
-            option_print_offsets = 1;
-            break;
-        default:
-            util_getopt_default(&ind,argv,opt,print_usage);
-        }
-    }
-    argc = ind;
-    argv[argc] = NULL;
-
-    if (command == -1) {
-        print_usage();
-        exit(1);
-    }
-
     switch (version) {
     case 6:
     case 7:
@@ -2456,243 +2964,278 @@ main(
     case 19:
     case 20:
     /* NEWHU: 20 */
-        break;
+        return 1;
     default:
-        if (version == 0)
-            fprintf(stderr, "%s: version must be specified\n", argv0);
-        else
-            fprintf(stderr, "%s: version %u is unsupported\n", argv0, version);
-        exit(1);
+        return 0;
     }
+}
 
-    switch (command) {
-    case 'l':
-        if (argc != 1) {
-            print_usage();
-            exit(1);
-        }
-
-        current_input = argv[0];
-        in = fopen(argv[0], "rb");
-        if (!in) {
-            fprintf(stderr, "%s: couldn't open %s for reading\n", argv0, current_input);
-            exit(1);
-        }
-        anm = anm_read_file(in, version);
-        fclose(in);
-        anm_dump(stdout, anm, version, argv[0]);
+int
+thanm_list(
+    const thanm_context_t* ctx,
+    unsigned int version,
+    FILE* in,
+    FILE* out)
+{
+    anm_archive_t* anm = anm_read_file(in, version, ctx->input);
+    if (!anm)
+        return 0;
+    TRACE_BEGIN(t_dump);
+    anm_dump(ctx, out, anm, version);
+    TRACE_END(t_dump, "anm_dump", ctx->input);
+    anm_free(anm);
+    return 1;
+}
 
-        anm_free(anm);
-        exit(0);
 #ifdef HAVE_LIBPNG
-    case 'x':
-        if (argc < 1) {
-            print_usage();
-            exit(1);
-        }
+/* Reads an archive for the modes below, which stop on errors. */
+static anm_archive_t*
+anm_read_path(
+    const char* path,
+    unsigned int version)
+{
+    FILE* in;
+    anm_archive_t* anm;
 
-        current_input = argv[0];
-        in = fopen(argv[0], "rb");
-        if (!in) {
-            fprintf(stderr, "%s: couldn't open %s for reading\n", argv0, current_input);
-            exit(1);
-        }
-        anm = anm_read_file(in, version);
-        fclose(in);
+    current_input = path;
+    in = file_open_input(path, version);
+    if (!in) {
+        fprintf(stderr, "%s: couldn't open %s for reading\n", argv0, current_input);
+        exit(1);
+    }
+    anm = anm_read_file(in, version, path);
+    file_close(in);
+    if (!anm)
+        exit(1);
+    return anm;
+}
+
+int
+thanm_extract(
+    unsigned int version,
+    int argc,
+    char* argv[])
+{
+    anm_archive_t* anm = anm_read_path(argv[0], version);
+    anm_entry_t* entry;
 
-        if (!option_unique_filenames)
-            anm_build_name_lists(anm);
+    if (!option_unique_filenames)
+        anm_build_name_lists(anm);
+
+    if (option_incremental)
+        g_incremental = incremental_open(THANM_INCREMENTAL_INDEX);
 
-        if (argc == 1) {
-            /* Extract all files. */
+    if (argc == 1) {
+        /* Extract all files. */
+        anm_extract_task_t* tasks = NULL;
+        size_t task_count = 0, task_capacity = 0;
+        anm_extract_plan(anm, argv[0], version, &tasks, &task_count, &task_capacity);
+        anm_extract_run(tasks, task_count, version);
+        free(tasks);
+    } else {
+        /* Extract all listed files. */
+        for (int i = 1; i < argc; ++i) {
             int j = 0;
             list_for_each(&anm->entries, entry) {
                 if (!entry->processed) {
-                    char *filename = 0;
-                    current_output = entry->name;
-                    if (option_verbose >= 1)
-                        fprintf(stderr, "%s\n", entry->name);
-                    if (option_unique_filenames)
-                        filename = anm_make_unique_filename(entry->name, argv[0], j);
-                    anm_extract(entry, filename ? filename : entry->name, version);
-                    free(filename);
-                }
-                j++;
-            }
-        } else {
-            /* Extract all listed files. */
-            for (i = 1; i < argc; ++i) {
-                int j = 0;
-                list_for_each(&anm->entries, entry) {
-                    if (!entry->processed) {
-                        if (strcmp(argv[i], entry->name) == 0) {
-                            char *filename = 0;
-                            current_output = entry->name;
-                            if (option_verbose >= 1)
-                                fprintf(stderr, "%s\n", entry->name);
-                            if (option_unique_filenames)
-                                filename = anm_make_unique_filename(entry->name, argv[0], j);
-                            anm_extract(entry, filename ? filename : entry->name, version);
-                            free(filename);
-                            /* unfortunately we can't just skip to next argv, because of possible duplicates */
-                        }
+                    if (strcmp(argv[i], entry->name) == 0) {
+                        char *filename = 0;
+                        current_output = entry->name;
+                        if (option_verbose >= 1)
+                            fprintf(stderr, "%s\n", entry->name);
+                        if (option_unique_filenames)
+                            filename = anm_make_unique_filename(entry->name, argv[0], j);
+                        anm_extract_claim(entry, version);
+                        anm_extract(entry, filename ? filename : entry->name, version, NULL);
+                        free(filename);
+                        /* unfortunately we can't just skip to next argv, because of possible duplicates */
                     }
-                    j++;
                 }
-                fprintf(stderr, "%s:%s: %s not found in archive\n",
-                    argv0, current_input, argv[i]);
+                j++;
             }
+            fprintf(stderr, "%s:%s: %s not found in archive\n",
+                argv0, current_input, argv[i]);
         }
+    }
 
-        anm_free(anm);
-        exit(0);
-    case 'X': {
-        list_t anms;
-        list_init(&anms);
-
-        if (argc < 1) {
-            print_usage();
-            exit(1);
-        }
+    anm_free(anm);
+    if (g_incremental && !incremental_close(g_incremental, stdout))
+        return 1;
+    return 0;
+}
 
-        for (i = 0; i < argc; ++i) {
-            current_input = argv[i];
-            in = fopen(argv[i], "rb");
-            if (!in) {
-                fprintf(stderr, "%s: couldn't open %s for reading\n", argv0, current_input);
-                exit(1);
-            }
-            anm = anm_read_file(in, version);
-            list_append_new(&anms, anm);
-            fclose(in);
-        }
+int
+thanm_extract_multiple(
+    unsigned int version,
+    int argc,
+    char* argv[])
+{
+    list_t anms;
+    anm_archive_t* anm;
+    int i;
 
-        anm_build_name_lists_multiple(&anms);
+    list_init(&anms);
+    for (i = 0; i < argc; ++i)
+        list_append_new(&anms, anm_read_path(argv[i], version));
 
-        i = 0;
-        list_for_each(&anms, anm) {
-            int j = 0;
-            list_for_each(&anm->entries, entry) {
-                if (!entry->processed) {
-                    char *filename = 0;
-                    current_output = entry->name;
-                    if (option_verbose >= 1)
-                        fprintf(stderr, "%s\n", entry->name);
-                    if (option_unique_filenames)
-                        filename = anm_make_unique_filename(entry->name, argv[i], j);
-                    anm_extract(entry, filename ? filename : entry->name, version);
-                    free(filename);
-                }
-                j++;
-            }
-            i++;
-        }
+    anm_build_name_lists_multiple(&anms);
 
-        list_for_each(&anms, anm)
-            anm_free(anm);
-        list_free_nodes(&anms);
-        exit(0);
-    }
-    case 'r':
-        if (argc != 3) {
-            print_usage();
-            exit(1);
-        }
+    if (option_incremental)
+        g_incremental = incremental_open(THANM_INCREMENTAL_INDEX);
 
-        if (TH19_OR_NEWER(version)) {
-            /* NEWHU: 20 */ /* FIXME: */
-            fprintf(stderr, "%s: -r doesn't work with th19+\n", argv0);
-            exit(1);
-        }
+    anm_extract_task_t* tasks = NULL;
+    size_t task_count = 0, task_capacity = 0;
+    i = 0;
+    list_for_each(&anms, anm)
+        anm_extract_plan(anm, argv[i++], version, &tasks, &task_count, &task_capacity);
+    anm_extract_run(tasks, task_count, version);
+    free(tasks);
 
-        current_output = argv[2];
-        current_input = argv[0];
-        in = fopen(argv[0], "rb");
-        if (!in) {
-            fprintf(stderr, "%s: couldn't open %s for reading\n", argv0, current_input);
-            exit(1);
-        }
-        anm = anm_read_file(in, version);
-        fclose(in);
-
-        anmfp = fopen(argv[0], "rb+");
-        if (!anmfp) {
-            fprintf(stderr, "%s: couldn't open %s for writing: %s\n",
-                argv0, current_input, strerror(errno));
-            exit(1);
-        }
+    list_for_each(&anms, anm)
+        anm_free(anm);
+    list_free_nodes(&anms);
+    if (g_incremental && !incremental_close(g_incremental, stdout))
+        return 1;
+    return 0;
+}
 
-        anm_build_name_lists(anm);
-        list_for_each(&anm->names, name) {
-            if (strcmp(argv[1], name) == 0) {
-                anm_replace(anm, anmfp, util_entry_by_name(anm, name), argv[2], version);
-                goto replace_done;
-            }
-        }
+int
+thanm_replace(
+    unsigned int version,
+    int argc,
+    char* argv[])
+{
+    anm_archive_t* anm;
+    anm_entry_t* entry;
+    FILE* anmfp;
 
-        fprintf(stderr, "%s:%s: %s not found in archive\n",
-            argv0, current_input, argv[1]);
+    if (TH19_OR_NEWER(version)) {
+        /* NEWHU: 20 */ /* FIXME: */
+        fprintf(stderr, "%s: -r doesn't work with th19+\n", argv0);
+        return 1;
+    }
 
-replace_done:
+    current_output = argv[2];
+    anm = anm_read_path(argv[0], version);
+
+    anmfp = fopen(argv[0], "rb+");
+    if (!anmfp) {
+        fprintf(stderr, "%s: couldn't open %s for writing: %s\n",
+            argv0, current_input, strerror(errno));
+        exit(1);
+    }
 
-        fclose(anmfp);
+    /* Only the named entries are replaced, all in one go. */
+    anm_name_index_t index = { NULL, 0, 0 };
+    list_for_each(&anm->entries, entry) {
+        anm_name_index_link(&index, entry);
+        entry->processed = 1;
+    }
+    for (int i = 1; i < argc; i += 2) {
+        anm_name_slot_t* slot = anm_name_index_probe(&index, argv[i]);
+        if (!slot->name) {
+            fprintf(stderr, "%s:%s: %s not found in archive\n",
+                argv0, current_input, argv[i]);
+            continue;
+        }
+        for (entry = slot->first; entry; entry = entry->next_by_name) {
+            entry->filename = arena_strdup(&anm->arena, argv[i + 1]);
+            entry->processed = 0;
+        }
+    }
+    free(index.slots);
+    anm_replace_all(anm, anmfp, version, NULL);
+
+    fclose(anmfp);
 
 #if 0
-        offset = 0;
-        list_for_each(&anm->entries, entry) {
-            unsigned int nextoffset = entry->header->nextoffset;
-            if (strcmp(argv[1], entry->name) == 0 && entry->header->hasdata) {
-                if (!file_seek(anmfp,
-                    offset + entry->header->thtxoffset + 4 + sizeof(thtx_header_t)))
-                    exit(1);
-                if (!file_write(anmfp, entry->data, entry->thtx->size))
-                    exit(1);
-            }
-            offset += nextoffset;
+    offset = 0;
+    list_for_each(&anm->entries, entry) {
+        unsigned int nextoffset = entry->header->nextoffset;
+        if (strcmp(argv[1], entry->name) == 0 && entry->header->hasdata) {
+            if (!file_seek(anmfp,
+                offset + entry->header->thtxoffset + 4 + sizeof(thtx_header_t)))
+                exit(1);
+            if (!file_write(anmfp, entry->data, entry->thtx->size))
+                exit(1);
         }
+        offset += nextoffset;
+    }
 #endif
 
-        anm_free(anm);
-        exit(0);
-    case 'c':
-        if (argc != 2) {
-            print_usage();
-            exit(1);
-        }
-        current_input = argv[1];
-        anm = anm_create(argv[1], symbolfp, version);
+    anm_free(anm);
+    return 0;
+}
+
+int
+thanm_create(
+    unsigned int version,
+    const char* archive,
+    char* spec,
+    FILE* symbolfp)
+{
+    anm_archive_t* anm;
+    anm_entry_t* entry;
+    FILE* in;
 
-        if (symbolfp)
-            fclose(symbolfp);
+    current_input = spec;
+    anm = anm_create(spec, symbolfp, version);
 
-        if (anm == NULL)
-            exit(0);
+    if (symbolfp)
+        fclose(symbolfp);
 
-        anm_defaults(anm, version);
+    if (anm == NULL)
+        return 0;
 
-        /* Allocate enough space for the THTX data. */
-        if (!option_unique_filenames)
-            anm_build_name_lists(anm);
-        list_for_each(&anm->entries, entry) {
-            if (entry->header->hasdata && !entry->data) {
-                /* XXX: There are a few entries with a thtx.size greater than
-                 *      w*h*Bpp.  The extra data appears to be all zeroes. */
-                entry->data = calloc(1, entry->thtx->size);
-            }
-        }
-        list_for_each(&anm->entries, entry) {
-            if (!entry->processed)
-                anm_replace(anm, NULL, entry, entry->filename ? entry->filename : entry->name, version);
-        }
+    anm_defaults(anm, version);
 
-        current_output = argv[0];
-        anm_write(anm, argv[0], version);
+    /* Allocate enough space for the THTX data. */
+    if (!option_unique_filenames)
+        anm_build_name_lists(anm);
+    list_for_each(&anm->entries, entry) {
+        if (entry->header->hasdata && !entry->data) {
+            /* XXX: There are a few entries with a thtx.size greater than
+             *      w*h*Bpp.  The extra data appears to be all zeroes. */
+            entry->data = calloc(1, entry->thtx->size);
+        }
+    }
 
-        anm_free(anm);
-        exit(0);
-#endif
-    default:
-        print_usage();
-        exit(1);
+    anm_archive_t* base = NULL;
+    if (option_incremental) {
+        /* The index is kept next to the archive, because it describes
+         * how the archive was built. */
+        char* index_path = malloc(strlen(archive) + sizeof(THANM_INCREMENTAL_INDEX));
+        strcpy(index_path, archive);
+        strcat(index_path, THANM_INCREMENTAL_INDEX);
+        g_incremental = incremental_open(index_path);
+        free(index_path);
+
+        /* Textures are only taken from an archive that is still the
+         * way the last run wrote it. */
+        if (incremental_unchanged(g_incremental, archive, version, NULL, 0) &&
+                (in = file_open_input(archive, version))) {
+            current_input = archive;
+            base = anm_read_file(in, version, archive);
+            file_close(in);
+            current_input = spec;
+            if (base && !option_unique_filenames)
+                anm_build_name_lists(base);
+        }
+    }
+    anm_replace_all(anm, NULL, version, base);
+    /* The archive is about to be overwritten. */
+    if (base)
+        anm_free(base);
+
+    current_output = archive;
+    anm_write(anm, archive, version);
+
+    anm_free(anm);
+    if (g_incremental) {
+        incremental_written(g_incremental, archive, version);
+        if (!incremental_close(g_incremental, NULL))
+            return 1;
     }
+    return 0;
 }
+#endif
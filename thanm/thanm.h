@@ -31,13 +31,20 @@
 
 #include <config.h>
 #include <anm_types.h>
+#include "anmlist.h"
 #include "anmmap.h"
 #include "value.h"
+#include "arena.h"
 #include "list.h"
 #include "path.h"
 
 extern anmmap_t* g_anmmap;
 extern unsigned int option_force;
+extern unsigned int option_print_offsets;
+extern unsigned int option_unique_filenames;
+extern unsigned int option_dont_add_offset_border;
+extern unsigned int option_verbose;
+extern int option_incremental;
 
 const char *anm_find_format(unsigned version, unsigned header_version, int id);
 
@@ -45,12 +52,19 @@ typedef struct {
     /* The id in the offset struct may not be the real index. */
     int32_t real_index;
     anm_offset_t* offset;
+    /* The arrays below are allocated from this arena. */
+    arena_t* arena;
     /* instrs of thanm_instr_t format */
-    list_t instrs;
-    /* instrs of anm_instr_t format */
-    list_t raw_instrs;
-    /* list of label_t */
-    list_t labels;
+    struct thanm_instr_t* instrs;
+    size_t instr_count;
+    size_t instr_capacity;
+    /* instrs of anm_instr_t format, one for each of instrs */
+    anm_instr_t** raw_instrs;
+    size_t raw_instr_count;
+    /* Hash table of label_t by name, see label_find. */
+    struct label_t** label_slots;
+    size_t label_slot_count;
+    size_t label_count;
     /* list of var_t */
     list_t vars;
     /* TH095 front.anm has no sentinel instruction in script18. This flag
@@ -58,7 +72,7 @@ typedef struct {
     int no_sentinel;
 } anm_script_t;
 
-anm_script_t* anm_script_new(void);
+anm_script_t* anm_script_new(arena_t* arena);
 
 typedef struct {
     uint16_t type;
@@ -87,6 +101,10 @@ typedef struct {
     unsigned char* map;
     long map_size;
 
+    /* Holds the entries, their names, scripts and instructions, and the
+     * lists of them.  Only the entry data is allocated separately. */
+    arena_t arena;
+
     /* List of const char*. */
     list_t names;
     /* List of anm_entry_t*. */
@@ -99,7 +117,7 @@ enum {
     THANM_INSTR_LABEL
 };
 
-typedef struct {
+typedef struct thanm_instr_t {
     int type;
     uint16_t id;
     uint16_t param_mask;
@@ -107,9 +125,14 @@ typedef struct {
     uint32_t offset;
     uint32_t address;
     uint32_t size;
-    list_t params;
+    struct thanm_param_t* params;
+    size_t param_count;
 } thanm_instr_t;
 
+/* Appends a zeroed instruction to script.  The pointer is valid until the
+ * next instruction is added. */
+thanm_instr_t* anm_script_add_instr(anm_script_t* script);
+
 uint32_t instr_get_size(thanm_instr_t* instr, int32_t version);
 
 typedef struct expr_t expr_t;
@@ -136,6 +159,8 @@ typedef struct parser_state_t {
     uint32_t sprite_id;
     int32_t script_id;
     int32_t script_real_index;
+    /* Arena of the archive being built. */
+    arena_t* arena;
     /* List of anm_entry_t */
     list_t entries;
     anm_entry_t* current_entry;
@@ -164,7 +189,9 @@ typedef struct label_t {
     char* name;
 } label_t;
 
-label_t* label_find(anm_script_t* script, char* name);
+label_t* label_find(anm_script_t* script, const char* name);
+/* Adds a label to script, which takes over name. */
+void label_add(anm_script_t* script, char* name, uint32_t offset, int16_t time);
 
 typedef struct global_t {
     char* name;
@@ -202,16 +229,36 @@ typedef struct png_IHDR_t {
 } png_IHDR_t;
 PACK_END;
 
-var_t* var_new(char* name, int type);
+var_t* var_new(arena_t* arena, char* name, int type);
 
-void var_free(var_t* var);
-
-thanm_instr_t* thanm_instr_new(void);
-thanm_instr_t* instr_new(parser_state_t* state, uint16_t id, list_t* params);
+/* Appends an instruction to the current script, and frees params. */
+void instr_new(parser_state_t* state, uint16_t id, list_t* params);
 
 #define DEFAULTVAL 0xffff
 
 extern FILE* thanm_yyin;
 extern int thanm_yyparse(parser_state_t*);
 
+#ifdef HAVE_LIBPNG
+/* The other modes of thanm, which return the exit status of the tool.  They
+ * use the global options, and exit on fatal errors. */
+int thanm_extract(
+    unsigned int version,
+    int argc,
+    char* argv[]);
+int thanm_extract_multiple(
+    unsigned int version,
+    int argc,
+    char* argv[]);
+int thanm_replace(
+    unsigned int version,
+    int argc,
+    char* argv[]);
+int thanm_create(
+    unsigned int version,
+    const char* archive,
+    char* spec,
+    FILE* symbolfp);
+#endif
+
 #endif
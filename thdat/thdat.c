@@ -31,30 +31,55 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <thtk/thtk.h>
+#include "incremental.h"
 #include "program.h"
+#include "tar.h"
+#include "trace.h"
 #include "util.h"
 #include "mygetopt.h"
 
 static const char *dat_chdir = NULL;
+static int dat_multiple = 0;
+static int dat_emit_manifest = 0;
+static int dat_diff = 0;
+static const char* dat_tar = NULL;
+static int dat_incremental = 0;
+
+/* Kept in the output directory by --incremental. */
+#define THDAT_INCREMENTAL_INDEX ".thdat-index"
 
 static void
 print_usage(
     void)
 {
-    printf("Usage: %s [-Vg] [-C DIR] [[-c | -l | -x] VERSION] [ARCHIVE [FILE...]]\n"
+    printf("Usage: %s [-Vgm] [-C DIR] [[-c | -l | -x | -v] VERSION] [ARCHIVE [FILE...]]\n"
+           "       %s --diff [VERSION] ARCHIVE1 ARCHIVE2\n"
            "Options:\n"
-           "  -c  create an archive\n"
-           "  -l  list the contents of an archive\n"
+           "  -c  create an archive, from a tar stream on stdin if FILE is -\n"
+           "  -l  list the contents of one or more archives\n"
            "  -x  extract an archive\n"
+           "  -v  check that every entry of ARCHIVE decodes, and compare the hashes\n"
+           "      with a manifest if one is given as FILE\n"
+           "  -d  detect the format of one or more archives\n"
            "  -V  display version information and exit\n"
            "  -g  enable glob matching for -x filenames\n"
+           "  -m  extract every ARCHIVE given to -x into a directory named after it\n"
            "  -C  change directory after opening the archive\n"
+           "  --trace FILE  write a Chrome trace-event JSON file (for Perfetto)\n"
+           "  --emit-manifest  with -v, write a manifest to FILE (or stdout)\n"
+           "                   instead of checking against one\n"
+           "  --diff  list the entries added, removed or changed between two archives\n"
+           "  --tar FILE  with -x, write all entries to a tar file, or to stdout for -\n"
+           "  --incremental  with -x, leave files that already hold the extracted\n"
+           "                 content alone, and remember them in " THDAT_INCREMENTAL_INDEX "\n"
            "VERSION can be:\n"
            "  1, 2, 3, 4, 5, 6, 7, 75, 8, 9, 95, 10, 103 (for Uwabami Breakers), 105, 11, 12, 123, 125, 128, 13, 14, 143, 15, 16, 165, 17, 18, 185, 19, or 20\n"
            /* NEWHU: 20 */
-       "Specify 'd' as VERSION to automatically detect archive format. (-l and -x only)\n\n"
-           "Report bugs to <" PACKAGE_BUGREPORT ">.\n", argv0);
+       "Specify 'd' as VERSION to automatically detect archive format. (-l, -x, -v and --diff only)\n\n"
+           "Report bugs to <" PACKAGE_BUGREPORT ">.\n", argv0, argv0);
 }
 
 static void
@@ -98,6 +123,7 @@ thdat_open_file(
     thtk_error_t** error)
 {
     thdat_state_t* state = thdat_state_alloc();
+    TRACE_BEGIN(t);
 
     if (!(state->stream = thtk_io_open_file(path, "rb", error))) {
         thdat_state_free(state);
@@ -109,29 +135,103 @@ thdat_open_file(
         return NULL;
     }
 
+    TRACE_END(t, "thdat_open", path);
     return state;
 }
 
+/* Decodes an entry into memory, and only writes it to path if the file
+ * there doesn't already hold the same data. */
+static int
+thdat_extract_changed(
+    thdat_state_t* state,
+    size_t entry_index,
+    const char* path,
+    incremental_t* inc,
+    thtk_error_t** error)
+{
+    thtk_io_t* memory;
+    thtk_io_t* file;
+    unsigned char* data = NULL;
+    off_t size;
+    int ret = 0;
+
+    if (!(memory = thtk_io_open_growing_memory(error)))
+        return 0;
+    if (thdat_entry_read_data(state->thdat, entry_index, memory, error) == -1 ||
+        (size = thtk_io_seek(memory, 0, SEEK_END, error)) == -1)
+        goto out;
+
+    /* Empty entries have nothing to map. */
+    if (size && !(data = thtk_io_map(memory, 0, size, error)))
+        goto out;
+    uint64_t hash = thtk_xxh64(data, size, 0);
+    if (incremental_unchanged(inc, path, hash, data, size)) {
+        ret = 1;
+        goto out;
+    }
+
+    if (!(file = thtk_io_open_file(path, "wb", error)))
+        goto out;
+    if (size && thtk_io_write(file, data, size, error) == -1) {
+        thtk_io_close(file);
+        goto out;
+    }
+    if (!thtk_io_close(file)) {
+        thtk_error_new(error, "couldn't write %s", path);
+        goto out;
+    }
+    incremental_written(inc, path, hash);
+    printf("%s\n", path);
+    ret = 1;
+out:
+    if (data)
+        thtk_io_unmap(memory, data);
+    thtk_io_close(memory);
+    return ret;
+}
+
+/* Extracts an entry into outdir, or into the current directory if outdir is
+ * NULL.  With inc, files that are already up to date are skipped. */
 static int
 thdat_extract_file(
     thdat_state_t* state,
     size_t entry_index,
+    const char* outdir,
+    incremental_t* inc,
     thtk_error_t** error)
 {
     const char* entry_name;
+    char* path = NULL;
     thtk_io_t* entry_stream;
+    TRACE_BEGIN(t);
 
     if (!(entry_name = thdat_entry_get_name(state->thdat, entry_index, error)))
         return 0;
 
+    if (outdir) {
+        path = malloc(strlen(outdir) + strlen(entry_name) + 2);
+        sprintf(path, "%s/%s", outdir, entry_name);
+        entry_name = path;
+    }
+
     // For th105: Make sure that the directory exists
     util_makepath(entry_name);
 
-    if (!(entry_stream = thtk_io_open_file(entry_name, "wb", error)))
+    if (inc) {
+        int ret = thdat_extract_changed(state, entry_index, entry_name, inc, error);
+        TRACE_END(t, "extract_entry", entry_name);
+        free(path);
+        return ret;
+    }
+
+    if (!(entry_stream = thtk_io_open_file(entry_name, "wb", error))) {
+        free(path);
         return 0;
+    }
 
     if (thdat_entry_read_data(state->thdat, entry_index, entry_stream, error) == -1) {
         thtk_io_close(entry_stream);
+        free(path);
         return 0;
     }
 
@@ -139,19 +239,79 @@ thdat_extract_file(
 
     thtk_io_close(entry_stream);
 
+    TRACE_END(t, "extract_entry", entry_name);
+    free(path);
     return 1;
 }
 
+typedef struct {
+    FILE* stream;
+    uint64_t mtime;
+} thdat_tar_sink_t;
+
 static int
-thdat_list(
-    unsigned int version,
+thdat_tar_write_entry(
+    void* user,
+    thdat_t* thdat,
+    int entry_index,
+    const void* data,
+    size_t size,
+    thtk_error_t** error)
+{
+    thdat_tar_sink_t* sink = user;
+    const char* name = thdat_entry_get_name(thdat, entry_index, error);
+    TRACE_BEGIN(t);
+
+    if (!name)
+        return 0;
+    if (!tar_write_file(sink->stream, name, data, size, sink->mtime)) {
+        thtk_error_new(error, "couldn't write %s to the tar stream", name);
+        return 0;
+    }
+
+    TRACE_END(t, "tar_entry", name);
+    return 1;
+}
+
+/* Writes every entry to a tar stream at path, or to stdout if path is "-".
+ * Entries are decoded in parallel and written in the order of the
+ * archive. */
+static int
+thdat_extract_tar(
+    thdat_state_t* state,
     const char* path,
     thtk_error_t** error)
 {
-    thdat_state_t* state = thdat_open_file(version, path, error);
-    if(!state) {
+    thdat_tar_sink_t sink;
+    int ret;
+
+    if (!strcmp(path, "-")) {
+#ifdef _WIN32
+        (void)_setmode(fileno(stdout), _O_BINARY);
+#endif
+        sink.stream = stdout;
+    } else if (!(sink.stream = fopen(path, "wb"))) {
+        thtk_error_new(error, "couldn't open %s for writing: %s", path, strerror(errno));
         return 0;
     }
+    sink.mtime = time(NULL);
+
+    ret = thdat_extract_all(state->thdat, 1, thdat_tar_write_entry, &sink, error) &&
+        tar_write_end(sink.stream);
+
+    if (sink.stream != stdout && fclose(sink.stream)) {
+        if (ret)
+            thtk_error_new(error, "couldn't write %s: %s", path, strerror(errno));
+        ret = 0;
+    }
+    return ret;
+}
+
+static int
+thdat_list(
+    thdat_state_t* state,
+    thtk_error_t** error)
+{
     ssize_t entry_count;
     struct {
         const char* name;
@@ -162,10 +322,8 @@ thdat_list(
     int name_width = 4;
     int all_uncompressed = 1;
 
-    if ((entry_count = thdat_entry_count(state->thdat, error)) == -1) {
-        thdat_state_free(state);
+    if ((entry_count = thdat_entry_count(state->thdat, error)) == -1)
         return 0;
-    }
 
     entries = malloc(entry_count * sizeof(*entries));
 
@@ -204,7 +362,6 @@ thdat_list(
     }
 
     free(entries);
-    thdat_state_free(state);
 
     return 1;
 }
@@ -222,8 +379,9 @@ thdat_create_wrapper(
     char** realpaths;
     int* entries_count = calloc(entry_count, sizeof(int));
     size_t real_entry_count = 0;
+    TRACE_BEGIN(t_scan);
 
-    if (!(state->stream = thtk_io_open_file(path, "wb", error))) {
+    if (!(state->stream = thtk_io_open_file(path, "w+b", error))) {
         thdat_state_free(state);
         exit(1);
     }
@@ -253,6 +411,7 @@ thdat_create_wrapper(
     }
 
     // Set entry names first...
+    int ret = 1;
     realpaths = calloc(real_entry_count, sizeof(char*));
     size_t k = 0;
     for (size_t i = 0; i < entry_count; ++i) {
@@ -261,6 +420,8 @@ thdat_create_wrapper(
             if (!thdat_entry_set_name(state->thdat, k, entries[i][j], &error)) {
                 print_error(error);
                 thtk_error_free(&error);
+                free(entries[i][j]);
+                ret = 0;
                 continue;
             }
             realpaths[k] = malloc(strlen(entries[i][j])+1);
@@ -272,21 +433,40 @@ thdat_create_wrapper(
     }
     free(entries);
     free(entries_count);
+
+    TRACE_END(t_scan, "scan_files", path);
+
+    // The uncompressed size is a good enough estimate of the archive size.
+    off_t total_size = 0;
+    for (size_t i = 0; i < k; ++i) {
+        struct stat st;
+        if (stat(realpaths[i], &st) == 0) {
+            total_size += st.st_size;
+            thdat_entry_expect_size(state->thdat, i, st.st_size, NULL);
+        }
+    }
+    if (!thtk_io_preallocate(state->stream, total_size, error)) {
+        print_error(*error);
+        thtk_error_free(error);
+    }
+
     // ...and then module->create, if this is th105 archive.
     // This is because the list of entries comes first in th105 archives.
+    TRACE_BEGIN(t_init);
     if (!thdat_init(state->thdat, error)) {
         thdat_state_free(state);
         exit(1);
     }
+    TRACE_END(t_init, "thdat_init", path);
 
     k = 0;
-    /* TODO: Properly indicate when insertion fails. */
     ssize_t i;
 #pragma omp parallel for schedule(dynamic)
     for (i = 0; i < real_entry_count; ++i) {
         thtk_error_t* error = NULL;
         thtk_io_t* entry_stream;
         off_t entry_size;
+        TRACE_BEGIN(t);
 
         printf("%s...\n", thdat_entry_get_name(state->thdat, i, &error));
 
@@ -294,42 +474,965 @@ thdat_create_wrapper(
         if (!(thdat_entry_get_name(state->thdat, i, &error))[0])
             continue;
 
-        if (!(entry_stream = thtk_io_open_file(realpaths[i], "rb", &error))) {
+        if (!(entry_stream = thtk_io_open_file(realpaths[i], "rb", &error)) ||
+            (entry_size = thtk_io_seek(entry_stream, 0, SEEK_END, &error)) == -1 ||
+            thtk_io_seek(entry_stream, 0, SEEK_SET, &error) == -1 ||
+            thdat_entry_write_data(state->thdat, i, entry_stream, entry_size, &error) == -1) {
             print_error(error);
             thtk_error_free(&error);
-            continue;
+#pragma omp atomic write
+            ret = 0;
         }
 
-        if ((entry_size = thtk_io_seek(entry_stream, 0, SEEK_END, &error)) == -1) {
+        if (entry_stream)
+            thtk_io_close(entry_stream);
+        TRACE_END(t, "write_entry", realpaths[i]);
+        free(realpaths[i]);
+    }
+    free(realpaths);
+
+    TRACE_BEGIN(t_close);
+    if (!thdat_close(state->thdat, error)) {
+        thdat_state_free(state);
+        return 0;
+    }
+    TRACE_END(t_close, "thdat_close", path);
+
+    thdat_state_free(state);
+    if (!ret)
+        thtk_error_new(error, "some entries could not be added");
+    return ret;
+}
+
+/* Bytes of a tar stream that are read ahead while the previous batch of
+ * entries is being compressed. */
+#define THDAT_STREAM_BATCH (64 << 20)
+
+typedef struct {
+    char* name;
+    /* NULL if the data has been spooled to a temporary file. */
+    unsigned char* data;
+    size_t size;
+    /* Set once the entry has been added, -1 if it was rejected. */
+    ssize_t entry_index;
+} thdat_pending_t;
+
+/* Copies the data of the current tar entry to the end of a temporary file.
+ * Returns 0 on error. */
+static int
+thdat_spool_data(
+    tar_reader_t* reader,
+    FILE* spool,
+    uint64_t size)
+{
+    unsigned char buffer[1 << 16];
+    while (size) {
+        const size_t chunk = size < sizeof(buffer) ? size : sizeof(buffer);
+        if (!tar_read_data(reader, buffer, chunk))
+            return 0;
+        if (fwrite(buffer, 1, chunk, spool) != chunk) {
+            fprintf(stderr, "%s: error writing temporary file: %s\n", argv0, strerror(errno));
+            return 0;
+        }
+        size -= chunk;
+    }
+    return 1;
+}
+
+/* Writes an entry from a buffer, which is freed.  Returns 0 on error. */
+static int
+thdat_write_buffer(
+    thdat_t* thdat,
+    ssize_t entry_index,
+    unsigned char* data,
+    size_t size)
+{
+    thtk_error_t* error = NULL;
+    thtk_io_t* entry_stream;
+    const char* name = thdat_entry_get_name(thdat, entry_index, NULL);
+    TRACE_BEGIN(t);
+
+    printf("%s...\n", name);
+
+    if (!(entry_stream = thtk_io_open_memory(data, size, &error))) {
+        free(data);
+        print_error(error);
+        thtk_error_free(&error);
+        return 0;
+    }
+
+    if (thdat_entry_write_data(thdat, entry_index, entry_stream, size, &error) == -1) {
+        thtk_io_close(entry_stream);
+        print_error(error);
+        thtk_error_free(&error);
+        return 0;
+    }
+
+    thtk_io_close(entry_stream);
+    TRACE_END(t, "write_entry", name);
+    return 1;
+}
+
+/* Adds an entry to the archive, and returns its index or -1 if the name was
+ * rejected, in which case the data is freed. */
+static ssize_t
+thdat_append_pending(
+    thdat_t* thdat,
+    thdat_pending_t* pending)
+{
+    thtk_error_t* error = NULL;
+    ssize_t entry_index = thdat_entry_append(thdat, pending->name, &error);
+    if (entry_index == -1) {
+        print_error(error);
+        thtk_error_free(&error);
+        free(pending->data);
+    }
+    free(pending->name);
+    return entry_index;
+}
+
+/* Creates an archive from the regular files of a tar stream.  Entries are
+ * compressed in batches while the next batch is read, unless the format
+ * needs every name before it can write any data.  In that case the data is
+ * spooled to a temporary file until the end of the stream, and read back in
+ * batches afterwards. */
+static int
+thdat_create_stream(
+    unsigned int version,
+    const char* path,
+    FILE* input,
+    thtk_error_t** error)
+{
+    thdat_state_t* state = thdat_state_alloc();
+    thdat_pending_t* pending = NULL;
+    size_t pending_count = 0;
+    size_t pending_capacity = 0;
+    size_t pending_bytes = 0;
+    FILE* spool = NULL;
+    tar_reader_t reader;
+    int ret = 1;
+
+    if (!(state->stream = thtk_io_open_file(path, "w+b", error))) {
+        thdat_state_free(state);
+        return 0;
+    }
+
+    if (!(state->thdat = thdat_create(version, state->stream, 0, error))) {
+        thdat_state_free(state);
+        return 0;
+    }
+
+    thdat_t* thdat = state->thdat;
+    const int list_first = thdat_entry_list_first(thdat);
+    if (list_first && !(spool = tmpfile())) {
+        thtk_error_new(error, "couldn't create a temporary file: %s", strerror(errno));
+        thdat_state_free(state);
+        return 0;
+    }
+    tar_reader_init(&reader, input);
+
+#pragma omp parallel
+#pragma omp single
+    {
+        int done = 0;
+        while (!done) {
+            tar_entry_t entry;
+            TRACE_BEGIN(t);
+            const int header = tar_read_header(&reader, &entry);
+            if (header != 1) {
+                if (header == -1)
+                    ret = 0;
+                done = 1;
+            } else if (entry.type != '0' && entry.type != '7') {
+                free(entry.name);
+                continue;
+            } else {
+                thdat_pending_t* p;
+                const char* name = entry.name;
+                while (name[0] == '.' && name[1] == '/')
+                    name += 2;
+
+                if (util_vec_ensure(&pending, &pending_capacity, pending_count + 1, sizeof(*pending))) {
+                    fprintf(stderr, "%s: out of memory\n", argv0);
+                    free(entry.name);
+                    ret = 0;
+                    done = 1;
+                    continue;
+                }
+                p = &pending[pending_count];
+                p->name = strcpy(malloc(strlen(name) + 1), name);
+                p->size = entry.size;
+                p->data = NULL;
+                free(entry.name);
+                int read;
+                if (p->size != entry.size) {
+                    fprintf(stderr, "%s: %s is too large\n", argv0, p->name);
+                    read = 0;
+                } else if (spool) {
+                    read = thdat_spool_data(&reader, spool, p->size);
+                } else if (!(p->data = malloc(p->size ? p->size : 1))) {
+                    fprintf(stderr, "%s: out of memory\n", argv0);
+                    read = 0;
+                } else {
+                    read = tar_read_data(&reader, p->data, p->size);
+                }
+                if (!read) {
+                    free(p->name);
+                    free(p->data);
+                    ret = 0;
+                    done = 1;
+                } else {
+                    TRACE_END(t, "read_entry", p->name);
+                    ++pending_count;
+                    pending_bytes += p->size;
+                }
+            }
+
+            if (list_first || !pending_count || (!done && pending_bytes < THDAT_STREAM_BATCH))
+                continue;
+
+            /* The entry list can't grow while any entry is being written,
+             * so the whole batch is added before its data. */
+#pragma omp taskwait
+            for (size_t i = 0; i < pending_count; ++i) {
+                pending[i].entry_index = thdat_append_pending(thdat, &pending[i]);
+                if (pending[i].entry_index != -1)
+                    thdat_entry_expect_size(thdat, pending[i].entry_index, pending[i].size, NULL);
+            }
+            for (size_t i = 0; i < pending_count; ++i) {
+                const ssize_t entry_index = pending[i].entry_index;
+                if (entry_index == -1)
+                    continue;
+                unsigned char* data = pending[i].data;
+                const size_t size = pending[i].size;
+#pragma omp task firstprivate(entry_index, data, size)
+                if (!thdat_write_buffer(thdat, entry_index, data, size)) {
+#pragma omp atomic write
+                    ret = 0;
+                }
+            }
+            pending_count = 0;
+            pending_bytes = 0;
+        }
+    }
+
+    tar_reader_free(&reader);
+
+    if (list_first) {
+        ssize_t* indices = malloc((pending_count ? pending_count : 1) * sizeof(*indices));
+        for (size_t i = 0; i < pending_count; ++i) {
+            indices[i] = thdat_append_pending(thdat, &pending[i]);
+            if (indices[i] != -1)
+                thdat_entry_expect_size(thdat, indices[i], pending[i].size, NULL);
+        }
+
+        if (!thtk_io_preallocate(state->stream, pending_bytes, error)) {
+            print_error(*error);
+            thtk_error_free(error);
+        }
+
+        TRACE_BEGIN(t_init);
+        if (!thdat_init(thdat, error)) {
+            /* thdat_init has freed the archive. */
+            state->thdat = NULL;
+            fclose(spool);
+            free(indices);
+            free(pending);
+            thdat_state_free(state);
+            return 0;
+        }
+        TRACE_END(t_init, "thdat_init", path);
+
+        /* The spooled data is read back in order, and at most one batch of
+         * it is held while it is being written. */
+        rewind(spool);
+#pragma omp parallel
+#pragma omp single
+        {
+            size_t batch_bytes = 0;
+            for (size_t i = 0; i < pending_count; ++i) {
+                const size_t size = pending[i].size;
+                unsigned char* data = malloc(size ? size : 1);
+                if (!data) {
+                    fprintf(stderr, "%s: out of memory\n", argv0);
+#pragma omp atomic write
+                    ret = 0;
+                    break;
+                }
+                if (fread(data, 1, size, spool) != size) {
+                    fprintf(stderr, "%s: error reading temporary file: %s\n", argv0, strerror(errno));
+                    free(data);
+#pragma omp atomic write
+                    ret = 0;
+                    break;
+                }
+                const ssize_t entry_index = indices[i];
+                if (entry_index == -1) {
+                    free(data);
+                    continue;
+                }
+                if (batch_bytes >= THDAT_STREAM_BATCH) {
+#pragma omp taskwait
+                    batch_bytes = 0;
+                }
+                batch_bytes += size;
+#pragma omp task firstprivate(entry_index, data, size)
+                if (!thdat_write_buffer(thdat, entry_index, data, size)) {
+#pragma omp atomic write
+                    ret = 0;
+                }
+            }
+        }
+        fclose(spool);
+        free(indices);
+    }
+    free(pending);
+
+    TRACE_BEGIN(t_close);
+    if (!thdat_close(thdat, error)) {
+        thdat_state_free(state);
+        return 0;
+    }
+    TRACE_END(t_close, "thdat_close", path);
+
+    thdat_state_free(state);
+    if (!ret)
+        thtk_error_new(error, "some entries could not be added");
+    return ret;
+}
+
+static int
+thdat_detect_file(
+    const char* path,
+    uint32_t out[4],
+    unsigned int* heur,
+    thtk_error_t** error)
+{
+    thtk_io_t* file;
+    int ret;
+    TRACE_BEGIN(t);
+
+    if (!(file = thtk_io_open_file(path, "rb", error)))
+        return -1;
+    ret = thdat_detect(path, file, out, heur, error);
+    thtk_io_close(file);
+    TRACE_END(t, "thdat_detect", path);
+    return ret;
+}
+
+typedef struct {
+    const char* path;
+    unsigned int version;
+    thdat_state_t* state;
+    /* Output directory for -m. */
+    char* outdir;
+    thtk_error_t* error;
+} thdat_archive_t;
+
+/* Detects (if version is ~0) and opens all archives in parallel.  Archives
+ * that couldn't be opened are reported and have a NULL state.  Detected
+ * versions are printed to info. */
+static thdat_archive_t*
+thdat_open_archives(
+    unsigned int version,
+    int count,
+    char** paths,
+    FILE* info)
+{
+    thdat_archive_t* archives = calloc(count, sizeof(*archives));
+    int i;
+
+#pragma omp parallel for schedule(dynamic)
+    for (i = 0; i < count; ++i) {
+        thdat_archive_t* archive = &archives[i];
+        archive->path = paths[i];
+        archive->version = version;
+        if (version == ~0) {
+            uint32_t out[4];
+            unsigned int heur;
+            if (thdat_detect_file(archive->path, out, &heur, &archive->error) == -1)
+                continue;
+            if (heur == -1) {
+                thtk_error_new(&archive->error, "couldn't detect version of '%s'", archive->path);
+                continue;
+            }
+            archive->version = heur;
+        }
+        archive->state = thdat_open_file(archive->version, archive->path, &archive->error);
+    }
+
+    for (i = 0; i < count; ++i) {
+        if (archives[i].error) {
+            print_error(archives[i].error);
+            thtk_error_free(&archives[i].error);
+        } else if (version == ~0) {
+            fprintf(info, "Detected version %d for '%s'\n", archives[i].version, archives[i].path);
+        }
+    }
+
+    return archives;
+}
+
+static void
+thdat_free_archives(
+    thdat_archive_t* archives,
+    int count)
+{
+    for (int i = 0; i < count; ++i) {
+        thdat_state_free(archives[i].state);
+        free(archives[i].outdir);
+    }
+    free(archives);
+}
+
+static int
+thdat_list_archives(
+    unsigned int version,
+    int count,
+    char** paths)
+{
+    thdat_archive_t* archives = thdat_open_archives(version, count, paths, stdout);
+    int ret = 1;
+
+    for (int i = 0; i < count; ++i) {
+        thtk_error_t* error = NULL;
+        if (!archives[i].state) {
+            ret = 0;
+            continue;
+        }
+        printf("%s%s:\n", i ? "\n" : "", archives[i].path);
+        if (!thdat_list(archives[i].state, &error)) {
             print_error(error);
             thtk_error_free(&error);
-            continue;
+            ret = 0;
+        }
+    }
+
+    thdat_free_archives(archives, count);
+    return ret;
+}
+
+/* Returns the archive filename without its extension, with a number appended
+ * if an earlier archive already uses that name. */
+static char*
+thdat_archive_outdir(
+    thdat_archive_t* archives,
+    int index)
+{
+    const char* name = util_shortname(archives[index].path);
+    const char* dot = strrchr(name, '.');
+    size_t len = dot && dot != name ? (size_t)(dot - name) : strlen(name);
+    char* outdir = malloc(len + 16);
+    memcpy(outdir, name, len);
+    outdir[len] = '\0';
+
+    for (int n = 2, i = 0; i < index; ++i) {
+        if (archives[i].outdir && !strcmp(archives[i].outdir, outdir)) {
+            sprintf(outdir + len, "_%d", n++);
+            i = -1;
         }
+    }
+
+    return outdir;
+}
+
+typedef struct {
+    thdat_archive_t* archive;
+    ssize_t entry;
+    ssize_t size;
+} thdat_task_t;
+
+static int
+thdat_task_compar(
+    const void* a,
+    const void* b)
+{
+    const thdat_task_t* ta = a;
+    const thdat_task_t* tb = b;
+    return (tb->size > ta->size) - (tb->size < ta->size);
+}
+
+/* Extracts several archives, each into its own directory.  The entries of
+ * all archives go into one work list, largest first, so that threads don't
+ * sit idle at the end of a small archive. */
+static int
+thdat_extract_archives(
+    unsigned int version,
+    int count,
+    char** paths)
+{
+    thdat_archive_t* archives = thdat_open_archives(version, count, paths, stdout);
+    thdat_task_t* tasks = NULL;
+    size_t task_count = 0;
+    size_t task_cap = 0;
+    int ret = 1;
+
+    if (dat_chdir && util_chdir(dat_chdir) == -1) {
+        fprintf(stderr, "%s: couldn't change directory to %s: %s\n",
+            argv0, dat_chdir, strerror(errno));
+        exit(1);
+    }
+    incremental_t* inc = dat_incremental ? incremental_open(THDAT_INCREMENTAL_INDEX) : NULL;
 
-        if (thtk_io_seek(entry_stream, 0, SEEK_SET, &error) == -1) {
+    for (int i = 0; i < count; ++i) {
+        thtk_error_t* error = NULL;
+        ssize_t entry_count;
+        if (!archives[i].state) {
+            ret = 0;
+            continue;
+        }
+        archives[i].outdir = thdat_archive_outdir(archives, i);
+        if ((entry_count = thdat_entry_count(archives[i].state->thdat, &error)) == -1) {
             print_error(error);
             thtk_error_free(&error);
+            ret = 0;
             continue;
         }
+        util_vec_ensure(&tasks, &task_cap, task_count + entry_count, sizeof(*tasks));
+        for (ssize_t e = 0; e < entry_count; ++e) {
+            tasks[task_count].archive = &archives[i];
+            tasks[task_count].entry = e;
+            tasks[task_count].size = thdat_entry_get_size(archives[i].state->thdat, e, &error);
+            task_count++;
+        }
+    }
+
+    qsort(tasks, task_count, sizeof(*tasks), thdat_task_compar);
 
-        if (thdat_entry_write_data(state->thdat, i, entry_stream, entry_size, &error) == -1) {
+    ssize_t t;
+#pragma omp parallel for schedule(dynamic)
+    for (t = 0; t < task_count; ++t) {
+        thtk_error_t* error = NULL;
+        if (!thdat_extract_file(tasks[t].archive->state, tasks[t].entry, tasks[t].archive->outdir, inc, &error)) {
             print_error(error);
             thtk_error_free(&error);
+#pragma omp atomic write
+            ret = 0;
+        }
+    }
+
+    free(tasks);
+    if (inc && !incremental_close(inc, stdout))
+        ret = 0;
+    thdat_free_archives(archives, count);
+    return ret;
+}
+
+typedef struct {
+    thtk_xxh64_t xxh;
+    ssize_t size;
+} thdat_hash_sink_t;
+
+static int
+thdat_hash_write(
+    void* user,
+    const void* buf,
+    size_t count,
+    thtk_error_t** error)
+{
+    (void)error;
+    thdat_hash_sink_t* sink = user;
+    thtk_xxh64_update(&sink->xxh, buf, count);
+    sink->size += count;
+    return 1;
+}
+
+/* Decodes an entry straight into a hash, without writing it anywhere.  If
+ * raw is set, the stored data is hashed instead. */
+static int
+thdat_hash_entry(
+    thdat_state_t* state,
+    size_t entry_index,
+    int raw,
+    ssize_t* size,
+    uint64_t* hash,
+    thtk_error_t** error)
+{
+    thdat_hash_sink_t sink = { .size = 0 };
+    thtk_io_t* output;
+    TRACE_BEGIN(t);
+
+    thtk_xxh64_init(&sink.xxh, 0);
+    if (!(output = thtk_io_open_callback(thdat_hash_write, &sink, error)))
+        return 0;
+    if ((raw ? thdat_entry_read_raw : thdat_entry_read_data)(state->thdat, entry_index, output, error) == -1) {
+        thtk_io_close(output);
+        return 0;
+    }
+    thtk_io_close(output);
+
+    *size = sink.size;
+    *hash = thtk_xxh64_final(&sink.xxh);
+    TRACE_END(t, "hash_entry", thdat_entry_get_name(state->thdat, entry_index, NULL));
+    return 1;
+}
+
+static int
+thdat_hash_archive(
+    const char* path,
+    off_t* size,
+    unsigned char digest[THTK_SHA256_SIZE],
+    thtk_error_t** error)
+{
+    const size_t chunk_size = 1 << 20;
+    thtk_io_t* stream;
+    thtk_sha256_t sha;
+    unsigned char* chunk;
+    int ret = 0;
+    TRACE_BEGIN(t);
+
+    if (!(stream = thtk_io_open_file(path, "rb", error)))
+        return 0;
+    if ((*size = thtk_io_seek(stream, 0, SEEK_END, error)) == -1 ||
+        thtk_io_seek(stream, 0, SEEK_SET, error) == -1) {
+        thtk_io_close(stream);
+        return 0;
+    }
+
+    chunk = malloc(chunk_size);
+    thtk_sha256_init(&sha);
+    for (off_t left = *size; left; ) {
+        const size_t count = left < (off_t)chunk_size ? (size_t)left : chunk_size;
+        if (thtk_io_read(stream, chunk, count, error) != (ssize_t)count)
+            goto end;
+        thtk_sha256_update(&sha, chunk, count);
+        left -= count;
+    }
+    thtk_sha256_final(&sha, digest);
+    ret = 1;
+
+end:
+    free(chunk);
+    thtk_io_close(stream);
+    TRACE_END(t, "hash_archive", path);
+    return ret;
+}
+
+static void
+thdat_print_hex(
+    FILE* stream,
+    const unsigned char* data,
+    size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+        fprintf(stream, "%02x", data[i]);
+}
+
+typedef struct {
+    ssize_t size;
+    uint64_t hash;
+    int ok;
+} thdat_entry_sum_t;
+
+/* Reads a manifest written by --emit-manifest and compares it with the
+ * hashes of the archive.  Returns the number of differences, or -1 if the
+ * manifest can't be read. */
+static int
+thdat_check_manifest(
+    thdat_state_t* state,
+    const char* manifest_path,
+    const thdat_entry_sum_t* sums,
+    ssize_t entry_count,
+    off_t archive_size,
+    const unsigned char* archive_digest)
+{
+    FILE* manifest = fopen(manifest_path, "r");
+    char line[1024];
+    char* seen;
+    int problems = 0;
+
+    if (!manifest) {
+        fprintf(stderr, "%s: couldn't open %s: %s\n", argv0, manifest_path, strerror(errno));
+        return -1;
+    }
+
+    seen = calloc(entry_count ? entry_count : 1, 1);
+    while (fgets(line, sizeof(line), manifest)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0')
             continue;
+
+        long long size;
+        char hex[65];
+        int name_offset = 0;
+        if (sscanf(line, "archive %lld %64s", &size, hex) == 2) {
+            char actual[65];
+            for (int i = 0; i < THTK_SHA256_SIZE; ++i)
+                sprintf(actual + i * 2, "%02x", archive_digest[i]);
+            if (size != (long long)archive_size || strcmp(hex, actual)) {
+                printf("CHANGED (archive)\n");
+                ++problems;
+            }
+        } else if (sscanf(line, "entry %lld %16s %n", &size, hex, &name_offset) == 2 && name_offset) {
+            const char* name = line + name_offset;
+            uint64_t hash = strtoull(hex, NULL, 16);
+            ssize_t e = thdat_entry_by_name(state->thdat, name, NULL);
+            if (e == -1) {
+                printf("MISSING %s\n", name);
+                ++problems;
+                continue;
+            }
+            seen[e] = 1;
+            if (sums[e].ok && (sums[e].size != size || sums[e].hash != hash)) {
+                printf("CHANGED %s\n", name);
+                ++problems;
+            }
+        } else {
+            fprintf(stderr, "%s: %s: unrecognized line: %s\n", argv0, manifest_path, line);
+            ++problems;
         }
+    }
+    fclose(manifest);
 
-        thtk_io_close(entry_stream);
-        free(realpaths[i]);
+    for (ssize_t e = 0; e < entry_count; ++e) {
+        if (!seen[e]) {
+            printf("EXTRA %s\n", thdat_entry_get_name(state->thdat, e, NULL));
+            ++problems;
+        }
     }
-    free(realpaths);
+    free(seen);
+    return problems;
+}
 
-    int ret = 1;
+/* Decodes every entry of an archive into a hash in parallel, while the whole
+ * file is hashed with SHA-256.  The hashes are then written as a manifest, or
+ * compared with one. */
+static int
+thdat_verify(
+    unsigned int version,
+    const char* path,
+    const char* manifest_path,
+    int emit_manifest)
+{
+    thtk_error_t* error = NULL;
+    thdat_state_t* state;
+    ssize_t entry_count;
+    int problems = 0;
 
-    if (!thdat_close(state->thdat, error))
-        ret = 0;
+    if (!(state = thdat_open_file(version, path, &error)) ||
+        (entry_count = thdat_entry_count(state->thdat, &error)) == -1) {
+        print_error(error);
+        thtk_error_free(&error);
+        thdat_state_free(state);
+        return 0;
+    }
+
+    thdat_entry_sum_t* sums = calloc(entry_count ? entry_count : 1, sizeof(*sums));
+    thtk_error_t** errors = calloc(entry_count + 1, sizeof(*errors));
+    /* Task 0 hashes the archive file, which is the largest job. */
+    thdat_task_t* tasks = malloc((entry_count + 1) * sizeof(*tasks));
+    off_t archive_size = 0;
+    unsigned char archive_digest[THTK_SHA256_SIZE];
+    int archive_ok = 0;
 
+    for (ssize_t e = 0; e < entry_count; ++e) {
+        tasks[e + 1].archive = NULL;
+        tasks[e + 1].entry = e;
+        tasks[e + 1].size = thdat_entry_get_size(state->thdat, e, NULL);
+    }
+    qsort(tasks + 1, entry_count, sizeof(*tasks), thdat_task_compar);
+
+    ssize_t t;
+#pragma omp parallel for schedule(dynamic)
+    for (t = 0; t <= entry_count; ++t) {
+        if (t == 0) {
+            archive_ok = thdat_hash_archive(path, &archive_size, archive_digest, &errors[0]);
+        } else {
+            const ssize_t e = tasks[t].entry;
+            sums[e].ok = thdat_hash_entry(state, e, 0, &sums[e].size, &sums[e].hash, &errors[e + 1]);
+        }
+    }
+    free(tasks);
+
+    if (!archive_ok) {
+        print_error(errors[0]);
+        thtk_error_free(&errors[0]);
+        ++problems;
+    }
+    for (ssize_t e = 0; e < entry_count; ++e) {
+        if (!sums[e].ok) {
+            printf("FAILED %s\n", thdat_entry_get_name(state->thdat, e, NULL));
+            print_error(errors[e + 1]);
+            thtk_error_free(&errors[e + 1]);
+            ++problems;
+        }
+    }
+    free(errors);
+
+    if (emit_manifest) {
+        FILE* out = manifest_path ? fopen(manifest_path, "w") : stdout;
+        if (!out) {
+            fprintf(stderr, "%s: couldn't open %s for writing: %s\n", argv0, manifest_path, strerror(errno));
+            ++problems;
+        } else if (!problems) {
+            fprintf(out, "# thdat manifest for %s\n", util_shortname(path));
+            fprintf(out, "archive %lld ", (long long)archive_size);
+            thdat_print_hex(out, archive_digest, THTK_SHA256_SIZE);
+            fprintf(out, "\n");
+            for (ssize_t e = 0; e < entry_count; ++e) {
+                fprintf(out, "entry %lld %016" PRIx64 " %s\n", (long long)sums[e].size,
+                    sums[e].hash, thdat_entry_get_name(state->thdat, e, NULL));
+            }
+        }
+        if (out && out != stdout)
+            fclose(out);
+    } else {
+        if (manifest_path) {
+            int ret = thdat_check_manifest(state, manifest_path, sums,
+                entry_count, archive_size, archive_digest);
+            problems += ret == -1 ? 1 : ret;
+        }
+        if (archive_ok) {
+            /* The same format as contrib/datsums.txt. */
+            thdat_print_hex(stdout, archive_digest, THTK_SHA256_SIZE);
+            printf(" *%s\n", util_shortname(path));
+        }
+        if (problems)
+            printf("%s: FAILED, %d problem%s\n", path, problems, problems == 1 ? "" : "s");
+        else
+            printf("%s: OK, %zd entries\n", path, entry_count);
+    }
+
+    free(sums);
     thdat_state_free(state);
+    return problems == 0;
+}
+
+typedef struct {
+    ssize_t a;
+    ssize_t b;
+    ssize_t size;
+    int changed;
+    thtk_error_t* error;
+} thdat_diff_pair_t;
+
+static int
+thdat_diff_pair_compar(
+    const void* a,
+    const void* b)
+{
+    const thdat_diff_pair_t* pa = a;
+    const thdat_diff_pair_t* pb = b;
+    return (pb->size > pa->size) - (pb->size < pa->size);
+}
 
+/* Sets pair->changed, decoding the entries only when their stored data
+ * can't be compared directly.  Returns 0 on error. */
+static int
+thdat_diff_entries(
+    const thdat_archive_t* a,
+    const thdat_archive_t* b,
+    thdat_diff_pair_t* pair)
+{
+    ssize_t size_a, size_b;
+    uint64_t hash_a, hash_b;
+    TRACE_BEGIN(t);
+
+    if (a->version == b->version &&
+        thdat_entry_get_size(a->state->thdat, pair->a, NULL) !=
+        thdat_entry_get_size(b->state->thdat, pair->b, NULL)) {
+        pair->changed = 1;
+        return 1;
+    }
+
+    if (thdat_entry_raw_comparable(a->state->thdat, pair->a, b->state->thdat, pair->b)) {
+        if (!thdat_hash_entry(a->state, pair->a, 1, &size_a, &hash_a, &pair->error) ||
+            !thdat_hash_entry(b->state, pair->b, 1, &size_b, &hash_b, &pair->error))
+            return 0;
+        if (size_a == size_b && hash_a == hash_b) {
+            pair->changed = 0;
+            TRACE_END(t, "diff_raw", thdat_entry_get_name(a->state->thdat, pair->a, NULL));
+            return 1;
+        }
+    }
+
+    if (!thdat_hash_entry(a->state, pair->a, 0, &size_a, &hash_a, &pair->error) ||
+        !thdat_hash_entry(b->state, pair->b, 0, &size_b, &hash_b, &pair->error))
+        return 0;
+    pair->changed = size_a != size_b || hash_a != hash_b;
+    TRACE_END(t, "diff_decoded", thdat_entry_get_name(a->state->thdat, pair->a, NULL));
+    return 1;
+}
+
+/* Compares the file tables of two archives, then the entries present in both
+ * in parallel.  Prints one "added", "removed" or "changed" line per entry,
+ * and returns 0 if the archives match, 1 if they differ and 2 on error. */
+static int
+thdat_diff(
+    unsigned int version,
+    char** paths)
+{
+    thdat_archive_t* archives = thdat_open_archives(version, 2, paths, stderr);
+    const thdat_archive_t* a = &archives[0];
+    const thdat_archive_t* b = &archives[1];
+    int ret = 0;
+
+    if (!a->state || !b->state) {
+        thdat_free_archives(archives, 2);
+        return 2;
+    }
+
+    const ssize_t count_a = thdat_entry_count(a->state->thdat, NULL);
+    const ssize_t count_b = thdat_entry_count(b->state->thdat, NULL);
+    thdat_diff_pair_t* pairs = malloc((count_a ? count_a : 1) * sizeof(*pairs));
+    char* in_a = calloc(count_b ? count_b : 1, 1);
+    ssize_t pair_count = 0;
+
+    for (ssize_t e = 0; e < count_a; ++e) {
+        const char* name = thdat_entry_get_name(a->state->thdat, e, NULL);
+        const ssize_t other = thdat_entry_by_name(b->state->thdat, name, NULL);
+        if (other == -1)
+            continue;
+        in_a[other] = 1;
+        pairs[pair_count].a = e;
+        pairs[pair_count].b = other;
+        pairs[pair_count].size = thdat_entry_get_size(a->state->thdat, e, NULL);
+        pairs[pair_count].changed = 0;
+        pairs[pair_count].error = NULL;
+        ++pair_count;
+    }
+
+    qsort(pairs, pair_count, sizeof(*pairs), thdat_diff_pair_compar);
+
+    ssize_t p;
+#pragma omp parallel for schedule(dynamic)
+    for (p = 0; p < pair_count; ++p) {
+        if (!thdat_diff_entries(a, b, &pairs[p])) {
+#pragma omp atomic write
+            ret = 2;
+        }
+    }
+
+    /* Report in the order of the first archive. */
+    char* changed = calloc(count_a ? count_a : 1, 1);
+    for (p = 0; p < pair_count; ++p) {
+        if (pairs[p].error) {
+            print_error(pairs[p].error);
+            thtk_error_free(&pairs[p].error);
+        }
+        changed[pairs[p].a] = pairs[p].changed ? 2 : 1;
+    }
+    for (ssize_t e = 0; e < count_a; ++e) {
+        const char* name = thdat_entry_get_name(a->state->thdat, e, NULL);
+        if (!changed[e])
+            printf("removed %s\n", name);
+        else if (changed[e] == 2)
+            printf("changed %s\n", name);
+        if (changed[e] != 1 && !ret)
+            ret = 1;
+    }
+    for (ssize_t e = 0; e < count_b; ++e) {
+        if (!in_a[e]) {
+            printf("added %s\n", thdat_entry_get_name(b->state->thdat, e, NULL));
+            if (!ret)
+                ret = 1;
+        }
+    }
+
+    free(changed);
+    free(in_a);
+    free(pairs);
+    thdat_free_archives(archives, 2);
     return ret;
 }
 
@@ -345,13 +1448,24 @@ main(
     int dat_use_glob = 0;
 
     argv0 = util_shortname(argv[0]);
+    util_stats_at_exit();
+    trace_init_args(&argc, argv);
+    const util_long_option_t long_options[] = {
+        { "emit-manifest", &dat_emit_manifest, NULL },
+        { "diff", &dat_diff, NULL },
+        { "tar", NULL, &dat_tar },
+        { "incremental", &dat_incremental, NULL },
+        { NULL, NULL, NULL }
+    };
+    util_long_options(&argc, argv, long_options);
     int opt;
     int ind=0;
     while(argv[util_optind]) {
-        switch(opt = util_getopt(argc, argv, "+:c:l:x:VdgC:")) {
+        switch(opt = util_getopt(argc, argv, "+:c:l:x:v:VdgmC:")) {
         case 'c':
         case 'l':
         case 'x':
+        case 'v':
         case 'd':
             if(mode != -1) {
                 fprintf(stderr,"%s: More than one mode specified\n",argv0);
@@ -359,7 +1473,7 @@ main(
                 exit(1);
             }
             mode = opt;
-            if((opt == 'x' || mode == 'l') && !strcmp(util_optarg, "d")) {
+            if((opt == 'x' || opt == 'l' || opt == 'v') && !strcmp(util_optarg, "d")) {
                 version = ~0;
             }
             else if(opt != 'd') version = parse_version(util_optarg);
@@ -367,6 +1481,9 @@ main(
         case 'g':
             dat_use_glob = 1;
             break;
+        case 'm':
+            dat_multiple = 1;
+            break;
         case 'C':
             dat_chdir = util_optarg;
             break;
@@ -377,38 +1494,56 @@ main(
     argc = ind;
     argv[argc] = NULL;
 
-    /* detect version */
-    if(argc && (mode == 'x' || mode == 'l') && version == ~0) {
-        thtk_io_t* file;
-        if(!(file = thtk_io_open_file(argv[0], "rb", &error))) {
-            print_error(error);
-            thtk_error_free(&error);
-            exit(1);
+    if (dat_diff) {
+        if (mode != -1 || argc < 2 || argc > 3) {
+            print_usage();
+            exit(2);
         }
+        if (argc == 3)
+            version = strcmp(argv[0], "d") ? parse_version(argv[0]) : ~0;
+        else
+            version = ~0;
+        exit(thdat_diff(version, &argv[argc - 2]));
+    }
+
+    if (dat_tar && (mode != 'x' || dat_multiple || argc != 1)) {
+        fprintf(stderr, "%s: --tar takes the whole of a single archive given to -x\n", argv0);
+        exit(1);
+    }
+
+    if (dat_incremental && (mode != 'x' || dat_tar)) {
+        fprintf(stderr, "%s: --incremental only works when -x writes files\n", argv0);
+        exit(1);
+    }
+
+    int batch = (mode == 'l' && argc > 1) || (mode == 'x' && dat_multiple);
+
+    /* detect version */
+    if(argc && !batch && (mode == 'x' || mode == 'l' || mode == 'v') && version == ~0) {
         uint32_t out[4];
         unsigned int heur;
-        printf("Detecting '%s'...\n",argv[0]);
-        if(-1 == thdat_detect(argv[0], file, out, &heur, &error)) {
-            thtk_io_close(file);
+        /* Keep a manifest written to stdout clean. */
+        FILE* info = (mode == 'v' && dat_emit_manifest) ||
+            (mode == 'x' && dat_tar && !strcmp(dat_tar, "-")) ? stderr : stdout;
+        fprintf(info, "Detecting '%s'...\n",argv[0]);
+        if(-1 == thdat_detect_file(argv[0], out, &heur, &error)) {
             print_error(error);
             thtk_error_free(&error);
             exit(1);
         }
         if(heur == -1) {
             const thdat_detect_entry_t* ent;
-            printf("Couldn't detect version!\nPossible versions: ");
+            fprintf(info, "Couldn't detect version!\nPossible versions: ");
             while((ent = thdat_detect_iter(out))) {
-                printf("%d,",ent->alias);
+                fprintf(info, "%d,",ent->alias);
             }
-            printf("\n");
-            thtk_io_close(file);
+            fprintf(info, "\n");
             exit(1);
         }
         else {
-            printf("Detected version %d\n",heur);
+            fprintf(info, "Detected version %d\n",heur);
             version = heur;
         }
-        thtk_io_close(file);
     }
 
     switch (mode) {
@@ -417,35 +1552,39 @@ main(
             print_usage();
             exit(1);
         }
-        for (int i = 0; i < argc; i++) {
-            thtk_io_t* file;
-            if (!(file = thtk_io_open_file(argv[i], "rb", &error))) {
-                print_error(error);
-                thtk_error_free(&error);
-                exit(1);
-            }
-
+        struct {
             uint32_t out[4];
             unsigned int heur;
+            int ret;
+            thtk_error_t* error;
+        }* results = calloc(argc, sizeof(*results));
+        int i, ret = 0;
+
+#pragma omp parallel for schedule(dynamic)
+        for (i = 0; i < argc; i++) {
+            results[i].ret = thdat_detect_file(argv[i],
+                results[i].out, &results[i].heur, &results[i].error);
+        }
 
+        for (i = 0; i < argc; i++) {
             printf("Detecting '%s'... ",argv[i]);
-            if (-1 == thdat_detect(argv[i], file, out, &heur, &error)) {
+            if (-1 == results[i].ret) {
                 printf("\n");
-                thtk_io_close(file);
-                print_error(error);
-                thtk_error_free(&error);
+                print_error(results[i].error);
+                thtk_error_free(&results[i].error);
+                ret = 1;
                 continue;
             }
 
             const thdat_detect_entry_t* ent;
-            printf("%d | possible versions: ", heur);
-            while((ent = thdat_detect_iter(out))) {
+            printf("%d | possible versions: ", results[i].heur);
+            while((ent = thdat_detect_iter(results[i].out))) {
                 printf("%d,",ent->alias);
             }
             printf(" | filename: %d\n", thdat_detect_filename(argv[i]));
-            thtk_io_close(file);
         }
-        exit(0);
+        free(results);
+        exit(ret);
     }
     case 'l': {
         if (argc < 1) {
@@ -453,20 +1592,45 @@ main(
             exit(1);
         }
 
-        if (!thdat_list(version, argv[0], &error)) {
+        if (batch)
+            exit(thdat_list_archives(version, argc, argv) ? 0 : 1);
+
+        thdat_state_t* state = thdat_open_file(version, argv[0], &error);
+        if (!state || !thdat_list(state, &error)) {
             print_error(error);
             thtk_error_free(&error);
             exit(1);
         }
 
+        thdat_state_free(state);
         exit(0);
     }
+    case 'v': {
+        if (argc < 1 || argc > 2) {
+            print_usage();
+            exit(1);
+        }
+
+        exit(thdat_verify(version, argv[0], argc > 1 ? argv[1] : NULL, dat_emit_manifest) ? 0 : 1);
+    }
     case 'c': {
         if (argc < 2) {
             print_usage();
             exit(1);
         }
 
+        if (argc == 2 && !strcmp(argv[1], "-")) {
+#ifdef _WIN32
+            (void)_setmode(fileno(stdin), _O_BINARY);
+#endif
+            if (!thdat_create_stream(version, argv[0], stdin, &error)) {
+                print_error(error);
+                thtk_error_free(&error);
+                exit(1);
+            }
+            exit(0);
+        }
+
         if (!thdat_create_wrapper(version, argv[0], (const char**)&argv[1], argc - 1, &error)) {
             print_error(error);
             thtk_error_free(&error);
@@ -481,6 +1645,9 @@ main(
             exit(1);
         }
 
+        if (batch)
+            exit(thdat_extract_archives(version, argc, argv) ? 0 : 1);
+
         thdat_state_t* state = thdat_open_file(version, argv[0], &error);
         if (!state) {
             print_error(error);
@@ -488,11 +1655,22 @@ main(
             exit(1);
         }
 
+        if (dat_tar) {
+            if (!thdat_extract_tar(state, dat_tar, &error)) {
+                print_error(error);
+                thtk_error_free(&error);
+                exit(1);
+            }
+            thdat_state_free(state);
+            exit(0);
+        }
+
         if (dat_chdir && util_chdir(dat_chdir) == -1) {
             fprintf(stderr, "%s: couldn't change directory to %s: %s\n",
                 argv0, dat_chdir, strerror(errno));
             exit(1);
         }
+        incremental_t* inc = dat_incremental ? incremental_open(THDAT_INCREMENTAL_INDEX) : NULL;
 
         if (argc > 1) {
             ssize_t a;
@@ -510,7 +1688,7 @@ main(
                             }
                             break;
                         }
-                        if (!thdat_extract_file(state, e, &error)) {
+                        if (!thdat_extract_file(state, e, NULL, inc, &error)) {
                             print_error(error);
                             thtk_error_free(&error);
                         }
@@ -525,7 +1703,7 @@ main(
                         }
                         continue;
                     }
-                    if (!thdat_extract_file(state, e, &error)) {
+                    if (!thdat_extract_file(state, e, NULL, inc, &error)) {
                         print_error(error);
                         thtk_error_free(&error);
                     }
@@ -543,7 +1721,7 @@ main(
 #pragma omp parallel for schedule(dynamic)
             for (entry_index = 0; entry_index < entry_count; ++entry_index) {
                 thtk_error_t* error = NULL;
-                if (!thdat_extract_file(state, entry_index, &error)) {
+                if (!thdat_extract_file(state, entry_index, NULL, inc, &error)) {
                     print_error(error);
                     thtk_error_free(&error);
                     continue;
@@ -551,8 +1729,9 @@ main(
             }
         }
 
+        int ret = inc && !incremental_close(inc, stdout);
         thdat_state_free(state);
-        exit(0);
+        exit(ret);
     }
     default:
     print_usage();
@@ -390,14 +390,14 @@ Statement:
       }
     | "insdef" IDENTIFIER[name] '(' Types[types] ')' '=' INTEGER[id] ';' {
         seqmap_entry_t sig_ent = { .key = $id, .value = $types };
-        seqmap_set(g_eclmap->ins_signatures, &sig_ent);
+        seqmap_set(g_ecl_ctx->eclmap->ins_signatures, &sig_ent);
         free($types); /* seqmap_set does a strdup */
 
         seqmap_entry_t name_ent = { .key = $id, .value = $name };
-        seqmap_set(g_eclmap->ins_names, &name_ent);
+        seqmap_set(g_ecl_ctx->eclmap->ins_names, &name_ent);
         free($name); /* seqmap_set does a strdup */
 
-        eclmap_rebuild(g_eclmap);
+        eclmap_rebuild(g_ecl_ctx->eclmap);
       }
     | DIRECTIVE TEXT {
         char buf[256];
@@ -439,7 +439,7 @@ Statement:
                 }
                 buf[s] = '\0';
                 seqmap_entry_t ent = { .key = id, .value = buf };
-                seqmap_set(is_timeline ? g_eclmap->timeline_ins_signatures : g_eclmap->ins_signatures, &ent);
+                seqmap_set(is_timeline ? g_ecl_ctx->eclmap->timeline_ins_signatures : g_ecl_ctx->eclmap->ins_signatures, &ent);
             } else {
                 yyerror(state, "#ins: specified format is too long");
             }
@@ -666,7 +666,7 @@ BreakStatement:
           }
           if(!head) {
               yyerror(state, "break not within while or switch");
-              g_was_error = true;
+              g_ecl_ctx->was_error = true;
           }
       }
       ;
@@ -781,7 +781,7 @@ WhileBlock:
 
 TimesBlock:
       "times" '(' ExpressionAny[count] ')' {
-          if (g_ecl_simplecreate) {
+          if (g_ecl_ctx->simplecreate) {
               yyerror(state, "times loops are not allowed in simple creation mode");
               exit(2);
           }
@@ -1052,7 +1052,7 @@ InstructionNoGoto:
         }
       }
       | MNEMONIC '(' Instruction_Parameters ')' {
-        seqmap_entry_t* ent = seqmap_find(state->is_timeline_sub ? g_eclmap->timeline_ins_names : g_eclmap->ins_names, $1);
+        seqmap_entry_t* ent = seqmap_find(state->is_timeline_sub ? g_ecl_ctx->eclmap->timeline_ins_names : g_ecl_ctx->eclmap->ins_names, $1);
         if (!ent) {
             /* Default to creating a sub call */
             instr_create_call(state, TH10_INS_CALL, $1, $3, false);
@@ -1091,7 +1091,7 @@ InstructionNoGoto:
         expression_free($1);
       }
     | VarDeclaration {
-        if (g_ecl_simplecreate)
+        if (g_ecl_ctx->simplecreate)
             instr_add(state->current_sub, instr_new(state, TH10_INS_STACK_ALLOC, "S", state->current_sub->stack));
      }
     | BreakStatement
@@ -1531,7 +1531,7 @@ instr_set_types(
             !(param->type == 'z' && (new_type == 'm' || new_type == 'x' || new_type == 'N' || new_type == 'n')) &&
             !(param->type == 'S' && (new_type == 's' || new_type == 'U' || new_type == 't'))
         ) {
-            seqmap_entry_t* ent = seqmap_get(g_eclmap->ins_names, instr->id);
+            seqmap_entry_t* ent = seqmap_get(g_ecl_ctx->eclmap->ins_names, instr->id);
             char buf[128];
             if (ent == NULL)
                 snprintf(buf, sizeof(buf), "%d", instr->id);
@@ -2098,7 +2098,7 @@ instr_create_call(
                 }
             } else {
                 yyerror(state, "invalid sub parameter type '%c': only float/int are acceptable.", iter_param->value.type);
-                g_was_error = true;
+                g_ecl_ctx->was_error = true;
             }
 
             if (is_load_expression)
@@ -2325,7 +2325,7 @@ expression_operation_new(
         }
         ret->result_type = expr->return_type;
 
-        if (!g_ecl_simplecreate)
+        if (!g_ecl_ctx->simplecreate)
             expression_optimize(state, ret);
         return ret;
 
@@ -2503,7 +2503,7 @@ expression_output(
     expression_t* expr,
     int has_no_parents)
 {
-    if (!g_ecl_simplecreate && has_no_parents)
+    if (!g_ecl_ctx->simplecreate && has_no_parents)
         /* Since expression_optimize is already done recursively for children, it shouldn't be called for child expressions. */
         expression_optimize(state, expr);
 
@@ -2812,7 +2812,7 @@ sub_begin(
             int diff = strcmp(name, iter_sub->name);
             if(diff == 0 && !iter_sub->forward_declaration) {
                 yyerror(state, "duplicate sub: %s", name);
-                g_was_error = true;
+                g_ecl_ctx->was_error = true;
                 break;
             } else if(diff < 0) {
                 list_prepend_to(&state->ecl->subs, sub, node);
@@ -2836,7 +2836,7 @@ static void
 sub_finish(
     parser_state_t* state)
 {
-    if (is_post_th10(state->ecl->version) && !g_ecl_simplecreate && !state->current_sub->is_inline) {
+    if (is_post_th10(state->ecl->version) && !g_ecl_ctx->simplecreate && !state->current_sub->is_inline) {
 
         thecl_instr_t* var_ins = instr_new(state, TH10_INS_STACK_ALLOC, "S", state->current_sub->stack);
         var_ins->time = 0;
@@ -2952,7 +2952,7 @@ var_create(
         yyerror(state, "stack variable declaration is not allowed in version: %i", state->version);
         exit(2);
     }
-    if (g_ecl_simplecreate && type != 0) {
+    if (g_ecl_ctx->simplecreate && type != 0) {
         yyerror(state, "only typeless variables are allowed in simple creation mode: %s", name);
         exit(2);
     }
@@ -2992,7 +2992,7 @@ var_create_assign(
     int type,
     expression_t* expr)
 {
-    if (g_ecl_simplecreate) {
+    if (g_ecl_ctx->simplecreate) {
         yyerror(state, "var creation with assignment is not allowed in simple creation mode");
         exit(2);
     }
@@ -3052,7 +3052,7 @@ var_stack(
     thecl_sub_t* sub,
     const char* name)
 {
-    seqmap_entry_t* ent = seqmap_find(g_eclmap->gvar_names, name);
+    seqmap_entry_t* ent = seqmap_find(g_ecl_ctx->eclmap->gvar_names, name);
     if (ent) return ent->key;
 
     thecl_variable_t* var = var_get(state, sub, name);
@@ -3069,9 +3069,9 @@ var_type(
     thecl_sub_t* sub,
     const char* name)
 {
-    seqmap_entry_t* ent = seqmap_find(g_eclmap->gvar_names, name);
+    seqmap_entry_t* ent = seqmap_find(g_ecl_ctx->eclmap->gvar_names, name);
     if (ent) {
-        ent = seqmap_get(g_eclmap->gvar_types, ent->key);
+        ent = seqmap_get(g_ecl_ctx->eclmap->gvar_types, ent->key);
         if (ent)
             return ent->value[0] == '$' ? 'S' : 'f';
     }
@@ -3090,7 +3090,7 @@ var_exists(
     thecl_sub_t* sub,
     const char* name)
 {
-    seqmap_entry_t* ent = seqmap_find(g_eclmap->gvar_names, name);
+    seqmap_entry_t* ent = seqmap_find(g_ecl_ctx->eclmap->gvar_names, name);
     if (ent) return 1;
 
     if (sub == NULL) return 0; /* we are outside of sub scope, no point in searching for variables */
@@ -3206,8 +3206,8 @@ char* name)
     if (map_file == NULL) {
         yyerror(state, "#eclmap error: couldn't open %s for reading", path);
     } else {
-        eclmap_load(state->version, g_eclmap, map_file, path);
-        eclmap_rebuild(g_eclmap);
+        eclmap_load(state->version, g_ecl_ctx->eclmap, map_file, path);
+        eclmap_rebuild(g_ecl_ctx->eclmap);
         fclose(map_file);
     }
     free(path);
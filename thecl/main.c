@@ -0,0 +1,240 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "file.h"
+#include "program.h"
+#include "thecl.h"
+#include "trace.h"
+#include "util.h"
+#include "mygetopt.h"
+
+/* Context of the single job run by the command line tool. */
+static thecl_context_t context;
+
+static void
+free_globals(void)
+{
+    eclmap_free(context.eclmap);
+}
+
+static void
+print_usage(void)
+{
+    printf("Usage: %s [-Vrsxj] [[-c | -h | -d] VERSION] [-m ECLMAP]... [INPUT [OUTPUT]]\n"
+           "Options:\n"
+           "  -c  create ECL file\n"
+           "  -h  create header file\n"
+           "  -d  dump ECL file\n"
+           "  -V  display version information and exit\n"
+           "  -m  use map file for translating mnemonics\n"
+           "  -r  output raw ECL opcodes, applying minimal transformations\n"
+           "  -s  use simple creation, which doesn't add any instructions automatically\n"
+           "  -x  add address information for ECL instructions\n"
+           "  -j  convert strings between Shift-JIS and UTF-8\n"
+           "  --trace FILE  write a Chrome trace-event JSON file (for Perfetto)\n"
+           "VERSION can be:\n"
+           "  6, 7, 8, 9, 95, 10, 103 (for Uwabami Breakers), 11, 12, 125, 128, 13, 14, 143, 15, 16, 165, 17, 18, 185, 19, or 20\n"
+           /* NEWHU: 20 */
+           "Report bugs to <" PACKAGE_BUGREPORT ">.\n", argv0);
+}
+
+int
+main(int argc, char* argv[])
+{
+    FILE* in = stdin;
+    FILE* out = stdout;
+    unsigned int version = 0;
+    int mode = -1;
+    const thecl_module_t* module = NULL;
+
+    current_input = "(stdin)";
+    current_output = "(stdout)";
+
+    g_ecl_ctx = &context;
+    context.eclmap = eclmap_new();
+    context.input = current_input;
+    atexit(free_globals);
+
+    argv0 = util_shortname(argv[0]);
+    util_stats_at_exit();
+    trace_init_args(&argc, argv);
+    int opt;
+    int ind=0;
+    while(argv[util_optind]) {
+        switch(opt = util_getopt(argc, argv, "+:c:h:d:Vm:rsxj")) {
+        case 'c':
+        case 'd':
+        case 'h':
+            if(mode != -1) {
+                fprintf(stderr,"%s: More than one mode specified\n", argv0);
+                print_usage();
+                exit(1);
+            }
+            mode = opt;
+            version = parse_version(util_optarg);
+            break;
+        case 'm': {
+            FILE* map_file = NULL;
+            map_file = fopen(util_optarg, "r");
+            if (!map_file) {
+                fprintf(stderr, "%s: couldn't open %s for reading: %s\n",
+                    argv0, util_optarg, strerror(errno));
+                exit(1);
+            }
+            eclmap_load(version, context.eclmap, map_file, util_optarg);
+            fclose(map_file);
+            break;
+        }
+        case 'r':
+            context.rawoutput = true;
+            break;
+        case 's':
+            context.simplecreate = true;
+            break;
+        case 'x':
+            context.hexdebug = true;
+            break;
+        case 'j':
+            context.encode_cp932 = true;
+            break;
+        default:
+            util_getopt_default(&ind,argv,opt,print_usage);
+        }
+    }
+    argc = ind;
+    argv[argc] = NULL;
+
+    eclmap_rebuild(context.eclmap);
+
+    module = thecl_module(version);
+    if (!module && (mode == 'c' || mode == 'd' || mode == 'h')) {
+        if (version == 0)
+            fprintf(stderr, "%s: version must be specified\n", argv0);
+        else
+            fprintf(stderr, "%s: version %u is unsupported\n", argv0, version);
+        exit(1);
+    }
+
+    switch (mode)
+    {
+    case 'c':
+    case 'h':
+    case 'd': {
+        if(context.rawoutput) {
+            if (mode != 'd') {
+                fprintf(stderr, "%s: 'r' option cannot be used while compiling\n", argv0);
+                exit(1);
+            }
+        }
+        if (context.hexdebug) {
+            if (mode != 'd') {
+                fprintf(stderr, "%s: 'x' option cannot be used while compiling\n", argv0);
+                exit(1);
+            }
+        }
+        if (context.simplecreate) {
+            if (mode != 'c' && mode != 'h') {
+                fprintf(stderr, "%s: 's' option cannot be used while dumping\n", argv0);
+                exit(1);
+            }
+        }
+        if (mode == 'h' && !is_post_th10(version)) {
+            fprintf(stderr, "%s: 'h' option can't be used with a pre-th10 version\n", argv0);
+            exit(1);
+        }
+
+        if (0 < argc) {
+            current_input = argv[0];
+            context.input = current_input;
+            in = file_open_input(argv[0], version);
+            if (!in) {
+                fprintf(stderr, "%s: couldn't open %s for reading: %s\n",
+                    argv0, argv[0], strerror(errno));
+                exit(1);
+            }
+            if (1 < argc) {
+                current_output = argv[1];
+                out = fopen(argv[1], "wb");
+                if (!out) {
+                    fprintf(stderr, "%s: couldn't open %s for writing: %s\n",
+                        argv0, argv[1], strerror(errno));
+                    file_close(in);
+                    exit(1);
+                }
+            }
+        }
+
+        if (mode == 'c') {
+#ifdef _WIN32
+            (void)_setmode(fileno(stdout), _O_BINARY);
+#endif
+            TRACE_BEGIN(t_parse);
+            thecl_t* ecl = module->parse(in, argv[0], version);
+            if (!ecl)
+                exit(1);
+            TRACE_END(t_parse, "parse", current_input);
+            TRACE_BEGIN(t_compile);
+            module->compile(ecl, out);
+            TRACE_END(t_compile, "compile", current_output);
+            thecl_free(ecl);
+        } else if (mode == 'h') {
+            TRACE_BEGIN(t_parse);
+            thecl_t* ecl = module->parse(in, argv[0], version);
+            if (!ecl)
+                exit(1);
+            TRACE_END(t_parse, "parse", current_input);
+            TRACE_BEGIN(t_header);
+            module->create_header(ecl, out);
+            TRACE_END(t_header, "create_header", current_output);
+            thecl_free(ecl);
+        } else if (mode == 'd') {
+#ifdef _WIN32
+            (void)_setmode(fileno(stdin), _O_BINARY);
+#endif
+            if (!thecl_dump(&context, version, in, out))
+                exit(1);
+        }
+        file_close(in);
+        fclose(out);
+
+        if(context.was_error) {
+          printf("%s: %s: there were errors.\n", argv0, argv[0]);
+          exit(1);
+        }
+        exit(0);
+    }
+    default:
+        print_usage();
+        exit(1);
+    }
+}
@@ -27,24 +27,18 @@
  * DAMAGE.
  */
 #include <config.h>
-#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "program.h"
 #include "thecl.h"
+#include "trace.h"
 #include "util.h"
-#include "mygetopt.h"
 
 extern const thecl_module_t th06_ecl;
 extern const thecl_module_t th10_ecl;
 
-eclmap_t *g_eclmap = NULL;
-bool g_ecl_rawoutput = false;
-bool g_ecl_simplecreate = false;
-bool g_ecl_hexdebug = false;
-bool g_ecl_encode_cp932 = false;
-bool g_was_error = false;
+THREAD_LOCAL thecl_context_t* g_ecl_ctx = NULL;
 
 thecl_t*
 thecl_new(
@@ -57,7 +51,7 @@ thecl_new(
     return ecl;
 }
 
-static void
+void
 thecl_free(
     thecl_t* ecl)
 {
@@ -92,6 +86,17 @@ thecl_free(
     }
     list_free_nodes(&ecl->subs);
 
+    thecl_timeline_t* timeline;
+    list_for_each(&ecl->timelines, timeline) {
+        thecl_instr_t* instr;
+        list_for_each(&timeline->instrs, instr)
+            thecl_instr_free(instr);
+        list_free_nodes(&timeline->instrs);
+
+        free(timeline);
+    }
+    list_free_nodes(&ecl->timelines);
+
     free(ecl);
 }
 
@@ -216,12 +221,6 @@ label_time(
     return 0;
 }
 
-static void
-free_globals(void)
-{
-    eclmap_free(g_eclmap);
-}
-
 bool
 is_post_th10(
     unsigned int version)
@@ -257,98 +256,17 @@ get_default_none_rank(unsigned int version) {
     }
 }
 
-static void
-print_usage(void)
-{
-    printf("Usage: %s [-Vrsxj] [[-c | -h | -d] VERSION] [-m ECLMAP]... [INPUT [OUTPUT]]\n"
-           "Options:\n"
-           "  -c  create ECL file\n"
-           "  -h  create header file\n"
-           "  -d  dump ECL file\n"
-           "  -V  display version information and exit\n"
-           "  -m  use map file for translating mnemonics\n"
-           "  -r  output raw ECL opcodes, applying minimal transformations\n"
-           "  -s  use simple creation, which doesn't add any instructions automatically\n"
-           "  -x  add address information for ECL instructions\n"
-           "  -j  convert strings between Shift-JIS and UTF-8\n"
-           "VERSION can be:\n"
-           "  6, 7, 8, 9, 95, 10, 103 (for Uwabami Breakers), 11, 12, 125, 128, 13, 14, 143, 15, 16, 165, 17, 18, 185, 19, or 20\n"
-           /* NEWHU: 20 */
-           "Report bugs to <" PACKAGE_BUGREPORT ">.\n", argv0);
-}
-
-int
-main(int argc, char* argv[])
+const thecl_module_t*
+thecl_module(
+    unsigned int version)
 {
-    FILE* in = stdin;
-    FILE* out = stdout;
-    unsigned int version = 0;
-    int mode = -1;
-    const thecl_module_t* module = NULL;
-
-    current_input = "(stdin)";
-    current_output = "(stdout)";
-
-    g_eclmap = eclmap_new();
-    atexit(free_globals);
-
-    argv0 = util_shortname(argv[0]);
-    int opt;
-    int ind=0;
-    while(argv[util_optind]) {
-        switch(opt = util_getopt(argc, argv, "+:c:h:d:Vm:rsxj")) {
-        case 'c':
-        case 'd':
-        case 'h':
-            if(mode != -1) {
-                fprintf(stderr,"%s: More than one mode specified\n", argv0);
-                print_usage();
-                exit(1);
-            }
-            mode = opt;
-            version = parse_version(util_optarg);
-            break;
-        case 'm': {
-            FILE* map_file = NULL;
-            map_file = fopen(util_optarg, "r");
-            if (!map_file) {
-                fprintf(stderr, "%s: couldn't open %s for reading: %s\n",
-                    argv0, util_optarg, strerror(errno));
-                exit(1);
-            }
-            eclmap_load(version, g_eclmap, map_file, util_optarg);
-            fclose(map_file);
-            break;
-        }
-        case 'r':
-            g_ecl_rawoutput = true;
-            break;
-        case 's':
-            g_ecl_simplecreate = true;
-            break;
-        case 'x':
-            g_ecl_hexdebug = true;
-            break;
-        case 'j':
-            g_ecl_encode_cp932 = true;
-            break;
-        default:
-            util_getopt_default(&ind,argv,opt,print_usage);
-        }
-    }
-    argc = ind;
-    argv[argc] = NULL;
-
-    eclmap_rebuild(g_eclmap);
-
     switch (version) {
     case 6:
     case 7:
     case 8:
     case 9:
     case 95:
-        module = &th06_ecl;
-        break;
+        return &th06_ecl;
     case 10:
     case 103:
     case 11:
@@ -367,103 +285,43 @@ main(int argc, char* argv[])
     case 19:
     case 20:
     /* NEWHU: 20 */
-        module = &th10_ecl;
-        break;
+        return &th10_ecl;
     default:
-        if (mode == 'c' || mode == 'd' || mode == 'h') {
-            if (version == 0)
-                fprintf(stderr, "%s: version must be specified\n", argv0);
-            else
-                fprintf(stderr, "%s: version %u is unsupported\n", argv0, version);
-            exit(1);
-        }
+        return NULL;
     }
+}
 
-    switch (mode)
-    {
-    case 'c':
-    case 'h':
-    case 'd': {
-        if(g_ecl_rawoutput) {
-            if (mode != 'd') {
-                fprintf(stderr, "%s: 'r' option cannot be used while compiling\n", argv0);
-                exit(1);
-            }
-        }
-        if (g_ecl_hexdebug) {
-            if (mode != 'd') {
-                fprintf(stderr, "%s: 'x' option cannot be used while compiling\n", argv0);
-                exit(1);
-            }
-        }
-        if (g_ecl_simplecreate) {
-            if (mode != 'c' && mode != 'h') {
-                fprintf(stderr, "%s: 's' option cannot be used while dumping\n", argv0);
-                exit(1);
-            }
-        }
-        if (mode == 'h' && !is_post_th10(version)) {
-            fprintf(stderr, "%s: 'h' option can't be used with a pre-th10 version\n", argv0);
-            exit(1);
-        }
-
-        if (0 < argc) {
-            current_input = argv[0];
-            in = fopen(argv[0], "rb");
-            if (!in) {
-                fprintf(stderr, "%s: couldn't open %s for reading: %s\n",
-                    argv0, argv[0], strerror(errno));
-                exit(1);
-            }
-            if (1 < argc) {
-                current_output = argv[1];
-                out = fopen(argv[1], "wb");
-                if (!out) {
-                    fprintf(stderr, "%s: couldn't open %s for writing: %s\n",
-                        argv0, argv[1], strerror(errno));
-                    fclose(in);
-                    exit(1);
-                }
-            }
-        }
-
-        if (mode == 'c') {
-#ifdef _WIN32
-            (void)_setmode(fileno(stdout), _O_BINARY);
-#endif
-            thecl_t* ecl = module->parse(in, argv[0], version);
-            if (!ecl)
-                exit(1);
-            module->compile(ecl, out);
-            thecl_free(ecl);
-        } else if (mode == 'h') {
-            thecl_t* ecl = module->parse(in, argv[0], version);
-            if (!ecl)
-                exit(1);
-            module->create_header(ecl, out);
-            thecl_free(ecl);
-        } else if (mode == 'd') {
-#ifdef _WIN32
-            (void)_setmode(fileno(stdin), _O_BINARY);
-#endif
-            thecl_t* ecl = module->open(in, version);
-            if (!ecl)
-                exit(1);
-            module->trans(ecl);
-            module->dump(ecl, out);
-            thecl_free(ecl);
-        }
-        fclose(in);
-        fclose(out);
-
-        if(g_was_error) {
-          printf("%s: %s: there were errors.\n", argv0, argv[0]);
-          exit(1);
-        }
-        exit(0);
+int
+thecl_dump(
+    thecl_context_t* ctx,
+    unsigned int version,
+    FILE* in,
+    FILE* out)
+{
+    const thecl_module_t* module = thecl_module(version);
+    thecl_context_t* saved = g_ecl_ctx;
+    int ret = 0;
+
+    if (!module) {
+        fprintf(stderr, "%s: version %u is unsupported\n", argv0, version);
+        return 0;
     }
-    default:
-        print_usage();
-        exit(1);
+    g_ecl_ctx = ctx;
+
+    TRACE_BEGIN(t_open);
+    thecl_t* ecl = module->open(in, version);
+    if (ecl) {
+        TRACE_END(t_open, "open", ctx->input);
+        TRACE_BEGIN(t_trans);
+        module->trans(ecl);
+        TRACE_END(t_trans, "trans", ctx->input);
+        TRACE_BEGIN(t_dump);
+        module->dump(ecl, out);
+        TRACE_END(t_dump, "dump", ctx->input);
+        thecl_free(ecl);
+        ret = 1;
     }
+
+    g_ecl_ctx = saved;
+    return ret;
 }
@@ -234,6 +234,9 @@ typedef struct {
 thecl_t* thecl_new(
     void);
 
+void thecl_free(
+    thecl_t* ecl);
+
 typedef struct {
     thecl_t* (*open)(FILE* stream, unsigned int ver);
     /* Translates the data to a more general format. */
@@ -275,11 +278,33 @@ typedef struct {
 extern FILE* thecl_yyin;
 extern int thecl_yyparse(parser_state_t*);
 
-extern eclmap_t* g_eclmap;
-extern bool g_ecl_rawoutput;
-extern bool g_ecl_hexdebug;
-extern bool g_ecl_simplecreate;
-extern bool g_ecl_encode_cp932;
-extern bool g_was_error;
+/* Settings and state of one job.  thtk-batch dumps several ECL files at once
+ * on its worker threads, each with a context of its own. */
+typedef struct {
+    /* Shared between jobs, and not changed once loaded. */
+    eclmap_t* eclmap;
+    bool rawoutput;
+    bool hexdebug;
+    bool simplecreate;
+    bool encode_cp932;
+    bool was_error;
+    /* Name of the input for messages. */
+    const char* input;
+} thecl_context_t;
+
+/* The context of the job running on this thread. */
+extern THREAD_LOCAL thecl_context_t* g_ecl_ctx;
+
+/* Returns the module for the version, or NULL if it isn't supported. */
+const thecl_module_t* thecl_module(
+    unsigned int version);
+
+/* Dumps an ECL file as thecl -d does, using ctx for the duration of the call.
+ * Returns 0 if the file couldn't be read, other errors set ctx->was_error. */
+int thecl_dump(
+    thecl_context_t* ctx,
+    unsigned int version,
+    FILE* in,
+    FILE* out);
 
 #endif
@@ -156,7 +156,7 @@ th06_param_to_text(
 {
     if (param->type == 'z' || param->type == 'm') {
         char *zstr = param->value.val.z;
-        if (g_ecl_encode_cp932)
+        if (g_ecl_ctx->encode_cp932)
             zstr = cp932_to_utf8(malloc(cp932_to_utf8_len(zstr) + 1), zstr);
         const size_t zlen = strlen(zstr);
         char* ret = malloc(4 + zlen * 2);
@@ -171,7 +171,7 @@ th06_param_to_text(
         }
         *temp++ = '"';
         *temp++ = '\0';
-        if (g_ecl_encode_cp932)
+        if (g_ecl_ctx->encode_cp932)
             free(zstr);
         return ret;
     } else
@@ -206,7 +206,7 @@ th06_stringify_param(
                 else if (param->value.type == 'f') val = floor(param->value.val.f);
                 else val = param->value.val.s;
 
-                seqmap_entry_t* ent = seqmap_get(g_eclmap->gvar_names, val);
+                seqmap_entry_t* ent = seqmap_get(g_ecl_ctx->eclmap->gvar_names, val);
                 if (ent) {
                     snprintf(temp, 256, "%c%s", param->value.type == 'f' ? '%' : '$', ent->value);
                     return strdup(temp);
@@ -272,7 +272,7 @@ th06_find_timeline_format(
     unsigned int version,
     unsigned int id)
 {
-    seqmap_entry_t *ent = seqmap_get(g_eclmap->timeline_ins_signatures, id);
+    seqmap_entry_t *ent = seqmap_get(g_ecl_ctx->eclmap->timeline_ins_signatures, id);
     if (ent)
         return ent->value;
 
@@ -827,7 +827,7 @@ th06_find_format(
 {
     if (is_timeline) return th06_find_timeline_format(version, id);
 
-    seqmap_entry_t *ent = seqmap_get(g_eclmap->ins_signatures, id);
+    seqmap_entry_t *ent = seqmap_get(g_ecl_ctx->eclmap->ins_signatures, id);
     if (ent)
         return ent->value;
 
@@ -1183,12 +1183,12 @@ th06_dump(
                 fprintf(out, "%s_%u:\n", sub->name, instr->offset);
                 break;
             case THECL_INSTR_INSTR: {
-                if (g_ecl_hexdebug) {
+                if (g_ecl_ctx->hexdebug) {
                     fprintf(out, "    /* %5x (+%5x) */ ", instr->address, instr->offset);
                 } else {
                     fprintf(out, "    ");
                 }
-                seqmap_entry_t *ent = seqmap_get(g_eclmap->ins_names, instr->id);
+                seqmap_entry_t *ent = seqmap_get(g_ecl_ctx->eclmap->ins_names, instr->id);
                 if (ent) {
                     fprintf(out, "%s(", ent->value);
                 } else {
@@ -1248,7 +1248,7 @@ th06_dump(
                 }
                 break;
             case THECL_INSTR_INSTR: {
-                seqmap_entry_t *ent = seqmap_get(g_eclmap->timeline_ins_names, instr->id);
+                seqmap_entry_t *ent = seqmap_get(g_ecl_ctx->eclmap->timeline_ins_names, instr->id);
                 if (ent)
                     fprintf(out, "    %s(", ent->value);
                 else
@@ -1325,7 +1325,7 @@ th06_instr_size(
                 ret += sizeof(uint16_t);
             } else if (param->type == 'o' || param->type == 'N')  {
                 ret += sizeof(uint32_t);
-            } else if (param->type == 'z' && g_ecl_encode_cp932) {
+            } else if (param->type == 'z' && g_ecl_ctx->encode_cp932) {
                 ret += utf8_to_cp932_len(param->value.val.z);
             } else {
                 value_t v = param->value;
@@ -1447,7 +1447,7 @@ th06_instr_serialize(
             param_data += sizeof(uint32_t);
         } else if (param->value.type == 'z') {
             char *zstr = param->value.val.z;
-            if (g_ecl_encode_cp932)
+            if (g_ecl_ctx->encode_cp932)
                 zstr = utf8_to_cp932(malloc(utf8_to_cp932_len(zstr)+1), zstr);
             if (ecl->version == 6) {
                 memset(param_data, 0, 34);
@@ -1476,7 +1476,7 @@ th06_instr_serialize(
                     break;
                 }
             }
-            if (g_ecl_encode_cp932)
+            if (g_ecl_ctx->encode_cp932)
                 free(zstr);
         } else {
             value_t v = param->value;
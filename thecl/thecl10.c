@@ -135,7 +135,7 @@ th10_param_to_text(
     case 'm':
     case 'x': {
         char *zstr = param->value.val.z;
-        if (g_ecl_encode_cp932)
+        if (g_ecl_ctx->encode_cp932)
             zstr = cp932_to_utf8(malloc(cp932_to_utf8_len(zstr) + 1), zstr);
         const size_t zlen = strlen(zstr);
         char* ret = malloc(4 + zlen * 2);
@@ -150,7 +150,7 @@ th10_param_to_text(
         }
         *temp++ = '"';
         *temp++ = '\0';
-        if (g_ecl_encode_cp932)
+        if (g_ecl_ctx->encode_cp932)
             free(zstr);
         return ret;
     }
@@ -1119,7 +1119,7 @@ th10_find_format(
 {
     if (is_timeline) return NULL;
 
-    seqmap_entry_t *ent = seqmap_get(g_eclmap->ins_signatures, id);
+    seqmap_entry_t *ent = seqmap_get(g_ecl_ctx->eclmap->ins_signatures, id);
     if (ent)
         return ent->value;
 
@@ -1244,14 +1244,14 @@ th10_open(
     header = (th10_header_t*)map;
     if (util_strcmp_ref(header->magic, stringref("SCPT")) != 0) {
         fprintf(stderr, "%s:%s: SCPT signature missing\n",
-            argv0, current_input);
+            argv0, g_ecl_ctx->input);
         return NULL;
     }
 
     anim_list = (th10_list_t*)(map + header->include_offset);
     if (util_strcmp_ref(anim_list->magic, stringref("ANIM")) != 0) {
         fprintf(stderr, "%s:%s: ANIM signature missing\n",
-            argv0, current_input);
+            argv0, g_ecl_ctx->input);
         return NULL;
     }
 
@@ -1268,7 +1268,7 @@ th10_open(
     ecli_list = (th10_list_t*)string_data;
     if (util_strcmp_ref(ecli_list->magic, stringref("ECLI")) != 0) {
         fprintf(stderr, "%s:%s: ECLI signature missing\n",
-            argv0, current_input);
+            argv0, g_ecl_ctx->input);
         return NULL;
     }
 
@@ -1314,7 +1314,7 @@ th10_open(
         raw_sub = (th10_sub_t*)(map + sub_offsets[i]);
         if (util_strcmp_ref(raw_sub->magic, stringref("ECLH")) != 0) {
             fprintf(stderr, "%s:%s: ECLH signature missing\n",
-                argv0, current_input);
+                argv0, g_ecl_ctx->input);
             return NULL;
         }
 
@@ -1360,7 +1360,7 @@ th10_open(
             if (param_size_total > 0) {
                 value_t* values = value_list_from_data(th10_value_from_data, instr->data, instr->size - sizeof(th10_instr_t), format);
                 if (!values) {
-                    const seqmap_entry_t* ent = seqmap_get(g_eclmap->ins_names, instr->id);
+                    const seqmap_entry_t* ent = seqmap_get(g_ecl_ctx->eclmap->ins_names, instr->id);
                     if (ent)
                         fprintf(stderr, "%s: error when dumping opcode %d (%s)\n", argv0, instr->id, ent->value);
                     else
@@ -1430,7 +1430,7 @@ th10_set_arity(
     if (sub->arity != -1 &&
         sub->arity != arity) {
         fprintf(stderr, "%s:%s: arity mismatch %zd %u for %s\n",
-            argv0, current_input,
+            argv0, g_ecl_ctx->input,
             sub->arity, arity, sub->name);
     } else {
         sub->arity = arity;
@@ -1466,7 +1466,7 @@ th10_trans(
     if (!ecl)
         return;
 
-    if (!g_ecl_rawoutput) list_for_each(&ecl->subs, sub) {
+    if (!g_ecl_ctx->rawoutput) list_for_each(&ecl->subs, sub) {
         list_node_t* node;
         list_node_t* node_next;
         list_for_each_node_safe(&sub->instrs, node, node_next) {
@@ -1618,7 +1618,7 @@ th10_stringify_param(
 
         if (D->zero != 0) {
             fprintf(stderr, "%s: bad ECL file - 'D' param padding is nonzero\n", argv0);
-            abort();
+            g_ecl_ctx->was_error = true;
         }
 
         if (D->from == 'f' && D->to == 'f') {
@@ -1638,8 +1638,12 @@ th10_stringify_param(
             sprintf(temp, "_SS ");
             new_value.type = 'S';
         } else {
+            /* Dumped as integers, so that the error doesn't stop the dump. */
             fprintf(stderr, "%s: bad ECL file - invalid types in 'D' param\n", argv0);
-            abort();
+            g_ecl_ctx->was_error = true;
+            new_value.val.S = D->val.S;
+            sprintf(temp, "_SS ");
+            new_value.type = 'S';
         }
 
         thecl_param_t temp_param = *param;
@@ -1655,7 +1659,7 @@ th10_stringify_param(
     }
     default: {
         thecl_instr_t* rep = th10_stack_index(node, *removed);
-        if (!g_ecl_rawoutput &&
+        if (!g_ecl_ctx->rawoutput &&
             param->value.type == 'S' &&
             param->stack &&
             param->value.val.S >= 0 &&
@@ -1664,7 +1668,7 @@ th10_stringify_param(
             format_bijective26(&temp[1], param->value.val.S / 4 + 1);
         } else if (
             /* TODO: Also check that it is a multiple of four. */
-            !g_ecl_rawoutput &&
+            !g_ecl_ctx->rawoutput &&
             param->value.type == 'f' &&
             param->stack &&
             param->value.val.f >= 0.0f) {
@@ -1701,7 +1705,7 @@ th10_stringify_param(
         } else {
             if (param->stack && (param->value.type == 'f' || param->value.type == 'S')) {
                 int val = param->value.type == 'f' ? floor(param->value.val.f) : param->value.val.S;
-                seqmap_entry_t* ent = seqmap_get(g_eclmap->gvar_names, val);
+                seqmap_entry_t* ent = seqmap_get(g_ecl_ctx->eclmap->gvar_names, val);
                 if (ent) {
                     sprintf(temp, "%c%s", param->value.type == 'f' ? '%' : '$', ent->value);
                     return strdup(temp);
@@ -1737,7 +1741,7 @@ th10_stringify_instr(
     if (instr->type != THECL_INSTR_INSTR)
         return;
 
-    if (instr->id == TH10_INS_STACK_ALLOC && !g_ecl_rawoutput) {
+    if (instr->id == TH10_INS_STACK_ALLOC && !g_ecl_ctx->rawoutput) {
         if (sub->arity * 4 != sub->stack) {
             /* Don't output empty var declarations. */
             strcat(string, "var");
@@ -1750,7 +1754,7 @@ th10_stringify_instr(
         }
     } else if (
            (instr->id == TH10_INS_CALL || instr->id == TH10_INS_CALL_ASYNC || instr->id == TH10_INS_CALL_ASYNC_ID)
-        && !g_ecl_rawoutput
+        && !g_ecl_ctx->rawoutput
      ) {
          strcat(string, "@");
          size_t removed = 0;
@@ -1769,7 +1773,7 @@ th10_stringify_instr(
 
                 if (D->zero != 0) {
                     fprintf(stderr, "%s: bad ECL file - 'D' param padding is nonzero\n", argv0);
-                    abort();
+                    g_ecl_ctx->was_error = true;
                 }
 
                 if (D->from == 'f' && D->to == 'f') {
@@ -1794,7 +1798,10 @@ th10_stringify_instr(
                 }
                 else {
                     fprintf(stderr, "%s: bad ECL file - invalid types in 'D' param\n", argv0);
-                    abort();
+                    g_ecl_ctx->was_error = true;
+                    new_value.val.S = D->val.S;
+                    strcpy(temp, "%s");
+                    new_value.type = 'S';
                 }
 
                 thecl_param_t temp_param = *param;
@@ -1825,12 +1832,12 @@ th10_stringify_instr(
         }
     } else {
         char *s = string;
-        if (g_ecl_hexdebug) {
+        if (g_ecl_ctx->hexdebug) {
             s += sprintf(s, "/* %5x (+%5x) */ ", instr->address, instr->offset);
             if (s < string)
                 abort();
         }
-        seqmap_entry_t *ent = seqmap_get(g_eclmap->ins_names, instr->id);
+        seqmap_entry_t *ent = seqmap_get(g_ecl_ctx->eclmap->ins_names, instr->id);
         if (ent) {
             sprintf(s, "%s(", ent->value);
         } else {
@@ -1961,7 +1968,7 @@ th10_dump(
                 instr->string = strdup(temp);
                 break;
             case THECL_INSTR_INSTR: {
-                const expr_t* expr = g_ecl_rawoutput ? NULL : expr_get_by_id(ecl->version, instr->id);
+                const expr_t* expr = g_ecl_ctx->rawoutput ? NULL : expr_get_by_id(ecl->version, instr->id);
 
                 if (expr) {
                     char pat[4];
@@ -2061,7 +2068,7 @@ th10_instr_size(
     list_for_each(&instr->params, param) {
         /* XXX: I think 'z' is what will be passed ... */
         if (param->type == 'm' || param->type == 'x') {
-            size_t zlen = g_ecl_encode_cp932 ? utf8_to_cp932_len(param->value.val.z) : strlen(param->value.val.z);
+            size_t zlen = g_ecl_ctx->encode_cp932 ? utf8_to_cp932_len(param->value.val.z) : strlen(param->value.val.z);
             ret += sizeof(uint32_t) + zlen + (4 - (zlen % 4));
         } else if (param->type == 'o' || param->type == 't') {
             ret += sizeof(uint32_t);
@@ -2159,7 +2166,7 @@ th10_instr_serialize(
     int param_count = 0;
     int param_mask_shift = 0;
 
-    seqmap_entry_t* ent = seqmap_get(g_eclmap->ins_names, instr->id);
+    seqmap_entry_t* ent = seqmap_get(g_ecl_ctx->eclmap->ins_names, instr->id);
     char buf[128];
     if (ent == NULL)
         snprintf(buf, sizeof(buf), "%d", instr->id);
@@ -2181,7 +2188,7 @@ th10_instr_serialize(
             fprintf(stderr, "%s:th10_instr_serialize: in sub %s: too few arguments for opcode %s\n", argv0, sub->name, buf);
     }
 
-    if (!g_ecl_simplecreate && (instr->id == TH10_INS_CALL || instr->id == TH10_INS_CALL_ASYNC || instr->id == TH10_INS_CALL_ASYNC_ID)) {
+    if (!g_ecl_ctx->simplecreate && (instr->id == TH10_INS_CALL || instr->id == TH10_INS_CALL_ASYNC || instr->id == TH10_INS_CALL_ASYNC_ID)) {
         /* Validate sub call parameters. */
         list_node_t* node = instr->params.head;
         thecl_param_t* sub_name_param = node->data;
@@ -2248,7 +2255,7 @@ th10_instr_serialize(
             param_data += sizeof(int32_t);
         } else if (param->type == 'x' || param->type == 'm') {
             char *zstr = param->value.val.z;
-            if (g_ecl_encode_cp932)
+            if (g_ecl_ctx->encode_cp932)
                 zstr = utf8_to_cp932(malloc(utf8_to_cp932_len(zstr)+1), zstr);
             size_t zlen = strlen(zstr);
             uint32_t padded_length = zlen + (4 - (zlen % 4));
@@ -2259,7 +2266,7 @@ th10_instr_serialize(
             if (param->type == 'x')
                 util_xor(param_data, padded_length, 0x77, 7, 16);
             param_data += padded_length;
-            if (g_ecl_encode_cp932)
+            if (g_ecl_ctx->encode_cp932)
                 free(zstr);
         } else
             param_data += value_to_data(&param->value, param_data, instr->size - (param_data - (unsigned char*)ret));
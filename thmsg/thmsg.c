@@ -30,8 +30,10 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include "file.h"
 #include "program.h"
 #include "thmsg.h"
+#include "trace.h"
 #include "util.h"
 #include "mygetopt.h"
 
@@ -49,6 +51,7 @@ print_usage(void)
            "  -d  dump a dialogue file\n"
            "  -V  display version information and exit\n"
            "  -e  extract or create ending dialogue\n"
+           "  --trace FILE  write a Chrome trace-event JSON file (for Perfetto)\n"
            "VERSION can be:\n"
            "  6, 7, 8, 9, 95, 10, 11, 12, 125, 128, 13, 14, 143, 15, 16, 165, 17, 18, 185, 19, or 20\n"
            /* NEWHU: 20 */
@@ -68,6 +71,8 @@ main(int argc, char* argv[])
     current_output = "(stdout)";
 
     argv0 = util_shortname(argv[0]);
+    util_stats_at_exit();
+    trace_init_args(&argc, argv);
     int opt;
     int ind=0;
     while(argv[util_optind]) {
@@ -142,7 +147,7 @@ main(int argc, char* argv[])
 
         if (argc > 0) {
             current_input = argv[0];
-            in = fopen(argv[0], "rb");
+            in = file_open_input(argv[0], version);
             if (!in) {
                 fprintf(stderr, "%s: couldn't open %s for reading: %s\n",
                     argv0, argv[0], strerror(errno));
@@ -154,7 +159,7 @@ main(int argc, char* argv[])
                 if (!out) {
                     fprintf(stderr, "%s: couldn't open %s for writing: %s\n",
                         argv0, argv[1], strerror(errno));
-                    fclose(in);
+                    file_close(in);
                     return 1;
                 }
             }
@@ -164,15 +169,19 @@ main(int argc, char* argv[])
 #ifdef _WIN32
             _setmode(fileno(stdout), _O_BINARY);
 #endif
+            TRACE_BEGIN(t);
             ret = module->write(in, out, version);
+            TRACE_END(t, "write", current_output);
         } else {
 #ifdef _WIN32
             _setmode(fileno(stdin), _O_BINARY);
 #endif
+            TRACE_BEGIN(t);
             ret = module->read(in, out, version);
+            TRACE_END(t, "read", current_input);
         }
 
-        fclose(in);
+        file_close(in);
         fclose(out);
 
         if (!ret)
@@ -36,6 +36,7 @@
 #include "file.h"
 #include "thstd.h"
 #include "program.h"
+#include "trace.h"
 #include "util.h"
 #include "value.h"
 #include "mygetopt.h"
@@ -782,6 +783,7 @@ print_usage(void)
     printf("  -V                    display version information and exit\n"
            "  -c                    create STD file\n"
            "  -d                    dump STD file\n"
+           "  --trace FILE          write a Chrome trace-event JSON file (for Perfetto)\n"
            "VERSION can be:\n"
            "  6, 7, 8, 9, 95, 10, 103 (for Uwabami Breakers), 11, 12, 125, 128, 13, 14, 143, 15, 16, 165, 17, 18, 185, 19, or 20\n"
            /* NEWHU: 20 */
@@ -802,6 +804,8 @@ main(
     thstd_t* std;
 
     argv0 = util_shortname(argv[0]);
+    util_stats_at_exit();
+    trace_init_args(&argc, argv);
     int opt;
     int ind=0;
     unsigned int version = 0;
@@ -872,7 +876,7 @@ main(
         }
 
         current_input = argv[0];
-        in = fopen(argv[0], "rb");
+        in = file_open_input(argv[0], version);
         if (!in) {
             fprintf(stderr, "%s: couldn't open %s for reading\n", argv0, current_input);
             exit(1);
@@ -883,14 +887,18 @@ main(
             if (!out) {
                 fprintf(stderr, "%s: couldn't open %s for writing: %s\n",
                         argv0, argv[1], strerror(errno));
-                fclose(in);
+                file_close(in);
                 exit(1);
             }
         }
 
+        TRACE_BEGIN(t_read);
         std = std_read_file(in);
-        fclose(in);
+        file_close(in);
+        TRACE_END(t_read, "std_read_file", current_input);
+        TRACE_BEGIN(t_dump);
         std_dump(out, std);
+        TRACE_END(t_dump, "std_dump", current_input);
         std_free(std);
         fclose(out);
         exit(0);
@@ -900,8 +908,12 @@ main(
             exit(1);
         }
 
+        TRACE_BEGIN(t_create);
         std = std_create(argv[0]);
+        TRACE_END(t_create, "std_create", argv[0]);
+        TRACE_BEGIN(t_write);
         std_write(std, argv[1]);
+        TRACE_END(t_write, "std_write", argv[1]);
         std_free(std);
         exit(0);
         break;
@@ -70,14 +70,21 @@ THTK_EXPORT thdat_t* thdat_create(
 
 /* Initializes the given archive.
  *
- * This function should be called manually when you create th105 archive,
- * after filling out entry names.
+ * This function should be called manually when you create an archive for
+ * which thdat_entry_list_first returns 1, after filling out entry names.
  *
  * 0 indicates an error. */
 THTK_EXPORT int thdat_init(
     thdat_t* thdat,
     thtk_error_t** error);
 
+/* Returns 1 if the format lays out its entry list before any entry data, so
+ * that every entry has to be added with thdat_entry_append before data is
+ * written, and thdat_init is called after the last one.  Other formats accept
+ * new entries until thdat_close. */
+THTK_EXPORT int thdat_entry_list_first(
+    thdat_t* thdat);
+
 /* Writes out the final pieces of data for a created archive.  The stream is
  * not closed.  0 indicates an error. */
 THTK_EXPORT int thdat_close(
@@ -114,6 +121,25 @@ THTK_EXPORT int thdat_entry_set_name(
     const char* name,
     thtk_error_t** error);
 
+/* Adds a named entry to a created archive and returns its index.  Nothing is
+ * added if the name is rejected.  This must not be called while another
+ * thread uses the archive.  -1 indicates an error. */
+THTK_EXPORT ssize_t thdat_entry_append(
+    thdat_t* thdat,
+    const char* name,
+    thtk_error_t** error);
+
+/* Declares the input length an entry's data will be written with.  Entries
+ * of a created archive are hashed to find identical contents, except those
+ * whose declared length no other entry shares, so declaring every length
+ * before writing any data saves that work.  This must not be called while
+ * another thread uses the archive.  0 indicates an error. */
+THTK_EXPORT int thdat_entry_expect_size(
+    thdat_t* thdat,
+    int entry_index,
+    size_t size,
+    thtk_error_t** error);
+
 /* Returns the entry's name.  NULL indicates an error. */
 THTK_EXPORT const char* thdat_entry_get_name(
     thdat_t* thdat,
@@ -136,7 +162,8 @@ THTK_EXPORT ssize_t thdat_entry_get_zsize(
 /* Reads no more bytes than the limit from the input stream, converts the data
  * as needed, and writes it to the archive's current offset using the specified
  * index.  The number of bytes read from the input stream is returned.  -1
- * indicates an error. */
+ * indicates an error.  An input_length of 0 stores an empty entry, which
+ * every format supports. */
 THTK_EXPORT ssize_t thdat_entry_write_data(
     thdat_t* thdat,
     int entry_index,
@@ -153,6 +180,47 @@ THTK_EXPORT ssize_t thdat_entry_read_data(
     thtk_io_t* output,
     thtk_error_t** error);
 
+/* Receives the decoded data of an entry from thdat_extract_all.  The data is
+ * only valid during the call.  0 indicates an error, and stops the
+ * extraction. */
+typedef int (*thdat_extract_callback_t)(
+    void* user,
+    thdat_t* thdat,
+    int entry_index,
+    const void* data,
+    size_t size,
+    thtk_error_t** error);
+
+/* Decodes every entry on a pool of threads and passes the data to callback.
+ * The callback is called from several threads at once, unless ordered is
+ * set, in which case the calls are made one at a time in the order the
+ * entries are stored in the archive while decoding still runs ahead.  0
+ * indicates an error. */
+THTK_EXPORT int thdat_extract_all(
+    thdat_t* thdat,
+    int ordered,
+    thdat_extract_callback_t callback,
+    void* user,
+    thtk_error_t** error);
+
+/* Writes the entry's data as it is stored in the archive, still compressed
+ * and encrypted.  The number of bytes written is returned.  -1 indicates an
+ * error. */
+THTK_EXPORT ssize_t thdat_entry_read_raw(
+    thdat_t* thdat,
+    int entry_index,
+    thtk_io_t* output,
+    thtk_error_t** error);
+
+/* Returns 1 if two entries are stored with the same name, sizes and
+ * encryption parameters, so that equal raw data means equal contents.  0 is
+ * returned otherwise, or if any parameter is invalid. */
+THTK_EXPORT int thdat_entry_raw_comparable(
+    thdat_t* a,
+    int entry_a,
+    thdat_t* b,
+    int entry_b);
+
 #ifdef __cplusplus
 }
 #endif
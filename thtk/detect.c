@@ -335,7 +335,7 @@ thdat_detect_08_95(
     if (thdat) {
         // We go in reverse order, because that's where the files we look for usually are.
         for (size_t i = thdat->entry_count-1; i+1 != 0; i--) {
-            const char *name = thdat->entries[i].name;
+            const char *name = thdat->entries.name[i];
             size_t len = strlen(name);
 
             // thXX_YYYYY.ver
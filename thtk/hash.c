@@ -0,0 +1,333 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include <config.h>
+#include <string.h>
+#include <thtk/hash.h>
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define ROTL64(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+static void
+sha256_block(
+    uint32_t* state,
+    const unsigned char* block)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i)
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16
+             | (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    for (int i = 16; i < 64; ++i) {
+        const uint32_t s0 = ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const uint32_t s1 = ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; ++i) {
+        const uint32_t s1 = ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25);
+        const uint32_t ch = (e & f) ^ (~e & g);
+        const uint32_t t1 = h + s1 + ch + sha256_k[i] + w[i];
+        const uint32_t s0 = ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22);
+        const uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        const uint32_t t2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void
+thtk_sha256_init(
+    thtk_sha256_t* ctx)
+{
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->length = 0;
+}
+
+void
+thtk_sha256_update(
+    thtk_sha256_t* ctx,
+    const void* data,
+    size_t size)
+{
+    const unsigned char* p = data;
+    size_t used = ctx->length % 64;
+    ctx->length += size;
+
+    if (used) {
+        const size_t fill = 64 - used < size ? 64 - used : size;
+        memcpy(ctx->buffer + used, p, fill);
+        p += fill;
+        size -= fill;
+        if (used + fill < 64)
+            return;
+        sha256_block(ctx->state, ctx->buffer);
+    }
+    for (; size >= 64; p += 64, size -= 64)
+        sha256_block(ctx->state, p);
+    memcpy(ctx->buffer, p, size);
+}
+
+void
+thtk_sha256_final(
+    thtk_sha256_t* ctx,
+    unsigned char digest[THTK_SHA256_SIZE])
+{
+    const uint64_t bits = ctx->length * 8;
+    size_t used = ctx->length % 64;
+
+    ctx->buffer[used++] = 0x80;
+    if (used > 56) {
+        memset(ctx->buffer + used, 0, 64 - used);
+        sha256_block(ctx->state, ctx->buffer);
+        used = 0;
+    }
+    memset(ctx->buffer + used, 0, 56 - used);
+    for (int i = 0; i < 8; ++i)
+        ctx->buffer[56 + i] = bits >> (56 - i * 8);
+    sha256_block(ctx->state, ctx->buffer);
+
+    for (int i = 0; i < 8; ++i) {
+        digest[i * 4] = ctx->state[i] >> 24;
+        digest[i * 4 + 1] = ctx->state[i] >> 16;
+        digest[i * 4 + 2] = ctx->state[i] >> 8;
+        digest[i * 4 + 3] = ctx->state[i];
+    }
+}
+
+#define XXH_P1 UINT64_C(11400714785074694791)
+#define XXH_P2 UINT64_C(14029467366897019727)
+#define XXH_P3 UINT64_C(1609587929392839161)
+#define XXH_P4 UINT64_C(9650029242287828579)
+#define XXH_P5 UINT64_C(2870177450012600261)
+
+static uint64_t
+xxh64_read64(
+    const unsigned char* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t
+xxh64_read32(
+    const unsigned char* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t
+xxh64_round(
+    uint64_t acc,
+    uint64_t input)
+{
+    acc += input * XXH_P2;
+    acc = ROTL64(acc, 31);
+    return acc * XXH_P1;
+}
+
+static uint64_t
+xxh64_merge_round(
+    uint64_t acc,
+    uint64_t v)
+{
+    acc ^= xxh64_round(0, v);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+/* The four lanes are independent, which lets the CPU overlap the multiplies. */
+static const unsigned char*
+xxh64_stripes(
+    uint64_t* v,
+    const unsigned char* p,
+    size_t count)
+{
+    uint64_t v1 = v[0], v2 = v[1], v3 = v[2], v4 = v[3];
+    for (size_t i = 0; i < count; ++i, p += 32) {
+        v1 = xxh64_round(v1, xxh64_read64(p));
+        v2 = xxh64_round(v2, xxh64_read64(p + 8));
+        v3 = xxh64_round(v3, xxh64_read64(p + 16));
+        v4 = xxh64_round(v4, xxh64_read64(p + 24));
+    }
+    v[0] = v1;
+    v[1] = v2;
+    v[2] = v3;
+    v[3] = v4;
+    return p;
+}
+
+void
+thtk_xxh64_init(
+    thtk_xxh64_t* ctx,
+    uint64_t seed)
+{
+    ctx->seed = seed;
+    ctx->length = 0;
+    ctx->v[0] = seed + XXH_P1 + XXH_P2;
+    ctx->v[1] = seed + XXH_P2;
+    ctx->v[2] = seed;
+    ctx->v[3] = seed - XXH_P1;
+}
+
+void
+thtk_xxh64_update(
+    thtk_xxh64_t* ctx,
+    const void* data,
+    size_t size)
+{
+    const unsigned char* p = data;
+    size_t used = ctx->length % 32;
+    ctx->length += size;
+
+    if (used) {
+        const size_t fill = 32 - used < size ? 32 - used : size;
+        memcpy(ctx->buffer + used, p, fill);
+        p += fill;
+        size -= fill;
+        if (used + fill < 32)
+            return;
+        xxh64_stripes(ctx->v, ctx->buffer, 1);
+    }
+    p = xxh64_stripes(ctx->v, p, size / 32);
+    memcpy(ctx->buffer, p, size % 32);
+}
+
+uint64_t
+thtk_xxh64_final(
+    const thtk_xxh64_t* ctx)
+{
+    const unsigned char* p = ctx->buffer;
+    size_t left = ctx->length % 32;
+    uint64_t h;
+
+    if (ctx->length >= 32) {
+        h = ROTL64(ctx->v[0], 1) + ROTL64(ctx->v[1], 7)
+          + ROTL64(ctx->v[2], 12) + ROTL64(ctx->v[3], 18);
+        for (int i = 0; i < 4; ++i)
+            h = xxh64_merge_round(h, ctx->v[i]);
+    } else {
+        h = ctx->seed + XXH_P5;
+    }
+    h += ctx->length;
+
+    for (; left >= 8; p += 8, left -= 8) {
+        h ^= xxh64_round(0, xxh64_read64(p));
+        h = ROTL64(h, 27) * XXH_P1 + XXH_P4;
+    }
+    if (left >= 4) {
+        h ^= (uint64_t)xxh64_read32(p) * XXH_P1;
+        h = ROTL64(h, 23) * XXH_P2 + XXH_P3;
+        p += 4;
+        left -= 4;
+    }
+    for (; left; ++p, --left) {
+        h ^= *p * XXH_P5;
+        h = ROTL64(h, 11) * XXH_P1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t
+thtk_xxh64(
+    const void* data,
+    size_t size,
+    uint64_t seed)
+{
+    thtk_xxh64_t ctx;
+    thtk_xxh64_init(&ctx, seed);
+    thtk_xxh64_update(&ctx, data, size);
+    return thtk_xxh64_final(&ctx);
+}
+
+uint32_t
+thtk_fnv1a(
+    uint32_t hash,
+    const void* data,
+    size_t size)
+{
+    const unsigned char* p = data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+size_t
+thtk_probe(
+    size_t slot_count,
+    uint32_t hash,
+    thtk_probe_stop_t stop,
+    const void* table,
+    const void* key)
+{
+    const size_t mask = slot_count - 1;
+    size_t slot = hash & mask;
+    while (!stop(table, slot, key))
+        slot = (slot + 1) & mask;
+    return slot;
+}
@@ -0,0 +1,90 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#ifndef THTK_HASH_H_
+#define THTK_HASH_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#ifndef THTK_EXPORT
+#define THTK_EXPORT /* */
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define THTK_SHA256_SIZE 32
+
+/* SHA-256, as used for the archive sums in contrib/datsums.txt. */
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char buffer[64];
+} thtk_sha256_t;
+
+THTK_EXPORT void thtk_sha256_init(thtk_sha256_t* ctx);
+THTK_EXPORT void thtk_sha256_update(thtk_sha256_t* ctx, const void* data, size_t size);
+THTK_EXPORT void thtk_sha256_final(thtk_sha256_t* ctx, unsigned char digest[THTK_SHA256_SIZE]);
+
+/* XXH64, a fast non-cryptographic hash for comparing file contents. */
+typedef struct {
+    uint64_t v[4];
+    uint64_t seed;
+    uint64_t length;
+    unsigned char buffer[32];
+} thtk_xxh64_t;
+
+THTK_EXPORT void thtk_xxh64_init(thtk_xxh64_t* ctx, uint64_t seed);
+THTK_EXPORT void thtk_xxh64_update(thtk_xxh64_t* ctx, const void* data, size_t size);
+/* Returns the hash of everything passed so far.  The context is not changed,
+ * so more data can be added afterwards. */
+THTK_EXPORT uint64_t thtk_xxh64_final(const thtk_xxh64_t* ctx);
+/* Hashes a single buffer. */
+THTK_EXPORT uint64_t thtk_xxh64(const void* data, size_t size, uint64_t seed);
+
+/* FNV-1a, for the open addressing tables that are keyed by name.  Start with
+ * THTK_FNV1A_INIT, and pass the result back in to hash more data. */
+#define THTK_FNV1A_INIT 2166136261u
+
+THTK_EXPORT uint32_t thtk_fnv1a(uint32_t hash, const void* data, size_t size);
+
+/* Returns 1 if the slot is empty or holds key, 0 to go on probing. */
+typedef int (*thtk_probe_stop_t)(const void* table, size_t slot, const void* key);
+
+/* Probes linearly from hash in a table of slot_count slots, which must be a
+ * power of two with at least one empty slot.  Returns the first slot that
+ * stop accepts. */
+THTK_EXPORT size_t thtk_probe(size_t slot_count, uint32_t hash, thtk_probe_stop_t stop, const void* table, const void* key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
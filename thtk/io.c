@@ -28,11 +28,13 @@
  */
 #include <config.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stddef.h>
 #include <thtk/io.h>
+#include "thstats.h"
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -43,6 +45,14 @@
 #include <windows.h>
 #endif
 
+/* Unbuffered file descriptor backend, used instead of stdio where the
+ * platform provides pread/pwrite. */
+#if defined(HAVE_PREAD) && !defined(_WIN32)
+#define THTK_IO_FD
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
 struct thtk_io_vtable {
     ssize_t (*read)(thtk_io_t *io, void *buf, size_t count, thtk_error_t **error);
     ssize_t (*write)(thtk_io_t *io, const void *buf, size_t count, thtk_error_t **error);
@@ -52,12 +62,26 @@ struct thtk_io_vtable {
     int (*close)(thtk_io_t *io);
     ssize_t (*pread)(thtk_io_t *io, void *buf, size_t count, off_t offset, thtk_error_t **error);
     ssize_t (*pwrite)(thtk_io_t *io, const void *buf, size_t count, off_t offset, thtk_error_t **error);
+    int (*preallocate)(thtk_io_t *io, off_t size, thtk_error_t **error);
+    /* Set for backends that do actual file IO, which is counted in the
+     * process-wide statistics. */
+    int file;
 };
 
 struct thtk_io_t {
     const struct thtk_io_vtable *v;
+    thtk_stats_t stats;
 };
 
+static void
+thtk_io_init(
+    thtk_io_t* io,
+    const struct thtk_io_vtable* v)
+{
+    io->v = v;
+    memset(&io->stats, 0, sizeof(io->stats));
+}
+
 ssize_t
 thtk_io_read(
     thtk_io_t* io,
@@ -70,7 +94,9 @@ thtk_io_read(
         thtk_error_new(error, "invalid parameter passed");
         return -1;
     }
+    THTK_STATS_BEGIN(t);
     ret = io->v->read(io, buf, count, error);
+    THTK_STATS_END(t, &io->stats, io->v->file, THTK_STAT_READ, ret > 0 ? ret : 0);
     if (ret == -1)
         return -1;
     if (ret != (ssize_t)count) {
@@ -92,7 +118,9 @@ thtk_io_write(
         thtk_error_new(error, "invalid parameter passed");
         return -1;
     }
+    THTK_STATS_BEGIN(t);
     ret = io->v->write(io, buf, count, error);
+    THTK_STATS_END(t, &io->stats, io->v->file, THTK_STAT_WRITE, ret > 0 ? ret : 0);
     if (ret == -1)
         return -1;
     if (ret != (ssize_t)count) {
@@ -113,7 +141,10 @@ thtk_io_seek(
         thtk_error_new(error, "invalid parameter passed");
         return (off_t)-1;
     }
-    return io->v->seek(io, offset, whence, error);
+    THTK_STATS_BEGIN(t);
+    off_t ret = io->v->seek(io, offset, whence, error);
+    THTK_STATS_END(t, &io->stats, io->v->file, THTK_STAT_SEEK, 0);
+    return ret;
 }
 
 unsigned char*
@@ -182,7 +213,9 @@ thtk_io_pread(
         return -1;
     }
     if (io->v->pread) {
+        THTK_STATS_BEGIN(t);
         ret = io->v->pread(io, buf, count, offset, error);
+        THTK_STATS_END(t, &io->stats, io->v->file, THTK_STAT_READ, ret > 0 ? ret : 0);
     } else {
 #pragma omp critical
         {
@@ -219,7 +252,9 @@ thtk_io_pwrite(
         return -1;
     }
     if (io->v->pwrite) {
+        THTK_STATS_BEGIN(t);
         ret = io->v->pwrite(io, buf, count, offset, error);
+        THTK_STATS_END(t, &io->stats, io->v->file, THTK_STAT_WRITE, ret > 0 ? ret : 0);
     } else {
 #pragma omp critical
         {
@@ -242,6 +277,81 @@ thtk_io_pwrite(
     return ret;
 }
 
+void
+thtk_io_stats_get(
+    thtk_io_t* io,
+    thtk_stats_t* stats)
+{
+    if (!stats)
+        return;
+    if (io)
+        *stats = io->stats;
+    else
+        memset(stats, 0, sizeof(*stats));
+}
+
+int
+thtk_io_preallocate(
+    thtk_io_t *io,
+    off_t size,
+    thtk_error_t **error)
+{
+    if (!io || size < 0) {
+        thtk_error_new(error, "invalid parameter passed");
+        return 0;
+    }
+    if (!io->v->preallocate)
+        return 1;
+    return io->v->preallocate(io, size, error);
+}
+
+#if defined(HAVE_MMAP) && (defined(MAP_ANON) || defined(MAP_ANONYMOUS))
+static unsigned char*
+thtk_io_mmap_fd(
+    int fd,
+    off_t offset,
+    size_t count,
+    thtk_error_t** error)
+{
+    int pagesize = sysconf(_SC_PAGE_SIZE);
+    int pagemask = pagesize-1;
+    off_t voffset = offset & ~(off_t)pagemask;
+    size_t vcount = count + (offset & pagemask);
+    vcount = (vcount + pagemask) & ~(size_t)pagemask;
+    /* We need an extra page to store the mapping size. Ugly */
+#ifndef MAP_ANON
+#define MAP_ANON MAP_ANONYMOUS
+#endif
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+    unsigned char *map = mmap(NULL, pagesize+vcount, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON|MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED) {
+        thtk_error_new(error, "mmap failed: %s", strerror(errno));
+        return NULL;
+    }
+    if (mmap(map+pagesize, vcount, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fd, voffset) == MAP_FAILED) {
+        munmap(map, pagesize+vcount);
+        thtk_error_new(error, "mmap failed: %s", strerror(errno));
+        return NULL;
+    }
+    /* Due to MAP_NORESERVE this might segfault... but so can any allocation, thanks to overcommit */
+    *(size_t *)map = vcount + pagesize;
+    return map + pagesize + (offset & pagemask);
+}
+
+static void
+thtk_io_munmap(
+    unsigned char* map)
+{
+    int pagesize = sysconf(_SC_PAGE_SIZE);
+    int pagemask = pagesize-1;
+    map -= ((intptr_t)map & pagemask) + pagesize;
+    munmap(map, *(size_t *)map);
+}
+#endif
+
+#ifndef THTK_IO_FD
 struct thtk_io_file {
     thtk_io_t io;
     FILE *stream;
@@ -287,13 +397,22 @@ thtk_io_file_seek(
     thtk_error_t** error)
 {
     struct thtk_io_file *private = (void *)io;
-    /* TODO: use fseeko on Unix, _fseeki64 on Windows */
+#ifdef HAVE_FSEEKO
+    if (fseeko(private->stream, offset, whence) == -1) {
+        thtk_error_new(error, "error while seeking: %s", strerror(errno));
+        return (off_t)-1;
+    }
+
+    return ftello(private->stream);
+#else
+    /* TODO: use _fseeki64 on Windows */
     if (fseek(private->stream, (long)offset, whence) == -1) {
         thtk_error_new(error, "error while seeking: %s", strerror(errno));
         return (off_t)-1;
     }
 
     return ftell(private->stream);
+#endif
 }
 
 #if defined(HAVE_MMAP) && (defined(MAP_ANON) || defined(MAP_ANONYMOUS))
@@ -305,31 +424,7 @@ thtk_io_file_map(
     thtk_error_t** error)
 {
     struct thtk_io_file *private = (void *)io;
-    int pagesize = sysconf(_SC_PAGE_SIZE);
-    int pagemask = pagesize-1;
-    off_t voffset = offset & ~(off_t)pagemask;
-    size_t vcount = count + (offset & pagemask);
-    vcount = (vcount + pagemask) & ~(size_t)pagemask;
-    /* We need an extra page to store the mapping size. Ugly */
-#ifndef MAP_ANON
-#define MAP_ANON MAP_ANONYMOUS
-#endif
-#ifndef MAP_NORESERVE
-#define MAP_NORESERVE 0
-#endif
-    unsigned char *map = mmap(NULL, pagesize+vcount, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON|MAP_NORESERVE, -1, 0);
-    if (map == MAP_FAILED) {
-        thtk_error_new(error, "mmap failed: %s", strerror(errno));
-        return NULL;
-    }
-    if (mmap(map+pagesize, vcount, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fileno_unlocked(private->stream), voffset) == MAP_FAILED) {
-        munmap(map, pagesize+vcount);
-        thtk_error_new(error, "mmap failed: %s", strerror(errno));
-        return NULL;
-    }
-    /* Due to MAP_NORESERVE this might segfault... but so can any allocation, thanks to overcommit */
-    *(size_t *)map = vcount + pagesize;
-    return map + pagesize + (offset & pagemask);
+    return thtk_io_mmap_fd(fileno_unlocked(private->stream), offset, count, error);
 }
 
 static void
@@ -338,10 +433,7 @@ thtk_io_file_unmap(
     unsigned char* map)
 {
     (void)io;
-    int pagesize = sysconf(_SC_PAGE_SIZE);
-    int pagemask = pagesize-1;
-    map -= ((intptr_t)map & pagemask) + pagesize;
-    munmap(map, *(size_t *)map);
+    thtk_io_munmap(map);
 }
 #elif defined(_WIN32)
 static unsigned char*
@@ -512,6 +604,7 @@ thtk_io_file_vtable = {
     .pread  = thtk_io_file_pread,
     .pwrite = thtk_io_file_pwrite,
 #endif
+    .file   = 1,
 };
 
 thtk_io_t*
@@ -521,7 +614,7 @@ thtk_io_open_file(
     thtk_error_t** error)
 {
     struct thtk_io_file *private = malloc(sizeof(*private));
-    private->io.v = &thtk_io_file_vtable;
+    thtk_io_init(&private->io, &thtk_io_file_vtable);
     private->stream = fopen(path, mode);
 
     if (!private->stream) {
@@ -541,7 +634,7 @@ thtk_io_open_file_w(
     thtk_error_t** error)
 {
     struct thtk_io_file *private = malloc(sizeof(*private));
-    private->io.v = &thtk_io_file_vtable;
+    thtk_io_init(&private->io, &thtk_io_file_vtable);
     private->stream = _wfopen(path, mode);
 
     if (!private->stream) {
@@ -553,6 +646,553 @@ thtk_io_open_file_w(
     return &private->io;
 }
 #endif
+#endif
+
+#ifdef THTK_IO_FD
+/* Sequential reads and writes go through a single buffer of this size.
+ * Positional IO and requests at least this large bypass it. */
+#define THTK_IO_FD_BUFSIZE 0x10000
+/* O_DIRECT wants buffer addresses, offsets and sizes aligned to the logical
+ * block size of the device; this covers all common ones. */
+#define THTK_IO_FD_ALIGN 4096
+
+struct thtk_io_fd {
+    thtk_io_t io;
+    int fd;
+    int writable;
+    /* Opened with O_DIRECT, only done for read-only files. */
+    int direct;
+    /* Offset used by read, write and seek. */
+    off_t offset;
+    unsigned char *buf;
+    /* File offset of buf[0]. */
+    off_t buf_offset;
+    size_t buf_len;
+    /* Whether buf holds data that hasn't been written yet. */
+    int buf_dirty;
+    /* After preallocation the file is truncated to end when closed. */
+    int preallocated;
+    off_t end;
+};
+
+static void*
+thtk_io_fd_alloc(
+    size_t size)
+{
+#ifdef HAVE_POSIX_MEMALIGN
+    void *ret;
+    if (posix_memalign(&ret, THTK_IO_FD_ALIGN, size))
+        return NULL;
+    return ret;
+#else
+    return malloc(size);
+#endif
+}
+
+static ssize_t
+thtk_io_fd_pread_full(
+    struct thtk_io_fd *private,
+    void *buf,
+    size_t count,
+    off_t offset)
+{
+    size_t done = 0;
+    while (done < count) {
+        ssize_t ret = pread(private->fd, (unsigned char*)buf + done, count - done, offset + done);
+        if (ret == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (ret == 0)
+            break;
+        done += ret;
+        /* The next request wouldn't be aligned anymore. */
+        if (private->direct)
+            break;
+    }
+    return done;
+}
+
+static ssize_t
+thtk_io_fd_pwrite_full(
+    struct thtk_io_fd *private,
+    const void *buf,
+    size_t count,
+    off_t offset)
+{
+    size_t done = 0;
+    while (done < count) {
+        ssize_t ret = pwrite(private->fd, (const unsigned char*)buf + done, count - done, offset + done);
+        if (ret == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        done += ret;
+    }
+    return done;
+}
+
+/* Reads from the file, going through an aligned bounce buffer if O_DIRECT is
+ * in effect and the request isn't aligned. */
+static ssize_t
+thtk_io_fd_pread_raw(
+    struct thtk_io_fd *private,
+    void *buf,
+    size_t count,
+    off_t offset)
+{
+    const size_t mask = THTK_IO_FD_ALIGN - 1;
+    if (!private->direct ||
+        ((uintptr_t)buf & mask) == 0 && (offset & mask) == 0 && (count & mask) == 0)
+        return thtk_io_fd_pread_full(private, buf, count, offset);
+
+    off_t start = offset & ~(off_t)mask;
+    size_t head = offset - start;
+    size_t len = (head + count + mask) & ~mask;
+    unsigned char *bounce = thtk_io_fd_alloc(len);
+    if (!bounce)
+        return -1;
+    ssize_t ret = thtk_io_fd_pread_full(private, bounce, len, start);
+    if (ret != -1) {
+        ret = (size_t)ret > head ? (size_t)ret - head : 0;
+        if ((size_t)ret > count)
+            ret = count;
+        memcpy(buf, bounce + head, ret);
+    }
+    free(bounce);
+    return ret;
+}
+
+static void
+thtk_io_fd_extend(
+    struct thtk_io_fd *private,
+    off_t end)
+{
+    if (!private->preallocated)
+        return;
+#pragma omp critical(thtk_io_fd_end)
+    if (end > private->end)
+        private->end = end;
+}
+
+static int
+thtk_io_fd_flush(
+    struct thtk_io_fd *private,
+    thtk_error_t **error)
+{
+    if (!private->buf_dirty)
+        return 1;
+    if (thtk_io_fd_pwrite_full(private, private->buf, private->buf_len, private->buf_offset) == -1) {
+        thtk_error_new(error, "error while writing: %s", strerror(errno));
+        return 0;
+    }
+    private->buf_dirty = 0;
+    thtk_io_fd_extend(private, private->buf_offset + private->buf_len);
+    return 1;
+}
+
+static ssize_t
+thtk_io_fd_read(
+    thtk_io_t* io,
+    void* buf,
+    size_t count,
+    thtk_error_t** error)
+{
+    struct thtk_io_fd *private = (void *)io;
+    unsigned char *out = buf;
+    size_t done = 0;
+
+    if (!thtk_io_fd_flush(private, error))
+        return -1;
+
+    while (done < count) {
+        if (private->offset >= private->buf_offset &&
+            private->offset < private->buf_offset + (off_t)private->buf_len) {
+            size_t n = private->buf_offset + private->buf_len - private->offset;
+            if (n > count - done)
+                n = count - done;
+            memcpy(out + done, private->buf + (private->offset - private->buf_offset), n);
+            done += n;
+            private->offset += n;
+            continue;
+        }
+
+        if (count - done >= THTK_IO_FD_BUFSIZE) {
+            ssize_t ret = thtk_io_fd_pread_raw(private, out + done, count - done, private->offset);
+            if (ret == -1) {
+                thtk_error_new(error, "error while reading: %s", strerror(errno));
+                return -1;
+            }
+            done += ret;
+            private->offset += ret;
+            break;
+        }
+
+        off_t start = private->offset;
+        if (private->direct)
+            start &= ~(off_t)(THTK_IO_FD_ALIGN - 1);
+        ssize_t ret = thtk_io_fd_pread_raw(private, private->buf, THTK_IO_FD_BUFSIZE, start);
+        if (ret == -1) {
+            private->buf_len = 0;
+            thtk_error_new(error, "error while reading: %s", strerror(errno));
+            return -1;
+        }
+        private->buf_offset = start;
+        private->buf_len = ret;
+        if (start + ret <= private->offset)
+            break;
+    }
+
+    return done;
+}
+
+static ssize_t
+thtk_io_fd_write(
+    thtk_io_t* io,
+    const void* buf,
+    size_t count,
+    thtk_error_t** error)
+{
+    struct thtk_io_fd *private = (void *)io;
+
+    if (!private->writable) {
+        thtk_error_new(error, "error while writing: %s", strerror(EBADF));
+        return -1;
+    }
+
+    if (private->buf_dirty &&
+        private->offset == private->buf_offset + (off_t)private->buf_len &&
+        private->buf_len + count <= THTK_IO_FD_BUFSIZE) {
+        memcpy(private->buf + private->buf_len, buf, count);
+        private->buf_len += count;
+        private->offset += count;
+        return count;
+    }
+
+    if (!thtk_io_fd_flush(private, error))
+        return -1;
+
+    if (count >= THTK_IO_FD_BUFSIZE) {
+        private->buf_len = 0;
+        ssize_t ret = thtk_io_fd_pwrite_full(private, buf, count, private->offset);
+        if (ret == -1) {
+            thtk_error_new(error, "error while writing: %s", strerror(errno));
+            return -1;
+        }
+        private->offset += ret;
+        thtk_io_fd_extend(private, private->offset);
+        return ret;
+    }
+
+    memcpy(private->buf, buf, count);
+    private->buf_offset = private->offset;
+    private->buf_len = count;
+    private->buf_dirty = 1;
+    private->offset += count;
+    return count;
+}
+
+static off_t
+thtk_io_fd_seek(
+    thtk_io_t* io,
+    off_t offset,
+    int whence,
+    thtk_error_t** error)
+{
+    struct thtk_io_fd *private = (void *)io;
+    off_t base;
+
+    switch (whence) {
+    case SEEK_SET:
+        base = 0;
+        break;
+    case SEEK_CUR:
+        base = private->offset;
+        break;
+    case SEEK_END:
+        if (!thtk_io_fd_flush(private, error))
+            return (off_t)-1;
+        if (private->preallocated) {
+            base = private->end;
+        } else {
+            struct stat st;
+            if (fstat(private->fd, &st) == -1) {
+                thtk_error_new(error, "error while seeking: %s", strerror(errno));
+                return (off_t)-1;
+            }
+            base = st.st_size;
+        }
+        break;
+    default:
+        thtk_error_new(error, "impossible");
+        return (off_t)-1;
+    }
+
+    if (base + offset < 0) {
+        thtk_error_new(error, "error while seeking: %s", strerror(EINVAL));
+        return (off_t)-1;
+    }
+
+    private->offset = base + offset;
+    return private->offset;
+}
+
+#if defined(HAVE_MMAP) && (defined(MAP_ANON) || defined(MAP_ANONYMOUS))
+static unsigned char*
+thtk_io_fd_map(
+    thtk_io_t* io,
+    off_t offset,
+    size_t count,
+    thtk_error_t** error)
+{
+    struct thtk_io_fd *private = (void *)io;
+    if (!thtk_io_fd_flush(private, error))
+        return NULL;
+    return thtk_io_mmap_fd(private->fd, offset, count, error);
+}
+
+static void
+thtk_io_fd_unmap(
+    thtk_io_t* io,
+    unsigned char* map)
+{
+    (void)io;
+    thtk_io_munmap(map);
+}
+#endif
+
+static int
+thtk_io_fd_close(
+    thtk_io_t* io)
+{
+    struct thtk_io_fd *private = (void *)io;
+    int ret = thtk_io_fd_flush(private, NULL);
+    if (private->preallocated && ftruncate(private->fd, private->end) == -1)
+        ret = 0;
+    if (close(private->fd) == -1)
+        ret = 0;
+    free(private->buf);
+    return ret;
+}
+
+/* Positional IO may be used from several threads at once, so the buffer it
+ * has to flush, or drop when writing over it, is only touched in a critical
+ * section.  Read, write and seek must still not run alongside it. */
+static int
+thtk_io_fd_sync_buffer(
+    struct thtk_io_fd *private,
+    off_t offset,
+    size_t count,
+    int drop,
+    thtk_error_t **error)
+{
+    int ret = 1;
+#pragma omp critical(thtk_io_fd_buf)
+    {
+        if (!thtk_io_fd_flush(private, error))
+            ret = 0;
+        else if (drop && private->buf_len &&
+            offset < private->buf_offset + (off_t)private->buf_len &&
+            offset + (off_t)count > private->buf_offset)
+            private->buf_len = 0;
+    }
+    return ret;
+}
+
+static ssize_t
+thtk_io_fd_pread(
+    thtk_io_t *io,
+    void *buf,
+    size_t count,
+    off_t offset,
+    thtk_error_t **error)
+{
+    struct thtk_io_fd *private = (void *)io;
+    if (!thtk_io_fd_sync_buffer(private, offset, count, 0, error))
+        return -1;
+    ssize_t ret = thtk_io_fd_pread_raw(private, buf, count, offset);
+    if (ret == -1) {
+        thtk_error_new(error, "error while reading: %s", strerror(errno));
+        return -1;
+    }
+    return ret;
+}
+
+static ssize_t
+thtk_io_fd_pwrite(
+    thtk_io_t *io,
+    const void *buf,
+    size_t count,
+    off_t offset,
+    thtk_error_t **error)
+{
+    struct thtk_io_fd *private = (void *)io;
+    if (!private->writable) {
+        thtk_error_new(error, "error while writing: %s", strerror(EBADF));
+        return -1;
+    }
+    if (!thtk_io_fd_sync_buffer(private, offset, count, 1, error))
+        return -1;
+    ssize_t ret = thtk_io_fd_pwrite_full(private, buf, count, offset);
+    if (ret == -1) {
+        thtk_error_new(error, "error while writing: %s", strerror(errno));
+        return -1;
+    }
+    thtk_io_fd_extend(private, offset + ret);
+    return ret;
+}
+
+static int
+thtk_io_fd_preallocate(
+    thtk_io_t *io,
+    off_t size,
+    thtk_error_t **error)
+{
+#ifdef HAVE_POSIX_FALLOCATE
+    struct thtk_io_fd *private = (void *)io;
+    struct stat st;
+
+    if (!private->writable)
+        return 1;
+    if (!thtk_io_fd_flush(private, error))
+        return 0;
+    if (fstat(private->fd, &st) == -1) {
+        thtk_error_new(error, "error while preallocating: %s", strerror(errno));
+        return 0;
+    }
+    if (size <= st.st_size)
+        return 1;
+
+    int ret = posix_fallocate(private->fd, 0, size);
+    /* Preallocation is only a hint, so unsupported filesystems are fine. */
+    if (ret == EINVAL || ret == EOPNOTSUPP)
+        return 1;
+    if (ret) {
+        thtk_error_new(error, "error while preallocating: %s", strerror(ret));
+        return 0;
+    }
+    if (!private->preallocated) {
+        private->preallocated = 1;
+        private->end = st.st_size;
+    }
+#else
+    (void)io;
+    (void)size;
+    (void)error;
+#endif
+    return 1;
+}
+
+static const struct thtk_io_vtable
+thtk_io_fd_vtable = {
+    .read   = thtk_io_fd_read,
+    .write  = thtk_io_fd_write,
+    .seek   = thtk_io_fd_seek,
+#if defined(HAVE_MMAP) && (defined(MAP_ANON) || defined(MAP_ANONYMOUS))
+    .map    = thtk_io_fd_map,
+    .unmap  = thtk_io_fd_unmap,
+#endif
+    .close  = thtk_io_fd_close,
+    .pread  = thtk_io_fd_pread,
+    .pwrite = thtk_io_fd_pwrite,
+    .preallocate = thtk_io_fd_preallocate,
+    .file   = 1,
+};
+
+thtk_io_t*
+thtk_io_open_file(
+    const char* path,
+    const char* mode,
+    thtk_error_t** error)
+{
+    int flags;
+    int plus = 0, direct = 0, excl = 0, cloexec = 0;
+
+    for (const char *m = mode + 1; *m; ++m) {
+        switch (*m) {
+        case '+': plus = 1; break;
+        case 'x': excl = 1; break;
+        case 'e': cloexec = 1; break;
+        case 'D': direct = 1; break;
+        }
+    }
+
+    switch (mode[0]) {
+    case 'r':
+        flags = plus ? O_RDWR : O_RDONLY;
+        break;
+    case 'w':
+        flags = (plus ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC;
+        break;
+    case 'a':
+        flags = (plus ? O_RDWR : O_WRONLY) | O_CREAT | O_APPEND;
+        break;
+    default:
+        thtk_error_new(error, "error while opening file `%s': invalid mode `%s'", path, mode);
+        return NULL;
+    }
+    if (excl)
+        flags |= O_EXCL;
+#ifdef O_CLOEXEC
+    if (cloexec)
+        flags |= O_CLOEXEC;
+#endif
+
+    struct thtk_io_fd *private = malloc(sizeof(*private));
+    if (!private) {
+        thtk_error_new(error, "error while opening file `%s': %s", path, strerror(ENOMEM));
+        return NULL;
+    }
+    thtk_io_init(&private->io, &thtk_io_fd_vtable);
+    private->writable = (flags & O_ACCMODE) != O_RDONLY;
+    private->direct = 0;
+    private->fd = -1;
+#if defined(O_DIRECT) && defined(HAVE_POSIX_MEMALIGN)
+    /* O_DIRECT is only used for reading, unaligned writes would need a
+     * read-modify-write cycle. */
+    if (direct && !private->writable) {
+        private->fd = open(path, flags | O_DIRECT, 0666);
+        /* Not every filesystem supports O_DIRECT, so on failure this
+         * falls through to a plain open. */
+        if (private->fd != -1)
+            private->direct = 1;
+    }
+#else
+    (void)direct;
+#endif
+    if (private->fd == -1)
+        private->fd = open(path, flags, 0666);
+
+    if (private->fd == -1) {
+        thtk_error_new(error, "error while opening file `%s': %s", path, strerror(errno));
+        free(private);
+        return NULL;
+    }
+
+    private->offset = 0;
+    if (flags & O_APPEND) {
+        struct stat st;
+        if (fstat(private->fd, &st) == 0)
+            private->offset = st.st_size;
+    }
+    private->buf = thtk_io_fd_alloc(THTK_IO_FD_BUFSIZE);
+    if (!private->buf) {
+        thtk_error_new(error, "error while opening file `%s': %s", path, strerror(ENOMEM));
+        close(private->fd);
+        free(private);
+        return NULL;
+    }
+    private->buf_offset = 0;
+    private->buf_len = 0;
+    private->buf_dirty = 0;
+    private->preallocated = 0;
+    private->end = 0;
+
+    return &private->io;
+}
+#endif
 
 struct thtk_io_memory {
     thtk_io_t io;
@@ -673,7 +1313,7 @@ thtk_io_open_memory(
 {
     (void)error;
     struct thtk_io_memory *private = malloc(sizeof(*private));
-    private->io.v = &thtk_io_memory_vtable;
+    thtk_io_init(&private->io, &thtk_io_memory_vtable);
     private->offset = 0;
     private->size = size;
     private->memory = buf;
@@ -810,7 +1450,7 @@ thtk_io_open_growing_memory(
 {
     (void)error;
     struct thtk_io_growing_memory *private = malloc(sizeof(*private));
-    private->io.v = &thtk_io_growing_memory_vtable;
+    thtk_io_init(&private->io, &thtk_io_growing_memory_vtable);
     private->offset = 0;
     private->size = 0;
     private->memory_size = 0;
@@ -818,3 +1458,124 @@ thtk_io_open_growing_memory(
 
     return &private->io;
 }
+
+struct thtk_io_callback {
+    thtk_io_t io;
+    thtk_io_write_callback_t write;
+    void *user;
+    off_t offset;
+    size_t used;
+    int failed;
+    unsigned char buffer[65536];
+};
+
+static int
+thtk_io_callback_flush(
+    struct thtk_io_callback *private,
+    thtk_error_t **error)
+{
+    if (private->used) {
+        const size_t used = private->used;
+        private->used = 0;
+        if (!private->write(private->user, private->buffer, used, error)) {
+            private->failed = 1;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static ssize_t
+thtk_io_callback_read(
+    thtk_io_t* io,
+    void* buf,
+    size_t count,
+    thtk_error_t** error)
+{
+    (void)io;
+    (void)buf;
+    (void)count;
+    thtk_error_new(error, "callback IO is write-only");
+    return -1;
+}
+
+static ssize_t
+thtk_io_callback_write(
+    thtk_io_t* io,
+    const void* buf,
+    size_t count,
+    thtk_error_t** error)
+{
+    struct thtk_io_callback *private = (void *)io;
+    if (private->used + count > sizeof(private->buffer)) {
+        if (!thtk_io_callback_flush(private, error))
+            return -1;
+        if (count >= sizeof(private->buffer)) {
+            if (!private->write(private->user, buf, count, error)) {
+                private->failed = 1;
+                return -1;
+            }
+            private->offset += count;
+            return count;
+        }
+    }
+    memcpy(private->buffer + private->used, buf, count);
+    private->used += count;
+    private->offset += count;
+    return count;
+}
+
+static off_t
+thtk_io_callback_seek(
+    thtk_io_t* io,
+    off_t offset,
+    int whence,
+    thtk_error_t** error)
+{
+    struct thtk_io_callback *private = (void *)io;
+    if ((whence == SEEK_CUR && offset == 0) ||
+        (whence != SEEK_CUR && offset == private->offset))
+        return private->offset;
+    thtk_error_new(error, "callback IO is not seekable");
+    return (off_t)-1;
+}
+
+static int
+thtk_io_callback_close(
+    thtk_io_t* io)
+{
+    struct thtk_io_callback *private = (void *)io;
+    thtk_error_t *error = NULL;
+    if (!thtk_io_callback_flush(private, &error))
+        thtk_error_free(&error);
+    return !private->failed;
+}
+
+static const struct thtk_io_vtable
+thtk_io_callback_vtable = {
+    .read   = thtk_io_callback_read,
+    .write  = thtk_io_callback_write,
+    .seek   = thtk_io_callback_seek,
+    .close  = thtk_io_callback_close,
+};
+
+thtk_io_t*
+thtk_io_open_callback(
+    thtk_io_write_callback_t write,
+    void* user,
+    thtk_error_t** error)
+{
+    if (!write) {
+        thtk_error_new(error, "invalid parameter passed");
+        return NULL;
+    }
+    struct thtk_io_callback *private = malloc(sizeof(*private));
+    thtk_io_init(&private->io, &thtk_io_callback_vtable);
+    private->write = write;
+    private->user = user;
+    private->offset = 0;
+    private->used = 0;
+    private->failed = 0;
+
+    return &private->io;
+}
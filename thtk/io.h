@@ -63,7 +63,14 @@ THTK_EXPORT ssize_t thtk_io_pread(thtk_io_t* io, void* buf, size_t count, off_t
  * -1 on error. */
 THTK_EXPORT ssize_t thtk_io_pwrite(thtk_io_t* io, const void* buf, size_t count, off_t offset, thtk_error_t** error);
 
-/* Opens a file in the mode specified, the mode works as it does for fopen. */
+/* Hints that the IO object will grow to about size bytes, so that space can be
+ * reserved up front.  Space that ends up unused is released when the object is
+ * closed.  Returns 0 on error, otherwise 1. */
+THTK_EXPORT int thtk_io_preallocate(thtk_io_t* io, off_t size, thtk_error_t** error);
+
+/* Opens a file in the mode specified, the mode works as it does for fopen.
+ * Where supported, a 'D' in the mode of a read-only file requests unbuffered
+ * O_DIRECT access to bypass the page cache. */
 THTK_EXPORT thtk_io_t* thtk_io_open_file(const char* path, const char* mode, thtk_error_t** error);
 #ifdef _WIN32
 THTK_EXPORT thtk_io_t* thtk_io_open_file_w(const wchar_t* path, const wchar_t* mode, thtk_error_t** error);
@@ -72,6 +79,13 @@ THTK_EXPORT thtk_io_t* thtk_io_open_file_w(const wchar_t* path, const wchar_t* m
 THTK_EXPORT thtk_io_t* thtk_io_open_memory(void* buf, size_t size, thtk_error_t** error);
 /* Creates a new memory buffer that automatically expands. */
 THTK_EXPORT thtk_io_t* thtk_io_open_growing_memory(thtk_error_t** error);
+/* Receives the data written to a callback IO object.  Returns 0 on error,
+ * otherwise 1. */
+typedef int (*thtk_io_write_callback_t)(void* user, const void* buf, size_t count, thtk_error_t** error);
+/* Creates a write-only IO object that passes everything written to it on to
+ * the callback, in blocks of up to 64 KiB.  Buffered data is passed on when
+ * the object is closed, and thtk_io_close returns 0 if any call failed. */
+THTK_EXPORT thtk_io_t* thtk_io_open_callback(thtk_io_write_callback_t write, void* user, thtk_error_t** error);
 
 #ifdef __cplusplus
 }
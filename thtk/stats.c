@@ -0,0 +1,267 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <thtk/thtk.h>
+#include "thdat.h"
+#include "thstats.h"
+
+#ifdef WITH_STATS
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/* -1 until the environment has been checked.  Threads may check it at the
+ * same time, so it is only accessed atomically; they all store the same
+ * value. */
+static int thtk_stats_state = -1;
+static thtk_stats_t thtk_stats_global;
+static THREAD_LOCAL thtk_stats_t* thtk_stats_sink;
+
+int
+thtk_stats_on(
+    void)
+{
+    int state;
+#pragma omp atomic read
+    state = thtk_stats_state;
+    if (state < 0) {
+        const char* env = getenv("THTK_STATS");
+        state = env && *env && strcmp(env, "0") != 0;
+#pragma omp atomic write
+        thtk_stats_state = state;
+    }
+    return state;
+}
+
+static void
+thtk_stats_add(
+    thtk_stats_t* stats,
+    thtk_stat_kind_t kind,
+    uint64_t bytes,
+    uint64_t nsec)
+{
+    thtk_stat_t* stat = &stats->stat[kind];
+    /* OpenMP atomics are relaxed unless asked otherwise, which is all that
+     * counters need. */
+#pragma omp atomic
+    stat->calls += 1;
+#pragma omp atomic
+    stat->bytes += bytes;
+#pragma omp atomic
+    stat->nsec += nsec;
+}
+
+void
+thtk_stats_record(
+    thtk_stats_t* local,
+    int shared,
+    thtk_stat_kind_t kind,
+    uint64_t bytes,
+    uint64_t nsec)
+{
+    if (local)
+        thtk_stats_add(local, kind, bytes, nsec);
+    if (shared) {
+        thtk_stats_add(&thtk_stats_global, kind, bytes, nsec);
+        if (thtk_stats_sink && thtk_stats_sink != local)
+            thtk_stats_add(thtk_stats_sink, kind, bytes, nsec);
+    }
+}
+
+thtk_stats_t*
+thtk_stats_set_sink(
+    thtk_stats_t* stats)
+{
+    thtk_stats_t* prev = thtk_stats_sink;
+    thtk_stats_sink = stats;
+    return prev;
+}
+#endif
+
+uint64_t
+thtk_stats_now(
+    void)
+{
+#if defined(_WIN32)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (uint64_t)(count.QuadPart / freq.QuadPart) * 1000000000 +
+        (uint64_t)(count.QuadPart % freq.QuadPart) * 1000000000 / freq.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    return (uint64_t)clock() * (1000000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+int
+thtk_stats_enabled(
+    void)
+{
+#ifdef WITH_STATS
+    return THTK_STATS_ON();
+#else
+    return 0;
+#endif
+}
+
+void
+thtk_stats_enable(
+    int enable)
+{
+#ifdef WITH_STATS
+#pragma omp atomic write
+    thtk_stats_state = !!enable;
+#else
+    (void)enable;
+#endif
+}
+
+static void
+thtk_stats_copy(
+    thtk_stats_t* dst,
+    const thtk_stats_t* src)
+{
+    for (int i = 0; i < THTK_STAT_COUNT; ++i) {
+#pragma omp atomic read
+        dst->stat[i].calls = src->stat[i].calls;
+#pragma omp atomic read
+        dst->stat[i].bytes = src->stat[i].bytes;
+#pragma omp atomic read
+        dst->stat[i].nsec = src->stat[i].nsec;
+    }
+}
+
+void
+thtk_stats_get(
+    thtk_stats_t* stats)
+{
+    if (!stats)
+        return;
+#ifdef WITH_STATS
+    thtk_stats_copy(stats, &thtk_stats_global);
+#else
+    memset(stats, 0, sizeof(*stats));
+#endif
+}
+
+void
+thdat_stats_get(
+    thdat_t* thdat,
+    thtk_stats_t* stats)
+{
+    if (!stats)
+        return;
+    if (thdat)
+        thtk_stats_copy(stats, &thdat->stats);
+    else
+        memset(stats, 0, sizeof(*stats));
+}
+
+const char*
+thtk_stats_name(
+    thtk_stat_kind_t kind)
+{
+    static const char* names[THTK_STAT_COUNT] = {
+        [THTK_STAT_READ] = "read",
+        [THTK_STAT_WRITE] = "write",
+        [THTK_STAT_SEEK] = "seek",
+        [THTK_STAT_LZSS] = "lzss",
+        [THTK_STAT_UNLZSS] = "unlzss",
+        [THTK_STAT_ENCRYPT] = "encrypt",
+        [THTK_STAT_DECRYPT] = "decrypt",
+    };
+    if ((unsigned int)kind >= THTK_STAT_COUNT)
+        return NULL;
+    return names[kind];
+}
+
+void
+thtk_stats_print(
+    FILE* stream,
+    const char* prefix,
+    const thtk_stats_t* stats)
+{
+    if (!stream || !stats)
+        return;
+    if (!prefix)
+        prefix = "";
+    fprintf(stream, "%s%-8s %10s %14s %12s %10s\n",
+        prefix, "stat", "calls", "bytes", "time (ms)", "MB/s");
+    for (int i = 0; i < THTK_STAT_COUNT; ++i) {
+        const thtk_stat_t* stat = &stats->stat[i];
+        if (!stat->calls)
+            continue;
+        double ms = stat->nsec / 1e6;
+        double mbps = stat->nsec ? (stat->bytes / 1e6) / (stat->nsec / 1e9) : 0.0;
+        fprintf(stream, "%s%-8s %10" PRIu64 " %14" PRIu64 " %12.3f %10.1f\n",
+            prefix, thtk_stats_name(i), stat->calls, stat->bytes, ms, mbps);
+    }
+}
+
+uint64_t
+thtk_stats_begin(
+    void)
+{
+#ifdef WITH_STATS
+    return THTK_STATS_ON() ? thtk_stats_now() : 0;
+#else
+    return 0;
+#endif
+}
+
+void
+thtk_stats_end(
+    uint64_t start,
+    thtk_stat_kind_t kind,
+    uint64_t bytes)
+{
+#ifdef WITH_STATS
+    if (start && (unsigned int)kind < THTK_STAT_COUNT)
+        thtk_stats_record(NULL, 1, kind, bytes, thtk_stats_now() - start);
+#else
+    (void)start;
+    (void)kind;
+    (void)bytes;
+#endif
+}
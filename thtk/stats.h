@@ -0,0 +1,125 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#ifndef THTK_STATS_H_
+#define THTK_STATS_H_
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <thtk/io.h>
+#include <thtk/dat.h>
+
+#ifndef THTK_EXPORT
+#define THTK_EXPORT /* */
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    THTK_STAT_READ,
+    THTK_STAT_WRITE,
+    THTK_STAT_SEEK,
+    THTK_STAT_LZSS,
+    THTK_STAT_UNLZSS,
+    THTK_STAT_ENCRYPT,
+    THTK_STAT_DECRYPT,
+    THTK_STAT_COUNT
+} thtk_stat_kind_t;
+
+typedef struct {
+    uint64_t calls;
+    /* Bytes processed.  For LZSS this is the uncompressed size. */
+    uint64_t bytes;
+    /* Wall-clock time spent, summed over all threads. */
+    uint64_t nsec;
+} thtk_stat_t;
+
+typedef struct {
+    thtk_stat_t stat[THTK_STAT_COUNT];
+} thtk_stats_t;
+
+/* Returns 1 if counters are being collected.  Collection is off unless
+ * THTK_STATS=1 is set in the environment or thtk_stats_enable was called, and
+ * it is never on when the library was built without WITH_STATS. */
+THTK_EXPORT int thtk_stats_enabled(
+    void);
+
+/* Turns collection on or off, overriding the environment. */
+THTK_EXPORT void thtk_stats_enable(
+    int enable);
+
+/* Copies the process-wide counters.  Read, write and seek only count file
+ * IO, not memory buffers. */
+THTK_EXPORT void thtk_stats_get(
+    thtk_stats_t* stats);
+
+/* Copies the counters of a single IO object. */
+THTK_EXPORT void thtk_io_stats_get(
+    thtk_io_t* io,
+    thtk_stats_t* stats);
+
+/* Copies the counters of work done on behalf of an archive: file IO and
+ * codec calls made by thdat_open, thdat_close and the entry functions. */
+THTK_EXPORT void thdat_stats_get(
+    thdat_t* thdat,
+    thtk_stats_t* stats);
+
+/* Returns a short name for a counter, e.g. "read" or "unlzss". */
+THTK_EXPORT const char* thtk_stats_name(
+    thtk_stat_kind_t kind);
+
+/* Prints a table of non-zero counters, each line prefixed with prefix. */
+THTK_EXPORT void thtk_stats_print(
+    FILE* stream,
+    const char* prefix,
+    const thtk_stats_t* stats);
+
+/* Returns a monotonic timestamp in nanoseconds, from the clock the counters
+ * are timed with.  It is available even without WITH_STATS. */
+THTK_EXPORT uint64_t thtk_stats_now(
+    void);
+
+/* Starts timing an operation that is done outside of the library.  Returns
+ * 0 if collection is off. */
+THTK_EXPORT uint64_t thtk_stats_begin(
+    void);
+
+/* Adds an operation started by thtk_stats_begin to the process-wide
+ * counters.  Does nothing if start is 0. */
+THTK_EXPORT void thtk_stats_end(
+    uint64_t start,
+    thtk_stat_kind_t kind,
+    uint64_t bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
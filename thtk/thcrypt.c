@@ -31,6 +31,7 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include "thcrypt.h"
+#include "thstats.h"
 
 void
 th_encrypt(
@@ -43,6 +44,8 @@ th_encrypt(
 {
     const unsigned char* end;
     unsigned char* temp = malloc(block);
+    const unsigned int total = size;
+    THTK_STATS_BEGIN(t);
     unsigned int increment = (block >> 1) + (block & 1);
 
     if (size < block >> 2)
@@ -81,6 +84,7 @@ th_encrypt(
     }
 
     free(temp);
+    THTK_STATS_END(t, NULL, 1, THTK_STAT_ENCRYPT, total);
 }
 
 void
@@ -94,6 +98,8 @@ th_decrypt(
 {
     const unsigned char* end;
     unsigned char* temp = malloc(block);
+    const unsigned int total = size;
+    THTK_STATS_BEGIN(t);
     unsigned int increment = (block >> 1) + (block & 1);
 
     if (size < block >> 2)
@@ -132,4 +138,5 @@ th_decrypt(
     }
 
     free(temp);
+    THTK_STATS_END(t, NULL, 1, THTK_STAT_DECRYPT, total);
 }
@@ -28,11 +28,15 @@
  */
 #include <config.h>
 #include <ctype.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <stdlib.h>
 #include <string.h>
 #include <thtk/thtk.h>
 #include "thdat.h"
 #include "thrle.h"
+#include "thstats.h"
 
 extern const thdat_module_t archive_th02;
 extern const thdat_module_t archive_th06;
@@ -92,15 +96,241 @@ thdat_version_to_module(
     return NULL;
 }
 
-void
-thdat_entry_init(
-    thdat_entry_t* entry)
+struct thdat_name_block_t {
+    thdat_name_block_t* next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+#define THDAT_NAME_BLOCK_SIZE 16384
+
+typedef struct {
+    const char* name;
+    size_t len;
+} thdat_name_key_t;
+
+static int
+thdat_name_stop(
+    const void* table,
+    size_t slot,
+    const void* key)
+{
+    const char* const* slots = table;
+    const thdat_name_key_t* k = key;
+    return !slots[slot] ||
+        (strncmp(slots[slot], k->name, k->len) == 0 && slots[slot][k->len] == '\0');
+}
+
+/* Returns the slot holding name, or the empty slot where it belongs. */
+static size_t
+thdat_name_slot(
+    const thdat_name_pool_t* pool,
+    const char* name,
+    size_t len)
 {
-    if (entry) {
-        memset(entry->name, 0, sizeof(entry->name));
-        entry->extra = 0;
-        entry->offset = entry->zsize = entry->size = -1;
+    const thdat_name_key_t key = { name, len };
+    return thtk_probe(pool->slot_count, thtk_fnv1a(THTK_FNV1A_INIT, name, len),
+        thdat_name_stop, pool->slots, &key);
+}
+
+static const char*
+thdat_name_intern(
+    thdat_name_pool_t* pool,
+    const char* name,
+    size_t len,
+    thtk_error_t** error)
+{
+    if ((pool->used + 1) * 2 > pool->slot_count) {
+        thdat_name_pool_t grown = *pool;
+        grown.slot_count = pool->slot_count ? pool->slot_count * 2 : 256;
+        if (!(grown.slots = calloc(grown.slot_count, sizeof(*grown.slots)))) {
+            thtk_error_new(error, "out of memory");
+            return NULL;
+        }
+        for (size_t i = 0; i < pool->slot_count; ++i) {
+            const char* old = pool->slots[i];
+            if (old)
+                grown.slots[thdat_name_slot(&grown, old, strlen(old))] = old;
+        }
+        free(pool->slots);
+        *pool = grown;
     }
+
+    const size_t slot = thdat_name_slot(pool, name, len);
+    if (pool->slots[slot])
+        return pool->slots[slot];
+
+    thdat_name_block_t* block = pool->blocks;
+    if (!block || block->size - block->used < len + 1) {
+        const size_t size = len + 1 > THDAT_NAME_BLOCK_SIZE ? len + 1 : THDAT_NAME_BLOCK_SIZE;
+        if (!(block = malloc(sizeof(*block) + size))) {
+            thtk_error_new(error, "out of memory");
+            return NULL;
+        }
+        block->next = pool->blocks;
+        block->size = size;
+        block->used = 0;
+        pool->blocks = block;
+    }
+
+    char* copy = block->data + block->used;
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+    block->used += len + 1;
+
+    pool->slots[slot] = copy;
+    ++pool->used;
+    return copy;
+}
+
+/* Returns the pooled copy of name, or NULL if no entry has ever used it. */
+static const char*
+thdat_name_find(
+    const thdat_name_pool_t* pool,
+    const char* name)
+{
+    if (!pool->used)
+        return NULL;
+    return pool->slots[thdat_name_slot(pool, name, strlen(name))];
+}
+
+static void
+thdat_name_pool_free(
+    thdat_name_pool_t* pool)
+{
+    thdat_name_block_t* block = pool->blocks;
+    while (block) {
+        thdat_name_block_t* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(pool->slots);
+}
+
+struct thdat_dedup_record_t {
+    unsigned char digest[THTK_SHA256_SIZE];
+    size_t size;
+    const void* key;
+    /* The entry that was converted. */
+    int source;
+    /* 0 while the source is being written, 1 once it is, and -1 if that
+     * failed. */
+    int done;
+#ifdef _OPENMP
+    /* Held by the source's writer until done is set. */
+    omp_lock_t lock;
+#endif
+};
+
+static void
+thdat_dedup_free(
+    thdat_dedup_t* dedup)
+{
+    for (size_t i = 0; i < dedup->slot_count; ++i) {
+#ifdef _OPENMP
+        if (dedup->slots[i])
+            omp_destroy_lock(&dedup->slots[i]->lock);
+#endif
+        free(dedup->slots[i]);
+    }
+    free(dedup->slots);
+    free(dedup->expected);
+    free(dedup->lengths);
+}
+
+int
+thdat_entries_reserve(
+    thdat_t* thdat,
+    size_t count,
+    thtk_error_t** error)
+{
+    thdat_entries_t* entries = &thdat->entries;
+    if (count <= entries->capacity)
+        return 1;
+    if (count < entries->capacity * 2)
+        count = entries->capacity * 2;
+
+    void* name = realloc(entries->name, count * sizeof(*entries->name));
+    if (name)
+        entries->name = name;
+    void* extra = realloc(entries->extra, count * sizeof(*entries->extra));
+    if (extra)
+        entries->extra = extra;
+    void* size = realloc(entries->size, count * sizeof(*entries->size));
+    if (size)
+        entries->size = size;
+    void* zsize = realloc(entries->zsize, count * sizeof(*entries->zsize));
+    if (zsize)
+        entries->zsize = zsize;
+    void* offset = realloc(entries->offset, count * sizeof(*entries->offset));
+    if (offset)
+        entries->offset = offset;
+
+    if (!name || !extra || !size || !zsize || !offset) {
+        thtk_error_new(error, "out of memory");
+        return 0;
+    }
+    entries->capacity = count;
+    return 1;
+}
+
+int
+thdat_entries_resize(
+    thdat_t* thdat,
+    size_t count,
+    thtk_error_t** error)
+{
+    if (!thdat_entries_reserve(thdat, count, error))
+        return 0;
+    thdat_entries_t* entries = &thdat->entries;
+    for (size_t e = thdat->entry_count; e < count; ++e) {
+        entries->name[e] = "";
+        entries->extra[e] = 0;
+        entries->offset[e] = entries->zsize[e] = entries->size[e] = -1;
+    }
+    thdat->entry_count = count;
+    return 1;
+}
+
+/* Entries of a new archive start out empty, so that one whose data is never
+ * written still gets a sane header record. */
+static void
+thdat_entries_clear(
+    thdat_t* thdat,
+    size_t first)
+{
+    thdat_entries_t* entries = &thdat->entries;
+    for (size_t e = first; e < thdat->entry_count; ++e)
+        entries->offset[e] = entries->zsize[e] = entries->size[e] = 0;
+}
+
+ssize_t
+thdat_entry_add(
+    thdat_t* thdat,
+    thtk_error_t** error)
+{
+    if (!thdat_entries_resize(thdat, thdat->entry_count + 1, error))
+        return -1;
+    return thdat->entry_count - 1;
+}
+
+int
+thdat_entry_store_name(
+    thdat_t* thdat,
+    size_t entry,
+    const char* name,
+    size_t len,
+    thtk_error_t** error)
+{
+    const char* end = memchr(name, '\0', len);
+    if (end)
+        len = end - name;
+    const char* pooled = thdat_name_intern(&thdat->names, name, len, error);
+    if (!pooled)
+        return 0;
+    thdat->entries.name[entry] = pooled;
+    return 1;
 }
 
 static thdat_t*
@@ -122,9 +352,13 @@ thdat_new(
     }
     thdat->stream = stream;
     thdat->entry_count = 0;
-    thdat->entries = NULL;
+    memset(&thdat->entries, 0, sizeof(thdat->entries));
+    memset(&thdat->names, 0, sizeof(thdat->names));
+    memset(&thdat->dedup, 0, sizeof(thdat->dedup));
     thdat->offset = 0;
     thdat->inited = 0;
+    thdat->data_written = 0;
+    memset(&thdat->stats, 0, sizeof(thdat->stats));
     return thdat;
 }
 
@@ -143,7 +377,10 @@ thdat_open(
         return NULL;
     if (!(thdat = thdat_new(version, input, error)))
         return NULL;
-    if (!thdat->module->open(thdat, error)) {
+    THTK_STATS_SINK_BEGIN(sink, &thdat->stats);
+    int ret = thdat->module->open(thdat, error);
+    THTK_STATS_SINK_END(sink);
+    if (!ret) {
         thdat_free(thdat);
         return NULL;
     }
@@ -157,7 +394,10 @@ thdat_init(
 {
     if (thdat->inited)
         return 1;
-    if (!thdat->module->create(thdat, error)) {
+    THTK_STATS_SINK_BEGIN(sink, &thdat->stats);
+    int ret = thdat->module->create(thdat, error);
+    THTK_STATS_SINK_END(sink);
+    if (!ret) {
         thdat_free(thdat);
         return 0;
     }
@@ -181,22 +421,91 @@ thdat_create(
         return NULL;
     if (!(thdat = thdat_new(version, output, error)))
         return NULL;
-    thdat->entry_count = entry_count;
-    thdat->entries = calloc(entry_count, sizeof(thdat_entry_t));
+    if (!thdat_entries_resize(thdat, entry_count, error)) {
+        thdat_free(thdat);
+        return NULL;
+    }
+    thdat_entries_clear(thdat, 0);
     if (!(thdat->module->flags & THDAT_LATE_INIT))
         if (!thdat_init(thdat, error))
             return NULL;
     return thdat;
 }
 
+int
+thdat_entry_list_first(
+    thdat_t* thdat)
+{
+    return thdat && (thdat->module->flags & (THDAT_LATE_INIT | THDAT_COUNTED_HEADER));
+}
+
+typedef struct {
+    ssize_t offset;
+    size_t index;
+} thdat_sort_key_t;
+
 static int
-thdat_entry_compar(
+thdat_sort_key_compar(
     const void* a,
     const void* b)
 {
-    const thdat_entry_t* ea = a;
-    const thdat_entry_t* eb = b;
-    return (int)ea->offset - eb->offset;
+    const thdat_sort_key_t* ka = a;
+    const thdat_sort_key_t* kb = b;
+    if (ka->offset != kb->offset)
+        return ka->offset < kb->offset ? -1 : 1;
+    return ka->index < kb->index ? -1 : ka->index > kb->index;
+}
+
+static void
+thdat_permute(
+    void* field,
+    size_t elem_size,
+    const thdat_sort_key_t* keys,
+    size_t count,
+    unsigned char* scratch)
+{
+    const unsigned char* src = field;
+    for (size_t i = 0; i < count; ++i)
+        memcpy(scratch + i * elem_size, src + keys[i].index * elem_size, elem_size);
+    memcpy(field, scratch, count * elem_size);
+}
+
+/* Puts the entries in the order they are stored in the archive.  Only the
+ * offsets and indices are sorted, the fields are then gathered once. */
+static int
+thdat_entries_sort(
+    thdat_t* thdat,
+    thtk_error_t** error)
+{
+    const size_t count = thdat->entry_count;
+    thdat_entries_t* entries = &thdat->entries;
+    if (count < 2)
+        return 1;
+
+    thdat_sort_key_t* keys = malloc(count * sizeof(*keys));
+    unsigned char* scratch = malloc(count * sizeof(ssize_t));
+    if (!keys || !scratch) {
+        free(keys);
+        free(scratch);
+        thtk_error_new(error, "out of memory");
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        keys[i].offset = entries->offset[i];
+        keys[i].index = i;
+    }
+    qsort(keys, count, sizeof(*keys), thdat_sort_key_compar);
+
+    thdat_permute(entries->name, sizeof(*entries->name), keys, count, scratch);
+    thdat_permute(entries->extra, sizeof(*entries->extra), keys, count, scratch);
+    thdat_permute(entries->size, sizeof(*entries->size), keys, count, scratch);
+    thdat_permute(entries->zsize, sizeof(*entries->zsize), keys, count, scratch);
+    thdat_permute(entries->offset, sizeof(*entries->offset), keys, count, scratch);
+
+    free(keys);
+    free(scratch);
+    return 1;
 }
 
 int
@@ -208,8 +517,12 @@ thdat_close(
         thtk_error_new(error, "invalid parameter passed");
         return 0;
     }
-    qsort(thdat->entries, thdat->entry_count, sizeof(thdat_entry_t), thdat_entry_compar);
-    return thdat->module->close(thdat, error);
+    if (!thdat_entries_sort(thdat, error))
+        return 0;
+    THTK_STATS_SINK_BEGIN(sink, &thdat->stats);
+    int ret = thdat->module->close(thdat, error);
+    THTK_STATS_SINK_END(sink);
+    return ret;
 }
 
 void
@@ -217,7 +530,13 @@ thdat_free(
     thdat_t* thdat)
 {
     if (thdat) {
-        free(thdat->entries);
+        free(thdat->entries.name);
+        free(thdat->entries.extra);
+        free(thdat->entries.size);
+        free(thdat->entries.zsize);
+        free(thdat->entries.offset);
+        thdat_name_pool_free(&thdat->names);
+        thdat_dedup_free(&thdat->dedup);
         free(thdat);
     }
 }
@@ -244,8 +563,12 @@ thdat_entry_by_name(
         thtk_error_new(error, "invalid parameter passed");
         return -1;
     }
+    /* Names are pooled, so matching entries share the pointer. */
+    const char* pooled = thdat_name_find(&thdat->names, name);
+    if (!pooled)
+        return -1;
     for (size_t e = 0; e < thdat->entry_count; ++e) {
-        if (strcmp(name, thdat->entries[e].name) == 0)
+        if (thdat->entries.name[e] == pooled)
             return e;
     }
     return -1;
@@ -263,7 +586,7 @@ thdat_entry_by_glob(
         return -1;
     }
     for (size_t e = first; e < thdat->entry_count; ++e) {
-        if (glob_match(glob, thdat->entries[e].name))
+        if (glob_match(glob, thdat->entries.name[e]))
             return e;
     }
     return -1;
@@ -279,6 +602,7 @@ thdat_entry_set_name(
     if (thdat && name && entry_index >= 0 && entry_index < (int)thdat->entry_count) {
         char temp_name[256];
         strncpy(temp_name, name, 255);
+        temp_name[255] = '\0';
 
         if (thdat->module->flags & THDAT_BASENAME) {
             char temp_name2[256];
@@ -303,15 +627,82 @@ thdat_entry_set_name(
             }
         }
 
-        strcpy(thdat->entries[entry_index].name, temp_name);
-
-        return 1;
+        return thdat_entry_store_name(thdat, entry_index, temp_name, sizeof(temp_name), error);
     }
 
     thtk_error_new(error, "invalid parameter passed");
     return 0;
 }
 
+ssize_t
+thdat_entry_append(
+    thdat_t* thdat,
+    const char* name,
+    thtk_error_t** error)
+{
+    if (!thdat || !name) {
+        thtk_error_new(error, "invalid parameter passed");
+        return -1;
+    }
+    const uint32_t flags = thdat->module->flags;
+    if ((thdat->inited && (flags & THDAT_LATE_INIT)) ||
+        (thdat->data_written && (flags & THDAT_COUNTED_HEADER))) {
+        thtk_error_new(error, "the entry list has already been written");
+        return -1;
+    }
+    ssize_t entry = thdat_entry_add(thdat, error);
+    if (entry == -1)
+        return -1;
+    thdat_entries_clear(thdat, entry);
+    /* A rejected entry may have left a length behind at this index. */
+    if ((size_t)entry < thdat->dedup.expected_count && thdat->dedup.expected[entry] != -1) {
+        thdat->dedup.expected[entry] = -1;
+        thdat->dedup.stale = 1;
+    }
+    if (!thdat_entry_set_name(thdat, entry, name, error)) {
+        --thdat->entry_count;
+        return -1;
+    }
+    /* Make room for the new entry in the header. */
+    if (thdat->inited && (flags & THDAT_COUNTED_HEADER) &&
+        !thdat->module->create(thdat, error)) {
+        --thdat->entry_count;
+        return -1;
+    }
+    return entry;
+}
+
+int
+thdat_entry_expect_size(
+    thdat_t* thdat,
+    int entry_index,
+    size_t size,
+    thtk_error_t** error)
+{
+    if (!thdat || entry_index < 0 || entry_index >= (int)thdat->entry_count) {
+        thtk_error_new(error, "invalid parameter passed");
+        return 0;
+    }
+    thdat_dedup_t* dedup = &thdat->dedup;
+    if ((size_t)entry_index >= dedup->expected_count) {
+        size_t count = dedup->expected_count ? dedup->expected_count : 64;
+        while (count <= (size_t)entry_index)
+            count *= 2;
+        ssize_t* expected = realloc(dedup->expected, count * sizeof(*expected));
+        if (!expected) {
+            thtk_error_new(error, "out of memory");
+            return 0;
+        }
+        for (size_t i = dedup->expected_count; i < count; ++i)
+            expected[i] = -1;
+        dedup->expected = expected;
+        dedup->expected_count = count;
+    }
+    dedup->expected[entry_index] = size;
+    dedup->stale = 1;
+    return 1;
+}
+
 const char*
 thdat_entry_get_name(
     thdat_t* thdat,
@@ -322,7 +713,7 @@ thdat_entry_get_name(
         thtk_error_new(error, "invalid parameter passed");
         return NULL;
     }
-    return thdat->entries[entry_index].name;
+    return thdat->entries.name[entry_index];
 }
 
 ssize_t
@@ -335,7 +726,7 @@ thdat_entry_get_size(
         thtk_error_new(error, "invalid parameter passed");
         return -1;
     }
-    return thdat->entries[entry_index].size;
+    return thdat->entries.size[entry_index];
 }
 
 ssize_t
@@ -348,8 +739,255 @@ thdat_entry_get_zsize(
         thtk_error_new(error, "invalid parameter passed");
         return -1;
     }
-    thdat_entry_t *ent = &thdat->entries[entry_index];
-    return thdat->module->flags & THDAT_NO_COMPRESSION ? ent->size : ent->zsize;
+    return thdat->module->flags & THDAT_NO_COMPRESSION
+        ? thdat->entries.size[entry_index]
+        : thdat->entries.zsize[entry_index];
+}
+
+static size_t
+thdat_dedup_slot(
+    const thdat_dedup_t* dedup,
+    const unsigned char* digest,
+    size_t size,
+    const void* key)
+{
+    size_t hash;
+    memcpy(&hash, digest, sizeof(hash));
+    size_t i = hash & (dedup->slot_count - 1);
+    for (;;) {
+        const thdat_dedup_record_t* record = dedup->slots[i];
+        if (!record || (record->size == size && record->key == key &&
+            !memcmp(record->digest, digest, THTK_SHA256_SIZE)))
+            return i;
+        i = (i + 1) & (dedup->slot_count - 1);
+    }
+}
+
+static int
+thdat_dedup_length_cmp(
+    const void* a,
+    const void* b)
+{
+    const ssize_t x = *(const ssize_t*)a;
+    const ssize_t y = *(const ssize_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* Returns 1 if the entry was declared with this input length and no other
+ * entry was, so that there is nothing its contents could be identical to. */
+static int
+thdat_dedup_unique(
+    thdat_t* thdat,
+    int entry_index,
+    size_t input_length)
+{
+    thdat_dedup_t* dedup = &thdat->dedup;
+    int unique = 0;
+    if ((size_t)entry_index >= dedup->expected_count ||
+        dedup->expected[entry_index] != (ssize_t)input_length)
+        return 0;
+
+#pragma omp critical(thdat_dedup)
+    {
+        if (dedup->stale) {
+            ssize_t* lengths = realloc(dedup->lengths, dedup->expected_count * sizeof(*lengths));
+            if (lengths) {
+                dedup->lengths = lengths;
+                dedup->length_count = 0;
+                for (size_t i = 0; i < dedup->expected_count; ++i)
+                    if (dedup->expected[i] != -1)
+                        lengths[dedup->length_count++] = dedup->expected[i];
+                qsort(lengths, dedup->length_count, sizeof(*lengths), thdat_dedup_length_cmp);
+                dedup->stale = 0;
+            }
+        }
+        if (!dedup->stale) {
+            /* Find the first copy of the length; the entry's own is one. */
+            size_t lo = 0, hi = dedup->length_count;
+            while (lo < hi) {
+                const size_t mid = lo + (hi - lo) / 2;
+                if (dedup->lengths[mid] < (ssize_t)input_length)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            unique = lo + 1 == dedup->length_count || dedup->lengths[lo + 1] != (ssize_t)input_length;
+        }
+    }
+    return unique;
+}
+
+/* Returns the record for the given contents, or adds one with entry_index as
+ * its source, which is then held until the source is written.  found tells
+ * which. */
+static thdat_dedup_record_t*
+thdat_dedup_claim(
+    thdat_t* thdat,
+    int entry_index,
+    const unsigned char* digest,
+    size_t size,
+    int* found)
+{
+    const thdat_module_t* module = thdat->module;
+    const void* key = module->data_key && !module->rekey ? module->data_key(thdat, entry_index) : NULL;
+    thdat_dedup_t* dedup = &thdat->dedup;
+    thdat_dedup_record_t* record;
+
+#pragma omp critical(thdat_dedup)
+    {
+        if (2 * (dedup->used + 1) > dedup->slot_count) {
+            thdat_dedup_t grown = { .slot_count = dedup->slot_count ? 2 * dedup->slot_count : 64 };
+            grown.slots = calloc(grown.slot_count, sizeof(*grown.slots));
+            for (size_t i = 0; i < dedup->slot_count; ++i) {
+                const thdat_dedup_record_t* old = dedup->slots[i];
+                if (old)
+                    grown.slots[thdat_dedup_slot(&grown, old->digest, old->size, old->key)] = dedup->slots[i];
+            }
+            free(dedup->slots);
+            dedup->slots = grown.slots;
+            dedup->slot_count = grown.slot_count;
+        }
+
+        const size_t slot = thdat_dedup_slot(dedup, digest, size, key);
+        record = dedup->slots[slot];
+        *found = record != NULL;
+        if (!record) {
+            record = malloc(sizeof(*record));
+            memcpy(record->digest, digest, THTK_SHA256_SIZE);
+            record->size = size;
+            record->key = key;
+            record->source = entry_index;
+            record->done = 0;
+#ifdef _OPENMP
+            omp_init_lock(&record->lock);
+            omp_set_lock(&record->lock);
+#endif
+            dedup->slots[slot] = record;
+            ++dedup->used;
+        }
+    }
+    return record;
+}
+
+/* Points an entry at the data already stored for source, or, for formats
+ * whose entry list can't express that, copies the stored data back from the
+ * archive.  Returns -1 on error and -2 if the stream can't be read back. */
+static ssize_t
+thdat_dedup_copy(
+    thdat_t* thdat,
+    int entry_index,
+    int source,
+    thtk_error_t** error)
+{
+    thdat_entries_t* entries = &thdat->entries;
+    const ssize_t stored = thdat->module->flags & THDAT_NO_COMPRESSION
+        ? entries->size[source]
+        : entries->zsize[source];
+
+    if (!(thdat->module->flags & THDAT_SHARED_DATA)) {
+        thtk_error_t* read_error = NULL;
+        unsigned char* data = malloc(stored);
+        ssize_t read;
+        /* Modules write to the stream from this section too. */
+#pragma omp critical
+        read = thtk_io_pread(thdat->stream, data, stored, entries->offset[source], &read_error);
+        if (read != stored) {
+            thtk_error_free(&read_error);
+            free(data);
+            return -2;
+        }
+        const thdat_module_t* module = thdat->module;
+        if (module->rekey &&
+            module->data_key(thdat, source) != module->data_key(thdat, entry_index))
+            module->rekey(thdat, source, entry_index, data, stored);
+
+        int failed;
+#pragma omp critical
+        {
+            failed = thtk_io_write(thdat->stream, data, stored, error) != stored;
+            if (!failed) {
+                entries->offset[entry_index] = thdat->offset;
+                thdat->offset += stored;
+            }
+        }
+        free(data);
+        if (failed)
+            return -1;
+    } else {
+        entries->offset[entry_index] = entries->offset[source];
+    }
+
+    entries->size[entry_index] = entries->size[source];
+    entries->zsize[entry_index] = entries->zsize[source];
+    entries->extra[entry_index] = entries->extra[source];
+    return stored;
+}
+
+/* Writes an entry, converting identical contents only once.  Only entries
+ * whose length may be shared are hashed to find them. */
+static ssize_t
+thdat_dedup_write(
+    thdat_t* thdat,
+    int entry_index,
+    thtk_io_t* input,
+    size_t input_length,
+    thtk_error_t** error)
+{
+    unsigned char digest[THTK_SHA256_SIZE];
+    thtk_sha256_t sha;
+    thtk_io_t* data_stream;
+    ssize_t ret;
+    int found;
+
+    if (thdat_dedup_unique(thdat, entry_index, input_length))
+        return thdat->module->write(thdat, entry_index, input, input_length, error);
+
+    unsigned char* data = malloc(input_length);
+    if (thtk_io_read(input, data, input_length, error) != (ssize_t)input_length) {
+        free(data);
+        return -1;
+    }
+    thtk_sha256_init(&sha);
+    thtk_sha256_update(&sha, data, input_length);
+    thtk_sha256_final(&sha, digest);
+
+    thdat_dedup_record_t* record = thdat_dedup_claim(thdat, entry_index, digest, input_length, &found);
+    if (found) {
+        int done;
+        /* Wait for the thread converting the first copy to release the
+         * record.  It holds nothing else meanwhile, so it can't be waiting
+         * for this one. */
+#ifdef _OPENMP
+        omp_set_lock(&record->lock);
+        omp_unset_lock(&record->lock);
+#endif
+#pragma omp atomic read
+        done = record->done;
+        if (done == 1) {
+            ret = thdat_dedup_copy(thdat, entry_index, record->source, error);
+            if (ret != -2) {
+                free(data);
+                return ret;
+            }
+        }
+    }
+
+    if (!(data_stream = thtk_io_open_memory(data, input_length, error))) {
+        free(data);
+        ret = -1;
+    } else {
+        ret = thdat->module->write(thdat, entry_index, data_stream, input_length, error);
+        thtk_io_close(data_stream);
+    }
+
+    if (!found) {
+#pragma omp atomic write
+        record->done = ret == -1 ? -1 : 1;
+#ifdef _OPENMP
+        omp_unset_lock(&record->lock);
+#endif
+    }
+    return ret;
 }
 
 ssize_t
@@ -364,7 +1002,201 @@ thdat_entry_write_data(
         thtk_error_new(error, "invalid parameter passed");
         return -1;
     }
-    return thdat->module->write(thdat, entry_index, input, input_length, error);
+#pragma omp atomic write
+    thdat->data_written = 1;
+    if (!input_length) {
+        /* Not every format can store an empty entry, so none of them is
+         * asked to; the entry just points at the current end of the data. */
+        thdat_entries_t* entries = &thdat->entries;
+#pragma omp critical
+        entries->offset[entry_index] = thdat->offset;
+        entries->size[entry_index] = entries->zsize[entry_index] = 0;
+        return 0;
+    }
+    THTK_STATS_SINK_BEGIN(sink, &thdat->stats);
+    ssize_t ret = thdat_dedup_write(thdat, entry_index, input, input_length, error);
+    THTK_STATS_SINK_END(sink);
+    return ret;
+}
+
+/* Decodes an entry into a growing memory stream.  The size is taken from the
+ * stream, as not every module returns it.  NULL indicates an error. */
+static thtk_io_t*
+thdat_extract_decode(
+    thdat_t* thdat,
+    int entry_index,
+    ssize_t* size,
+    thtk_error_t** error)
+{
+    thtk_io_t* output = thtk_io_open_growing_memory(error);
+    if (!output)
+        return NULL;
+    if (thdat_entry_read_data(thdat, entry_index, output, error) == -1 ||
+        (*size = thtk_io_seek(output, 0, SEEK_END, error)) == -1) {
+        thtk_io_close(output);
+        return NULL;
+    }
+    return output;
+}
+
+/* Hands a decoded entry to the callback and closes the stream.  Keeps the
+ * first error, and sets failed so that no more entries are extracted. */
+static void
+thdat_extract_deliver(
+    thdat_t* thdat,
+    int entry_index,
+    thtk_io_t* output,
+    ssize_t size,
+    thtk_error_t* entry_error,
+    thdat_extract_callback_t callback,
+    void* user,
+    int* failed,
+    thtk_error_t** error)
+{
+    int stop, ok = output != NULL;
+#pragma omp atomic read
+    stop = *failed;
+    if (ok && !stop) {
+        const unsigned char* data = size ? thtk_io_map(output, 0, size, &entry_error) : NULL;
+        ok = (!size || data) && callback(user, thdat, entry_index, data, size, &entry_error);
+    }
+    if (output)
+        thtk_io_close(output);
+    if (!ok && !stop) {
+#pragma omp atomic write
+        *failed = 1;
+    }
+    if (entry_error) {
+#pragma omp critical(thdat_extract_error)
+        {
+            if (!*error)
+                *error = entry_error;
+            else
+                thtk_error_free(&entry_error);
+        }
+    }
+}
+
+int
+thdat_extract_all(
+    thdat_t* thdat,
+    int ordered,
+    thdat_extract_callback_t callback,
+    void* user,
+    thtk_error_t** error)
+{
+    if (!thdat || !callback) {
+        thtk_error_new(error, "invalid parameter passed");
+        return 0;
+    }
+
+    const ssize_t count = thdat->entry_count;
+    thdat_sort_key_t* keys = malloc((count ? count : 1) * sizeof(*keys));
+    for (ssize_t e = 0; e < count; ++e) {
+        keys[e].offset = thdat->entries.offset[e];
+        keys[e].index = e;
+    }
+    qsort(keys, count, sizeof(*keys), thdat_sort_key_compar);
+
+    int failed = 0;
+    thtk_error_t* first_error = NULL;
+    ssize_t i;
+    if (ordered) {
+#pragma omp parallel for ordered schedule(dynamic)
+        for (i = 0; i < count; ++i) {
+            thtk_error_t* entry_error = NULL;
+            thtk_io_t* output = NULL;
+            ssize_t size = 0;
+            int stop;
+#pragma omp atomic read
+            stop = failed;
+            if (!stop)
+                output = thdat_extract_decode(thdat, keys[i].index, &size, &entry_error);
+#pragma omp ordered
+            thdat_extract_deliver(thdat, keys[i].index, output, size, entry_error,
+                callback, user, &failed, &first_error);
+        }
+    } else {
+#pragma omp parallel for schedule(dynamic)
+        for (i = 0; i < count; ++i) {
+            thtk_error_t* entry_error = NULL;
+            thtk_io_t* output = NULL;
+            ssize_t size = 0;
+            int stop;
+#pragma omp atomic read
+            stop = failed;
+            if (!stop)
+                output = thdat_extract_decode(thdat, keys[i].index, &size, &entry_error);
+            thdat_extract_deliver(thdat, keys[i].index, output, size, entry_error,
+                callback, user, &failed, &first_error);
+        }
+    }
+    free(keys);
+
+    if (first_error) {
+        if (error)
+            *error = first_error;
+        else
+            thtk_error_free(&first_error);
+    }
+    return !failed;
+}
+
+ssize_t
+thdat_entry_read_raw(
+    thdat_t* thdat,
+    int entry_index,
+    thtk_io_t* output,
+    thtk_error_t** error)
+{
+    if (!thdat || entry_index < 0 || entry_index >= (int)thdat->entry_count || !output) {
+        thtk_error_new(error, "invalid parameter passed");
+        return -1;
+    }
+    const ssize_t size = thdat->module->flags & THDAT_NO_COMPRESSION
+        ? thdat->entries.size[entry_index]
+        : thdat->entries.zsize[entry_index];
+    const off_t offset = thdat->entries.offset[entry_index];
+    if (size < 0 || offset < 0) {
+        thtk_error_new(error, "entry has no data");
+        return -1;
+    }
+    if (!size)
+        return 0;
+
+    THTK_STATS_SINK_BEGIN(sink, &thdat->stats);
+    unsigned char* data = malloc(size);
+    ssize_t ret = thtk_io_pread(thdat->stream, data, size, offset, error);
+    if (ret != -1)
+        ret = thtk_io_write(output, data, size, error);
+    free(data);
+    THTK_STATS_SINK_END(sink);
+    return ret;
+}
+
+int
+thdat_entry_raw_comparable(
+    thdat_t* a,
+    int entry_a,
+    thdat_t* b,
+    int entry_b)
+{
+    if (!a || !b || entry_a < 0 || entry_a >= (int)a->entry_count ||
+        entry_b < 0 || entry_b >= (int)b->entry_count)
+        return 0;
+    /* Keys are chosen by version and, in most formats, by name. */
+    if (a->version != b->version ||
+        strcmp(a->entries.name[entry_a], b->entries.name[entry_b]) ||
+        a->entries.extra[entry_a] != b->entries.extra[entry_b] ||
+        a->entries.size[entry_a] != b->entries.size[entry_b])
+        return 0;
+    if (!(a->module->flags & THDAT_NO_COMPRESSION) &&
+        a->entries.zsize[entry_a] != b->entries.zsize[entry_b])
+        return 0;
+    if ((a->module->flags & THDAT_OFFSET_KEY) &&
+        a->entries.offset[entry_a] != b->entries.offset[entry_b])
+        return 0;
+    return 1;
 }
 
 ssize_t
@@ -378,5 +1210,10 @@ thdat_entry_read_data(
         thtk_error_new(error, "invalid parameter passed");
         return -1;
     }
-    return thdat->module->read(thdat, entry_index, output, error);
+    if (!thdat->entries.size[entry_index])
+        return 0;
+    THTK_STATS_SINK_BEGIN(sink, &thdat->stats);
+    ssize_t ret = thdat->module->read(thdat, entry_index, output, error);
+    THTK_STATS_SINK_END(sink);
+    return ret;
 }
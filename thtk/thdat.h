@@ -34,20 +34,52 @@
 #include <stdio.h>
 #include <thtk/thtk.h>
 
+/* Strings referenced by the entry table.  Names are copied into blocks that
+ * are never moved, so pointers into the pool stay valid for the lifetime of
+ * the archive, and equal names are only stored once. */
+typedef struct thdat_name_block_t thdat_name_block_t;
+
+typedef struct {
+    thdat_name_block_t* blocks;
+    /* Open addressing hash table of the stored names. */
+    const char** slots;
+    size_t slot_count;
+    size_t used;
+} thdat_name_pool_t;
+
+/* The entry table, stored as one array per field, all indexed by entry. */
 typedef struct {
-    char name[260];
+    size_t capacity;
+    /* Points into the name pool. */
+    const char** name;
     /* Format-specific data. */
-    uint32_t extra;
+    uint32_t* extra;
     /* These fields are -1 before being filled out. */
     /* Original file size. */
-    ssize_t size;
+    ssize_t* size;
     /* Compressed file size. */
-    ssize_t zsize;
+    ssize_t* zsize;
     /* Offset in archive. */
-    ssize_t offset;
-} thdat_entry_t;
+    ssize_t* offset;
+} thdat_entries_t;
 
-void thdat_entry_init(thdat_entry_t* entry);
+/* Entries written so far, by content, so that identical files are only
+ * converted once. */
+typedef struct thdat_dedup_record_t thdat_dedup_record_t;
+
+typedef struct {
+    /* Open addressing hash table. */
+    thdat_dedup_record_t** slots;
+    size_t slot_count;
+    size_t used;
+    /* Input lengths given to thdat_entry_expect_size by entry, or -1. */
+    ssize_t* expected;
+    size_t expected_count;
+    /* The declared lengths in order, rebuilt when stale is set. */
+    ssize_t* lengths;
+    size_t length_count;
+    int stale;
+} thdat_dedup_t;
 
 typedef struct thdat_module_t thdat_module_t;
 
@@ -56,9 +88,15 @@ struct thdat_t {
     const thdat_module_t* module;
     thtk_io_t* stream;
     size_t entry_count;
-    thdat_entry_t* entries;
+    thdat_entries_t entries;
+    thdat_name_pool_t names;
+    thdat_dedup_t dedup;
     uint32_t offset;
     int inited;
+    /* Set once entry data has been written. */
+    int data_written;
+    /* Counters for work done by the module on behalf of this archive. */
+    thtk_stats_t stats;
 };
 
 /* Strip path names. */
@@ -71,6 +109,14 @@ struct thdat_t {
 #define THDAT_NO_COMPRESSION 8
 /* thdat_init must be called _after_ setting the filenames. */
 #define THDAT_LATE_INIT 16
+/* The encryption of an entry depends on its offset in the archive. */
+#define THDAT_OFFSET_KEY 32
+/* The entry list stores the offset and every size of each entry, so entries
+ * may point at the same data. */
+#define THDAT_SHARED_DATA 64
+/* The size of the header depends on the entry count, so entries can only be
+ * appended before any data is written. */
+#define THDAT_COUNTED_HEADER 128
 
 struct thdat_module_t {
     /* THDAT_ flags. */
@@ -82,14 +128,28 @@ struct thdat_module_t {
 
     ssize_t (*read)(thdat_t* thdat, int entry, thtk_io_t* output, thtk_error_t** error);
     ssize_t (*write)(thdat_t* thdat, int entry, thtk_io_t* input, size_t length, thtk_error_t** error);
+
+    /* Returns what the stored data depends on besides the contents of the
+     * entry, such as the encryption parameters picked by its name.  Only
+     * entries with the same key share converted data.  May be NULL. */
+    const void* (*data_key)(thdat_t* thdat, int entry);
+    /* Converts the stored data of source in place into the stored data of
+     * entry, which has the same contents but a different data key.  When
+     * set, entries are deduplicated regardless of their keys.  May be
+     * NULL. */
+    void (*rekey)(thdat_t* thdat, int source, int entry, unsigned char* data, size_t size);
 };
 
-#define ARRAY_GROW(counter, array, target) \
-    do { \
-        ++(counter); \
-        (array) = realloc((array), (counter) * sizeof(*(array))); \
-        (target) = &(array)[(counter) - 1]; \
-    } while (0)
+/* thdat.c */
+/* Makes room for at least count entries without changing entry_count. */
+int thdat_entries_reserve(thdat_t* thdat, size_t count, thtk_error_t** error);
+/* Sets entry_count to count, initializing any new entries. */
+int thdat_entries_resize(thdat_t* thdat, size_t count, thtk_error_t** error);
+/* Appends an initialized entry and returns its index, or -1 on error. */
+ssize_t thdat_entry_add(thdat_t* thdat, thtk_error_t** error);
+/* Sets the name of an entry to the first len bytes of name, stopping early at
+ * a terminating zero.  No transformations are applied. */
+int thdat_entry_store_name(thdat_t* thdat, size_t entry, const char* name, size_t len, thtk_error_t** error);
 
 /* detect.c */
 const char *detect_basename(const char *path);
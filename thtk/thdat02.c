@@ -63,7 +63,10 @@ th02_open(
         thdat->entry_count = th03_archive_header.count;
     }
 
-    thdat->entries = malloc(thdat->entry_count * sizeof(thdat_entry_t));
+    size_t entry_count = thdat->entry_count;
+    thdat->entry_count = 0;
+    if (!thdat_entries_resize(thdat, entry_count, error))
+        return 0;
 
     if (thdat->version <= 2) {
         th02_entry_headers = malloc(thdat->entry_count * sizeof(th02_entry_header_t));
@@ -83,10 +86,9 @@ th02_open(
         }
     }
 
+    thdat_entries_t* entries = &thdat->entries;
     for (unsigned int e = 0; e < thdat->entry_count; ++e) {
-        thdat_entry_t* entry = &thdat->entries[e];
-
-        entry->extra = thdat->version <= 2
+        entries->extra[e] = thdat->version <= 2
             ? th02_keys[thdat->version - 1] /* th02_entry_headers[e].key */
             : th03_entry_headers[e].key;
 
@@ -94,16 +96,17 @@ th02_open(
             for (unsigned int i = 0; i < 13 && th02_entry_headers[e].name[i]; ++i)
                 th02_entry_headers[e].name[i] ^= 0xff;
         }
-        memcpy(entry->name, thdat->version <= 2
-            ? th02_entry_headers[e].name
-            : th03_entry_headers[e].name, 13);
-        entry->zsize = thdat->version <= 2
+        if (!thdat_entry_store_name(thdat, e, (const char*)(thdat->version <= 2
+                ? th02_entry_headers[e].name
+                : th03_entry_headers[e].name), 13, error))
+            return 0;
+        entries->zsize[e] = thdat->version <= 2
             ? th02_entry_headers[e].zsize
             : th03_entry_headers[e].zsize;
-        entry->size = thdat->version <= 2
+        entries->size[e] = thdat->version <= 2
             ? th02_entry_headers[e].size
             : th03_entry_headers[e].size;
-        entry->offset = thdat->version <= 2
+        entries->offset[e] = thdat->version <= 2
             ? th02_entry_headers[e].offset
             : th03_entry_headers[e].offset;
     }
@@ -121,30 +124,32 @@ th02_read(
     thtk_io_t* output,
     thtk_error_t** error)
 {
-    thdat_entry_t* entry = &thdat->entries[entry_index];
-    unsigned char* data = malloc(entry->zsize);
+    const ssize_t size = thdat->entries.size[entry_index];
+    const ssize_t zsize = thdat->entries.zsize[entry_index];
+    const uint32_t key = thdat->entries.extra[entry_index];
+    unsigned char* data = malloc(zsize);
     ssize_t ret;
 
 #pragma omp critical
     {
-        ret = thtk_io_pread(thdat->stream, data, entry->zsize, entry->offset, error);
+        ret = thtk_io_pread(thdat->stream, data, zsize, thdat->entries.offset[entry_index], error);
     }
-    if (ret != (ssize_t)entry->zsize) {
+    if (ret != zsize) {
         free(data);
         return -1;
     }
 
-    for (ssize_t i = 0; i < entry->zsize; ++i)
-        data[i] ^= entry->extra;
+    for (ssize_t i = 0; i < zsize; ++i)
+        data[i] ^= key;
 
-    if (entry->size == entry->zsize) {
-        ret = thtk_io_write(output, data, entry->zsize, error);
+    if (size == zsize) {
+        ret = thtk_io_write(output, data, zsize, error);
         free(data);
     } else {
-        thtk_io_t* data_stream = thtk_io_open_memory(data, entry->zsize, error);
+        thtk_io_t* data_stream = thtk_io_open_memory(data, zsize, error);
         if (!data_stream)
             return -1;
-        ret = thtk_unrle(data_stream, entry->zsize, output, error);
+        ret = thtk_unrle(data_stream, zsize, output, error);
         thtk_io_close(data_stream);
     }
 
@@ -174,53 +179,49 @@ th02_write(
     size_t input_length,
     thtk_error_t** error)
 {
-    thdat_entry_t* entry = &thdat->entries[entry_index];
-    entry->size = input_length;
+    const ssize_t size = input_length;
+    ssize_t zsize;
 
     off_t input_offset = thtk_io_seek(input, 0, SEEK_CUR, error);
     if (input_offset == -1)
         return -1;
 
-    if (thdat->version <= 2) {
-        for (unsigned int i = 0; i < 13; ++i)
-            if (entry->name[i])
-                entry->name[i] ^= 0xff;
-    }
-
     thtk_io_t* output = thtk_io_open_growing_memory(error);
     if (!output)
         return -1;
 
-    if ((entry->zsize = thtk_rle(input, entry->size, output, error)) == -1)
+    if ((zsize = thtk_rle(input, size, output, error)) == -1)
         return -1;
 
-    if (entry->zsize >= entry->size) {
-        entry->zsize = entry->size;
+    if (zsize >= size) {
+        zsize = size;
         thtk_io_close(output);
         if (thtk_io_seek(input, input_offset, SEEK_SET, error) == -1)
             return -1;
         output = input;
     }
 
-    unsigned char* data = malloc(entry->zsize);
-    ssize_t ret = thtk_io_pread(output, data, entry->zsize, 0, error);
-    if (ret != entry->zsize) {
+    unsigned char* data = malloc(zsize);
+    ssize_t ret = thtk_io_pread(output, data, zsize, 0, error);
+    if (ret != zsize) {
         free(data);
         if (output != input)
             thtk_io_close(output);
         return -1;
     }
 
-    for (ssize_t i = 0; i < entry->zsize; ++i)
+    for (ssize_t i = 0; i < zsize; ++i)
         data[i] ^= thdat->version <= 2 ? th02_keys[thdat->version - 1] : entry_key;
 
-
+    off_t offset;
 #pragma omp critical
     {
-        entry->offset = thtk_io_seek(thdat->stream, 0, SEEK_CUR, error);
+        offset = thtk_io_seek(thdat->stream, 0, SEEK_CUR, error);
 
-        if (entry->offset != -1)
-            ret = thtk_io_write(thdat->stream, data, entry->zsize, error);
+        if (offset != -1)
+            ret = thtk_io_write(thdat->stream, data, zsize, error);
+        else
+            ret = -1;
 
         if (ret != -1)
             thdat->offset += ret;
@@ -231,6 +232,10 @@ th02_write(
     if (output != input)
         thtk_io_close(output);
 
+    thdat->entries.size[entry_index] = size;
+    thdat->entries.zsize[entry_index] = zsize;
+    thdat->entries.offset[entry_index] = offset;
+
     return ret;
 }
 
@@ -260,30 +265,34 @@ th02_close(
 
     memset(buffer, 0, buffer_size);
 
+    const thdat_entries_t* entries = &thdat->entries;
     for (size_t i = 0; i < thdat->entry_count; ++i) {
-        thdat_entry_t* entry = &thdat->entries[i];
+        const size_t name_len = strlen(entries->name[i]);
         if (thdat->version <= 2) {
             th02_entry_header_t eh2 = {
-                .magic = entry->zsize == entry->size ? magic1 : magic2,
+                .magic = entries->zsize[i] == entries->size[i] ? magic1 : magic2,
                 .key = 3,
-                .zsize = entry->zsize,
-                .size = entry->size,
-                .offset = entry->offset
+                .zsize = entries->zsize[i],
+                .size = entries->size[i],
+                .offset = entries->offset[i]
             };
 
-            memcpy(eh2.name, entry->name, 13);
+            memcpy(eh2.name, entries->name[i], name_len < 13 ? name_len : 13);
+            for (unsigned int j = 0; j < 13; ++j)
+                if (eh2.name[j])
+                    eh2.name[j] ^= 0xff;
 
             buffer_ptr = MEMPCPY(buffer_ptr, &eh2, sizeof(eh2));
         } else {
             th03_entry_header_t eh3 = {
-                .magic = entry->zsize == entry->size ? magic1 : magic2,
+                .magic = entries->zsize[i] == entries->size[i] ? magic1 : magic2,
                 .key = entry_key,
-                .zsize = entry->zsize,
-                .size = entry->size,
-                .offset = entry->offset
+                .zsize = entries->zsize[i],
+                .size = entries->size[i],
+                .offset = entries->offset[i]
             };
 
-            memcpy(eh3.name, entry->name, 13);
+            memcpy(eh3.name, entries->name[i], name_len < 13 ? name_len : 13);
 
             buffer_ptr = MEMPCPY(buffer_ptr, &eh3, sizeof(eh3));
         }
@@ -309,10 +318,12 @@ th02_close(
 }
 
 const thdat_module_t archive_th02 = {
-    THDAT_BASENAME | THDAT_UPPERCASE | THDAT_8_3,
+    THDAT_BASENAME | THDAT_UPPERCASE | THDAT_8_3 | THDAT_COUNTED_HEADER | THDAT_SHARED_DATA,
     th02_open,
     th02_create,
     th02_close,
     th02_read,
-    th02_write
+    th02_write,
+    NULL,
+    NULL
 };
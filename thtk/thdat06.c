@@ -81,7 +81,7 @@ static void
 th06_write_string(
     struct bitstream* b,
     unsigned int length,
-    char* data)
+    const char* data)
 {
     unsigned int i;
     for (i = 0; i < length; ++i)
@@ -107,17 +107,23 @@ th06_open(
         if (thtk_io_seek(thdat->stream, thdat->offset, SEEK_SET, error) == -1)
             return 0;
 
+        if (!thdat_entries_reserve(thdat, entry_count, error))
+            return 0;
+
         bitstream_init(&b, thdat->stream);
         for (unsigned int i = 0; i < entry_count; ++i) {
-            thdat_entry_t* entry;
-            ARRAY_GROW(thdat->entry_count, thdat->entries, entry);
-            thdat_entry_init(entry);
+            char name[256] = { 0 };
+            ssize_t e = thdat_entry_add(thdat, error);
+            if (e == -1)
+                return 0;
             th06_read_uint32(&b);
             th06_read_uint32(&b);
-            entry->extra = th06_read_uint32(&b);
-            entry->offset = th06_read_uint32(&b);
-            entry->size = th06_read_uint32(&b);
-            th06_read_string(&b, 255, entry->name);
+            thdat->entries.extra[e] = th06_read_uint32(&b);
+            thdat->entries.offset[e] = th06_read_uint32(&b);
+            thdat->entries.size[e] = th06_read_uint32(&b);
+            th06_read_string(&b, 255, name);
+            if (!thdat_entry_store_name(thdat, e, name, sizeof(name), error))
+                return 0;
         }
     } else if (strncmp(magic, "PBG4", 4) == 0) {
         th07_header_t header;
@@ -140,15 +146,19 @@ th06_open(
         const uint32_t* ptr = (uint32_t*)thtk_io_map(entry_headers, 0, header.size, error);
         if (!ptr)
             return 0;
+        if (!thdat_entries_reserve(thdat, header.count, error))
+            return 0;
         for (unsigned int i = 0; i < header.count; ++i) {
-            thdat_entry_t* entry = NULL;
-            ARRAY_GROW(thdat->entry_count, thdat->entries, entry);
-            thdat_entry_init(entry);
-            strcpy(entry->name, (char*)ptr);
-            ptr = (uint32_t*)((char*)ptr + strlen(entry->name) + 1);
-            entry->offset = *ptr++;
-            entry->size = *ptr++;
-            entry->extra = *ptr++;
+            ssize_t e = thdat_entry_add(thdat, error);
+            if (e == -1)
+                return 0;
+            const size_t name_len = strlen((char*)ptr);
+            if (!thdat_entry_store_name(thdat, e, (char*)ptr, name_len, error))
+                return 0;
+            ptr = (uint32_t*)((char*)ptr + name_len + 1);
+            thdat->entries.offset[e] = *ptr++;
+            thdat->entries.size[e] = *ptr++;
+            thdat->entries.extra[e] = *ptr++;
         }
 
         thtk_io_unmap(entry_headers, (unsigned char*)ptr);
@@ -162,15 +172,12 @@ th06_open(
     if (end_offset == -1)
         return 0;
 
+    thdat_entries_t* entries = &thdat->entries;
+    for (size_t i = 0; i + 1 < thdat->entry_count; ++i)
+        entries->zsize[i] = entries->offset[i + 1] - entries->offset[i];
     if (thdat->entry_count) {
-        thdat_entry_t* prev = NULL;
-        for (unsigned int i = 0; i < thdat->entry_count; ++i) {
-            thdat_entry_t* entry = &thdat->entries[i];
-            if (prev)
-                prev->zsize = entry->offset - prev->offset;
-            prev = entry;
-        }
-        prev->zsize = end_offset - prev->offset;
+        const size_t last = thdat->entry_count - 1;
+        entries->zsize[last] = end_offset - entries->offset[last];
     }
 
     return 1;
@@ -183,23 +190,23 @@ th06_read(
     thtk_io_t* output,
     thtk_error_t** error)
 {
-    thdat_entry_t* entry = &thdat->entries[entry_index];
-    unsigned char* zdata = malloc(entry->zsize);
+    const ssize_t zsize = thdat->entries.zsize[entry_index];
+    unsigned char* zdata = malloc(zsize);
 
     int failed;
 #pragma omp critical
     {
-        failed = (thtk_io_seek(thdat->stream, entry->offset, SEEK_SET, error) == -1) ||
-                 (thtk_io_read(thdat->stream, zdata, entry->zsize, error) != entry->zsize);
+        failed = (thtk_io_seek(thdat->stream, thdat->entries.offset[entry_index], SEEK_SET, error) == -1) ||
+                 (thtk_io_read(thdat->stream, zdata, zsize, error) != zsize);
     }
     if (failed)
         return -1;
 
-    thtk_io_t* zdata_stream = thtk_io_open_memory(zdata, entry->zsize, error);
+    thtk_io_t* zdata_stream = thtk_io_open_memory(zdata, zsize, error);
     if (!zdata_stream)
         return -1;
 
-    int ret = th_unlzss(zdata_stream, output, entry->size, error);
+    int ret = th_unlzss(zdata_stream, output, thdat->entries.size[entry_index], error);
 
     thtk_io_close(zdata_stream);
     
@@ -227,39 +234,42 @@ th06_write(
     size_t input_length,
     thtk_error_t** error)
 {
-    thdat_entry_t* entry = &thdat->entries[entry_index];
-    entry->size = input_length;
+    thdat_entries_t* entries = &thdat->entries;
+    ssize_t zsize;
+    entries->size[entry_index] = input_length;
     thtk_io_t* zdata_stream = thtk_io_open_growing_memory(error);
     if (!zdata_stream)
         return -1;
     /* There is a chance that one of the games support uncompressed data. */
 
-    if ((entry->zsize = th_lzss(input, entry->size, zdata_stream, error)) == -1)
+    if ((zsize = th_lzss(input, input_length, zdata_stream, error)) == -1)
         return -1;
+    entries->zsize[entry_index] = zsize;
 
-    unsigned char* zdata = thtk_io_map(zdata_stream, 0, entry->zsize, error);
+    unsigned char* zdata = thtk_io_map(zdata_stream, 0, zsize, error);
     if (!zdata)
         return -1;
 
     if (thdat->version == 6) {
-        entry->extra = 0;
-        for (ssize_t i = 0; i < entry->zsize; ++i)
-            entry->extra += zdata[i];
+        uint32_t checksum = 0;
+        for (ssize_t i = 0; i < zsize; ++i)
+            checksum += zdata[i];
+        entries->extra[entry_index] = checksum;
     }
 
     int ret;
 
 #pragma omp critical
     {
-        ret = thtk_io_write(thdat->stream, zdata, entry->zsize, error);
-        entry->offset = thdat->offset;
-        thdat->offset += entry->zsize;
+        ret = thtk_io_write(thdat->stream, zdata, zsize, error);
+        entries->offset[entry_index] = thdat->offset;
+        thdat->offset += zsize;
     }
 
     thtk_io_unmap(zdata_stream, zdata);
     thtk_io_close(zdata_stream);
 
-    if (ret != entry->zsize)
+    if (ret != zsize)
         return -1;
 
     return ret;
@@ -285,7 +295,9 @@ th06_close(
     }
 
     for (i = 0; i < thdat->entry_count; ++i) {
-        thdat_entry_t* entry = &thdat->entries[i];
+        const char* name = thdat->entries.name[i];
+        const uint32_t offset = thdat->entries.offset[i];
+        const uint32_t size = thdat->entries.size[i];
 
         if (thdat->version == 6) {
             /* These values are unknown, but it seems they can be ignored. */
@@ -295,16 +307,16 @@ th06_close(
                                     * per entry. */
             th06_write_uint32(&b, unknown1);
             th06_write_uint32(&b, unknown2);
-            th06_write_uint32(&b, entry->extra);
-            th06_write_uint32(&b, entry->offset);
-            th06_write_uint32(&b, entry->size);
-            th06_write_string(&b, strlen(entry->name) + 1, entry->name);
+            th06_write_uint32(&b, thdat->entries.extra[i]);
+            th06_write_uint32(&b, offset);
+            th06_write_uint32(&b, size);
+            th06_write_string(&b, strlen(name) + 1, name);
         } else {
-            if (thtk_io_write(buffer, entry->name, strlen(entry->name) + 1, error) == -1)
+            if (thtk_io_write(buffer, name, strlen(name) + 1, error) == -1)
                 return 0;
-            if (thtk_io_write(buffer, &entry->offset, sizeof(uint32_t), error) != sizeof(uint32_t))
+            if (thtk_io_write(buffer, &offset, sizeof(uint32_t), error) != sizeof(uint32_t))
                 return 0;
-            if (thtk_io_write(buffer, &entry->size, sizeof(uint32_t), error) != sizeof(uint32_t))
+            if (thtk_io_write(buffer, &size, sizeof(uint32_t), error) != sizeof(uint32_t))
                 return 0;
             if (thtk_io_write(buffer, &zero, sizeof(uint32_t), error) != sizeof(uint32_t))
                 return 0;
@@ -355,5 +367,7 @@ const thdat_module_t archive_th06 = {
     th06_create,
     th06_close,
     th06_read,
-    th06_write
+    th06_write,
+    NULL,
+    NULL
 };
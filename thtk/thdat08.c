@@ -104,28 +104,31 @@ th08_open(
         return 0;
     thtk_io_close(raw_data);
 
+    /* Every entry takes at least a terminator and three words. */
+    if (header.count > header.size / 13) {
+        thtk_error_new(error, "entry count does not fit the entry list");
+        return 0;
+    }
+    if (!thdat_entries_resize(thdat, header.count, error))
+        return 0;
+
+    thdat_entries_t* entries = &thdat->entries;
     const uint32_t* ptr = (uint32_t*)data;
     for (unsigned int i = 0; i < header.count; ++i) {
-        thdat_entry_t* entry;
-        ARRAY_GROW(thdat->entry_count, thdat->entries, entry);
-        thdat_entry_init(entry);
-
-        strcpy(entry->name, (char*)ptr);
-        ptr = (uint32_t*)((char*)ptr + strlen(entry->name) + 1);
-        entry->offset = *ptr++;
-        entry->size = *ptr++;
-        entry->extra = *ptr++;
+        const size_t name_len = strlen((char*)ptr);
+        if (!thdat_entry_store_name(thdat, i, (char*)ptr, name_len, error))
+            return 0;
+        ptr = (uint32_t*)((char*)ptr + name_len + 1);
+        entries->offset[i] = *ptr++;
+        entries->size[i] = *ptr++;
+        entries->extra[i] = *ptr++;
     }
 
+    for (unsigned int i = 0; i + 1 < header.count; ++i)
+        entries->zsize[i] = entries->offset[i + 1] - entries->offset[i];
     if (header.count) {
-        thdat_entry_t* prev = NULL;
-        for (unsigned int i = 0; i < header.count; ++i) {
-            thdat_entry_t* entry = &thdat->entries[i];
-            if (prev)
-                prev->zsize = entry->offset - prev->offset;
-            prev = entry;
-        }
-        prev->zsize = (filesize - zsize) - prev->offset;
+        const unsigned int last = header.count - 1;
+        entries->zsize[last] = (filesize - zsize) - entries->offset[last];
     }
 
     free(data);
@@ -140,7 +143,9 @@ th08_read(
     thtk_io_t* output,
     thtk_error_t** error)
 {
-    thdat_entry_t* entry = &thdat->entries[entry_index];
+    const ssize_t zsize = thdat->entries.zsize[entry_index];
+    /* The stored size includes the four byte entry header. */
+    ssize_t size = thdat->entries.size[entry_index];
     const crypt_params* current_crypt_params = thdat->version == 8 ?
         th08_crypt_params : th09_crypt_params;
     unsigned int i = 0;
@@ -149,23 +154,23 @@ th08_read(
     thtk_io_t* raw_entry = thtk_io_open_growing_memory(error);
     if (!raw_entry)
         return -1;
-    unsigned char* zdata = malloc(entry->zsize);
+    unsigned char* zdata = malloc(zsize);
 
     int failed = 0;
 #pragma omp critical
     {
-        failed = (thtk_io_seek(thdat->stream, entry->offset, SEEK_SET, error) == -1) ||
-                 (thtk_io_read(thdat->stream, zdata, entry->zsize, error) != entry->zsize);
+        failed = (thtk_io_seek(thdat->stream, thdat->entries.offset[entry_index], SEEK_SET, error) == -1) ||
+                 (thtk_io_read(thdat->stream, zdata, zsize, error) != zsize);
     }
 
     if (failed)
         return -1;
 
-    thtk_io_t* zdata_stream = thtk_io_open_memory(zdata, entry->zsize, error);
+    thtk_io_t* zdata_stream = thtk_io_open_memory(zdata, zsize, error);
     if (!zdata_stream)
         return -1;
 
-    if (th_unlzss(zdata_stream, raw_entry, entry->size, error) == -1)
+    if (th_unlzss(zdata_stream, raw_entry, size, error) == -1)
         return -1;
     thtk_io_close(zdata_stream);
     if (thtk_io_seek(raw_entry, 0, SEEK_SET, error) == -1)
@@ -185,7 +190,7 @@ th08_read(
         return -1;
     }
 
-    entry->size -= 4;
+    size -= 4;
 
     for (i = 0; i < 8; ++i) {
         if (current_crypt_params[i].type == entry_type) {
@@ -199,25 +204,25 @@ th08_read(
         return -1;
     }
 
-    unsigned char* data = thtk_io_map(raw_entry, 4, entry->size, error);
+    unsigned char* data = thtk_io_map(raw_entry, 4, size, error);
     if (!data)
         return -1;
 
     th_decrypt(data,
-               entry->size,
+               size,
                current_crypt_params[type].key,
                current_crypt_params[type].step,
                current_crypt_params[type].block,
                current_crypt_params[type].limit);
 
-    if (thtk_io_write(output, data, entry->size, error) == -1)
+    if (thtk_io_write(output, data, size, error) == -1)
         return -1;
 
     thtk_io_unmap(raw_entry, data);
 
     thtk_io_close(raw_entry);
 
-    return entry->size;
+    return size;
 }
 
 static int
@@ -274,10 +279,10 @@ th08_write(
     size_t input_length,
     thtk_error_t** error)
 {
-    thdat_entry_t* entry = &thdat->entries[entry_index];
-    const crypt_params* crypt_params = find_crypt_params(thdat->version, entry->name);
-    entry->size = input_length + 4;
-    unsigned char* data = malloc(entry->size);
+    const crypt_params* crypt_params = find_crypt_params(thdat->version, thdat->entries.name[entry_index]);
+    const ssize_t size = input_length + 4;
+    ssize_t zsize;
+    unsigned char* data = malloc(size);
 
     data[0] = 'e';
     data[1] = 'd';
@@ -288,33 +293,36 @@ th08_write(
 
     th_encrypt(data + 4, input_length, crypt_params->key, crypt_params->step, crypt_params->block, crypt_params->limit);
 
-    thtk_io_t* data_stream = thtk_io_open_memory(data, entry->size, error);
+    thtk_io_t* data_stream = thtk_io_open_memory(data, size, error);
     if (!data_stream)
         return -1;
 
     thtk_io_t* zdata_stream = thtk_io_open_growing_memory(error);
     if (!zdata_stream)
         return -1;
-    entry->zsize = th_lzss(data_stream, entry->size, zdata_stream, error);
+    zsize = th_lzss(data_stream, size, zdata_stream, error);
     thtk_io_close(data_stream);
-    if (entry->zsize == -1)
+    if (zsize == -1)
         return -1;
-    unsigned char* zdata = thtk_io_map(zdata_stream, 0, entry->zsize, error);
+    unsigned char* zdata = thtk_io_map(zdata_stream, 0, zsize, error);
     if (!zdata)
         return -1;
 
+    thdat->entries.size[entry_index] = size;
+    thdat->entries.zsize[entry_index] = zsize;
+
 #pragma omp critical
     {
         /* TODO: Handle error. */
-        thtk_io_write(thdat->stream, zdata, entry->zsize, error);
-        entry->offset = thdat->offset;
-        thdat->offset += entry->zsize;
+        thtk_io_write(thdat->stream, zdata, zsize, error);
+        thdat->entries.offset[entry_index] = thdat->offset;
+        thdat->offset += zsize;
     }
 
     thtk_io_unmap(zdata_stream, zdata);
     thtk_io_close(zdata_stream);
 
-    return entry->zsize;
+    return zsize;
 }
 
 static int
@@ -332,7 +340,7 @@ th08_close(
     const uint32_t zero = 0;
 
     for (i = 0; i < thdat->entry_count; ++i)
-        list_size += strlen(thdat->entries[i].name) + 1 + (sizeof(uint32_t) * 3);
+        list_size += strlen(thdat->entries.name[i]) + 1 + (sizeof(uint32_t) * 3);
 
     /* XXX: I'm adding some padding here to satisfy pbgzmlt.
      * The games work fine without it. */
@@ -342,10 +350,12 @@ th08_close(
 
     buffer_ptr = buffer;
     for (i = 0; i < thdat->entry_count; ++i) {
-        thdat_entry_t* entry = &thdat->entries[i];
-        buffer_ptr = MEMPCPY(buffer_ptr, entry->name, strlen(entry->name) + 1);
-        buffer_ptr = MEMPCPY(buffer_ptr, &entry->offset, sizeof(uint32_t));
-        buffer_ptr = MEMPCPY(buffer_ptr, &entry->size, sizeof(uint32_t));
+        const char* name = thdat->entries.name[i];
+        const uint32_t offset = thdat->entries.offset[i];
+        const uint32_t size = thdat->entries.size[i];
+        buffer_ptr = MEMPCPY(buffer_ptr, name, strlen(name) + 1);
+        buffer_ptr = MEMPCPY(buffer_ptr, &offset, sizeof(uint32_t));
+        buffer_ptr = MEMPCPY(buffer_ptr, &size, sizeof(uint32_t));
         buffer_ptr = MEMPCPY(buffer_ptr, &zero, sizeof(uint32_t));
     }
 
@@ -394,11 +404,21 @@ th08_close(
     return 1;
 }
 
+static const void*
+th08_data_key(
+    thdat_t* thdat,
+    int entry_index)
+{
+    return find_crypt_params(thdat->version, thdat->entries.name[entry_index]);
+}
+
 const thdat_module_t archive_th08 = {
     THDAT_BASENAME,
     th08_open,
     th08_create,
     th08_close,
     th08_read,
-    th08_write
+    th08_write,
+    th08_data_key,
+    NULL
 };
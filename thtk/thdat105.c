@@ -69,21 +69,19 @@ th75_open(
         return 0;
     th_crypt75_list(header_buf, header_size, 0x64, 0x64, 0x4d);
 
-    thdat->entry_count = entry_count;
-    thdat->entries = calloc(entry_count, sizeof(thdat_entry_t));
+    if (!thdat_entries_resize(thdat, entry_count, error))
+        return 0;
 
     uint8_t *ptr = header_buf;
     for (uint16_t i = 0; i < entry_count; i++) {
-        thdat_entry_t *entry = &thdat->entries[i];
-        thdat_entry_init(entry);
-
-        strncpy(entry->name, (char *)ptr, name_len);
-        entry->name[name_len-1] = 0;
-        th75_path_normalize((char *)entry->name, '\\', '/');
+        ptr[name_len-1] = 0;
+        th75_path_normalize((char *)ptr, '\\', '/');
+        if (!thdat_entry_store_name(thdat, i, (char *)ptr, name_len, error))
+            return 0;
         ptr += name_len;
-        entry->size = *((uint32_t *)ptr);
+        thdat->entries.size[i] = *((uint32_t *)ptr);
         ptr += 4;
-        entry->offset = *((uint32_t *)ptr);
+        thdat->entries.offset[i] = *((uint32_t *)ptr);
         ptr += 4;
     }
     free(header_buf);
@@ -117,23 +115,21 @@ th105_open(
     if (thdat->version != 105105)
         th_crypt75_list(header_buf, header_size, 0xc5, 0x83, 0x53);
 
-    thdat->entry_count = entry_count;
-    thdat->entries = calloc(entry_count, sizeof(thdat_entry_t));
+    if (!thdat_entries_resize(thdat, entry_count, error))
+        return 0;
 
     if (header.entry_count) {
         unsigned char* ptr = header_buf;
         for (uint16_t i = 0; i < entry_count; ++i) {
-            thdat_entry_t* entry = thdat->entries + i;
-            thdat_entry_init(entry);
-
-            entry->offset = *((uint32_t*)ptr);
+            thdat->entries.offset[i] = *((uint32_t*)ptr);
             ptr += 4;
-            entry->size = *((uint32_t*)ptr);
+            thdat->entries.size[i] = *((uint32_t*)ptr);
             ptr += 4;
             // zsize and extra are not used.
 
             unsigned char name_length = *(ptr++);
-            strncpy(entry->name, (char*)ptr, name_length);
+            if (!thdat_entry_store_name(thdat, i, (char*)ptr, name_length, error))
+                return 0;
             ptr += name_length;
         }
     }
@@ -145,20 +141,21 @@ th105_open(
 static void
 th105_data_crypt(
     thdat_t *thdat,
-    thdat_entry_t *entry,
+    ssize_t size,
+    ssize_t offset,
     uint8_t *data)
 {
     switch (thdat->version) {
     case 75:
         break;
     case 7575:
-        th_crypt105_file(data, entry->size, entry->offset, THCRYPT_MEGAMARI_KEY);
+        th_crypt105_file(data, size, offset, THCRYPT_MEGAMARI_KEY);
         break;
     case 105105:
     case 105:
     case 123:
     default:
-        th_crypt105_file(data, entry->size, entry->offset, THCRYPT_PATCHCON_KEY);
+        th_crypt105_file(data, size, offset, THCRYPT_PATCHCON_KEY);
         break;
     }
 }
@@ -170,17 +167,18 @@ th105_read(
     thtk_io_t* output,
     thtk_error_t** error)
 {
-    thdat_entry_t *entry = &thdat->entries[entry_index];
-    uint8_t *data = malloc(entry->size);
+    const ssize_t size = thdat->entries.size[entry_index];
+    const ssize_t offset = thdat->entries.offset[entry_index];
+    uint8_t *data = malloc(size);
 
-    if (thtk_io_pread(thdat->stream, data, entry->size, entry->offset, error) == -1) {
+    if (thtk_io_pread(thdat->stream, data, size, offset, error) == -1) {
         free(data);
         return -1;
     }
 
-    th105_data_crypt(thdat, entry, data);
+    th105_data_crypt(thdat, size, offset, data);
 
-    if (thtk_io_write(output, data, entry->size, error) == -1) {
+    if (thtk_io_write(output, data, size, error) == -1) {
         free(data);
         return -1;
     }
@@ -210,8 +208,7 @@ th105_create(
     off_t size = 6;
     unsigned int i;
     for (i = 0; i < thdat->entry_count; ++i) {
-        const thdat_entry_t* entry = thdat->entries + i;
-        const size_t namelen = strlen(entry->name);
+        const size_t namelen = strlen(thdat->entries.name[i]);
         size += 8; // for offset and size
         size += (1 + namelen); // for name
     }
@@ -229,36 +226,37 @@ th105_write(
     size_t input_length,
     thtk_error_t** error)
 {
-    thdat_entry_t *entry = &thdat->entries[entry_index];
-
-    entry->size = input_length;
-    uint8_t *data = malloc(entry->size);
+    const ssize_t size = input_length;
+    ssize_t offset;
+    uint8_t *data = malloc(size);
 
     if (thtk_io_seek(input, 0, SEEK_SET, error) == -1) {
         free(data);
         return -1;
     }
-    int ret = thtk_io_read(input, data, entry->size, error);
-    if (ret != entry->size) {
+    int ret = thtk_io_read(input, data, size, error);
+    if (ret != size) {
         free(data);
         return -1;
     }
 
 #pragma omp critical
     {
-        entry->offset = thdat->offset;
-        thdat->offset += entry->size;
+        offset = thdat->offset;
+        thdat->offset += size;
     }
+    thdat->entries.size[entry_index] = size;
+    thdat->entries.offset[entry_index] = offset;
 
-    th105_data_crypt(thdat, entry, data);
+    th105_data_crypt(thdat, size, offset, data);
 
-    if (thtk_io_pwrite(thdat->stream, data, entry->size, entry->offset, error) == -1) {
+    if (thtk_io_pwrite(thdat->stream, data, size, offset, error) == -1) {
         free(data);
         return -1;
     }
 
     free(data);
-    return entry->size;
+    return size;
 }
 
 static int
@@ -274,14 +272,13 @@ th75_close(
 
     uint8_t *ptr = header_buf;
     for (uint16_t i = 0; i < entry_count; i++) {
-        thdat_entry_t *entry = &thdat->entries[i];
-        strncpy((char *)ptr, entry->name, name_len);
+        strncpy((char *)ptr, thdat->entries.name[i], name_len);
         ptr[name_len-1] = 0;
         th75_path_normalize((char *)ptr, '/', '\\');
         ptr += name_len;
-        *(uint32_t *)ptr = entry->size;
+        *(uint32_t *)ptr = thdat->entries.size[i];
         ptr += 4;
-        *(uint32_t *)ptr = entry->offset;
+        *(uint32_t *)ptr = thdat->entries.offset[i];
         ptr += 4;
     }
     th_crypt75_list(header_buf, header_size, 0x64, 0x64, 0x4d);
@@ -310,7 +307,7 @@ th105_close(
     uint32_t header_size = 0;
 
     for (unsigned i = 0; i < entry_count; ++i) {
-        const size_t namelen = strlen(thdat->entries[i].name);
+        const size_t namelen = strlen(thdat->entries.name[i]);
         header_size += 9 + namelen;
     }
 
@@ -324,13 +321,13 @@ th105_close(
     unsigned char* buffer_ptr = buffer;
     for (unsigned i = 0; i < entry_count; i++) {
         uint32_t* buffer_ptr_32 = (uint32_t*) buffer_ptr;
-        const thdat_entry_t* entry = thdat->entries + i;
-        const uint8_t namelen = strlen(entry->name);
-        *(buffer_ptr_32++) = entry->offset;
-        *(buffer_ptr_32++) = entry->size;
+        const char* name = thdat->entries.name[i];
+        const uint8_t namelen = strlen(name);
+        *(buffer_ptr_32++) = thdat->entries.offset[i];
+        *(buffer_ptr_32++) = thdat->entries.size[i];
         buffer_ptr = (unsigned char*) buffer_ptr_32;
         *(buffer_ptr++) = namelen;
-        buffer_ptr = MEMPCPY(buffer_ptr, entry->name, namelen);
+        buffer_ptr = MEMPCPY(buffer_ptr, name, namelen);
     }
 
     th_crypt105_list(buffer, header_size, 6+header_size);
@@ -353,19 +350,23 @@ th105_close(
 }
 
 const thdat_module_t archive_th75 = {
-    THDAT_NO_COMPRESSION,
+    THDAT_NO_COMPRESSION|THDAT_COUNTED_HEADER|THDAT_OFFSET_KEY|THDAT_SHARED_DATA,
     th75_open,
     th75_create,
     th75_close,
     th105_read,
-    th105_write
+    th105_write,
+    NULL,
+    NULL
 };
 
 const thdat_module_t archive_th105 = {
-    THDAT_NO_COMPRESSION|THDAT_LATE_INIT,
+    THDAT_NO_COMPRESSION|THDAT_LATE_INIT|THDAT_OFFSET_KEY|THDAT_SHARED_DATA,
     th105_open,
     th105_create,
     th105_close,
     th105_read,
-    th105_write
+    th105_write,
+    NULL,
+    NULL
 };
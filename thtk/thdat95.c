@@ -127,31 +127,35 @@ th95_open(
         return 0;
     thtk_io_close(data_stream);
 
-    thdat->entry_count = header.entry_count;
-    thdat->entries = calloc(header.entry_count, sizeof(thdat_entry_t));
+    /* Every entry takes at least a padded name and three words. */
+    if (header.entry_count > header.size / 16) {
+        thtk_error_new(error, "entry count does not fit the entry list");
+        return 0;
+    }
+    if (!thdat_entries_resize(thdat, header.entry_count, error))
+        return 0;
 
     if (header.entry_count) {
-        thdat_entry_t* prev = NULL;
+        thdat_entries_t* entries = &thdat->entries;
         const uint32_t* ptr = (uint32_t*)data;
         for (uint32_t i = 0; i < header.entry_count; ++i) {
-            thdat_entry_t* entry = &thdat->entries[i];
-            thdat_entry_init(entry);
-
-            strcpy(entry->name, (char*)ptr);
-            ptr = (uint32_t*)((char*)ptr + strlen(entry->name) + (4 - strlen(entry->name) % 4));
-            entry->offset = *ptr++;
-            entry->size = *ptr++;
+            const size_t name_len = strlen((char*)ptr);
+            if (!thdat_entry_store_name(thdat, i, (char*)ptr, name_len, error))
+                return 0;
+            ptr = (uint32_t*)((char*)ptr + name_len + (4 - name_len % 4));
+            entries->offset[i] = *ptr++;
+            entries->size[i] = *ptr++;
             /* Zero. */
-            entry->extra = *ptr++;
+            entries->extra[i] = *ptr++;
 
-            if (prev)
-                prev->zsize = entry->offset - prev->offset;
-            prev = entry;
+            if (i)
+                entries->zsize[i - 1] = entries->offset[i] - entries->offset[i - 1];
         }
         off_t filesize = thtk_io_seek(thdat->stream, 0, SEEK_END, error);
         if (filesize == -1)
             return 0;
-        prev->zsize = (filesize - header.zsize) - prev->offset;
+        const uint32_t last = header.entry_count - 1;
+        entries->zsize[last] = (filesize - header.zsize) - entries->offset[last];
     }
 
     free(data);
@@ -166,46 +170,47 @@ th95_read(
     thtk_io_t* output,
     thtk_error_t** error)
 {
-    thdat_entry_t* entry = &thdat->entries[entry_index];
+    const ssize_t size = thdat->entries.size[entry_index];
+    const ssize_t zsize = thdat->entries.zsize[entry_index];
     unsigned char* data;
-    unsigned char* zdata = malloc(entry->zsize);
+    unsigned char* zdata = malloc(zsize);
 
     int failed = 0;
 #pragma omp critical
     {
-        failed = (thtk_io_seek(thdat->stream, entry->offset, SEEK_SET, error) == -1) ||
-                 (thtk_io_read(thdat->stream, zdata, entry->zsize, error) != entry->zsize);
+        failed = (thtk_io_seek(thdat->stream, thdat->entries.offset[entry_index], SEEK_SET, error) == -1) ||
+                 (thtk_io_read(thdat->stream, zdata, zsize, error) != zsize);
     }
 
     if (failed)
         return -1;
 
-    const crypt_params_t* crypt_params = th95_get_crypt_param(thdat->version, entry->name);
-    th_decrypt(zdata, entry->zsize, crypt_params->key, crypt_params->step,
+    const crypt_params_t* crypt_params = th95_get_crypt_param(thdat->version, thdat->entries.name[entry_index]);
+    th_decrypt(zdata, zsize, crypt_params->key, crypt_params->step,
         crypt_params->block, crypt_params->limit);
 
-    if (entry->zsize == entry->size) {
+    if (zsize == size) {
         data = zdata;
     } else {
-        thtk_io_t* zdata_stream = thtk_io_open_memory(zdata, entry->zsize, error);
+        thtk_io_t* zdata_stream = thtk_io_open_memory(zdata, zsize, error);
         if (!zdata_stream)
             return -1;
         thtk_io_t* data_stream = thtk_io_open_growing_memory(error);
         if (!data_stream)
             return -1;
-        if (th_unlzss(zdata_stream, data_stream, entry->size, error) == -1)
+        if (th_unlzss(zdata_stream, data_stream, size, error) == -1)
             return -1;
         thtk_io_close(zdata_stream);
 
         if (thtk_io_seek(data_stream, 0, SEEK_SET, error) == -1)
             return -1;
-        data = malloc(entry->size);
-        if (thtk_io_read(data_stream, data, entry->size, error) != entry->size)
+        data = malloc(size);
+        if (thtk_io_read(data_stream, data, size, error) != size)
             return -1;
         thtk_io_close(data_stream);
     }
 
-    if (thtk_io_write(output, data, entry->size, error) == -1)
+    if (thtk_io_write(output, data, size, error) == -1)
         return -1;
 
     free(data);
@@ -232,51 +237,54 @@ th95_write(
     size_t input_length,
     thtk_error_t** error)
 {
-    thdat_entry_t* entry = &thdat->entries[entry_index];
+    const ssize_t size = input_length;
+    ssize_t zsize;
     unsigned char* data;
 
     off_t first_offset = thtk_io_seek(input, 0, SEEK_CUR, error);
     if (first_offset == -1)
         return -1;
 
-    entry->size = input_length;
     thtk_io_t* data_stream = thtk_io_open_growing_memory(error);
     if (!data_stream)
         return -1;
-    if ((entry->zsize = th_lzss(input, entry->size, data_stream, error)) == -1)
+    if ((zsize = th_lzss(input, size, data_stream, error)) == -1)
         return -1;
 
-    if (entry->zsize >= entry->size) {
+    if (zsize >= size) {
         thtk_io_close(data_stream);
 
         if (thtk_io_seek(input, first_offset, SEEK_SET, error) == -1)
             return -1;
-        data = malloc(entry->size);
-        if (thtk_io_read(input, data, entry->size, error) != entry->size)
+        data = malloc(size);
+        if (thtk_io_read(input, data, size, error) != size)
             return -1;
 
-        entry->zsize = entry->size;
+        zsize = size;
     } else {
-        data = malloc(entry->zsize);
+        data = malloc(zsize);
         if (thtk_io_seek(data_stream, 0, SEEK_SET, error) == -1)
             return -1;
-        int ret = thtk_io_read(data_stream, data, entry->zsize, error);
-        if (ret != entry->zsize)
+        int ret = thtk_io_read(data_stream, data, zsize, error);
+        if (ret != zsize)
             return -1;
         thtk_io_close(data_stream);
     }
 
-    const crypt_params_t* crypt_params = th95_get_crypt_param(thdat->version, entry->name);
-    th_encrypt(data, entry->zsize, crypt_params->key, crypt_params->step,
+    thdat->entries.size[entry_index] = size;
+    thdat->entries.zsize[entry_index] = zsize;
+
+    const crypt_params_t* crypt_params = th95_get_crypt_param(thdat->version, thdat->entries.name[entry_index]);
+    th_encrypt(data, zsize, crypt_params->key, crypt_params->step,
         crypt_params->block, crypt_params->limit);
 
     int failed = 0;
 #pragma omp critical
     {
-        failed = (thtk_io_write(thdat->stream, data, entry->zsize, error) != entry->zsize);
+        failed = (thtk_io_write(thdat->stream, data, zsize, error) != zsize);
         if (!failed) {
-            entry->offset = thdat->offset;
-            thdat->offset += entry->zsize;
+            thdat->entries.offset[entry_index] = thdat->offset;
+            thdat->offset += zsize;
         }
     }
 
@@ -285,7 +293,7 @@ th95_write(
     if (failed)
         return -1;
 
-    return entry->zsize;
+    return zsize;
 }
 
 static int
@@ -301,7 +309,7 @@ th95_close(
     ssize_t list_zsize = 0;
 
     for (i = 0; i < thdat->entry_count; ++i) {
-        const size_t namelen = strlen(thdat->entries[i].name);
+        const size_t namelen = strlen(thdat->entries.name[i]);
         list_size += (sizeof(uint32_t) * 3) + namelen + (4 - namelen % 4);
     }
 
@@ -314,12 +322,14 @@ th95_close(
 
     uint32_t* buffer_ptr = (uint32_t*)buffer;
     for (i = 0; i < thdat->entry_count; ++i) {
-        const thdat_entry_t* entry = &thdat->entries[i];
-        const size_t namelen = strlen(entry->name);
-        buffer_ptr = MEMPCPY(buffer_ptr, entry->name,
-            namelen + (4 - namelen % 4));
-        *buffer_ptr++ = entry->offset;
-        *buffer_ptr++ = entry->size;
+        const char* name = thdat->entries.name[i];
+        const size_t namelen = strlen(name);
+        const size_t padding = 4 - namelen % 4;
+        char* name_ptr = MEMPCPY(buffer_ptr, name, namelen);
+        memset(name_ptr, 0, padding);
+        buffer_ptr = (uint32_t*)(name_ptr + padding);
+        *buffer_ptr++ = thdat->entries.offset[i];
+        *buffer_ptr++ = thdat->entries.size[i];
         *buffer_ptr++ = 0;
     }
 
@@ -366,11 +376,37 @@ th95_close(
     return 1;
 }
 
+static const void*
+th95_data_key(
+    thdat_t* thdat,
+    int entry_index)
+{
+    return th95_get_crypt_param(thdat->version, thdat->entries.name[entry_index]);
+}
+
+/* Only the compressed data is encrypted, so it can be reused with other
+ * parameters. */
+static void
+th95_rekey(
+    thdat_t* thdat,
+    int source,
+    int entry_index,
+    unsigned char* data,
+    size_t size)
+{
+    const crypt_params_t* from = th95_get_crypt_param(thdat->version, thdat->entries.name[source]);
+    const crypt_params_t* to = th95_get_crypt_param(thdat->version, thdat->entries.name[entry_index]);
+    th_decrypt(data, size, from->key, from->step, from->block, from->limit);
+    th_encrypt(data, size, to->key, to->step, to->block, to->limit);
+}
+
 const thdat_module_t archive_th95 = {
     THDAT_BASENAME,
     th95_open,
     th95_create,
     th95_close,
     th95_read,
-    th95_write
+    th95_write,
+    th95_data_key,
+    th95_rekey
 };
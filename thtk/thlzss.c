@@ -35,6 +35,7 @@
 
 #include "bits.h"
 #include "thlzss.h"
+#include "thstats.h"
 
 /* Compression specification:
  *
@@ -112,8 +113,8 @@ list_add(
     hash->hash[key] = offset;
 }
 
-ssize_t
-th_lzss(
+static ssize_t
+th_lzss_internal(
     thtk_io_t* input,
     size_t input_size,
     thtk_io_t* output,
@@ -238,8 +239,8 @@ th_lzss(
     return bs.byte_count;
 }
 
-ssize_t
-th_unlzss(
+static ssize_t
+th_unlzss_internal(
     thtk_io_t* input,
     thtk_io_t* output,
     size_t output_size,
@@ -288,3 +289,29 @@ th_unlzss(
 
     return bytes_written;
 }
+
+ssize_t
+th_lzss(
+    thtk_io_t* input,
+    size_t input_size,
+    thtk_io_t* output,
+    thtk_error_t** error)
+{
+    THTK_STATS_BEGIN(t);
+    ssize_t ret = th_lzss_internal(input, input_size, output, error);
+    THTK_STATS_END(t, NULL, 1, THTK_STAT_LZSS, ret != -1 ? input_size : 0);
+    return ret;
+}
+
+ssize_t
+th_unlzss(
+    thtk_io_t* input,
+    thtk_io_t* output,
+    size_t output_size,
+    thtk_error_t** error)
+{
+    THTK_STATS_BEGIN(t);
+    ssize_t ret = th_unlzss_internal(input, output, output_size, error);
+    THTK_STATS_END(t, NULL, 1, THTK_STAT_UNLZSS, ret > 0 ? ret : 0);
+    return ret;
+}
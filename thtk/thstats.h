@@ -0,0 +1,75 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#ifndef THSTATS_H_
+#define THSTATS_H_
+
+#include <config.h>
+#include <thtk/stats.h>
+
+#ifdef WITH_STATS
+/* Returns whether counters are collected, checking the environment on the
+ * first call.  Safe to call from any thread. */
+int thtk_stats_on(
+    void);
+
+/* Adds to local if it isn't NULL.  If shared is set, also adds to the
+ * process-wide counters and to those of the archive being worked on by the
+ * current thread. */
+void thtk_stats_record(
+    thtk_stats_t* local,
+    int shared,
+    thtk_stat_kind_t kind,
+    uint64_t bytes,
+    uint64_t nsec);
+
+/* Directs counters of the current thread to stats, returning the previous
+ * target. */
+thtk_stats_t* thtk_stats_set_sink(
+    thtk_stats_t* stats);
+
+#define THTK_STATS_ON() thtk_stats_on()
+#define THTK_STATS_BEGIN(t) \
+    uint64_t t = THTK_STATS_ON() ? thtk_stats_now() : 0
+#define THTK_STATS_END(t, local, shared, kind, bytes) \
+    do { \
+        if (t) \
+            thtk_stats_record((local), (shared), (kind), (bytes), thtk_stats_now() - (t)); \
+    } while (0)
+#define THTK_STATS_SINK_BEGIN(s, stats) \
+    thtk_stats_t* s = thtk_stats_set_sink(stats)
+#define THTK_STATS_SINK_END(s) \
+    thtk_stats_set_sink(s)
+#else
+#define THTK_STATS_BEGIN(t)
+#define THTK_STATS_END(t, local, shared, kind, bytes) do { (void)(bytes); } while (0)
+#define THTK_STATS_SINK_BEGIN(s, stats)
+#define THTK_STATS_SINK_END(s) do { } while (0)
+#endif
+
+#endif
@@ -36,4 +36,10 @@
 
 #include <thtk/detect.h>
 
+#include <thtk/stats.h>
+
+#include <thtk/hash.h>
+
+#include <thtk/vfs.h>
+
 #endif
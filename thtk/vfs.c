@@ -0,0 +1,717 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(HAVE_FSTAT) && defined(HAVE_SCANDIR)
+#include <sys/stat.h>
+#include <dirent.h>
+#endif
+#include <thtk/thtk.h>
+
+enum {
+    THTK_VFS_ARCHIVE,
+    THTK_VFS_THDAT,
+    THTK_VFS_DIRECTORY,
+};
+
+typedef struct {
+    int kind;
+    int priority;
+    /* Archive or directory path, NULL for THTK_VFS_THDAT. */
+    char* path;
+    unsigned int version;
+    /* Set once the mount has been opened or scanned. */
+    int ready;
+    thtk_io_t* stream;
+    thdat_t* thdat;
+    /* Directory files, relative to path. */
+    char** files;
+    size_t file_count;
+} thtk_vfs_mount_t;
+
+typedef struct {
+    const char* name;
+    uint32_t hash;
+    size_t mount;
+    size_t entry;
+} thtk_vfs_file_t;
+
+struct thtk_vfs_t {
+    thtk_vfs_mount_t* mounts;
+    size_t mount_count;
+
+    /* Merged index, rebuilt when built is cleared. */
+    int built;
+    thtk_vfs_file_t* files;
+    size_t file_count;
+    /* Open addressing, holds file indices plus one, zero is empty. */
+    size_t* slots;
+    size_t slot_count;
+};
+
+static int
+thtk_vfs_fold(
+    int c)
+{
+    if (c == '\\')
+        return '/';
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A' + 'a';
+    return c;
+}
+
+static uint32_t
+thtk_vfs_hash(
+    const char* name)
+{
+    uint32_t hash = THTK_FNV1A_INIT;
+    unsigned char folded[64];
+    size_t n = 0;
+    for (; *name; ++name) {
+        folded[n++] = thtk_vfs_fold((unsigned char)*name);
+        if (n == sizeof(folded)) {
+            hash = thtk_fnv1a(hash, folded, n);
+            n = 0;
+        }
+    }
+    return thtk_fnv1a(hash, folded, n);
+}
+
+static int
+thtk_vfs_name_equal(
+    const char* a,
+    const char* b)
+{
+    for (; *a && *b; ++a, ++b)
+        if (thtk_vfs_fold((unsigned char)*a) != thtk_vfs_fold((unsigned char)*b))
+            return 0;
+    return *a == *b;
+}
+
+thtk_vfs_t*
+thtk_vfs_new(
+    thtk_error_t** error)
+{
+    thtk_vfs_t* vfs = calloc(1, sizeof(*vfs));
+    if (!vfs)
+        thtk_error_new(error, "calloc failed");
+    return vfs;
+}
+
+static void
+thtk_vfs_index_free(
+    thtk_vfs_t* vfs)
+{
+    free(vfs->files);
+    free(vfs->slots);
+    vfs->files = NULL;
+    vfs->file_count = 0;
+    vfs->slots = NULL;
+    vfs->slot_count = 0;
+    vfs->built = 0;
+}
+
+void
+thtk_vfs_free(
+    thtk_vfs_t* vfs)
+{
+    if (!vfs)
+        return;
+    for (size_t m = 0; m < vfs->mount_count; ++m) {
+        thtk_vfs_mount_t* mount = &vfs->mounts[m];
+        if (mount->kind == THTK_VFS_ARCHIVE) {
+            if (mount->thdat)
+                thdat_free(mount->thdat);
+            if (mount->stream)
+                thtk_io_close(mount->stream);
+        }
+        for (size_t f = 0; f < mount->file_count; ++f)
+            free(mount->files[f]);
+        free(mount->files);
+        free(mount->path);
+    }
+    free(vfs->mounts);
+    thtk_vfs_index_free(vfs);
+    free(vfs);
+}
+
+static thtk_vfs_mount_t*
+thtk_vfs_mount_add(
+    thtk_vfs_t* vfs,
+    int kind,
+    const char* path,
+    int priority,
+    thtk_error_t** error)
+{
+    thtk_vfs_mount_t* mounts = realloc(vfs->mounts,
+        (vfs->mount_count + 1) * sizeof(*mounts));
+    if (!mounts) {
+        thtk_error_new(error, "realloc failed");
+        return NULL;
+    }
+    vfs->mounts = mounts;
+
+    thtk_vfs_mount_t* mount = &mounts[vfs->mount_count];
+    memset(mount, 0, sizeof(*mount));
+    mount->kind = kind;
+    mount->priority = priority;
+    if (path) {
+        if (!(mount->path = malloc(strlen(path) + 1))) {
+            thtk_error_new(error, "malloc failed");
+            return NULL;
+        }
+        strcpy(mount->path, path);
+    }
+    ++vfs->mount_count;
+    /* The new mount may shadow names already in the index. */
+    vfs->built = 0;
+    return mount;
+}
+
+int
+thtk_vfs_mount_archive(
+    thtk_vfs_t* vfs,
+    const char* path,
+    unsigned int version,
+    int priority,
+    thtk_error_t** error)
+{
+    if (!vfs || !path) {
+        thtk_error_new(error, "invalid parameter passed");
+        return 0;
+    }
+    thtk_vfs_mount_t* mount =
+        thtk_vfs_mount_add(vfs, THTK_VFS_ARCHIVE, path, priority, error);
+    if (!mount)
+        return 0;
+    mount->version = version;
+    return 1;
+}
+
+int
+thtk_vfs_mount_thdat(
+    thtk_vfs_t* vfs,
+    thdat_t* thdat,
+    int priority,
+    thtk_error_t** error)
+{
+    if (!vfs || !thdat) {
+        thtk_error_new(error, "invalid parameter passed");
+        return 0;
+    }
+    thtk_vfs_mount_t* mount =
+        thtk_vfs_mount_add(vfs, THTK_VFS_THDAT, NULL, priority, error);
+    if (!mount)
+        return 0;
+    mount->thdat = thdat;
+    mount->ready = 1;
+    return 1;
+}
+
+int
+thtk_vfs_mount_directory(
+    thtk_vfs_t* vfs,
+    const char* path,
+    int priority,
+    thtk_error_t** error)
+{
+    if (!vfs || !path) {
+        thtk_error_new(error, "invalid parameter passed");
+        return 0;
+    }
+    return thtk_vfs_mount_add(vfs, THTK_VFS_DIRECTORY, path, priority, error) != NULL;
+}
+
+static char*
+thtk_vfs_join(
+    const char* dir,
+    const char* name)
+{
+    size_t len = strlen(dir);
+    char* path = malloc(len + strlen(name) + 2);
+    if (!path)
+        return NULL;
+    strcpy(path, dir);
+    if (len && dir[len - 1] != '/' && dir[len - 1] != '\\')
+        strcat(path, "/");
+    strcat(path, name);
+    return path;
+}
+
+static int
+thtk_vfs_scan_add(
+    thtk_vfs_mount_t* mount,
+    size_t* capacity,
+    const char* prefix,
+    const char* name)
+{
+    if (mount->file_count == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 64;
+        char** files = realloc(mount->files, new_capacity * sizeof(*files));
+        if (!files)
+            return 0;
+        mount->files = files;
+        *capacity = new_capacity;
+    }
+    char* file = thtk_vfs_join(prefix, name);
+    if (!file)
+        return 0;
+    mount->files[mount->file_count++] = file;
+    return 1;
+}
+
+/* Adds the files below mount->path/prefix to the mount, named relative to
+ * mount->path. */
+#if defined(_WIN32)
+static int
+thtk_vfs_scan(
+    thtk_vfs_mount_t* mount,
+    size_t* capacity,
+    const char* prefix,
+    thtk_error_t** error)
+{
+    char* dir = thtk_vfs_join(mount->path, prefix);
+    char* query = dir ? thtk_vfs_join(dir, "*") : NULL;
+    free(dir);
+    if (!query) {
+        thtk_error_new(error, "malloc failed");
+        return 0;
+    }
+
+    WIN32_FIND_DATAA wfd;
+    HANDLE h = FindFirstFileA(query, &wfd);
+    free(query);
+    if (h == INVALID_HANDLE_VALUE) {
+        thtk_error_new(error, "couldn't scan %s/%s", mount->path, prefix);
+        return 0;
+    }
+
+    int ret = 1;
+    do {
+        const char* name = wfd.cFileName;
+        /* Ignore ".", "..", or hidden files. */
+        if (name[0] == '.')
+            continue;
+        if (wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            char* sub = thtk_vfs_join(prefix, name);
+            if (!sub) {
+                thtk_error_new(error, "malloc failed");
+                ret = 0;
+                break;
+            }
+            ret = thtk_vfs_scan(mount, capacity, sub, error);
+            free(sub);
+            if (!ret)
+                break;
+        } else if (!thtk_vfs_scan_add(mount, capacity, prefix, name)) {
+            thtk_error_new(error, "malloc failed");
+            ret = 0;
+            break;
+        }
+    } while (FindNextFileA(h, &wfd));
+    FindClose(h);
+    return ret;
+}
+#elif defined(HAVE_FSTAT) && defined(HAVE_SCANDIR)
+static int
+thtk_vfs_scan_filter(
+    const struct dirent* file)
+{
+    /* Ignore ".", "..", or hidden files. */
+    return file->d_name[0] != '.';
+}
+
+static int
+thtk_vfs_scan(
+    thtk_vfs_mount_t* mount,
+    size_t* capacity,
+    const char* prefix,
+    thtk_error_t** error)
+{
+    char* dir = thtk_vfs_join(mount->path, prefix);
+    if (!dir) {
+        thtk_error_new(error, "malloc failed");
+        return 0;
+    }
+
+    struct dirent** entries;
+    int n = scandir(dir, &entries, thtk_vfs_scan_filter, alphasort);
+    if (n < 0) {
+        thtk_error_new(error, "couldn't scan %s", dir);
+        free(dir);
+        return 0;
+    }
+
+    int ret = 1;
+    for (int i = 0; i < n; ++i) {
+        const char* name = entries[i]->d_name;
+        struct stat stat_buf;
+        char* full = ret ? thtk_vfs_join(dir, name) : NULL;
+        if (ret && !full) {
+            thtk_error_new(error, "malloc failed");
+            ret = 0;
+        }
+        if (ret && stat(full, &stat_buf) != -1) {
+            if (S_ISDIR(stat_buf.st_mode)) {
+                char* sub = thtk_vfs_join(prefix, name);
+                if (!sub) {
+                    thtk_error_new(error, "malloc failed");
+                    ret = 0;
+                } else {
+                    ret = thtk_vfs_scan(mount, capacity, sub, error);
+                    free(sub);
+                }
+            } else if (!thtk_vfs_scan_add(mount, capacity, prefix, name)) {
+                thtk_error_new(error, "malloc failed");
+                ret = 0;
+            }
+        }
+        free(full);
+        free(entries[i]);
+    }
+    free(entries);
+    free(dir);
+    return ret;
+}
+#else
+static int
+thtk_vfs_scan(
+    thtk_vfs_mount_t* mount,
+    size_t* capacity,
+    const char* prefix,
+    thtk_error_t** error)
+{
+    (void)capacity;
+    (void)prefix;
+    thtk_error_new(error, "directory mounts are not supported on this platform: %s", mount->path);
+    return 0;
+}
+#endif
+
+static int
+thtk_vfs_mount_prepare(
+    thtk_vfs_mount_t* mount,
+    thtk_error_t** error)
+{
+    if (mount->ready)
+        return 1;
+
+    if (mount->kind == THTK_VFS_ARCHIVE) {
+        if (!(mount->stream = thtk_io_open_file(mount->path, "rb", error)))
+            return 0;
+        if (!(mount->thdat = thdat_open(mount->version, mount->stream, error))) {
+            thtk_io_close(mount->stream);
+            mount->stream = NULL;
+            return 0;
+        }
+    } else {
+        size_t capacity = 0;
+        if (!thtk_vfs_scan(mount, &capacity, "", error)) {
+            for (size_t f = 0; f < mount->file_count; ++f)
+                free(mount->files[f]);
+            free(mount->files);
+            mount->files = NULL;
+            mount->file_count = 0;
+            return 0;
+        }
+    }
+    mount->ready = 1;
+    return 1;
+}
+
+static const char*
+thtk_vfs_mount_name(
+    thtk_vfs_mount_t* mount,
+    size_t entry)
+{
+    if (mount->kind == THTK_VFS_DIRECTORY)
+        return mount->files[entry];
+    return thdat_entry_get_name(mount->thdat, (int)entry, NULL);
+}
+
+typedef struct {
+    const char* name;
+    uint32_t hash;
+} thtk_vfs_key_t;
+
+static int
+thtk_vfs_slot_stop(
+    const void* table,
+    size_t slot,
+    const void* key)
+{
+    const thtk_vfs_t* vfs = table;
+    const thtk_vfs_key_t* k = key;
+    if (!vfs->slots[slot])
+        return 1;
+    const thtk_vfs_file_t* file = &vfs->files[vfs->slots[slot] - 1];
+    return file->hash == k->hash && thtk_vfs_name_equal(file->name, k->name);
+}
+
+/* Returns the slot the name hashes to, which is either empty or holds the
+ * file with that name. */
+static size_t
+thtk_vfs_slot(
+    const thtk_vfs_t* vfs,
+    const char* name,
+    uint32_t hash)
+{
+    const thtk_vfs_key_t key = { name, hash };
+    return thtk_probe(vfs->slot_count, hash, thtk_vfs_slot_stop, vfs, &key);
+}
+
+/* Returns 1 if mount a provides a name before mount b does. */
+static int
+thtk_vfs_mount_wins(
+    const thtk_vfs_mount_t* mounts,
+    size_t a,
+    size_t b)
+{
+    if (mounts[a].priority != mounts[b].priority)
+        return mounts[a].priority > mounts[b].priority;
+    return a > b;
+}
+
+static int
+thtk_vfs_build(
+    thtk_vfs_t* vfs,
+    thtk_error_t** error)
+{
+    thtk_vfs_index_free(vfs);
+
+    /* Opening archives and walking directories is the slow part, and every
+     * mount is independent. */
+    const ssize_t mount_count = (ssize_t)vfs->mount_count;
+    thtk_error_t* first_error = NULL;
+#pragma omp parallel for schedule(dynamic)
+    for (ssize_t m = 0; m < mount_count; ++m) {
+        thtk_error_t* mount_error = NULL;
+        if (!thtk_vfs_mount_prepare(&vfs->mounts[m], &mount_error)) {
+#pragma omp critical(thtk_vfs_error)
+            {
+                if (!first_error)
+                    first_error = mount_error;
+                else
+                    thtk_error_free(&mount_error);
+            }
+        }
+    }
+    if (first_error) {
+        if (error)
+            *error = first_error;
+        else
+            thtk_error_free(&first_error);
+        return 0;
+    }
+
+    /* Visit the mounts from the winning one down, so that the first file
+     * with a name is the one that stays. */
+    size_t* order = malloc((vfs->mount_count + 1) * sizeof(*order));
+    if (!order) {
+        thtk_error_new(error, "malloc failed");
+        return 0;
+    }
+    size_t total = 0;
+    for (size_t m = 0; m < vfs->mount_count; ++m) {
+        thtk_vfs_mount_t* mount = &vfs->mounts[m];
+        order[m] = m;
+        if (mount->kind == THTK_VFS_DIRECTORY) {
+            total += mount->file_count;
+        } else {
+            ssize_t count = thdat_entry_count(mount->thdat, error);
+            if (count == -1) {
+                free(order);
+                return 0;
+            }
+            total += (size_t)count;
+        }
+    }
+    /* There are never many mounts, and qsort has no context parameter. */
+    for (size_t i = 1; i < vfs->mount_count; ++i) {
+        size_t key = order[i], j = i;
+        for (; j > 0 && thtk_vfs_mount_wins(vfs->mounts, key, order[j - 1]); --j)
+            order[j] = order[j - 1];
+        order[j] = key;
+    }
+
+    size_t slot_count = 16;
+    while (slot_count < total * 2)
+        slot_count *= 2;
+    vfs->files = malloc((total + 1) * sizeof(*vfs->files));
+    vfs->slots = calloc(slot_count, sizeof(*vfs->slots));
+    vfs->slot_count = slot_count;
+    if (!vfs->files || !vfs->slots) {
+        free(order);
+        thtk_vfs_index_free(vfs);
+        thtk_error_new(error, "malloc failed");
+        return 0;
+    }
+
+    for (size_t o = 0; o < vfs->mount_count; ++o) {
+        const size_t m = order[o];
+        thtk_vfs_mount_t* mount = &vfs->mounts[m];
+        size_t count = mount->kind == THTK_VFS_DIRECTORY ?
+            mount->file_count : (size_t)thdat_entry_count(mount->thdat, NULL);
+        for (size_t e = 0; e < count; ++e) {
+            const char* name = thtk_vfs_mount_name(mount, e);
+            if (!name)
+                continue;
+            uint32_t hash = thtk_vfs_hash(name);
+            size_t slot = thtk_vfs_slot(vfs, name, hash);
+            if (vfs->slots[slot])
+                continue;
+            thtk_vfs_file_t* file = &vfs->files[vfs->file_count];
+            file->name = name;
+            file->hash = hash;
+            file->mount = m;
+            file->entry = e;
+            vfs->slots[slot] = ++vfs->file_count;
+        }
+    }
+    free(order);
+    return 1;
+}
+
+static int
+thtk_vfs_ensure_index(
+    thtk_vfs_t* vfs,
+    thtk_error_t** error)
+{
+    int built;
+#pragma omp atomic read
+    built = vfs->built;
+    if (built)
+        return 1;
+
+    int ret = 1;
+#pragma omp critical(thtk_vfs_index)
+    {
+        if (!vfs->built) {
+            ret = thtk_vfs_build(vfs, error);
+#pragma omp flush
+            if (ret) {
+#pragma omp atomic write
+                vfs->built = 1;
+            }
+        }
+    }
+    return ret;
+}
+
+ssize_t
+thtk_vfs_count(
+    thtk_vfs_t* vfs,
+    thtk_error_t** error)
+{
+    if (!vfs) {
+        thtk_error_new(error, "invalid parameter passed");
+        return -1;
+    }
+    if (!thtk_vfs_ensure_index(vfs, error))
+        return -1;
+    return (ssize_t)vfs->file_count;
+}
+
+const char*
+thtk_vfs_name(
+    thtk_vfs_t* vfs,
+    size_t index,
+    thtk_error_t** error)
+{
+    if (!vfs) {
+        thtk_error_new(error, "invalid parameter passed");
+        return NULL;
+    }
+    if (!thtk_vfs_ensure_index(vfs, error))
+        return NULL;
+    if (index >= vfs->file_count) {
+        thtk_error_new(error, "invalid parameter passed");
+        return NULL;
+    }
+    return vfs->files[index].name;
+}
+
+ssize_t
+thtk_vfs_find(
+    thtk_vfs_t* vfs,
+    const char* name,
+    thtk_error_t** error)
+{
+    if (!vfs || !name) {
+        thtk_error_new(error, "invalid parameter passed");
+        return -1;
+    }
+    if (!thtk_vfs_ensure_index(vfs, error))
+        return -1;
+    size_t slot = thtk_vfs_slot(vfs, name, thtk_vfs_hash(name));
+    if (!vfs->slots[slot]) {
+        thtk_error_new(error, "entry name '%s' not found", name);
+        return -1;
+    }
+    return (ssize_t)(vfs->slots[slot] - 1);
+}
+
+thtk_io_t*
+thtk_vfs_open(
+    thtk_vfs_t* vfs,
+    const char* name,
+    thtk_error_t** error)
+{
+    ssize_t index = thtk_vfs_find(vfs, name, error);
+    if (index == -1)
+        return NULL;
+    const thtk_vfs_file_t* file = &vfs->files[index];
+    thtk_vfs_mount_t* mount = &vfs->mounts[file->mount];
+
+    if (mount->kind == THTK_VFS_DIRECTORY) {
+        char* path = thtk_vfs_join(mount->path, file->name);
+        if (!path) {
+            thtk_error_new(error, "malloc failed");
+            return NULL;
+        }
+        thtk_io_t* io = thtk_io_open_file(path, "rb", error);
+        free(path);
+        return io;
+    }
+
+    thtk_io_t* io = thtk_io_open_growing_memory(error);
+    if (!io)
+        return NULL;
+    if (thdat_entry_read_data(mount->thdat, (int)file->entry, io, error) == -1 ||
+        thtk_io_seek(io, 0, SEEK_SET, error) == -1) {
+        thtk_io_close(io);
+        return NULL;
+    }
+    return io;
+}
@@ -0,0 +1,124 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#ifndef THTK_VFS_H_
+#define THTK_VFS_H_
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#include <thtk/error.h>
+#include <thtk/io.h>
+#include <thtk/dat.h>
+
+#ifndef THTK_EXPORT
+#define THTK_EXPORT /* */
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A read-only view of several archives and directories merged into one
+ * namespace.  When a name exists in more than one mount, the mount with the
+ * highest priority provides it, and among equal priorities the one mounted
+ * last wins.  Names use '/' as the separator and are compared without regard
+ * to ASCII case.
+ *
+ * Mounting only records the source.  Archives are opened, directories are
+ * scanned and the merged index is built on the first lookup, and again after
+ * anything new has been mounted.  Mounting must not happen while other
+ * threads use the object, but lookups and opens may run concurrently. */
+typedef struct thtk_vfs_t thtk_vfs_t;
+
+/* Creates an empty file system.  NULL indicates an error. */
+THTK_EXPORT thtk_vfs_t* thtk_vfs_new(
+    thtk_error_t** error);
+
+/* Frees the file system, along with the archives it opened itself. */
+THTK_EXPORT void thtk_vfs_free(
+    thtk_vfs_t* vfs);
+
+/* Mounts the archive at path, which is opened as the given version when it
+ * is first needed.  0 indicates an error. */
+THTK_EXPORT int thtk_vfs_mount_archive(
+    thtk_vfs_t* vfs,
+    const char* path,
+    unsigned int version,
+    int priority,
+    thtk_error_t** error);
+
+/* Mounts an archive that is already open.  The archive and its stream must
+ * outlive the file system, which doesn't free them.  0 indicates an
+ * error. */
+THTK_EXPORT int thtk_vfs_mount_thdat(
+    thtk_vfs_t* vfs,
+    thdat_t* thdat,
+    int priority,
+    thtk_error_t** error);
+
+/* Mounts the files below a directory, named relative to it.  Hidden files
+ * and directories are skipped.  0 indicates an error. */
+THTK_EXPORT int thtk_vfs_mount_directory(
+    thtk_vfs_t* vfs,
+    const char* path,
+    int priority,
+    thtk_error_t** error);
+
+/* Returns the number of distinct names.  -1 indicates an error. */
+THTK_EXPORT ssize_t thtk_vfs_count(
+    thtk_vfs_t* vfs,
+    thtk_error_t** error);
+
+/* Returns the name with the given index, as spelled by the mount that
+ * provides it.  NULL indicates an error. */
+THTK_EXPORT const char* thtk_vfs_name(
+    thtk_vfs_t* vfs,
+    size_t index,
+    thtk_error_t** error);
+
+/* Returns the index of the named file.  -1 indicates an error, which
+ * includes the name not existing. */
+THTK_EXPORT ssize_t thtk_vfs_find(
+    thtk_vfs_t* vfs,
+    const char* name,
+    thtk_error_t** error);
+
+/* Opens the named file for reading.  Files from directories are opened
+ * directly, archive entries are decoded into memory.  The object is closed
+ * with thtk_io_close.  NULL indicates an error. */
+THTK_EXPORT thtk_io_t* thtk_vfs_open(
+    thtk_vfs_t* vfs,
+    const char* name,
+    thtk_error_t** error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
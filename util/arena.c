@@ -0,0 +1,141 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include <config.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "util.h"
+
+/* A type with the strictest alignment that the objects may need. */
+typedef union {
+    long double d;
+    void* p;
+    long long l;
+} arena_align_t;
+
+struct arena_chunk_t {
+    arena_chunk_t* next;
+    arena_align_t data[];
+};
+
+void
+arena_init(
+    arena_t* arena)
+{
+    arena->chunks = NULL;
+    arena->next = NULL;
+    arena->end = NULL;
+}
+
+void*
+arena_alloc(
+    arena_t* arena,
+    size_t size)
+{
+    unsigned char* ret;
+
+    size = (size + sizeof(arena_align_t) - 1) & ~(sizeof(arena_align_t) - 1);
+    if ((size_t)(arena->end - arena->next) < size) {
+        size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+        arena_chunk_t* chunk = util_malloc(sizeof(arena_chunk_t) + chunk_size);
+
+        if (chunk_size > ARENA_CHUNK_SIZE && arena->chunks) {
+            /* Keep using the free space of the current chunk for the
+             * smaller allocations that follow. */
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+            return chunk->data;
+        }
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->next = (unsigned char*)chunk->data;
+        arena->end = arena->next + chunk_size;
+    }
+    ret = arena->next;
+    arena->next += size;
+    return ret;
+}
+
+void*
+arena_calloc(
+    arena_t* arena,
+    size_t size)
+{
+    void* ret = arena_alloc(arena, size);
+    memset(ret, 0, size);
+    return ret;
+}
+
+char*
+arena_strdup(
+    arena_t* arena,
+    const char* str)
+{
+    size_t size = strlen(str) + 1;
+    char* ret = arena_alloc(arena, size);
+    memcpy(ret, str, size);
+    return ret;
+}
+
+void
+arena_vec_ensure(
+    arena_t* arena,
+    void* data, /* It's actually void **. This is done to avoid casts. */
+    size_t* cap,
+    size_t size,
+    size_t element_size)
+{
+    if (size <= *cap)
+        return;
+
+    size_t ncap = *cap ? *cap : 4;
+    while (ncap < size)
+        ncap <<= 1;
+
+    void* ndata = arena_alloc(arena, ncap * element_size);
+    if (*cap)
+        memcpy(ndata, *(void**)data, *cap * element_size);
+    *(void**)data = ndata;
+    *cap = ncap;
+}
+
+void
+arena_free(
+    arena_t* arena)
+{
+    arena_chunk_t* chunk;
+    arena_chunk_t* chunk_next;
+
+    for (chunk = arena->chunks; chunk; chunk = chunk_next) {
+        chunk_next = chunk->next;
+        free(chunk);
+    }
+    arena_init(arena);
+}
@@ -0,0 +1,64 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <config.h>
+#include <stddef.h>
+
+/* A bump allocator for objects that all live as long as one owner, such as
+ * the entries, scripts and instructions of an archive.  Memory is taken from
+ * a chain of chunks, and is only given back all at once by arena_free. */
+typedef struct arena_chunk_t arena_chunk_t;
+
+typedef struct arena_t {
+    arena_chunk_t* chunks;
+    /* Free space in the first chunk. */
+    unsigned char* next;
+    unsigned char* end;
+} arena_t;
+
+/* Size of the chunks, unless an allocation needs more. */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+/* Initializes an empty arena. */
+void arena_init(arena_t* arena);
+/* Returns size bytes aligned for any type.  Aborts if memory runs out. */
+void* arena_alloc(arena_t* arena, size_t size);
+/* Like arena_alloc, but clears the memory. */
+void* arena_calloc(arena_t* arena, size_t size);
+/* Copies a string into the arena. */
+char* arena_strdup(arena_t* arena, const char* str);
+/* Makes room for size elements in *data, an array of *cap elements, like
+ * util_vec_ensure.  The old array is left in the arena. */
+void arena_vec_ensure(arena_t* arena, void* data, size_t* cap, size_t size, size_t element_size);
+/* Frees every chunk, and leaves the arena empty. */
+void arena_free(arena_t* arena);
+
+#endif
@@ -40,15 +40,57 @@
 #ifdef _WIN32
 #include <windows.h>
 #endif
+#include <thtk/thtk.h>
 #include "file.h"
 #include "program.h"
 
+/* Streams opened by file_open_input on a decoded archive entry.  The data is
+ * the buffer of the memory IO object the entry was decoded into, handed out
+ * directly by file_fsize and file_mmap, and freed once the stream is closed
+ * and the data is no longer mapped, in either order. */
+typedef struct file_memory_t {
+    FILE* stream;
+    thtk_io_t* io;
+    void* data;
+    size_t size;
+    int mapped;
+    struct file_memory_t* next;
+} file_memory_t;
+
+static file_memory_t* file_memories;
+
+/* Must be called inside critical(file_memory). */
+static file_memory_t**
+file_memory_link(
+    FILE* stream,
+    const void* data)
+{
+    file_memory_t** link;
+    for (link = &file_memories; *link; link = &(*link)->next)
+        if ((stream && (*link)->stream == stream) ||
+            (data && (*link)->data == data))
+            break;
+    return link;
+}
+
+static void
+file_memory_free(
+    file_memory_t* memory)
+{
+    thtk_io_unmap(memory->io, memory->data);
+    thtk_io_close(memory->io);
+    free(memory);
+}
+
 int
 file_seek(
     FILE* stream,
     long offset)
 {
-    if (fseek(stream, offset, SEEK_SET) != 0) {
+    uint64_t t = thtk_stats_begin();
+    int ret = fseek(stream, offset, SEEK_SET);
+    thtk_stats_end(t, THTK_STAT_SEEK, 0);
+    if (ret != 0) {
         fprintf(stderr, "%s: failed seeking to %lu: %s\n",
             argv0, offset, strerror(errno));
         return 0;
@@ -79,7 +121,10 @@ file_read(
     void* buffer,
     size_t size)
 {
-    if (fread_unlocked(buffer, size, 1, stream) != 1 && size != 0) {
+    uint64_t t = thtk_stats_begin();
+    size_t ret = fread_unlocked(buffer, size, 1, stream);
+    thtk_stats_end(t, THTK_STAT_READ, ret == 1 ? size : 0);
+    if (ret != 1 && size != 0) {
         if (feof_unlocked(stream)) {
             fprintf(stderr,
                 "%s: failed reading %lu bytes: unexpected end of file\n",
@@ -99,13 +144,16 @@ file_write(
     const void* buffer,
     size_t size)
 {
-    if (fwrite_unlocked(buffer, size, 1, stream) != 1 && size != 0) {
+    uint64_t t = thtk_stats_begin();
+    size_t ret = fwrite_unlocked(buffer, size, 1, stream);
+    if (ret != 1 && size != 0) {
         fprintf(stderr, "%s: failed writing %lu bytes: %s\n",
             argv0, (long unsigned int)size, strerror(errno));
         return 0;
     }
     else {
         fflush(stream);
+        thtk_stats_end(t, THTK_STAT_WRITE, size);
         return 1;
     }
 }
@@ -139,6 +187,16 @@ long
 file_fsize(
     FILE* stream)
 {
+    long size = -1;
+#pragma omp critical(file_memory)
+    {
+        file_memory_t* memory = *file_memory_link(stream, NULL);
+        if (memory)
+            size = (long)memory->size;
+    }
+    if (size != -1)
+        return size;
+
 #if defined(HAVE_FILENO) && defined(HAVE_FSTAT)
     struct stat sb;
     int fd = fileno_unlocked(stream);
@@ -181,6 +239,25 @@ file_mmap(
     FILE* stream,
     size_t length)
 {
+    int found = 0;
+    void* data = NULL;
+#pragma omp critical(file_memory)
+    {
+        file_memory_t* memory = *file_memory_link(stream, NULL);
+        if (memory) {
+            found = 1;
+            if (length && length <= memory->size) {
+                memory->mapped = 1;
+                data = memory->data;
+            }
+        }
+    }
+    if (found) {
+        if (!data)
+            fprintf(stderr, "%s: mmap failed: %s\n", argv0, strerror(EINVAL));
+        return data;
+    }
+
 #if defined(HAVE_MMAP)
     void* map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fileno_unlocked(stream), 0);
     if (map == MAP_FAILED) {
@@ -229,6 +306,25 @@ file_munmap(
     void* map,
     size_t length)
 {
+    file_memory_t* memory = NULL;
+    int found = 0;
+#pragma omp critical(file_memory)
+    {
+        file_memory_t** link = file_memory_link(NULL, map);
+        if (*link) {
+            found = 1;
+            (*link)->mapped = 0;
+            if (!(*link)->stream) {
+                memory = *link;
+                *link = memory->next;
+            }
+        }
+    }
+    if (memory)
+        file_memory_free(memory);
+    if (found)
+        return 1;
+
 #if defined(HAVE_MMAP)
     if (munmap(map, length) == -1) {
         fprintf(stderr, "%s: munmap failed: %s\n", argv0, strerror(errno));
@@ -253,3 +349,228 @@ file_munmap(
     return 0;
 #endif
 }
+
+static void
+file_print_error(
+    thtk_error_t** error)
+{
+    fprintf(stderr, "%s:%s\n", argv0, thtk_error_message(*error));
+    thtk_error_free(error);
+}
+
+/* Opens the archive as the given version and looks up the entry.  Returns -1
+ * if either fails. */
+static ssize_t
+file_try_dat(
+    unsigned int version,
+    const char* entry,
+    thtk_io_t* file,
+    thdat_t** thdat)
+{
+    thtk_error_t* error = NULL;
+    ssize_t index = -1;
+    if ((*thdat = thdat_open(version, file, &error)) &&
+        (index = thdat_entry_by_name(*thdat, entry, &error)) == -1) {
+        thdat_free(*thdat);
+        *thdat = NULL;
+    }
+    thtk_error_free(&error);
+    return index;
+}
+
+/* Opens an archive as one of the versions that thdat_detect finds possible
+ * from its contents, and looks up the entry.  The version the tool was given
+ * is tried first, then the one the archive's filename suggests, and then the
+ * other candidates, so that renamed archives are found as well.  Returns -1
+ * on error, or if the entry is in none of them. */
+static ssize_t
+file_open_dat(
+    const char* archive,
+    const char* entry,
+    unsigned int version,
+    thtk_io_t* file,
+    thdat_t** thdat,
+    thtk_error_t** error)
+{
+    const thdat_detect_entry_t* ent;
+    uint32_t out[4];
+    uint32_t candidates[4];
+    unsigned int heur;
+    unsigned int first[2];
+    size_t first_count = 0;
+    ssize_t index;
+
+    if (thdat_detect(archive, file, out, &heur, error) == -1)
+        return -1;
+    /* Detection may leave the error of a probe that didn't pan out. */
+    thtk_error_free(error);
+
+    memcpy(candidates, out, sizeof(out));
+    while ((ent = thdat_detect_iter(candidates)))
+        if (version && ent->alias == version)
+            first[first_count++] = version;
+    if (heur != (unsigned int)-1 && heur != version)
+        first[first_count++] = heur;
+
+    for (size_t f = 0; f < first_count; ++f)
+        if ((index = file_try_dat(first[f], entry, file, thdat)) != -1)
+            return index;
+
+    memcpy(candidates, out, sizeof(out));
+    if (!thdat_detect_iter(candidates)) {
+        fprintf(stderr, "%s: couldn't detect version of '%s'\n", argv0, archive);
+        return -1;
+    }
+    while ((ent = thdat_detect_iter(out))) {
+        if ((first_count > 0 && ent->alias == first[0]) ||
+            (first_count > 1 && ent->alias == first[1]))
+            continue;
+        if ((index = file_try_dat(ent->alias, entry, file, thdat)) != -1)
+            return index;
+    }
+    fprintf(stderr, "%s: '%s' not found in '%s'\n", argv0, entry, archive);
+    return -1;
+}
+
+/* Decodes the named entry of an archive into a new memory IO object, and maps
+ * its buffer. */
+static thtk_io_t*
+file_read_dat_entry(
+    const char* archive,
+    const char* entry,
+    unsigned int version,
+    void** data,
+    size_t* size)
+{
+    thtk_error_t* error = NULL;
+    thtk_io_t* file = NULL;
+    thtk_io_t* memory = NULL;
+    thdat_t* thdat = NULL;
+    ssize_t index;
+    off_t end;
+
+    if (!(file = thtk_io_open_file(archive, "rb", &error)))
+        goto fail;
+    if ((index = file_open_dat(archive, entry, version, file, &thdat, &error)) == -1) {
+        if (error)
+            goto fail;
+        goto done;
+    }
+    /* An empty entry has no buffer, and can't be mapped, as with a file. */
+    if (!(memory = thtk_io_open_growing_memory(&error)) ||
+        thdat_entry_read_data(thdat, (int)index, memory, &error) == -1 ||
+        (end = thtk_io_seek(memory, 0, SEEK_END, &error)) == -1 ||
+        (end && !(*data = thtk_io_map(memory, 0, (size_t)end, &error))))
+        goto fail;
+    *size = (size_t)end;
+    goto done;
+
+fail:
+    file_print_error(&error);
+    if (memory)
+        thtk_io_close(memory);
+    memory = NULL;
+done:
+    if (thdat)
+        thdat_free(thdat);
+    if (file)
+        thtk_io_close(file);
+    return memory;
+}
+
+/* Returns the length of the archive path in an ARCHIVE.dat:ENTRY input, or 0
+ * if the path has no such form. */
+static size_t
+file_dat_prefix(
+    const char* path)
+{
+    for (const char* p = path; (p = strchr(p, ':')); ++p) {
+        size_t len = (size_t)(p - path);
+        if (len > 4 && p[1] &&
+            p[-4] == '.' &&
+            (p[-3] == 'd' || p[-3] == 'D') &&
+            (p[-2] == 'a' || p[-2] == 'A') &&
+            (p[-1] == 't' || p[-1] == 'T'))
+            return len;
+    }
+    return 0;
+}
+
+FILE*
+file_open_input(
+    const char* path,
+    unsigned int version)
+{
+    FILE* stream = fopen(path, "rb");
+    size_t prefix;
+    if (stream || !(prefix = file_dat_prefix(path)))
+        return stream;
+
+    char* archive = malloc(prefix + 1);
+    if (!archive)
+        return NULL;
+    memcpy(archive, path, prefix);
+    archive[prefix] = '\0';
+    size_t size = 0;
+    void* data = NULL;
+    thtk_io_t* io = file_read_dat_entry(archive, path + prefix + 1, version, &data, &size);
+    free(archive);
+    if (!io) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    /* Readers that use stdio, such as the script parsers, still get a normal
+     * stream over the data. */
+#ifdef HAVE_FMEMOPEN
+    stream = size ? fmemopen(data, size, "r") : NULL;
+    if (!stream)
+#endif
+    {
+        stream = tmpfile();
+        if (stream && (fwrite(data, 1, size, stream) != size || fseek(stream, 0, SEEK_SET))) {
+            fclose(stream);
+            stream = NULL;
+        }
+    }
+    file_memory_t* memory = stream ? malloc(sizeof(*memory)) : NULL;
+    if (!memory) {
+        if (stream)
+            fclose(stream);
+        thtk_io_close(io);
+        return NULL;
+    }
+    memory->stream = stream;
+    memory->io = io;
+    memory->data = data;
+    memory->size = size;
+    memory->mapped = 0;
+#pragma omp critical(file_memory)
+    {
+        memory->next = file_memories;
+        file_memories = memory;
+    }
+    return stream;
+}
+
+int
+file_close(
+    FILE* stream)
+{
+    file_memory_t* memory = NULL;
+#pragma omp critical(file_memory)
+    {
+        file_memory_t** link = file_memory_link(stream, NULL);
+        if (*link) {
+            (*link)->stream = NULL;
+            if (!(*link)->mapped) {
+                memory = *link;
+                *link = memory->next;
+            }
+        }
+    }
+    int ret = fclose(stream);
+    if (memory)
+        file_memory_free(memory);
+    return ret;
+}
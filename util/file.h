@@ -76,4 +76,19 @@ int file_munmap(
     void* map,
     size_t length);
 
+/* Opens a file for binary reading.  If there is no such file and the path has
+ * the form ARCHIVE.dat:ENTRY, the entry is read from the archive instead, and
+ * decoded into memory which file_fsize and file_mmap give out without
+ * copying.  The archive is opened as the tool's version if its contents allow
+ * it, so that it needn't have the game's filename; 0 leaves the version to
+ * detection.  Returns NULL on error, with errno set or an error message
+ * printed.  The stream is closed with file_close. */
+FILE* file_open_input(
+    const char* path,
+    unsigned int version);
+
+/* Closes a stream opened by file_open_input. */
+int file_close(
+    FILE* stream);
+
 #endif
@@ -0,0 +1,268 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include <config.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <thtk/hash.h>
+#include "incremental.h"
+#include "program.h"
+#include "util.h"
+
+typedef struct {
+    char* path;
+    uint64_t hash;
+    uint64_t size;
+    int64_t mtime;
+} incremental_entry_t;
+
+struct incremental_t {
+    char* index_path;
+    incremental_entry_t* entries;
+    size_t entry_count;
+    size_t entry_cap;
+    /* Open addressing over entries, holds indices plus one, zero is empty. */
+    size_t* slots;
+    size_t slot_count;
+    size_t written;
+    size_t skipped;
+};
+
+static int
+incremental_slot_stop(
+    const void* table,
+    size_t slot,
+    const void* key)
+{
+    const incremental_t* inc = table;
+    return !inc->slots[slot] || !strcmp(inc->entries[inc->slots[slot] - 1].path, key);
+}
+
+static size_t*
+incremental_slot(
+    incremental_t* inc,
+    const char* path)
+{
+    const uint32_t hash = thtk_fnv1a(THTK_FNV1A_INIT, path, strlen(path));
+    return &inc->slots[thtk_probe(inc->slot_count, hash, incremental_slot_stop, inc, path)];
+}
+
+/* Adds or updates the entry for path.  Must be called inside
+ * critical(incremental). */
+static void
+incremental_set(
+    incremental_t* inc,
+    const char* path,
+    uint64_t hash,
+    uint64_t size,
+    int64_t mtime)
+{
+    if ((inc->entry_count + 1) * 2 > inc->slot_count) {
+        size_t slot_count = inc->slot_count * 2;
+        free(inc->slots);
+        inc->slots = calloc(slot_count, sizeof(*inc->slots));
+        inc->slot_count = slot_count;
+        for (size_t e = 0; e < inc->entry_count; ++e)
+            *incremental_slot(inc, inc->entries[e].path) = e + 1;
+    }
+
+    size_t* slot = incremental_slot(inc, path);
+    incremental_entry_t* entry;
+    if (*slot) {
+        entry = &inc->entries[*slot - 1];
+    } else {
+        util_vec_ensure(&inc->entries, &inc->entry_cap, inc->entry_count + 1, sizeof(*inc->entries));
+        entry = &inc->entries[inc->entry_count];
+        entry->path = strdup(path);
+        *slot = ++inc->entry_count;
+    }
+    entry->hash = hash;
+    entry->size = size;
+    entry->mtime = mtime;
+}
+
+incremental_t*
+incremental_open(
+    const char* index_path)
+{
+    incremental_t* inc = calloc(1, sizeof(*inc));
+    inc->index_path = strdup(index_path);
+    inc->slot_count = 256;
+    inc->slots = calloc(inc->slot_count, sizeof(*inc->slots));
+
+    FILE* stream = fopen(index_path, "r");
+    if (!stream)
+        return inc;
+
+    char line[4096];
+    while (fgets(line, sizeof(line), stream)) {
+        uint64_t hash, size;
+        int64_t mtime;
+        int pos;
+        size_t len = strlen(line);
+        while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (sscanf(line, "%" SCNx64 " %" SCNu64 " %" SCNd64 " %n",
+                &hash, &size, &mtime, &pos) != 3 || !line[pos])
+            continue;
+        incremental_set(inc, line + pos, hash, size, mtime);
+    }
+    fclose(stream);
+    return inc;
+}
+
+/* Returns 1 if the file holds exactly size bytes of data. */
+static int
+incremental_same_content(
+    const char* path,
+    const void* data,
+    size_t size)
+{
+    FILE* stream = fopen(path, "rb");
+    if (!stream)
+        return 0;
+    const unsigned char* expected = data;
+    unsigned char buffer[65536];
+    int same = 1;
+    while (same) {
+        size_t got = fread(buffer, 1, sizeof(buffer), stream);
+        if (got > size || memcmp(buffer, expected, got)) {
+            same = 0;
+            break;
+        }
+        expected += got;
+        size -= got;
+        if (got < sizeof(buffer))
+            break;
+    }
+    fclose(stream);
+    return same && !size;
+}
+
+int
+incremental_unchanged(
+    incremental_t* inc,
+    const char* path,
+    uint64_t hash,
+    const void* data,
+    size_t size)
+{
+    struct stat st;
+    if (stat(path, &st) == -1)
+        return 0;
+
+    int unchanged = 0;
+#pragma omp critical(incremental)
+    {
+        size_t slot = *incremental_slot(inc, path);
+        if (slot) {
+            const incremental_entry_t* entry = &inc->entries[slot - 1];
+            unchanged = entry->hash == hash &&
+                entry->size == (uint64_t)st.st_size &&
+                entry->mtime == (int64_t)st.st_mtime;
+        }
+    }
+    if (!unchanged && data && (uint64_t)st.st_size == size)
+        unchanged = incremental_same_content(path, data, size);
+
+    if (unchanged) {
+#pragma omp critical(incremental)
+        {
+            incremental_set(inc, path, hash, st.st_size, st.st_mtime);
+            inc->skipped++;
+        }
+    }
+    return unchanged;
+}
+
+void
+incremental_written(
+    incremental_t* inc,
+    const char* path,
+    uint64_t hash)
+{
+    struct stat st;
+    int ok = stat(path, &st) != -1;
+#pragma omp critical(incremental)
+    {
+        /* A file that can't be examined is simply written again next time. */
+        if (ok)
+            incremental_set(inc, path, hash, st.st_size, st.st_mtime);
+        inc->written++;
+    }
+}
+
+static int
+incremental_entry_cmp(
+    const void* a,
+    const void* b)
+{
+    return strcmp(((const incremental_entry_t*)a)->path, ((const incremental_entry_t*)b)->path);
+}
+
+int
+incremental_close(
+    incremental_t* inc,
+    FILE* report)
+{
+    int ret = 1;
+    FILE* stream = fopen(inc->index_path, "w");
+    if (!stream) {
+        fprintf(stderr, "%s: couldn't open %s for writing: %s\n",
+            argv0, inc->index_path, strerror(errno));
+        ret = 0;
+    }
+    /* Entries are added in whatever order the threads finish, so sort them
+     * to keep the index stable. */
+    qsort(inc->entries, inc->entry_count, sizeof(*inc->entries), incremental_entry_cmp);
+    for (size_t e = 0; e < inc->entry_count; ++e) {
+        const incremental_entry_t* entry = &inc->entries[e];
+        if (stream)
+            fprintf(stream, "%016" PRIx64 " %" PRIu64 " %" PRId64 " %s\n",
+                entry->hash, entry->size, entry->mtime, entry->path);
+        free(entry->path);
+    }
+    if (stream && fclose(stream)) {
+        fprintf(stderr, "%s: couldn't write %s: %s\n",
+            argv0, inc->index_path, strerror(errno));
+        ret = 0;
+    }
+
+    if (report)
+        fprintf(report, "%zu files written, %zu unchanged\n", inc->written, inc->skipped);
+
+    free(inc->entries);
+    free(inc->slots);
+    free(inc->index_path);
+    free(inc);
+    return ret;
+}
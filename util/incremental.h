@@ -0,0 +1,73 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#ifndef INCREMENTAL_H_
+#define INCREMENTAL_H_
+
+#include <config.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+/* Tracks output files across runs, so that files which would be rewritten
+ * with the same content can be skipped.
+ *
+ * Every output is identified by a 64-bit hash of what it is made from.  The
+ * hashes are saved to an index file along with the size and modification
+ * time each output had when it was last written, which lets a later run
+ * tell that a file is unchanged without reading it.  All functions may be
+ * called from several threads at once. */
+typedef struct incremental_t incremental_t;
+
+/* Loads the index left by an earlier run, if there is one. */
+incremental_t* incremental_open(
+    const char* index_path);
+
+/* Returns 1 if the file at path is up to date for hash, and doesn't need to
+ * be written.  If data is passed, it is the exact content of the output,
+ * and is compared with the file when the index has no say. */
+int incremental_unchanged(
+    incremental_t* inc,
+    const char* path,
+    uint64_t hash,
+    const void* data,
+    size_t size);
+
+/* Records that path has just been written with output made from hash. */
+void incremental_written(
+    incremental_t* inc,
+    const char* path,
+    uint64_t hash);
+
+/* Saves the index, prints how many files were written and skipped to
+ * report unless it is NULL, and frees the object.  Returns 0 if the index
+ * couldn't be saved. */
+int incremental_close(
+    incremental_t* inc,
+    FILE* report);
+
+#endif
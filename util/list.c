@@ -37,6 +37,17 @@ list_init(
 {
     list->head = NULL;
     list->tail = NULL;
+    list->arena = NULL;
+}
+
+void
+list_init_arena(
+    list_t* list,
+    arena_t* arena)
+{
+    list->head = NULL;
+    list->tail = NULL;
+    list->arena = arena;
 }
 
 list_t*
@@ -59,6 +70,20 @@ list_node_new(
     return node;
 }
 
+list_node_t*
+list_node_new_for(
+    list_t* list)
+{
+    if (!list->arena)
+        return list_node_new();
+
+    list_node_t* node = arena_alloc(list->arena, sizeof(list_node_t));
+    node->next = NULL;
+    node->prev = NULL;
+    node->data = NULL;
+    return node;
+}
+
 void*
 list_head(
     list_t* list)
@@ -105,7 +130,7 @@ list_prepend_new(
     list_t* list,
     void* data)
 {
-    list_node_t* node = list_node_new();
+    list_node_t* node = list_node_new_for(list);
     node->data = data;
     list_prepend(list, node);
 }
@@ -116,7 +141,7 @@ list_prepend_to(
     void* data,
     list_node_t* old)
 {
-    list_node_t* new = list_node_new();
+    list_node_t* new = list_node_new_for(list);
     new->data = data;
 
     if (old->prev)
@@ -147,7 +172,7 @@ list_append_new(
     list_t* list,
     void* data)
 {
-    list_node_t* node = list_node_new();
+    list_node_t* node = list_node_new_for(list);
     node->data = data;
     list_append(list, node);
 }
@@ -158,7 +183,7 @@ list_append_to(
     void* data,
     list_node_t* old)
 {
-    list_node_t* new = list_node_new();
+    list_node_t* new = list_node_new_for(list);
     new->data = data;
 
     if (old->next)
@@ -185,7 +210,8 @@ list_del(
     else
         list->tail = node->prev;
 
-    free(node);
+    if (!list->arena)
+        free(node);
 }
 
 void
@@ -195,10 +221,13 @@ list_free_nodes(
     list_node_t* node;
     list_node_t* node_next;
 
-    for (node = list->head; node; node = node_next) {
-        node_next = node->next;
-        free(node);
+    if (!list->arena) {
+        for (node = list->head; node; node = node_next) {
+            node_next = node->next;
+            free(node);
+        }
     }
-    
-    list_init(list);
+
+    list->head = NULL;
+    list->tail = NULL;
 }
@@ -31,6 +31,7 @@
 
 #include <config.h>
 #include <stddef.h>
+#include "arena.h"
 
 typedef struct list_node_t {
     struct list_node_t* next;
@@ -41,14 +42,21 @@ typedef struct list_node_t {
 typedef struct list_t {
     list_node_t* head;
     list_node_t* tail;
+    /* Where the nodes are allocated from, or NULL for the heap. */
+    arena_t* arena;
 } list_t;
 
 /* Initializes a list. */
 void list_init(list_t* list);
+/* Initializes a list whose nodes are allocated from arena, and are freed
+ * along with it. */
+void list_init_arena(list_t* list, arena_t* arena);
 /* Allocates a list and initializes it. */
 list_t* list_new(void);
 /* Allocates a list node and initializes it. */
 list_node_t* list_node_new(void);
+/* Allocates a node for the list and initializes it. */
+list_node_t* list_node_new_for(list_t* list);
 /* Returns the data of head in the list. */
 void* list_head(list_t* list);
 /* Returns the data of tail in the list. */
@@ -72,7 +80,7 @@ void list_append_to(list_t* list, void* data, list_node_t* node);
 /* Removes and frees the node from the list.
  * Does not free the data. */
 void list_del(list_t* list, list_node_t* node);
-/* Frees each node in the list.
+/* Frees each node in the list, unless they come from an arena.
  * Resets the list.
  * Does not free the data or the list. */
 void list_free_nodes(list_t* list);
@@ -33,6 +33,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <thtk/stats.h>
 #include "program.h"
 #include "util.h"
 #include "mygetopt.h"
@@ -95,6 +96,60 @@ util_getopt_default(
     }
 }
 
+void
+util_long_options(
+    int* argc,
+    char** argv,
+    const util_long_option_t* options)
+{
+    int in = 1, out = 1;
+    while (in < *argc) {
+        const util_long_option_t* option = NULL;
+        const char* value = NULL;
+
+        if (!strcmp(argv[in], "--"))
+            break;
+        if (!strncmp(argv[in], "--", 2)) {
+            for (option = options; option->name; ++option) {
+                const size_t len = strlen(option->name);
+                if (strncmp(argv[in] + 2, option->name, len))
+                    continue;
+                if (argv[in][2 + len] == '\0')
+                    break;
+                if (argv[in][2 + len] == '=' && option->arg) {
+                    value = argv[in] + 3 + len;
+                    break;
+                }
+            }
+            if (!option->name)
+                option = NULL;
+        }
+
+        if (!option) {
+            argv[out++] = argv[in++];
+            continue;
+        }
+
+        ++in;
+        if (option->flag) {
+            *option->flag = 1;
+        } else {
+            if (!value) {
+                if (in >= *argc) {
+                    fprintf(stderr, "%s: Missing required argument for option '--%s'\n", argv0, option->name);
+                    exit(1);
+                }
+                value = argv[in++];
+            }
+            *option->arg = value;
+        }
+    }
+    while (in < *argc)
+        argv[out++] = argv[in++];
+    argv[out] = NULL;
+    *argc = out;
+}
+
 unsigned int parse_version(char *str) {
     struct version_abbr {
         unsigned int version;
@@ -161,3 +216,21 @@ unsigned int parse_version(char *str) {
     }
     return vp->version;
 }
+
+static void
+util_stats_print(
+    void)
+{
+    thtk_stats_t stats;
+    thtk_stats_get(&stats);
+    fprintf(stderr, "%s: statistics:\n", argv0);
+    thtk_stats_print(stderr, "  ", &stats);
+}
+
+void
+util_stats_at_exit(
+    void)
+{
+    if (thtk_stats_enabled())
+        atexit(util_stats_print);
+}
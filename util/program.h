@@ -40,9 +40,31 @@ void util_getopt_default(
     int opt,
     void (*usage)(void));
 
+typedef struct {
+    /* Without the leading "--". */
+    const char* name;
+    /* Set to 1 if the option is given.  Used for options without an
+     * argument. */
+    int* flag;
+    /* Set to the argument, given as --name ARG or --name=ARG. */
+    const char** arg;
+} util_long_option_t;
+
+/* Removes the options listed in the NULL-terminated options table from argv,
+ * before the rest is passed to getopt.  Stops at "--". */
+void util_long_options(
+    int* argc,
+    char** argv,
+    const util_long_option_t* options);
+
 unsigned int parse_version(
     char *str);
 
+/* Prints the libthtk IO and codec counters to stderr when the program exits,
+ * if THTK_STATS=1 is set. */
+void util_stats_at_exit(
+    void);
+
 extern const char* argv0;
 extern const char* current_input;
 extern const char* current_output;
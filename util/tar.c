@@ -0,0 +1,429 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "program.h"
+#include "tar.h"
+
+#define TAR_BLOCK 512
+
+void
+tar_reader_init(
+    tar_reader_t* reader,
+    FILE* stream)
+{
+    reader->stream = stream;
+    reader->remaining = 0;
+    reader->padding = 0;
+    reader->next_name = NULL;
+    reader->has_next_size = 0;
+    reader->next_size = 0;
+}
+
+void
+tar_reader_free(
+    tar_reader_t* reader)
+{
+    free(reader->next_name);
+    reader->next_name = NULL;
+}
+
+static int
+tar_read(
+    tar_reader_t* reader,
+    void* buffer,
+    size_t size)
+{
+    if (fread(buffer, 1, size, reader->stream) != size) {
+        if (ferror(reader->stream))
+            fprintf(stderr, "%s: error reading tar stream: %s\n",
+                argv0, strerror(errno));
+        else
+            fprintf(stderr, "%s: unexpected end of tar stream\n", argv0);
+        return 0;
+    }
+    return 1;
+}
+
+static int
+tar_skip(
+    tar_reader_t* reader,
+    uint64_t size)
+{
+    unsigned char buffer[4096];
+    while (size) {
+        const size_t chunk = size < sizeof(buffer) ? size : sizeof(buffer);
+        if (!tar_read(reader, buffer, chunk))
+            return 0;
+        size -= chunk;
+    }
+    return 1;
+}
+
+/* Parses an octal field, or a base-256 one as written by GNU tar for large
+ * values. */
+static int
+tar_parse_number(
+    const unsigned char* field,
+    size_t size,
+    uint64_t* value)
+{
+    *value = 0;
+    if (field[0] & 0x80) {
+        *value = field[0] & 0x7f;
+        for (size_t i = 1; i < size; ++i)
+            *value = *value << 8 | field[i];
+        return 1;
+    }
+    size_t i = 0;
+    while (i < size && field[i] == ' ')
+        ++i;
+    for (; i < size && field[i] >= '0' && field[i] <= '7'; ++i)
+        *value = *value << 3 | (field[i] - '0');
+    return i == size || field[i] == ' ' || field[i] == '\0';
+}
+
+static int
+tar_checksum_ok(
+    const unsigned char* block)
+{
+    uint64_t stored;
+    unsigned int sum = 0;
+    int signed_sum = 0;
+    if (!tar_parse_number(block + 148, 8, &stored))
+        return 0;
+    for (int i = 0; i < TAR_BLOCK; ++i) {
+        const unsigned char c = i >= 148 && i < 156 ? ' ' : block[i];
+        sum += c;
+        signed_sum += (signed char)c;
+    }
+    return stored == sum || stored == (uint64_t)(unsigned int)signed_sum;
+}
+
+static char*
+tar_read_string(
+    tar_reader_t* reader,
+    uint64_t size)
+{
+    char* data;
+    if (size > 1 << 20) {
+        fprintf(stderr, "%s: tar extended header is too large\n", argv0);
+        return NULL;
+    }
+    data = malloc(size + 1);
+    if (!tar_read(reader, data, size) || !tar_skip(reader, -size & (TAR_BLOCK - 1))) {
+        free(data);
+        return NULL;
+    }
+    data[size] = '\0';
+    return data;
+}
+
+/* Takes path and size from the records of a pax extended header. */
+static int
+tar_parse_pax(
+    tar_reader_t* reader,
+    const char* data,
+    size_t size)
+{
+    const char* end = data + size;
+    while (data < end) {
+        char* key;
+        const unsigned long length = strtoul(data, &key, 10);
+        if (!length || length > (size_t)(end - data) || *key != ' ') {
+            fprintf(stderr, "%s: malformed pax header\n", argv0);
+            return 0;
+        }
+        const char* record_end = data + length;
+        ++key;
+        const char* value = memchr(key, '=', record_end - key);
+        if (!value || record_end[-1] != '\n') {
+            fprintf(stderr, "%s: malformed pax header\n", argv0);
+            return 0;
+        }
+        ++value;
+        const size_t value_len = record_end - 1 - value;
+        if (value - key == 5 && !strncmp(key, "path", 4)) {
+            free(reader->next_name);
+            reader->next_name = malloc(value_len + 1);
+            memcpy(reader->next_name, value, value_len);
+            reader->next_name[value_len] = '\0';
+        } else if (value - key == 5 && !strncmp(key, "size", 4)) {
+            reader->next_size = strtoull(value, NULL, 10);
+            reader->has_next_size = 1;
+        }
+        data = record_end;
+    }
+    return 1;
+}
+
+int
+tar_read_header(
+    tar_reader_t* reader,
+    tar_entry_t* entry)
+{
+    unsigned char block[TAR_BLOCK];
+
+    if (!tar_skip(reader, reader->remaining + reader->padding))
+        return -1;
+    reader->remaining = reader->padding = 0;
+
+    for (;;) {
+        uint64_t size;
+        size_t read = fread(block, 1, TAR_BLOCK, reader->stream);
+        /* Some writers leave out the end-of-archive blocks. */
+        if (read == 0 && !ferror(reader->stream))
+            return 0;
+        if (read != TAR_BLOCK) {
+            fprintf(stderr, "%s: unexpected end of tar stream\n", argv0);
+            return -1;
+        }
+
+        int zero = 1;
+        for (int i = 0; i < TAR_BLOCK && zero; ++i)
+            zero = !block[i];
+        if (zero)
+            return 0;
+
+        if (!tar_checksum_ok(block) || !tar_parse_number(block + 124, 12, &size)) {
+            fprintf(stderr, "%s: invalid tar header\n", argv0);
+            return -1;
+        }
+
+        const char type = block[156];
+        if (type == 'x' || type == 'g' || type == 'L') {
+            char* data = tar_read_string(reader, size);
+            if (!data)
+                return -1;
+            int ret = 1;
+            if (type == 'x') {
+                ret = tar_parse_pax(reader, data, size);
+            } else if (type == 'L') {
+                free(reader->next_name);
+                reader->next_name = data;
+                data = NULL;
+            }
+            free(data);
+            if (!ret)
+                return -1;
+            continue;
+        }
+
+        if (reader->has_next_size)
+            size = reader->next_size;
+        if (reader->next_name) {
+            entry->name = reader->next_name;
+        } else {
+            /* ustar splits long paths into a prefix and a name. */
+            const int ustar = !memcmp(block + 257, "ustar", 6);
+            size_t prefix_len = ustar ? strnlen((char*)block + 345, 155) : 0;
+            const size_t name_len = strnlen((char*)block, 100);
+            entry->name = malloc(prefix_len + name_len + 2);
+            memcpy(entry->name, block + 345, prefix_len);
+            if (prefix_len)
+                entry->name[prefix_len++] = '/';
+            memcpy(entry->name + prefix_len, block, name_len);
+            entry->name[prefix_len + name_len] = '\0';
+        }
+        reader->next_name = NULL;
+        reader->has_next_size = 0;
+
+        entry->size = size;
+        entry->type = type ? type : '0';
+        /* Links, devices, directories and FIFOs have no data, whatever
+         * their size field says. */
+        if (entry->type >= '1' && entry->type <= '6')
+            size = entry->size = 0;
+        reader->remaining = size;
+        reader->padding = -size & (TAR_BLOCK - 1);
+        return 1;
+    }
+}
+
+int
+tar_read_data(
+    tar_reader_t* reader,
+    void* buffer,
+    size_t size)
+{
+    if (size > reader->remaining) {
+        fprintf(stderr, "%s: read past the end of a tar entry\n", argv0);
+        return 0;
+    }
+    if (!tar_read(reader, buffer, size))
+        return 0;
+    reader->remaining -= size;
+    return 1;
+}
+
+static int
+tar_write(
+    FILE* stream,
+    const void* buffer,
+    size_t size)
+{
+    if (fwrite(buffer, 1, size, stream) != size) {
+        fprintf(stderr, "%s: error writing tar stream: %s\n",
+            argv0, strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+static int
+tar_write_padding(
+    FILE* stream,
+    uint64_t size)
+{
+    static const unsigned char zero[TAR_BLOCK];
+    return tar_write(stream, zero, -size & (TAR_BLOCK - 1));
+}
+
+/* Writes an octal field, which has to fit together with its terminator. */
+static void
+tar_format_number(
+    unsigned char* field,
+    size_t size,
+    uint64_t value)
+{
+    field[--size] = '\0';
+    while (size--) {
+        field[size] = '0' + (value & 7);
+        value >>= 3;
+    }
+}
+
+static int
+tar_write_header(
+    FILE* stream,
+    const char* name,
+    const char* prefix,
+    size_t prefix_len,
+    uint64_t size,
+    uint64_t mtime,
+    char type)
+{
+    unsigned char block[TAR_BLOCK] = { 0 };
+    unsigned int sum = 0;
+
+    strncpy((char*)block, name, 100);
+    tar_format_number(block + 100, 8, 0644);
+    tar_format_number(block + 108, 8, 0);
+    tar_format_number(block + 116, 8, 0);
+    tar_format_number(block + 124, 12, size);
+    tar_format_number(block + 136, 12, mtime);
+    memset(block + 148, ' ', 8);
+    block[156] = type;
+    memcpy(block + 257, "ustar", 6);
+    memcpy(block + 263, "00", 2);
+    memcpy(block + 345, prefix, prefix_len);
+
+    for (int i = 0; i < TAR_BLOCK; ++i)
+        sum += block[i];
+    tar_format_number(block + 148, 7, sum);
+
+    return tar_write(stream, block, TAR_BLOCK);
+}
+
+/* Appends a "LENGTH key=value\n" record, whose length counts its own
+ * digits. */
+static size_t
+tar_pax_record(
+    char* out,
+    const char* key,
+    const char* value)
+{
+    const size_t base = 1 + strlen(key) + 1 + strlen(value) + 1;
+    size_t length = base + 1;
+    while (length != base + snprintf(NULL, 0, "%zu", length))
+        length = base + snprintf(NULL, 0, "%zu", length);
+    return sprintf(out, "%zu %s=%s\n", length, key, value);
+}
+
+int
+tar_write_file(
+    FILE* stream,
+    const char* name,
+    const void* data,
+    uint64_t size,
+    uint64_t mtime)
+{
+    const size_t name_len = strlen(name);
+    const char* short_name = name;
+    const char* prefix = "";
+    size_t prefix_len = 0;
+    int pax_path = 0;
+    /* Sizes from 8 GiB on don't fit eleven octal digits. */
+    const int pax_size = size >> 33 != 0;
+
+    if (name_len > 100) {
+        /* Split at the first slash that leaves a short enough name. */
+        const char* slash = strchr(name + name_len - 101, '/');
+        if (slash && slash != name && slash - name <= 155 && slash[1]) {
+            prefix = name;
+            prefix_len = slash - name;
+            short_name = slash + 1;
+        } else {
+            pax_path = 1;
+        }
+    }
+
+    if (pax_path || pax_size) {
+        char* records = malloc(name_len + 64);
+        size_t length = 0;
+        char size_string[24];
+        if (pax_path)
+            length += tar_pax_record(records + length, "path", name);
+        if (pax_size) {
+            sprintf(size_string, "%" PRIu64, size);
+            length += tar_pax_record(records + length, "size", size_string);
+        }
+        int ret = tar_write_header(stream, "PaxHeader", "", 0, length, mtime, 'x') &&
+            tar_write(stream, records, length) &&
+            tar_write_padding(stream, length);
+        free(records);
+        if (!ret)
+            return 0;
+    }
+
+    return tar_write_header(stream, short_name, prefix, prefix_len, pax_size ? 0 : size, mtime, '0') &&
+        tar_write(stream, data, size) &&
+        tar_write_padding(stream, size);
+}
+
+int
+tar_write_end(
+    FILE* stream)
+{
+    static const unsigned char zero[2 * TAR_BLOCK];
+    return tar_write(stream, zero, sizeof(zero)) && fflush(stream) == 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#ifndef TAR_H_
+#define TAR_H_
+
+#include <config.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+/* Reading and writing of ustar and pax tar streams, for stdin and other
+ * unseekable streams.  Errors are printed, and the functions return -1 or 0
+ * for them. */
+
+typedef struct tar_entry_t {
+    /* Path of the entry, taken from pax and GNU long name headers if
+     * present. */
+    char* name;
+    uint64_t size;
+    /* '0' for regular files, '5' for directories. */
+    char type;
+} tar_entry_t;
+
+typedef struct tar_reader_t {
+    FILE* stream;
+    /* Data left in the current entry, and the padding after it. */
+    uint64_t remaining;
+    uint64_t padding;
+    /* Overrides read from the last pax or GNU header. */
+    char* next_name;
+    int has_next_size;
+    uint64_t next_size;
+} tar_reader_t;
+
+/* Starts reading a tar stream. */
+void tar_reader_init(
+    tar_reader_t* reader,
+    FILE* stream);
+
+/* Frees what the reader holds, but doesn't close the stream. */
+void tar_reader_free(
+    tar_reader_t* reader);
+
+/* Skips what is left of the current entry and reads the next header.  Pax,
+ * global and GNU long name headers are consumed on the way.  Returns 1 if
+ * an entry was read, 0 at the end of the archive, and -1 on error.  The
+ * entry name has to be freed by the caller. */
+int tar_read_header(
+    tar_reader_t* reader,
+    tar_entry_t* entry);
+
+/* Reads the next size bytes of the current entry's data.  Returns 0 on
+ * error. */
+int tar_read_data(
+    tar_reader_t* reader,
+    void* buffer,
+    size_t size);
+
+/* Writes a regular file with its header and padding.  Names that don't fit
+ * the ustar fields are stored in a pax header.  Returns 0 on error. */
+int tar_write_file(
+    FILE* stream,
+    const char* name,
+    const void* data,
+    uint64_t size,
+    uint64_t mtime);
+
+/* Writes the end-of-archive blocks.  Returns 0 on error. */
+int tar_write_end(
+    FILE* stream);
+
+#endif
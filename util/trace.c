@@ -0,0 +1,196 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thtk/stats.h>
+#include "program.h"
+#include "trace.h"
+#include "util.h"
+
+/* Spans kept per thread. */
+#define TRACE_BUFFER_SIZE 65536
+
+typedef struct {
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+    char detail[48];
+} trace_event_t;
+
+typedef struct trace_buffer_t {
+    struct trace_buffer_t* next;
+    unsigned int tid;
+    /* Total number of spans recorded, including overwritten ones. */
+    size_t count;
+    trace_event_t events[TRACE_BUFFER_SIZE];
+} trace_buffer_t;
+
+int trace_enabled = 0;
+static const char* trace_path = NULL;
+static uint64_t trace_epoch;
+static trace_buffer_t* trace_buffers = NULL;
+static unsigned int trace_thread_count = 0;
+static THREAD_LOCAL trace_buffer_t* trace_buffer = NULL;
+
+uint64_t
+trace_now(
+    void)
+{
+    return thtk_stats_now();
+}
+
+void
+trace_span(
+    const char* name,
+    const char* detail,
+    uint64_t start)
+{
+    uint64_t end = trace_now();
+    trace_buffer_t* buffer = trace_buffer;
+    trace_event_t* event;
+
+    if (!buffer) {
+        buffer = malloc(sizeof(*buffer));
+        if (!buffer)
+            return;
+        buffer->count = 0;
+#pragma omp critical(trace_buffers)
+        {
+            buffer->tid = ++trace_thread_count;
+            buffer->next = trace_buffers;
+            trace_buffers = buffer;
+        }
+        trace_buffer = buffer;
+    }
+
+    event = &buffer->events[buffer->count++ % TRACE_BUFFER_SIZE];
+    event->name = name;
+    event->start = start;
+    event->duration = end - start;
+    if (detail) {
+        strncpy(event->detail, detail, sizeof(event->detail) - 1);
+        event->detail[sizeof(event->detail) - 1] = '\0';
+    } else {
+        event->detail[0] = '\0';
+    }
+}
+
+static void
+trace_write_string(
+    FILE* stream,
+    const char* str)
+{
+    fputc('"', stream);
+    for (; *str; ++str) {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\')
+            fprintf(stream, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(stream, "\\u%04x", c);
+        else
+            fputc(c, stream);
+    }
+    fputc('"', stream);
+}
+
+static void
+trace_write(
+    void)
+{
+    FILE* stream;
+
+    trace_enabled = 0;
+    if (!(stream = fopen(trace_path, "w"))) {
+        fprintf(stderr, "%s: couldn't open %s for writing\n", argv0, trace_path);
+        return;
+    }
+
+    fprintf(stream, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(stream,
+        "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":");
+    trace_write_string(stream, argv0 ? argv0 : "thtk");
+    fprintf(stream, "}}");
+    for (trace_buffer_t* buffer = trace_buffers; buffer; buffer = buffer->next) {
+        size_t begin = buffer->count > TRACE_BUFFER_SIZE ?
+            buffer->count - TRACE_BUFFER_SIZE : 0;
+        if (buffer->count > TRACE_BUFFER_SIZE)
+            fprintf(stderr, "%s: trace buffer of thread %u overflowed, "
+                "dropped %zu oldest spans\n",
+                argv0, buffer->tid, begin);
+        for (size_t i = begin; i < buffer->count; ++i) {
+            const trace_event_t* event = &buffer->events[i % TRACE_BUFFER_SIZE];
+            /* Timestamps are in microseconds. */
+            fprintf(stream, ",\n{\"name\":");
+            trace_write_string(stream, event->name);
+            fprintf(stream,
+                ",\"cat\":\"thtk\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                "\"ts\":%.3f,\"dur\":%.3f",
+                buffer->tid,
+                (event->start - trace_epoch) / 1000.0,
+                event->duration / 1000.0);
+            if (event->detail[0]) {
+                fprintf(stream, ",\"args\":{\"detail\":");
+                trace_write_string(stream, event->detail);
+                fputc('}', stream);
+            }
+            fputc('}', stream);
+        }
+    }
+    fprintf(stream, "\n]}\n");
+    fclose(stream);
+}
+
+void
+trace_start(
+    const char* path)
+{
+    if (trace_path)
+        return;
+    trace_path = path;
+    trace_epoch = trace_now();
+    trace_enabled = 1;
+    atexit(trace_write);
+}
+
+void
+trace_init_args(
+    int* argc,
+    char** argv)
+{
+    const char* path = NULL;
+    const util_long_option_t options[] = {
+        { "trace", NULL, &path },
+        { NULL, NULL, NULL }
+    };
+    util_long_options(argc, argv, options);
+    if (path)
+        trace_start(path);
+}
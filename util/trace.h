@@ -0,0 +1,77 @@
+/*
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that the
+ * following conditions are met:
+ *
+ * 1. Redistributions of source code must retain this list
+ *    of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce this
+ *    list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <config.h>
+#include <inttypes.h>
+
+/* Span tracing in the Chrome trace event format, which can be loaded in
+ * Perfetto or chrome://tracing.  Each thread records into its own ring
+ * buffer, so only the most recent spans are kept if a thread records more
+ * than the buffer holds.  Nothing is recorded unless tracing was enabled
+ * with --trace. */
+
+extern int trace_enabled;
+
+/* Removes --trace FILE and --trace=FILE from the arguments with
+ * util_long_options, and starts tracing to FILE if given.  The trace is
+ * written when the program exits. */
+void trace_init_args(
+    int* argc,
+    char** argv);
+
+/* Starts tracing; the trace is written to path at exit. */
+void trace_start(
+    const char* path);
+
+/* Returns a monotonic timestamp in nanoseconds, from thtk_stats_now. */
+uint64_t trace_now(
+    void);
+
+/* Records a span from start until now.  name must be a string literal or
+ * otherwise outlive the program; detail may be NULL and is copied. */
+void trace_span(
+    const char* name,
+    const char* detail,
+    uint64_t start);
+
+/* Usage:
+ *   TRACE_BEGIN(t);
+ *   ...
+ *   TRACE_END(t, "png_write", filename); */
+#define TRACE_BEGIN(t) \
+    uint64_t t = trace_enabled ? trace_now() : 0
+#define TRACE_END(t, name, detail) \
+    do { \
+        if (t) \
+            trace_span((name), (detail), (t)); \
+    } while (0)
+
+#endif
@@ -328,7 +328,7 @@ const char*
 util_printfloat(
     const void* data)
 {
-    static char buf[256];
+    static THREAD_LOCAL char buf[256];
     float f;
     unsigned int i;
 
@@ -41,6 +41,12 @@
 #  define MAX(a, b) ((a) > (b) ? (a) : (b))
 #endif
 
+#ifdef _MSC_VER
+#  define THREAD_LOCAL __declspec(thread)
+#else
+#  define THREAD_LOCAL __thread
+#endif
+
 typedef struct {
     const char *str;
     size_t len;
@@ -60,7 +66,7 @@ void util_print_version(
     void);
 
 /* Returns an unique string representation of a float.  Returns a pointer to a
- * static buffer, not thread-safe. */
+ * buffer of the calling thread, valid until its next call. */
 const char* util_printfloat(
     const void* data);
 